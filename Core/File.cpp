@@ -24,6 +24,7 @@
 
 #include <Core/Util.hpp>
 #include <Core/Assert.hpp>
+#include <Core/BoostFilesystem.hpp>
 #include <Core/CheckedIntegerAlias.hpp>
 #include <Core/Error.hpp>
 #include <Core/WindowsError.hpp>
@@ -31,6 +32,15 @@
 #include <Core/OStream.hpp>
 
 #include <vector>
+#include <sstream>
+
+#include <cstdio>
+
+#include <boost/bind.hpp>
+
+#if OS_UNIX
+#include <unistd.h>
+#endif
 
 #if OS_WIN
 #include <windows.h>
@@ -102,6 +112,36 @@ namespace Core {
       writeFile (filename, data);
   }
 
+  void writeFileAtomically (const boost::filesystem::path& filename, const boost::function<void (const OStream&)>& write, std::ios_base::openmode mode) {
+    std::stringstream str;
+    str << filename.BOOST_FILE_STRING << ".new.";
+#if OS_UNIX
+    str << getpid ();
+#elif OS_WIN
+    str << GetCurrentProcessId ();
+#else
+#error Unknown OS
+#endif
+    std::string fileNew = str.str ();
+
+    {
+      Core::OStream stream = Core::OStream::open (fileNew, mode);
+      write (stream);
+      stream->flush ();
+      stream.assertGood ();
+    }
+
+#if OS_WIN
+    remove (filename.BOOST_FILE_STRING.c_str ());
+#endif
+    Core::Error::check ("rename", rename (fileNew.c_str (), filename.BOOST_FILE_STRING.c_str ()));
+  }
+
+  void writeFileAtomically (const boost::filesystem::path& filename, const std::string& data) {
+    void (*f) (const OStream&, const std::string&) = writeFile;
+    writeFileAtomically (filename, boost::bind (f, _1, boost::cref (data)));
+  }
+
   class SystemCommandException : public Exception {
     int status_;
     const std::string command_;
@@ -29,8 +29,10 @@
 #include <Core/OStream.forward.hpp>
 
 #include <string>
+#include <ios>
 
 #include <boost/filesystem/path.hpp>
+#include <boost/function.hpp>
 
 namespace Core {
   // Return the absolute path of the executable
@@ -50,6 +52,14 @@ namespace Core {
   // Write data to file or to stdout if filename is "-"
   void writeFileOrStdout (const std::string& filename, const std::string& data);
 
+  // Call write with a stream for a temporary file in the same directory and
+  // rename the temporary file to filename afterwards, so that no partially
+  // written file is ever visible to other processes. The name of the
+  // temporary file contains the process ID, so concurrent runs do not write
+  // to the same temporary file.
+  void writeFileAtomically (const boost::filesystem::path& filename, const boost::function<void (const OStream&)>& write, std::ios_base::openmode mode = std::ios_base::out);
+  void writeFileAtomically (const boost::filesystem::path& filename, const std::string& data);
+
   // Call ::system (cmd) and throw an exception if the return value is not 0
   void system (const std::string& cmd);
 }
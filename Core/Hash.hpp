@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef CORE_HASH_HPP_INCLUDED
+#define CORE_HASH_HPP_INCLUDED
+
+// Non-cryptographic hash functions, e.g. for creating file names of cache
+// entries
+
+#include <string>
+
+#include <cstddef>
+
+#include <stdint.h>
+
+namespace Core {
+  // 64 bit FNV-1a hash
+  uint64_t fnv1aHash (const void* data, size_t length);
+  uint64_t fnv1aHash (const std::string& str);
+}
+
+#endif // !CORE_HASH_HPP_INCLUDED
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "ThreadPool.hpp"
+
+#include <Core/Assert.hpp>
+
+#include <boost/bind.hpp>
+
+namespace Core {
+  ThreadPool::ThreadPool (size_t threadCount) : threadCount_ (threadCount), generation (0), shutdown (false), running (0), function (NULL), count (0) {
+    ASSERT (threadCount > 0);
+    for (size_t i = 1; i < threadCount; i++)
+      threads.create_thread (boost::bind (&ThreadPool::worker, this, i));
+  }
+  ThreadPool::~ThreadPool () {
+    {
+      boost::lock_guard<boost::mutex> lock (mutex);
+      shutdown = true;
+    }
+    startCond.notify_all ();
+    threads.join_all ();
+  }
+
+  void ThreadPool::runPart (size_t thread) {
+    size_t begin = count * thread / threadCount ();
+    size_t end = count * (thread + 1) / threadCount ();
+    if (begin == end)
+      return;
+    try {
+      (*function) (thread, begin, end);
+    } catch (...) {
+      boost::lock_guard<boost::mutex> lock (mutex);
+      if (!error)
+        error = boost::current_exception ();
+    }
+  }
+
+  void ThreadPool::worker (size_t thread) {
+    uint64_t lastGeneration = 0;
+    for (;;) {
+      {
+        boost::unique_lock<boost::mutex> lock (mutex);
+        while (!shutdown && generation == lastGeneration)
+          startCond.wait (lock);
+        if (shutdown)
+          return;
+        lastGeneration = generation;
+      }
+      runPart (thread);
+      {
+        boost::lock_guard<boost::mutex> lock (mutex);
+        running--;
+        if (running == 0)
+          doneCond.notify_one ();
+      }
+    }
+  }
+
+  void ThreadPool::run (size_t count, const Function& f) {
+    if (threadCount () == 1) {
+      if (count)
+        f (0, 0, count);
+      return;
+    }
+
+    {
+      boost::lock_guard<boost::mutex> lock (mutex);
+      ASSERT (running == 0);
+      this->function = &f;
+      this->count = count;
+      this->error = boost::exception_ptr ();
+      running = threadCount () - 1;
+      generation++;
+    }
+    startCond.notify_all ();
+
+    runPart (0);
+
+    boost::exception_ptr err;
+    {
+      boost::unique_lock<boost::mutex> lock (mutex);
+      while (running != 0)
+        doneCond.wait (lock);
+      this->function = NULL;
+      err = error;
+      error = boost::exception_ptr ();
+    }
+    if (err)
+      boost::rethrow_exception (err);
+  }
+
+  size_t ThreadPool::defaultThreadCount () {
+    size_t count = boost::thread::hardware_concurrency ();
+    return count ? count : 1;
+  }
+}
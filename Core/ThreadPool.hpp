@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef CORE_THREADPOOL_HPP_INCLUDED
+#define CORE_THREADPOOL_HPP_INCLUDED
+
+// A fixed set of worker threads which can be used to run a loop in parallel
+//
+// The calling thread takes part in the work, so a pool with a thread count of
+// 1 does not create any threads and simply runs the loop.
+
+#include <Core/Util.hpp>
+
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace Core {
+  class ThreadPool {
+    NO_COPY_CLASS (ThreadPool);
+
+  public:
+    // Called with the index of the thread (0 <= thread < threadCount ()) and a
+    // range [begin, end) of loop indices
+    typedef boost::function<void (size_t thread, size_t begin, size_t end)> Function;
+
+  private:
+    size_t threadCount_;
+    boost::thread_group threads;
+
+    boost::mutex mutex;
+    boost::condition_variable startCond;
+    boost::condition_variable doneCond;
+    uint64_t generation;
+    bool shutdown;
+    size_t running;
+    const Function* function;
+    size_t count;
+    boost::exception_ptr error;
+
+    void worker (size_t thread);
+    void runPart (size_t thread);
+
+  public:
+    explicit ThreadPool (size_t threadCount = 1);
+    ~ThreadPool ();
+
+    size_t threadCount () const { return threadCount_; }
+
+    // Split [0, count) into threadCount () contiguous ranges, call f for every
+    // range in a separate thread and wait until all calls have finished.
+    // Exceptions thrown by f are rethrown in the calling thread.
+    // Must not be called from f or from different threads at the same time.
+    void run (size_t count, const Function& f);
+
+    // The number of hardware threads or 1 if unknown
+    static size_t defaultThreadCount ();
+  };
+}
+
+#endif // !CORE_THREADPOOL_HPP_INCLUDED
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Test Core::ThreadPool
+
+#include <Core/ThreadPool.hpp>
+#include <Core/Assert.hpp>
+
+#include <vector>
+#include <stdexcept>
+
+#include <boost/bind.hpp>
+
+static void mark (std::vector<int>& data, size_t thread, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++)
+    data[i] += (int) thread + 1;
+}
+
+static void fail (size_t thread, UNUSED size_t begin, UNUSED size_t end) {
+  if (thread == 1)
+    throw std::runtime_error ("fail");
+}
+
+int main () {
+  for (size_t threads = 1; threads <= 5; threads++) {
+    Core::ThreadPool pool (threads);
+    ASSERT (pool.threadCount () == threads);
+    for (size_t count = 0; count < 20; count++) {
+      for (int rep = 0; rep < 3; rep++) {
+        std::vector<int> data (count, 0);
+        pool.run (count, boost::bind (mark, boost::ref (data), _1, _2, _3));
+        for (size_t i = 0; i < count; i++)
+          ASSERT (data[i] >= 1 && data[i] <= (int) threads);
+        for (size_t i = 1; i < count; i++)
+          ASSERT (data[i] >= data[i - 1]);
+      }
+    }
+  }
+
+  {
+    Core::ThreadPool pool (3);
+    try {
+      pool.run (10, fail);
+      ABORT ();
+    } catch (std::runtime_error& e) {
+    }
+    std::vector<int> data (10, 0);
+    pool.run (10, boost::bind (mark, boost::ref (data), _1, _2, _3));
+    for (size_t i = 0; i < 10; i++)
+      ASSERT (data[i] != 0);
+  }
+
+  return 0;
+}
@@ -68,6 +68,32 @@
 
 #define NORETURN NORETURN_ATTRIBUTE void
 
+// Pointers which do not alias any other pointer used in the same scope
+#if defined (__GNUC__)
+#define RESTRICT __restrict__
+#else
+#define RESTRICT
+#endif
+
+// Compile a function for several x86 instruction set extensions and choose the
+// variant at runtime depending on the CPU. This needs ifunc support, which is
+// only available for ELF targets (not on Windows). The variants only differ
+// if the loops are vectorized, which GCC only does reliably with -O3, so the
+// function is always optimized with -O3.
+#if defined (__GNUC__) && !defined (__clang__)
+#define SIMD_OPTIMIZE_ATTRIBUTE __attribute__ ((optimize ("O3")))
+#else
+#define SIMD_OPTIMIZE_ATTRIBUTE
+#endif
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__)) && (defined (__ELF__) || defined (__linux__))
+#if __has_attribute(target_clones) || __GNUC__ >= 6
+#define SIMD_CLONES_ATTRIBUTE __attribute__ ((target_clones ("arch=skylake-avx512", "arch=haswell", "default"))) SIMD_OPTIMIZE_ATTRIBUTE
+#endif
+#endif
+#ifndef SIMD_CLONES_ATTRIBUTE
+#define SIMD_CLONES_ATTRIBUTE SIMD_OPTIMIZE_ATTRIBUTE
+#endif
+
 #if defined(__POSIX__) || defined (__unix) || defined (__unix__)
 #define OS_UNIX 1
 #define OS_WIN 0
@@ -53,16 +53,24 @@ namespace DDA {
   }
   template <typename F> BicgCs<F>::~BicgCs () {}
 
+  template <typename F> boost::shared_ptr<CpuIterativeSolver<F> > BicgCs<F>::createLane () {
+    return boost::shared_ptr<CpuIterativeSolver<ftype> > (new BicgCs<ftype> (g (), this->matVec (), this->maxIterations ()));
+  }
+
   template <typename F> void BicgCs<F>::init (UNUSED std::ostream& log, UNUSED Core::ProfilingDataPtr prof) {
   }
 
-  template <typename F> F BicgCs<F>::iteration (csize_t nr, UNUSED std::ostream& log, UNUSED bool profilingRun, Core::ProfilingDataPtr prof) {
+  template <typename F> F BicgCs<F>::iteration (csize_t nr, UNUSED std::ostream& log, bool profilingRun, Core::ProfilingDataPtr prof) {
+    const std::vector<ctype>& pvec = iterationBegin (nr, profilingRun);
+    this->matVec ().apply (pvec, this->Avecbuffer (), false, prof);
+    return iterationEnd (nr, profilingRun);
+  }
+
+  template <typename F> const std::vector<std::complex<F> >& BicgCs<F>::iterationBegin (csize_t nr, bool profilingRun) {
     std::vector<ctype>& rvec = this->rvec ();
-    std::vector<ctype>& Avecbuffer = this->Avecbuffer ();
-    std::vector<ctype>& xvec = this->xvec ();
     std::vector<ctype>& pvec = this->tmpVec1 ();
 
-    vars.ro_new = vecProdConj (rvec, rvec);
+    vars.ro_new = this->matVec ().sum (vecProdConj (rvec, rvec));
     vars.abs_ro_new = std::abs (vars.ro_new);
     ftype dtmp = vars.abs_ro_new / this->inprodR ();
     ASSERT (!(dtmp < 1e-10 || dtmp > 1e+10) || profilingRun);
@@ -72,17 +80,24 @@ namespace DDA {
       vars.beta = vars.ro_new / vars.ro_old;
       LinAlg::linComb (pvec, vars.beta, rvec, pvec);
     }
-    this->matVec ().apply (pvec, Avecbuffer, false, prof);
-    ctype mu_k = vecProdConj (pvec, Avecbuffer);
+    return pvec;
+  }
+
+  template <typename F> F BicgCs<F>::iterationEnd (UNUSED csize_t nr, bool profilingRun) {
+    std::vector<ctype>& rvec = this->rvec ();
+    std::vector<ctype>& Avecbuffer = this->Avecbuffer ();
+    std::vector<ctype>& xvec = this->xvec ();
+    std::vector<ctype>& pvec = this->tmpVec1 ();
+
+    ctype mu_k = this->matVec ().sum (vecProdConj (pvec, Avecbuffer));
     ftype dtmp2 = std::abs (mu_k) / vars.abs_ro_new;
     ASSERT (!(dtmp2 < 10e-10) || profilingRun);
     vars.alpha = vars.ro_new / mu_k;
     LinAlg::linComb (pvec, vars.alpha, xvec, xvec);
-    LinAlg::linComb (Avecbuffer, -vars.alpha, rvec, rvec);
+    ftype inprodRplus1 = this->matVec ().sum (LinAlg::linCombNorm (Avecbuffer, -vars.alpha, rvec, rvec, this->matVec ().vectorThreadPool ()));
     vars.ro_old = vars.ro_new;
-    return LinAlg::norm (rvec);
+    return inprodRplus1;
   }
 
-
   CALL_MACRO_FOR_DEFAULT_FP_TYPES(CREATE_TEMPLATE_INSTANCE, BicgCs)
 }
@@ -29,7 +29,7 @@
 
 namespace DDA {
   template <typename T>
-  class BicgCs : public CpuIterativeSolver<T> {
+  class BicgCs : public CpuIterativeSolver<T>, public CpuSolverLane<T> {
     typedef T ftype;
     typedef std::complex<ftype> ctype;
     typedef FPConst<ftype> Const;
@@ -49,6 +49,10 @@ namespace DDA {
 
     virtual void init (std::ostream& log, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
     virtual ftype iteration (csize_t nr, std::ostream& log, bool profilingRun, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
+
+    virtual boost::shared_ptr<CpuIterativeSolver<ftype> > createLane ();
+    virtual const std::vector<ctype>& iterationBegin (csize_t nr, bool profilingRun);
+    virtual ftype iterationEnd (csize_t nr, bool profilingRun);
   };
 
   CALL_MACRO_FOR_DEFAULT_FP_TYPES(DISABLE_TEMPLATE_INSTANCE, BicgCs)
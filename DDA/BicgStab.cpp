@@ -40,6 +40,20 @@ namespace DDA {
       return sum;
     }
 
+    // Returns vecProd (v1, v2) and stores LinAlg::norm (v2) in norm2
+    template <typename F> std::complex<F> vecProdNorm (const std::vector<std::complex<F> >& v1, const std::vector<std::complex<F> >& v2, F& norm2) {
+      ASSERT (v1.size () == v2.size ());
+
+      std::complex<F> sum = 0;
+      F sumNorm = 0;
+      for (size_t i = 0; i < v1.size (); i++) {
+        sum += v1[i] * std::conj (v2[i]);
+        sumNorm += norm (v2[i]);
+      }
+      norm2 = sumNorm;
+      return sum;
+    }
+
     template <typename F> void copy (const std::vector<std::complex<F> >& from, std::vector<std::complex<F> >& to) {
       ASSERT (from.size () == to.size ());
       for (size_t i = 0; i < from.size (); i++)
@@ -49,9 +63,9 @@ namespace DDA {
 
   template <typename F> BicgStab<F>::BicgStab (const DDAParams<ftype>& ddaParams, MatVec<ftype>& matVec, csize_t maxIter) : 
     CpuIterativeSolver<F> (ddaParams, matVec, 30000, maxIter),
-    tmpVec2_ (g ().vecSize ()),
-    tmpVec3_ (g ().vecSize ()),
-    tmpVec4_ (g ().vecSize ())
+    tmpVec2_ (matVec.localVecSize ()),
+    tmpVec3_ (matVec.localVecSize ()),
+    tmpVec4_ (matVec.localVecSize ())
   {
   }
   template <typename F> BicgStab<F>::~BicgStab () {}
@@ -73,7 +87,7 @@ namespace DDA {
     std::vector<ctype>& s = this->tmpVec3 ();
     std::vector<ctype>& rtilda = this->tmpVec4 ();
 
-    vars.ro_new = vecProd (rvec, rtilda);
+    vars.ro_new = this->matVec ().sum (vecProd (rvec, rtilda));
     // Use higher precision to avoid underflow / overflow
     ftype dtmp = static_cast<ftype> (std::abs<ldouble> (vars.ro_new) / this->inprodR ());
     ASSERT (dtmp >= 1e-16 || profilingRun);
@@ -91,21 +105,20 @@ namespace DDA {
     // Use higher precision to avoid underflow / overflow
     //vars.alpha = vars.ro_new / vecProd (v, rtilda);
     cldouble ro_new = vars.ro_new;
-    cldouble vRtilda = vecProd (v, rtilda);
+    cldouble vRtilda = this->matVec ().sum (vecProd (v, rtilda));
     vars.alpha = static_cast<ctype> (ro_new / vRtilda);
-    LinAlg::linComb (v, -vars.alpha, rvec, s);
-    ftype inprodRplus1 = LinAlg::norm (s);
+    ftype inprodRplus1 = this->matVec ().sum (LinAlg::linCombNorm (v, -vars.alpha, rvec, s, this->matVec ().vectorThreadPool ()));
     if (inprodRplus1 < this->epsB && !profilingRun) {
       LinAlg::linComb (pvec, vars.alpha, xvec, xvec);
     } else {
       this->matVec ().apply (s, Avecbuffer, false, prof);
-      vars.denumOmega = LinAlg::norm (Avecbuffer);
+      ctype sAvec = this->matVec ().sum (vecProdNorm (s, Avecbuffer, vars.denumOmega));
+      vars.denumOmega = this->matVec ().sum (vars.denumOmega);
       // Use higher precision to avoid underflow / overflow
       //vars.omega = vecProd (s, Avecbuffer) / vars.denumOmega;
-      vars.omega = static_cast<ctype> (static_cast<cldouble> (vecProd (s, Avecbuffer)) / static_cast<ldouble> (vars.denumOmega));
+      vars.omega = static_cast<ctype> (static_cast<cldouble> (sAvec) / static_cast<ldouble> (vars.denumOmega));
       LinAlg::linComb (pvec, vars.alpha, s, vars.omega, xvec, xvec);
-      LinAlg::linComb (Avecbuffer, -vars.omega, s, rvec);
-      inprodRplus1 = LinAlg::norm (rvec);
+      inprodRplus1 = this->matVec ().sum (LinAlg::linCombNorm (Avecbuffer, -vars.omega, s, rvec, this->matVec ().vectorThreadPool ()));
       vars.ro_old = vars.ro_new;
     }
     return inprodRplus1;
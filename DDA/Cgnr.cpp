@@ -51,13 +51,13 @@ namespace DDA {
         Core::ProfileHandle _p1 (prof, "matvec1");
         this->matVec ().apply (rvec, pvec, true, prof);
       }
-      vars.ro_new = LinAlg::norm (pvec);
+      vars.ro_new = this->matVec ().sum (LinAlg::norm (pvec));
     } else {
       {
         Core::ProfileHandle _p1 (prof, "matvec1");
         this->matVec ().apply (rvec, Avecbuffer, true, prof);
       }
-      vars.ro_new = LinAlg::norm (Avecbuffer);
+      vars.ro_new = this->matVec ().sum (LinAlg::norm (Avecbuffer));
       vars.beta = vars.ro_new / vars.ro_old;
       LinAlg::linComb (pvec, vars.beta, Avecbuffer, pvec);
     }
@@ -65,11 +65,11 @@ namespace DDA {
       Core::ProfileHandle _p1 (prof, "matvec2");
       this->matVec ().apply (pvec, Avecbuffer, false, prof);
     }
-    ctype alpha = vars.ro_new / LinAlg::norm (Avecbuffer);
+    ctype alpha = vars.ro_new / this->matVec ().sum (LinAlg::norm (Avecbuffer));
     LinAlg::linComb (pvec, alpha, xvec, xvec);
-    LinAlg::linComb (Avecbuffer, -alpha, rvec, rvec);
+    ftype inprodRplus1 = this->matVec ().sum (LinAlg::linCombNorm (Avecbuffer, -alpha, rvec, rvec, this->matVec ().vectorThreadPool ()));
     vars.ro_old = vars.ro_new;
-    return LinAlg::norm (rvec);
+    return inprodRplus1;
   }
 
 
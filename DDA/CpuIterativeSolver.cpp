@@ -24,16 +24,17 @@
 
 #include <LinAlg/LinComb.hpp>
 
+#include <boost/lexical_cast.hpp>
+
 namespace DDA {
   template <class F> CpuIterativeSolver<F>::CpuIterativeSolver (const DDAParams<ftype>& ddaParams, MatVec<ftype>& matVec, csize_t maxResIncrease, csize_t maxIter) :
     IterativeSolverBase<ftype> (ddaParams, maxResIncrease, maxIter),
     matVec_ (matVec),
-    Avecbuffer_ (g ().vecSize ()),
-    rvec_ (g ().vecSize ()),
-    xvec_ (g ().vecSize ()),
-    tmpVec1_ (g ().vecSize ())
+    Avecbuffer_ (matVec.localVecSize ()),
+    rvec_ (matVec.localVecSize ()),
+    xvec_ (matVec.localVecSize ()),
+    tmpVec1_ (matVec.localVecSize ())
   {
-    ASSERT (g ().procs () == 1);
     ASSERT (&ddaParams == &matVec.ddaParams ());
   }
   template <class F> CpuIterativeSolver<F>::~CpuIterativeSolver () {}
@@ -43,25 +44,27 @@ namespace DDA {
   }
 
   template <class F> F CpuIterativeSolver<F>::initGeneral (const std::vector<ctype>& einc, std::ostream& log, const std::vector<ctype>& start, UNUSED Core::ProfilingDataPtr prof) {
+    // The vectors of the solver only contain the dipoles of this process if
+    // the matrix-vector-product is distributed, reductions over them have to
+    // be summed with matVec ().sum ()
     std::vector<ctype>& pvec = tmpVec1 ();
     for (int j = 0; j < 3; j++)
-      for (uint32_t i = g ().nvCount (); i < g ().vecStride (); i++)
-        pvec[i + j * g ().vecStride ()] =  0;
-    g ().multMat (matVec ().cc ().cc_sqrt (), einc, pvec);
+      for (uint32_t i = matVec ().localNvCount (); i < matVec ().localVecStride (); i++)
+        pvec[i + j * matVec ().localVecStride ()] =  0;
+    matVec ().multMatLocal (matVec ().cc ().cc_sqrt (), einc, pvec);
 
-    ftype temp = LinAlg::norm (pvec);
+    ftype temp = matVec ().sum (LinAlg::norm (pvec));
     this->residScale = 1 / temp;
 
     ftype inprodR = 0.0 / 0.0;
 
     if (start.size () != 0) {
       std::vector<ctype>& xvec = this->xvec ();
-      g ().multMatInv (matVec ().cc ().cc_sqrt (), start, xvec); // xvec = start / cc_sqrt
+      matVec ().multMatLocal (matVec ().cc ().cc_sqrt (), start, xvec, true); // xvec = start / cc_sqrt
       std::vector<ctype>& Avecbuffer = this->Avecbuffer ();
       matVec ().apply (xvec, Avecbuffer, false);
       std::vector<ctype>& rvec = this->rvec ();
-      LinAlg::linComb (Avecbuffer, ctype (-1), pvec, rvec);
-      inprodR = LinAlg::norm (rvec);
+      inprodR = matVec ().sum (LinAlg::linCombNorm (Avecbuffer, ctype (-1), pvec, rvec, matVec ().vectorThreadPool ()));
       log << "Use loaded start value" << std::endl;
     } else {
 
@@ -69,8 +72,7 @@ namespace DDA {
       matVec ().apply (pvec, Avecbuffer, false);
 
       std::vector<ctype>& rvec = this->rvec ();
-      LinAlg::linComb (Avecbuffer, ctype (-1), pvec, rvec);
-      inprodR = LinAlg::norm (rvec);
+      inprodR = matVec ().sum (LinAlg::linCombNorm (Avecbuffer, ctype (-1), pvec, rvec, matVec ().vectorThreadPool ()));
 
       log << "temp = " << temp << ", inprodR = " << inprodR << std::endl;
 
@@ -91,13 +93,83 @@ namespace DDA {
   }
 
   template <class F> boost::shared_ptr<std::vector<std::complex<F> > > CpuIterativeSolver<F>::getResult (UNUSED std::ostream& log, UNUSED Core::ProfilingDataPtr prof) {
-    std::vector<ctype>& pvec = tmpVec1 ();
     std::vector<ctype>& xvec = this->xvec ();
 
-    g ().multMat (matVec ().cc ().cc_sqrt (), xvec, pvec);
-    return boost::make_shared<std::vector<std::complex<F> > > (pvec);
+    boost::shared_ptr<std::vector<ctype> > result = boost::make_shared<std::vector<ctype> > (g ().vecSize ());
+    matVec ().multMatGlobal (matVec ().cc ().cc_sqrt (), xvec, *result);
+    return result;
   }
 
+  template <class F> std::vector<boost::shared_ptr<std::vector<std::complex<F> > > > CpuIterativeSolver<F>::getPolVecs (const std::vector<boost::shared_ptr<const CoupleConstants<ftype> > >& ccs, const std::vector<const std::vector<ctype>*>& eincs, ftype eps, std::ostream& log, const std::vector<const std::vector<ctype>*>& starts, Core::ProfilingDataPtr prof) {
+    ASSERT (ccs.size () == eincs.size () && eincs.size () == starts.size ());
+
+    CpuSolverLane<ftype>* self = dynamic_cast<CpuSolverLane<ftype>*> (this);
+    if (!self || eincs.size () < 2)
+      return IterativeSolverBase<ftype>::getPolVecs (ccs, eincs, eps, log, starts, prof);
+
+    std::vector<CpuIterativeSolver<ftype>*> lanes (1, this);
+    std::vector<CpuSolverLane<ftype>*> laneIfs (1, self);
+    for (size_t i = 1; i < eincs.size (); i++) {
+      if (lanes_.size () < i)
+        lanes_.push_back (self->createLane ());
+      CpuSolverLane<ftype>* laneIf = dynamic_cast<CpuSolverLane<ftype>*> (lanes_[i - 1].get ());
+      ASSERT (laneIf);
+      lanes.push_back (lanes_[i - 1].get ());
+      laneIfs.push_back (laneIf);
+    }
+
+    for (size_t i = 0; i < lanes.size (); i++) {
+      matVec ().setCoupleConstants (ccs[i]);
+      lanes[i]->initSolve (*eincs[i], eps, log, *starts[i], prof);
+    }
+
+    {
+      Core::ProfileHandle _p1 (prof, "itsolv");
+      for (size_t i = 0; i < lanes.size (); i++)
+        lanes[i]->init (log, prof);
+      for (;;) {
+        std::vector<CpuIterativeSolver<ftype>*> active;
+        std::vector<CpuSolverLane<ftype>*> activeIfs;
+        std::vector<size_t> activeIndices;
+        std::vector<boost::shared_ptr<const CoupleConstants<ftype> > > activeCcs;
+        std::vector<const std::vector<ctype>*> args;
+        std::vector<std::vector<ctype>*> results;
+        for (size_t i = 0; i < lanes.size (); i++) {
+          if (lanes[i]->converged ())
+            continue;
+          lanes[i]->checkIteration ();
+          active.push_back (lanes[i]);
+          activeIfs.push_back (laneIfs[i]);
+          activeIndices.push_back (i);
+          activeCcs.push_back (ccs[i]);
+          args.push_back (&laneIfs[i]->iterationBegin (lanes[i]->iterationCount (), false));
+          results.push_back (&lanes[i]->Avecbuffer ());
+        }
+        if (active.empty ())
+          break;
+        {
+          Core::ProfileHandle _p2 (prof, "matvec");
+          matVec ().applyBlock (activeCcs, args, results, false, prof);
+        }
+        // One progress line for all lanes, each prefixed by its polarization
+        std::string progress;
+        for (size_t i = 0; i < active.size (); i++) {
+          ftype inprodRplus1 = activeIfs[i]->iterationEnd (active[i]->iterationCount (), false);
+          std::string label = "Pol" + boost::lexical_cast<std::string> (activeIndices[i] + 1) + ": ";
+          progress += (i ? " | " : "") + active[i]->updateIteration (inprodRplus1, log, label);
+        }
+        this->showProgress (progress);
+      }
+      Core::OStream::getStderr () << std::endl;
+    }
+
+    std::vector<boost::shared_ptr<std::vector<ctype> > > results;
+    for (size_t i = 0; i < lanes.size (); i++) {
+      matVec ().setCoupleConstants (ccs[i]);
+      results.push_back (lanes[i]->getResult (log, prof));
+    }
+    return results;
+  }
 
   CALL_MACRO_FOR_DEFAULT_FP_TYPES(CREATE_TEMPLATE_INSTANCE, CpuIterativeSolver)
 }
@@ -44,6 +44,9 @@ namespace DDA {
     std::vector<ctype> xvec_;
     std::vector<ctype> tmpVec1_;
 
+    // Additional solvers used by getPolVecs (), created on demand
+    std::vector<boost::shared_ptr<CpuIterativeSolver<ftype> > > lanes_;
+
   public:
     CpuIterativeSolver (const DDAParams<ftype>& ddaParams, MatVec<ftype>& matVec, csize_t maxResIncrease, csize_t maxIter);
     virtual ~CpuIterativeSolver ();
@@ -54,6 +57,11 @@ namespace DDA {
 
     virtual void setCoupleConstants (const boost::shared_ptr<const CoupleConstants<ftype> >& cc);
 
+    // Runs the solves in lockstep, the matrix-vector-products of all solves
+    // are done with one MatVec::applyBlock () call. Falls back to solving one
+    // after the other if the solver does not implement CpuSolverLane.
+    virtual std::vector<boost::shared_ptr<std::vector<ctype> > > getPolVecs (const std::vector<boost::shared_ptr<const CoupleConstants<ftype> > >& ccs, const std::vector<const std::vector<ctype>*>& eincs, ftype eps, std::ostream& log, const std::vector<const std::vector<ctype>*>& starts, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
+
   protected:
     std::vector<ctype>& Avecbuffer () { return Avecbuffer_; }
     std::vector<ctype>& rvec () { return rvec_; }
@@ -64,6 +72,22 @@ namespace DDA {
     virtual boost::shared_ptr<std::vector<ctype> > getResult (std::ostream& log, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
   };
 
+  // Interface for solvers which need exactly one matrix-vector-product per
+  // iteration, these can be run in lockstep by CpuIterativeSolver::getPolVecs ()
+  template <typename T>
+  class CpuSolverLane {
+  public:
+    virtual ~CpuSolverLane () {}
+
+    // Returns a new solver of the same type using the same MatVec
+    virtual boost::shared_ptr<CpuIterativeSolver<T> > createLane () = 0;
+    // The part of iteration () before the product, returns the argument of
+    // the product, the result has to go to Avecbuffer ()
+    virtual const std::vector<std::complex<T> >& iterationBegin (csize_t nr, bool profilingRun) = 0;
+    // The part of iteration () after the product, returns the new inprodR
+    virtual T iterationEnd (csize_t nr, bool profilingRun) = 0;
+  };
+
   CALL_MACRO_FOR_DEFAULT_FP_TYPES(DISABLE_TEMPLATE_INSTANCE, CpuIterativeSolver)
 }
 
@@ -34,8 +34,11 @@
 #include <Core/Error.hpp>
 #include <Core/File.hpp>
 #include <Core/HelpResultException.hpp>
+#include <Core/ThreadPool.hpp>
 
 #include <OpenCL/Context.hpp>
+#include <OpenCL/ProgramCache.hpp>
+#include <OpenCL/WorkSizeTuner.hpp>
 
 #include <LinAlg/FFTWPlan.hpp>
 
@@ -45,6 +48,7 @@
 
 #include <EMSim/CrossSection.hpp>
 #include <EMSim/Length.hpp>
+#include <EMSim/Parse.hpp>
 #include <EMSim/Mie.hpp>
 #include <EMSim/OutputDirectory.hpp>
 #include <EMSim/DataFilesUtil.hpp>
@@ -59,11 +63,16 @@
 #include <DDA/BicgStab.hpp>
 #include <DDA/GpuBicgCs.hpp>
 #include <DDA/GpuBicgStab.hpp>
+#include <DDA/RefinementSolver.hpp>
 #include <DDA/Geometry.hpp>
 #include <DDA/GeometryParser.hpp>
 #include <DDA/DipoleGeometry.hpp>
 #include <DDA/DMatrixCpu.hpp>
 #include <DDA/DMatrixGpu.hpp>
+#include <DDA/DMatrixCache.hpp>
+#include <DDA/DeviceCalibration.hpp>
+#include <DDA/OrientationAverage.hpp>
+#include <DDA/DispersionTable.hpp>
 #include <DDA/Beam.hpp>
 #include <DDA/FarFieldCalc.hpp>
 #include <DDA/PolarizabilityDescription.hpp>
@@ -75,13 +84,18 @@
 #include <DDA/Load.hpp>
 #include <DDA/Options.hpp>
 #include <DDA/GpuFFTPlans.hpp>
+#include <DDA/MpiComm.hpp>
 
 #include <boost/program_options.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
 
 #include <cmath>
+#include <iomanip>
+#include <limits>
 
 using namespace DDA;
 
@@ -98,14 +112,50 @@ namespace {
   };
 }
 
+// Returns the wavelengths given by --lambda-list or --lambda-range (or an empty
+// vector if there are none)
+static std::vector<ldouble> getLambdas (const DDAOptions& opt) {
+  std::vector<ldouble> lambdas;
+  ASSERT_MSG (!opt.map.count ("lambda-list") || !opt.map.count ("lambda-range"), "Got both --lambda-list and --lambda-range");
+  if (opt.map.count ("lambda-list")) {
+    BOOST_FOREACH (const std::string& value, Core::split (opt.map["lambda-list"].as<std::string> (), ",")) {
+      EMSim::Length lambda;
+      EMSim::parse (value, lambda);
+      lambdas.push_back (lambda.valueAs<ldouble> ());
+    }
+  } else if (opt.map.count ("lambda-range")) {
+    std::vector<std::string> values = Core::split (opt.map["lambda-range"].as<std::string> (), ",");
+    ASSERT_MSG (values.size () == 3, "Expected `min,max,count' for --lambda-range");
+    EMSim::Length min, max;
+    uint32_t count;
+    EMSim::parse (values[0], min);
+    EMSim::parse (values[1], max);
+    EMSim::parse (values[2], count);
+    ASSERT_MSG (count > 0, "Got 0 as count for --lambda-range");
+    for (uint32_t i = 0; i < count; i++)
+      lambdas.push_back (count == 1 ? min.valueAs<ldouble> () : min.valueAs<ldouble> () + (max.valueAs<ldouble> () - min.valueAs<ldouble> ()) * i / (count - 1));
+  }
+  BOOST_FOREACH (ldouble lambda, lambdas)
+    ASSERT_MSG (lambda > 0, "Got non-positive wavelength");
+  return lambdas;
+}
+
 template <class ftype>
-static void createGeometryDDAParams (const DDAOptions& opt, boost::shared_ptr<DDAParams<ftype> >& ddaParams, boost::shared_ptr<const Beam<ftype> >& beam, boost::shared_ptr<const CoupleConstants<ftype> >& cc1, boost::shared_ptr<const CoupleConstants<ftype> >& cc2, bool& symmetric, bool supportNonPot, cuint32_t procs = 1) {
+static void createGeometryDDAParams (const DDAOptions& opt, boost::shared_ptr<DDAParams<ftype> >& ddaParams, boost::shared_ptr<const Beam<ftype> >& beam, boost::shared_ptr<const CoupleConstants<ftype> >& cc1, boost::shared_ptr<const CoupleConstants<ftype> >& cc2, bool& symmetric, bool supportNonPot, cuint32_t procs = 1, const boost::function<std::vector<double> (const DDAParams<ftype>&)>& getWeights = boost::function<std::vector<double> (const DDAParams<ftype>&)> ()) {
   boost::scoped_ptr<Core::ProfileHandle> p1;
   p1.reset (new Core::ProfileHandle (opt.prof, "ddaParams cr"));
 
   // true = dipole model is symmatric with respect to rotation by 90 degrees over the z-axis
   symmetric = true;
   EMSim::Length lambda = opt.map["lambda"].as<EMSim::Length> ();
+  // For a wavelength sweep the first wavelength is used for setting up the
+  // DDAParams and the smallest one for the default grid unit
+  EMSim::Length minLambda = lambda;
+  std::vector<ldouble> lambdas = getLambdas (opt);
+  if (lambdas.size ()) {
+    lambda = lambdas.front ();
+    minLambda = *std::min_element (lambdas.begin (), lambdas.end ());
+  }
   boost::shared_ptr<Geometry> geometry = parseGeometry (opt.map["geometry"].as<std::string> ());
 
   Math::Vector3<ldouble> propNotNorm = opt.map["prop"].as<Math::Vector3<ldouble> > ();
@@ -142,7 +192,7 @@ static void createGeometryDDAParams (const DDAOptions& opt, boost::shared_ptr<DD
         for (int j = 0; j < 3; j++)
           tmp2 = std::max (tmp2, std::norm (materials[i][j]));
       ldouble dpl_def = 10 * std::sqrt (tmp2);
-      gridUnit = lambda.valueAs<ldouble> () / dpl_def;
+      gridUnit = minLambda.valueAs<ldouble> () / dpl_def;
       BOOST_FOREACH (ldouble length, dimensions) {
         ldouble gu = length / 16.0;
         gridUnit = std::min (gridUnit, gu);
@@ -260,7 +310,21 @@ static void createGeometryDDAParams (const DDAOptions& opt, boost::shared_ptr<DD
     symmetric = false;
   dipoleGeometry->normalize ();
 
-  ddaParams.reset (new DDAParams<ftype> (geometry, opt.map["geometry"].as<std::string> (), dipoleGeometry, lambda.valueAs <ftype> (), supportNonPot, procs, opt.map["fft-grid"].as<Math::Vector3<uint32_t> > (), static_cast<ftype> (opt.map["gamma"].as<ldouble> ())));
+  const std::string& latticeSum = opt.map["lattice-sum"].as<std::string> ();
+  ASSERT_MSG (latticeSum == "ewald" || latticeSum == "direct", "Unknown lattice sum `" + latticeSum + "'");
+
+  ddaParams.reset (new DDAParams<ftype> (geometry, opt.map["geometry"].as<std::string> (), dipoleGeometry, lambda.valueAs <ftype> (), supportNonPot, procs, opt.map["fft-grid"].as<Math::Vector3<uint32_t> > (), static_cast<ftype> (opt.map["gamma"].as<ldouble> ()), latticeSum == "ewald"));
+  std::vector<double> weights;
+  if (getWeights)
+    weights = getWeights (*ddaParams);
+  if (weights.size ()) {
+    // The grid size is only known after creating the DDAParams, create them
+    // again with the grid split according to the weights
+    ASSERT (weights.size () == procs);
+    std::vector<uint32_t> localGridX = DDAParams<ftype>::partition (ddaParams->cgridX (), weights);
+    std::vector<uint32_t> localBoxZ = DDAParams<ftype>::partition (ddaParams->dipoleGeometry ().box ().z (), weights);
+    ddaParams.reset (new DDAParams<ftype> (geometry, opt.map["geometry"].as<std::string> (), dipoleGeometry, lambda.valueAs <ftype> (), supportNonPot, procs, opt.map["fft-grid"].as<Math::Vector3<uint32_t> > (), static_cast<ftype> (opt.map["gamma"].as<ldouble> ()), latticeSum == "ewald", localGridX, localBoxZ));
+  }
 
   DataFiles::createDDADipoleListGeometryFile (ddaParams->dipoleGeometry ())->write (opt.outputDir / "Geometry", opt.map.count ("write-txt") ? (std::string) ".txt" : boost::optional<std::string> ());
 
@@ -281,41 +345,34 @@ static void createGeometryDDAParams (const DDAOptions& opt, boost::shared_ptr<DD
   p1.reset ();
 }
 
+// Returns false if cross sections are not implemented for the geometry
 template <class ftype>
-static void outputCrossSections (const boost::filesystem::path& output, const Core::OStream& out, const DDAParams<ftype>& ddaParams, FieldCalculator<ftype>& calculator, const boost::shared_ptr<const Beam<ftype> >& beam, const boost::shared_ptr<const CoupleConstants<ftype> >& cc, uint32_t polarizationNr, const std::string& label, const std::vector<std::complex<ftype> >& result, BeamPolarization pol) {
+static bool calcCrossSection (const DDAParams<ftype>& ddaParams, FieldCalculator<ftype>& calculator, const boost::shared_ptr<const Beam<ftype> >& beam, const boost::shared_ptr<const CoupleConstants<ftype> >& cc, const std::vector<std::complex<ftype> >& result, BeamPolarization pol, EMSim::CrossSection& cs) {
   ftype normFactor;
   if (ddaParams.periodicityDimension () == 0) {
     ftype a_eq = std::pow (FPConst<ftype>::three_over_four_pi * static_cast<ftype> (ddaParams.nvCount ()), FPConst<ftype>::one_third) * ddaParams.gridUnit ();
     normFactor = 1 / (FPConst<ftype>::pi * a_eq * a_eq);
   } else if (ddaParams.periodicityDimension () == 1) {
-    return; // TODO: implement
+    return false; // TODO: implement
   } else if (ddaParams.periodicityDimension () == 2) {
-    return; // TODO: implement
+    return false; // TODO: implement
   } else {
     ABORT ();
   }
-  EMSim::CrossSection cs;
   cs.Cext = beam->extCross (ddaParams, calculator, result, pol);
   cs.Cabs = AbsCross<ftype>::absCross (ddaParams, result, *cc);
   cs.setSca ();
   cs.setQFromC (normFactor);
+  return true;
+}
+
+static void outputCrossSection (const boost::filesystem::path& output, const Core::OStream& out, uint32_t polarizationNr, const std::string& label, const EMSim::CrossSection& cs) {
   EMSim::DataFiles::createCrossSectionFile (polarizationNr, cs)->write (output, (std::string) ".txt");
   cs.print (out, label);
 }
 
 template <class ftype>
-static void createResOutput (const DDAOptions& opt, const DDAParams<ftype>& ddaParams, FieldCalculator<ftype>& calculator, bool symmetric, const boost::shared_ptr<IterativeSolverBase<ftype> >& solver, const boost::shared_ptr<const Beam<ftype> > beam, const boost::shared_ptr<const CoupleConstants<ftype> >& cc1, const boost::shared_ptr<const CoupleConstants<ftype> >& cc2) {
-  typedef std::complex<ftype> ctype;
-  boost::scoped_ptr<Core::ProfileHandle> p1;
-
-  ftype epsilon = std::pow (10.0f, -static_cast<ftype> (opt.map["epsilon"].as<ldouble> ()));
-
-  if (opt.map.count ("profiling-run")) {
-    solver->setCoupleConstants (cc1);
-    solver->profilingRun (*opt.out, *opt.log, opt.prof);
-    return;
-  }
-
+static std::map<EMSim::GridAngleList, std::vector<FarFieldOption> > getFarFieldOptions (const DDAOptions& opt, const DDAParams<ftype>& ddaParams) {
   std::vector<std::string> farFieldOptions;
 
   if (opt.map.count ("far-field"))
@@ -349,7 +406,6 @@ static void createResOutput (const DDAOptions& opt, const DDAParams<ftype>& ddaP
     farFieldOptions.push_back ("Grid=0..180/91,0..360/61,mueller");
 
   std::map<EMSim::GridAngleList, std::vector<FarFieldOption> > farFields;
-  typedef std::pair<EMSim::GridAngleList, std::vector<FarFieldOption> > pairType;
   BOOST_FOREACH (const std::string& str, farFieldOptions) {
     FarFieldOption ff = FarFieldOption::parse (str);
     std::map<EMSim::GridAngleList, std::vector<FarFieldOption> >::iterator iter = farFields.find (ff.angleList ());
@@ -357,7 +413,11 @@ static void createResOutput (const DDAOptions& opt, const DDAParams<ftype>& ddaP
       iter = farFields.insert (std::make_pair (ff.angleList (), std::vector<FarFieldOption> ())).first;
     iter->second.push_back (ff);
   }
+  return farFields;
+}
 
+template <class ftype>
+static boost::shared_ptr<EMSim::DataFiles::Parameters<EMSim::DataFiles::DDAParameters> > createParameters (const DDAOptions& opt, const DDAParams<ftype>& ddaParams, const boost::shared_ptr<const Beam<ftype> >& beam) {
   boost::shared_ptr<EMSim::DataFiles::Parameters<EMSim::DataFiles::DDAParameters> > parameters = DataFiles::createParametersDDA (ddaParams);
   parameters->MethodParameters.PolarizabilityType = opt.map["pol"].as<std::string> ();
   parameters->CmdLine = opt.cmdLine;
@@ -366,16 +426,71 @@ static void createResOutput (const DDAOptions& opt, const DDAParams<ftype>& ddaP
   parameters->Polarizations.resize (2);
   parameters->Polarizations[0] = beam->getIncPol (BEAMPOLARIZATION_1);
   parameters->Polarizations[1] = beam->getIncPol (BEAMPOLARIZATION_2);
+  return parameters;
+}
+
+// If res1 / res2 are not empty they are used as start values for the solver
+// (unless --load-start-dip-pol is given). On return they contain the dipole
+// polarizations. Returns true if the cross sections were calculated, they
+// are stored in cs1 / cs2 if these are not NULL.
+template <class ftype>
+static bool createResOutput (const DDAOptions& opt, const DDAParams<ftype>& ddaParams, FieldCalculator<ftype>& calculator, bool symmetric, const boost::shared_ptr<IterativeSolverBase<ftype> >& solver, const boost::shared_ptr<const Beam<ftype> > beam, const boost::shared_ptr<const CoupleConstants<ftype> >& cc1, const boost::shared_ptr<const CoupleConstants<ftype> >& cc2, std::vector<std::complex<ftype> >& res1, std::vector<std::complex<ftype> >& res2, EMSim::CrossSection* cs1 = NULL, EMSim::CrossSection* cs2 = NULL) {
+  typedef std::complex<ftype> ctype;
+  boost::scoped_ptr<Core::ProfileHandle> p1;
+
+  ftype epsilon = std::pow (10.0f, -static_cast<ftype> (opt.map["epsilon"].as<ldouble> ()));
+
+  if (opt.map.count ("profiling-run")) {
+    solver->setCoupleConstants (cc1);
+    solver->profilingRun (*opt.out, *opt.log, opt.prof);
+    return false;
+  }
+
+  std::map<EMSim::GridAngleList, std::vector<FarFieldOption> > farFields = getFarFieldOptions (opt, ddaParams);
+  typedef std::pair<EMSim::GridAngleList, std::vector<FarFieldOption> > pairType;
+
+  boost::shared_ptr<EMSim::DataFiles::Parameters<EMSim::DataFiles::DDAParameters> > parameters = createParameters (opt, ddaParams, beam);
 
   boost::shared_ptr<EMSim::DataFiles::MieGeometry> mieGeometry;
   boost::shared_ptr<EMSim::DataFiles::Parameters<EMSim::DataFiles::MieParameters> > mieParameters;
 
-  std::vector<ctype> res1, res2;
   if (opt.map.count ("load-dip-pol")) {
     boost::filesystem::path dpDir = opt.map["load-dip-pol"].as<std::string> ();
     Load<ftype>::loadDipPol (dpDir / "DipPol-Pol1", ddaParams, res1);
     if (!symmetric)
       Load<ftype>::loadDipPol (dpDir / "DipPol-Pol2", ddaParams, res2);
+  } else if (!symmetric && opt.map.count ("block-solver")) {
+    opt.out << "Solve Pol1 and Pol2:" << std::endl;
+    p1.reset (new Core::ProfileHandle (opt.prof, "res12"));
+    std::vector<ctype> einc1 (ddaParams.vecSize ());
+    std::vector<ctype> einc2 (ddaParams.vecSize ());
+    beam->createEInc (ddaParams, BEAMPOLARIZATION_1, einc1);
+    beam->createEInc (ddaParams, BEAMPOLARIZATION_2, einc2);
+    if (opt.map.count ("store-incbeam")) {
+      DataFiles::createDDAFieldFile<ftype> (ddaParams, parameters, "IncidentBeam", 1, einc1)->write (opt.outputDir / "IncBeam-Pol1", opt.map.count ("write-txt") ? (std::string) ".txt" : boost::optional<std::string> ());
+      DataFiles::createDDAFieldFile<ftype> (ddaParams, parameters, "IncidentBeam", 2, einc2)->write (opt.outputDir / "IncBeam-Pol2", opt.map.count ("write-txt") ? (std::string) ".txt" : boost::optional<std::string> ());
+    }
+    std::vector<ctype> start1 (res1);
+    std::vector<ctype> start2 (res2);
+    if (opt.map.count ("load-start-dip-pol")) {
+      boost::filesystem::path dpDir = opt.map["load-start-dip-pol"].as<std::string> ();
+      Load<ftype>::loadDipPol (dpDir / "DipPol-Pol1", ddaParams, start1);
+      Load<ftype>::loadDipPol (dpDir / "DipPol-Pol2", ddaParams, start2);
+    }
+    std::vector<boost::shared_ptr<const CoupleConstants<ftype> > > ccs;
+    ccs.push_back (cc1);
+    ccs.push_back (cc2);
+    std::vector<const std::vector<ctype>*> eincs;
+    eincs.push_back (&einc1);
+    eincs.push_back (&einc2);
+    std::vector<const std::vector<ctype>*> starts;
+    starts.push_back (&start1);
+    starts.push_back (&start2);
+    std::vector<boost::shared_ptr<std::vector<ctype> > > res = solver->getPolVecs (ccs, eincs, epsilon, *opt.log, starts, opt.prof);
+    swap (res1, *res[0]);
+    swap (res2, *res[1]);
+    p1.reset ();
+    opt.out << std::endl;
   } else {
     opt.out << "Solve " << (symmetric ? "Pol1/Pol2:" : "Pol1:") << std::endl;
     p1.reset (new Core::ProfileHandle (opt.prof, symmetric ? "res12" : "res1"));
@@ -384,7 +499,7 @@ static void createResOutput (const DDAOptions& opt, const DDAParams<ftype>& ddaP
     if (opt.map.count ("store-incbeam"))
       DataFiles::createDDAFieldFile<ftype> (ddaParams, parameters, "IncidentBeam", 1, einc)->write (opt.outputDir / "IncBeam-Pol1", opt.map.count ("write-txt") ? (std::string) ".txt" : boost::optional<std::string> ());
     solver->setCoupleConstants (cc1);
-    std::vector<ctype> start (0);
+    std::vector<ctype> start (res1);
     if (opt.map.count ("load-start-dip-pol")) {
       boost::filesystem::path dpDir = opt.map["load-start-dip-pol"].as<std::string> ();
       Load<ftype>::loadDipPol (dpDir / "DipPol-Pol1", ddaParams, start);
@@ -399,7 +514,7 @@ static void createResOutput (const DDAOptions& opt, const DDAParams<ftype>& ddaP
       if (opt.map.count ("store-incbeam"))
         DataFiles::createDDAFieldFile<ftype> (ddaParams, parameters, "IncidentBeam", 2, einc)->write (opt.outputDir / "IncBeam-Pol2", opt.map.count ("write-txt") ? (std::string) ".txt" : boost::optional<std::string> ());
       solver->setCoupleConstants (cc2);
-      std::vector<ctype> start (0);
+      std::vector<ctype> start (res2);
       if (opt.map.count ("load-start-dip-pol")) {
         boost::filesystem::path dpDir = opt.map["load-start-dip-pol"].as<std::string> ();
         Load<ftype>::loadDipPol (dpDir / "DipPol-Pol2", ddaParams, start);
@@ -429,7 +544,8 @@ static void createResOutput (const DDAOptions& opt, const DDAParams<ftype>& ddaP
   p1.reset (new Core::ProfileHandle (opt.prof, "output"));
   opt.out << std::endl;
   if (ddaParams.template geometryIs<Shapes::Sphere> () && ddaParams.periodicityDimension () == 0 && dynamic_cast<const Beams::PlaneWave<ftype>*> (beam.get ())) {
-    Math::DiagMatrix3<cldouble > m = ddaParams.template geometryAs<Shapes::Sphere> ().material ();
+    // Use the material of the dipole geometry, which might have been changed by a wavelength sweep
+    Math::DiagMatrix3<cldouble > m = ddaParams.dipoleGeometry ().materials ()[0];
     if (m.m11 () == m.m22 () && m.m11 () == m.m33 ()) {
       mieGeometry = boost::make_shared<EMSim::DataFiles::MieGeometry> ();
       mieGeometry->Type = "Mie";
@@ -458,16 +574,36 @@ static void createResOutput (const DDAOptions& opt, const DDAParams<ftype>& ddaP
       opt.out << std::endl;
     }
   }
+  // In the symmetric case the cross sections of Pol2 are the same as the
+  // ones of Pol1
+  EMSim::CrossSection csPol1, csPol2;
+  bool haveCs = calcCrossSection (ddaParams, calculator, beam, cc1, res1, BEAMPOLARIZATION_1, csPol1);
+  if (haveCs) {
+    if (symmetric) {
+      csPol2 = csPol1;
+    } else {
+      bool haveCs2 = calcCrossSection (ddaParams, calculator, beam, cc2, res2, BEAMPOLARIZATION_2, csPol2);
+      ASSERT (haveCs2);
+    }
+  }
   if (symmetric) {
-    outputCrossSections (opt.outputDir / "CrossSec-Pol1", opt.out, ddaParams, calculator, beam, cc1, 1, "    ", res1, BEAMPOLARIZATION_1);
+    if (haveCs)
+      outputCrossSection (opt.outputDir / "CrossSec-Pol1", opt.out, 1, "    ", csPol1);
     opt.out << std::endl;
-    outputCrossSections (opt.outputDir / "CrossSec-Pol2", Core::OStream::openNull (), ddaParams, calculator, beam, cc1, 2, "    ", res1, BEAMPOLARIZATION_1);
+    if (haveCs)
+      outputCrossSection (opt.outputDir / "CrossSec-Pol2", Core::OStream::openNull (), 2, "    ", csPol2);
   } else {
-    outputCrossSections (opt.outputDir / "CrossSec-Pol1", opt.out, ddaParams, calculator, beam, cc1, 1, "Pol1", res1, BEAMPOLARIZATION_1);
+    if (haveCs)
+      outputCrossSection (opt.outputDir / "CrossSec-Pol1", opt.out, 1, "Pol1", csPol1);
     opt.out << std::endl;
-    outputCrossSections (opt.outputDir / "CrossSec-Pol2", opt.out, ddaParams, calculator, beam, cc2, 2, "Pol2", res2, BEAMPOLARIZATION_2);
+    if (haveCs)
+      outputCrossSection (opt.outputDir / "CrossSec-Pol2", opt.out, 2, "Pol2", csPol2);
     opt.out << std::endl;
   }
+  if (haveCs && cs1)
+    *cs1 = csPol1;
+  if (haveCs && cs2)
+    *cs2 = csPol2;
   p1.reset ();
 
   p1.reset (new Core::ProfileHandle (opt.prof, "farfield"));
@@ -490,6 +626,433 @@ static void createResOutput (const DDAOptions& opt, const DDAParams<ftype>& ddaP
     }
   }
   p1.reset ();
+
+  return haveCs;
+}
+
+static void addCrossSection (EMSim::CrossSection& sum, const EMSim::CrossSection& cs, ldouble weight) {
+  sum.Cext += weight * cs.Cext;
+  sum.Cabs += weight * cs.Cabs;
+  sum.Csca += weight * cs.Csca;
+  sum.Qext += weight * cs.Qext;
+  sum.Qabs += weight * cs.Qabs;
+  sum.Qsca += weight * cs.Qsca;
+}
+
+// Solves the DDA problem for single orientations of the particle. Only the
+// incident field and the couple constants depend on the orientation, so the
+// DMatrix, the FFT plans and the solver are reused for all orientations.
+namespace {
+  template <class ftype>
+  class OrientationSolver {
+    typedef std::complex<ftype> ctype;
+
+  public:
+    typedef std::map<EMSim::GridAngleList, boost::shared_ptr<EMSim::DataFiles::MuellerFarField<ftype> > > MuellerFarFieldMap;
+    typedef std::pair<const EMSim::GridAngleList, boost::shared_ptr<EMSim::DataFiles::MuellerFarField<ftype> > > MuellerPairType;
+
+  private:
+    const DDAOptions& opt;
+    DDAParams<ftype>& ddaParams;
+    FieldCalculator<ftype>& calculator;
+    boost::shared_ptr<IterativeSolverBase<ftype> > solver;
+    boost::shared_ptr<const Beam<ftype> > beam;
+    boost::shared_ptr<const PolarizabilityDescription<ftype> > polDesc;
+    ftype epsilon;
+    Core::OStream orientOut;
+    size_t solveCount;
+
+    std::vector<ctype> einc, res1, res2;
+
+  public:
+    OrientationSolver (const DDAOptions& opt, DDAParams<ftype>& ddaParams, FieldCalculator<ftype>& calculator, const boost::shared_ptr<IterativeSolverBase<ftype> >& solver, const boost::shared_ptr<const Beam<ftype> >& beam)
+      : opt (opt), ddaParams (ddaParams), calculator (calculator), solver (solver), beam (beam),
+        polDesc (PolarizabilityDescription<ftype>::parsePolDesc (opt.map["pol"].as<std::string> ())),
+        epsilon (std::pow (10.0f, -static_cast<ftype> (opt.map["epsilon"].as<ldouble> ()))),
+        orientOut (Core::OStream::open (opt.outputDir / "OrientCrossSec.txt")),
+        solveCount (0),
+        einc (ddaParams.vecSize ()) {
+      orientOut << "alpha beta gamma weight Cext1 Cabs1 Cext2 Cabs2" << std::endl;
+    }
+
+    // Solve for the orientation given by angles (zyz-notation, in deg) and
+    // calculate the cross sections and the mueller matrices for all angle
+    // lists in muellerFarFields. The mueller matrices are averaged over
+    // alphaCount additional rotations around the z axis, which need no
+    // additional solves. weight is only written to OrientCrossSec.txt.
+    void solve (Math::Vector3<ldouble> angles, ldouble weight, EMSim::CrossSection& cs1, EMSim::CrossSection& cs2, MuellerFarFieldMap& muellerFarFields, uint32_t alphaCount) {
+      boost::scoped_ptr<Core::ProfileHandle> p1;
+
+      solveCount++;
+      opt.out << "Orientation " << solveCount << ": " << angles << std::endl;
+      ddaParams.orientation (EMSim::Rotation<ldouble>::fromZYZDeg (angles.x (), angles.y (), angles.z ()));
+      boost::shared_ptr<const CoupleConstants<ftype> > cc1 = boost::make_shared<CoupleConstants<ftype> > (ddaParams, *beam, BEAMPOLARIZATION_1, *polDesc);
+      boost::shared_ptr<const CoupleConstants<ftype> > cc2 = boost::make_shared<CoupleConstants<ftype> > (ddaParams, *beam, BEAMPOLARIZATION_2, *polDesc);
+
+      opt.out << "Solve Pol1:" << std::endl;
+      p1.reset (new Core::ProfileHandle (opt.prof, "res1"));
+      beam->createEInc (ddaParams, BEAMPOLARIZATION_1, einc);
+      solver->setCoupleConstants (cc1);
+      swap (res1, *solver->getPolVec (einc, epsilon, *opt.log, std::vector<ctype> (0), opt.prof));
+      p1.reset ();
+      opt.out << std::endl;
+
+      opt.out << "Solve Pol2:" << std::endl;
+      p1.reset (new Core::ProfileHandle (opt.prof, "res2"));
+      beam->createEInc (ddaParams, BEAMPOLARIZATION_2, einc);
+      solver->setCoupleConstants (cc2);
+      swap (res2, *solver->getPolVec (einc, epsilon, *opt.log, std::vector<ctype> (0), opt.prof));
+      p1.reset ();
+      opt.out << std::endl;
+
+      p1.reset (new Core::ProfileHandle (opt.prof, "output"));
+      bool haveCs1 = calcCrossSection (ddaParams, calculator, beam, cc1, res1, BEAMPOLARIZATION_1, cs1);
+      ASSERT (haveCs1);
+      bool haveCs2 = calcCrossSection (ddaParams, calculator, beam, cc2, res2, BEAMPOLARIZATION_2, cs2);
+      ASSERT (haveCs2);
+      orientOut << angles.x () << " " << angles.y () << " " << angles.z () << " " << weight << " " << cs1.Cext << " " << cs1.Cabs << " " << cs2.Cext << " " << cs2.Cabs << std::endl;
+      p1.reset ();
+
+      p1.reset (new Core::ProfileHandle (opt.prof, "farfield"));
+      BOOST_FOREACH (MuellerPairType& pair, muellerFarFields) {
+        pair.second.reset ();
+        for (uint32_t i = 0; i < alphaCount; i++) {
+          // The jones matrices are given relative to the scattering plane,
+          // so rotating the particle by alpha around the z axis gives the
+          // same mueller matrix as looking in the direction phi - alpha
+          ldouble alpha = 2 * FPConst<ldouble>::pi * i / alphaCount;
+          EMSim::GridAngleList angleList (pair.first.theta0 (), pair.first.phi0 () - alpha, pair.first.radPerTheta (), pair.first.radPerPhi (), pair.first.nTheta (), pair.first.nPhi ());
+          boost::shared_ptr<EMSim::DataFiles::MuellerFarField<ftype> > muellerFarField = EMSim::MuellerCalculus<ftype>::computeMuellerFarField (FarFieldCalc<ftype>::calcJonesFarField (ddaParams, calculator, res1, res2, false, *beam, alphaCount == 1 ? pair.first : angleList));
+          ftype* data = muellerFarField->Data->data ();
+          if (!pair.second) {
+            for (size_t j = 0; j < muellerFarField->Data->num_elements (); j++)
+              data[j] /= static_cast<ftype> (alphaCount);
+            BOOST_FOREACH (ldouble& phi, muellerFarField->Phi)
+              phi += alpha;
+            pair.second = muellerFarField;
+          } else {
+            ftype* sum = pair.second->Data->data ();
+            ASSERT (pair.second->Data->num_elements () == muellerFarField->Data->num_elements ());
+            for (size_t j = 0; j < muellerFarField->Data->num_elements (); j++)
+              sum[j] += data[j] / static_cast<ftype> (alphaCount);
+          }
+        }
+      }
+      p1.reset ();
+    }
+
+    // Integrand for OrientationAverage::integrate(): The cross sections
+    // averaged over alpha (which is the mean over both polarizations)
+    // followed by the mueller matrices averaged over alpha
+    void integrand (MuellerFarFieldMap& muellerFarFields, uint32_t alphaCount, ldouble beta, ldouble gamma, std::vector<ldouble>& values) {
+      EMSim::CrossSection cs1, cs2;
+      // The weight of an orientation is only known when the integration
+      // has finished
+      solve (Math::Vector3<ldouble> (0, beta, gamma), std::numeric_limits<ldouble>::quiet_NaN (), cs1, cs2, muellerFarFields, alphaCount);
+      values.clear ();
+      values.push_back ((cs1.Cext + cs2.Cext) / 2);
+      values.push_back ((cs1.Cabs + cs2.Cabs) / 2);
+      values.push_back ((cs1.Csca + cs2.Csca) / 2);
+      values.push_back ((cs1.Qext + cs2.Qext) / 2);
+      values.push_back ((cs1.Qabs + cs2.Qabs) / 2);
+      values.push_back ((cs1.Qsca + cs2.Qsca) / 2);
+      BOOST_FOREACH (const MuellerPairType& pair, muellerFarFields) {
+        const ftype* data = pair.second->Data->data ();
+        values.insert (values.end (), data, data + pair.second->Data->num_elements ());
+      }
+    }
+  };
+}
+
+// Difference between two results of OrientationSolver::integrand(): The
+// differences of the efficiencies relative to Qext and the differences of the
+// mueller matrices relative to the largest S11 value of the far field
+static ldouble orientAvgError (const std::vector<size_t>& muellerSizes, const std::vector<ldouble>& values1, const std::vector<ldouble>& values2) {
+  ASSERT (values1.size () == values2.size ());
+  ldouble error = 0;
+  for (size_t i = 3; i < 6; i++)
+    error = std::max (error, std::abs (values1[i] - values2[i]) / std::abs (values1[3]));
+  size_t offset = 6;
+  BOOST_FOREACH (size_t size, muellerSizes) {
+    ldouble maxS11 = 0;
+    ldouble maxDiff = 0;
+    for (size_t i = 0; i < size; i++) {
+      if (i % 16 == 0)
+        maxS11 = std::max (maxS11, std::abs (values1[offset + i]));
+      maxDiff = std::max (maxDiff, std::abs (values1[offset + i] - values2[offset + i]));
+    }
+    if (maxS11 != 0)
+      error = std::max (error, maxDiff / maxS11);
+    offset += size;
+  }
+  ASSERT (offset == values1.size ());
+  return error;
+}
+
+// Solve for the orientations given by --orient-avg and output the orientation
+// averaged cross sections and mueller matrices.
+template <class ftype>
+static void createOrientAvgOutput (const DDAOptions& opt, DDAParams<ftype>& ddaParams, FieldCalculator<ftype>& calculator, const boost::shared_ptr<IterativeSolverBase<ftype> >& solver, const boost::shared_ptr<const Beam<ftype> > beam, const OrientationAverage& orientations) {
+  typedef typename OrientationSolver<ftype>::MuellerFarFieldMap MuellerFarFieldMap;
+  typedef typename OrientationSolver<ftype>::MuellerPairType MuellerPairType;
+  boost::scoped_ptr<Core::ProfileHandle> p1;
+
+  ASSERT_MSG (!opt.map.count ("load-dip-pol") && !opt.map.count ("profiling-run"), "--orient-avg cannot be used together with --load-dip-pol or --profiling-run");
+  ASSERT_MSG (opt.map["orient"].defaulted (), "--orient-avg cannot be used together with --orient");
+  // For periodic targets the DMatrix depends on the phase shift of the beam and therefore on the orientation
+  ASSERT_MSG (ddaParams.periodicityDimension () == 0, "--orient-avg is only supported for non-periodic targets");
+  if (orientations.adaptive ()) {
+    // Only for a plane wave propagating along the z axis a rotation by alpha
+    // is a rotation around the propagation direction which leaves the
+    // incident field unchanged (except for the polarization)
+    ASSERT_MSG (Math::abs2 (beam->prop () - Math::Vector3<ldouble> (0, 0, 1)) <= 1e-12l, "Adaptive orientation averaging needs --prop (0,0,1)");
+    ASSERT_MSG (dynamic_cast<const Beams::PlaneWave<ftype>*> (beam.get ()), "Adaptive orientation averaging needs a plane wave");
+    if (opt.map["pol"].as<std::string> () == "ldr")
+      opt.out << "Warning: The ldr polarizability depends on the polarization, averaging over alpha will only be approximate (use ldr-avgpol or cm)" << std::endl;
+  }
+
+  std::map<EMSim::GridAngleList, std::vector<FarFieldOption> > farFields = getFarFieldOptions (opt, ddaParams);
+  typedef std::pair<EMSim::GridAngleList, std::vector<FarFieldOption> > pairType;
+  MuellerFarFieldMap muellerFarFields;
+  BOOST_FOREACH (const pairType& pair, farFields) {
+    BOOST_FOREACH (const FarFieldOption& option, pair.second) {
+      if (option.storeJones ())
+        opt.out << "Warning: Jones matrices cannot be orientation averaged, far field `" << option.outputName () << "' will only contain the mueller matrix" << std::endl;
+      if (option.storeMueller ())
+        muellerFarFields[pair.first];
+    }
+  }
+
+  boost::shared_ptr<EMSim::DataFiles::Parameters<EMSim::DataFiles::DDAParameters> > parameters = createParameters (opt, ddaParams, beam);
+  boost::shared_ptr<EMSim::DataFiles::DDADipoleListGeometry> geometry = DataFiles::createDDADipoleListGeometry (ddaParams.dipoleGeometry (), false);
+
+  OrientationSolver<ftype> orientationSolver (opt, ddaParams, calculator, solver, beam);
+  EMSim::CrossSection cs1Avg = EMSim::CrossSection ();
+  EMSim::CrossSection cs2Avg = EMSim::CrossSection ();
+  MuellerFarFieldMap muellerAvg;
+  size_t count;
+  if (!orientations.adaptive ()) {
+    BOOST_FOREACH (const OrientationAverage::Entry& entry, orientations.entries ()) {
+      EMSim::CrossSection cs1, cs2;
+      orientationSolver.solve (entry.angles, entry.weight, cs1, cs2, muellerFarFields, 1);
+      addCrossSection (cs1Avg, cs1, entry.weight);
+      addCrossSection (cs2Avg, cs2, entry.weight);
+      BOOST_FOREACH (const MuellerPairType& pair, muellerFarFields) {
+        boost::shared_ptr<EMSim::DataFiles::MuellerFarField<ftype> >& sum = muellerAvg[pair.first];
+        ftype* data = pair.second->Data->data ();
+        if (!sum) {
+          for (size_t i = 0; i < pair.second->Data->num_elements (); i++)
+            data[i] *= static_cast<ftype> (entry.weight);
+          sum = pair.second;
+        } else {
+          ASSERT (sum->Data->num_elements () == pair.second->Data->num_elements ());
+          for (size_t i = 0; i < pair.second->Data->num_elements (); i++)
+            sum->Data->data ()[i] += static_cast<ftype> (entry.weight) * data[i];
+        }
+      }
+    }
+    count = orientations.entries ().size ();
+  } else {
+    // Determine the sizes of the mueller matrix blocks of the integrand
+    std::vector<size_t> muellerSizes;
+    BOOST_FOREACH (const MuellerPairType& pair, muellerFarFields)
+      muellerSizes.push_back (16 * pair.first.count ());
+
+    std::vector<ldouble> values;
+    count = orientations.integrate (boost::bind (&OrientationSolver<ftype>::integrand, &orientationSolver, boost::ref (muellerFarFields), orientations.alphaCount (), _1, _2, _3),
+                                    boost::bind (&orientAvgError, boost::cref (muellerSizes), _1, _2),
+                                    values, opt.out);
+
+    // Averaging over alpha makes the cross sections independent of the polarization
+    cs1Avg.Cext = values[0];
+    cs1Avg.Cabs = values[1];
+    cs1Avg.Csca = values[2];
+    cs1Avg.Qext = values[3];
+    cs1Avg.Qabs = values[4];
+    cs1Avg.Qsca = values[5];
+    cs2Avg = cs1Avg;
+    size_t offset = 6;
+    BOOST_FOREACH (const MuellerPairType& pair, muellerFarFields) {
+      // Reuse the angles and frequencies of the last evaluation
+      boost::shared_ptr<EMSim::DataFiles::MuellerFarField<ftype> >& avg = muellerAvg[pair.first];
+      avg = pair.second;
+      ftype* data = avg->Data->data ();
+      for (size_t i = 0; i < avg->Data->num_elements (); i++)
+        data[i] = static_cast<ftype> (values[offset + i]);
+      offset += avg->Data->num_elements ();
+    }
+    ASSERT (offset == values.size ());
+  }
+
+  p1.reset (new Core::ProfileHandle (opt.prof, "output"));
+  opt.out << "Orientation averaged cross sections (" << count << " orientations):" << std::endl;
+  EMSim::DataFiles::createCrossSectionFile (1, cs1Avg)->write (opt.outputDir / "CrossSec-Pol1", (std::string) ".txt");
+  cs1Avg.print (opt.out, "Pol1");
+  opt.out << std::endl;
+  EMSim::DataFiles::createCrossSectionFile (2, cs2Avg)->write (opt.outputDir / "CrossSec-Pol2", (std::string) ".txt");
+  cs2Avg.print (opt.out, "Pol2");
+  opt.out << std::endl;
+  p1.reset ();
+
+  p1.reset (new Core::ProfileHandle (opt.prof, "farfield"));
+  BOOST_FOREACH (const pairType& pair, farFields)
+    BOOST_FOREACH (const FarFieldOption& option, pair.second)
+      if (option.storeMueller ())
+        FarFieldCalc<ftype>::storeMueller (opt.outputDir / "Far", geometry, parameters, muellerAvg[pair.first], option, opt.map.count ("write-txt"));
+  p1.reset ();
+}
+
+// Solve for all wavelengths given by --lambda-list or --lambda-range. The
+// geometry, the FFT plans, the OpenCL stubs and the solver are reused, only
+// the DMatrix (using createDMatrix) and the couple constants are recalculated
+// for every wavelength. The dipole polarizations of the previous wavelength
+// are used as start values for the solver. The output for every wavelength is
+// written to a separate subdirectory.
+template <class ftype>
+static void createSpectrumOutput (const DDAOptions& opt, DDAParams<ftype>& ddaParams, FieldCalculator<ftype>& calculator, bool symmetric, const boost::shared_ptr<IterativeSolverBase<ftype> >& solver, const boost::shared_ptr<const Beam<ftype> > beam, const std::vector<ldouble>& lambdas, const boost::function<void ()>& createDMatrix) {
+  typedef std::complex<ftype> ctype;
+  boost::scoped_ptr<Core::ProfileHandle> p1;
+
+  ASSERT_MSG (!opt.map.count ("load-dip-pol") && !opt.map.count ("profiling-run"), "--lambda-list and --lambda-range cannot be used together with --load-dip-pol or --profiling-run");
+
+  boost::scoped_ptr<DispersionTable> dispersion;
+  if (opt.map.count ("dispersion")) {
+    dispersion.reset (new DispersionTable (DispersionTable::load (opt.map["dispersion"].as<std::string> ())));
+    ASSERT_MSG (dispersion->materialCount () >= ddaParams.dipoleGeometry ().matCount (), "Dispersion table contains less materials than the geometry");
+  }
+  boost::shared_ptr<const PolarizabilityDescription<ftype> > polDesc = PolarizabilityDescription<ftype>::parsePolDesc (opt.map["pol"].as<std::string> ());
+
+  Core::OStream spectrumOut = Core::OStream::open (opt.outputDir / "Spectrum.txt");
+  spectrumOut << "lambda Cext1 Cabs1 Cext2 Cabs2" << std::endl;
+
+  std::vector<ctype> res1, res2;
+  for (size_t i = 0; i < lambdas.size (); i++) {
+    opt.out << "Wavelength " << (i + 1) << " / " << lambdas.size () << ": " << EMSim::Length (lambdas[i]) << std::endl;
+    if (dispersion)
+      ddaParams.materials (dispersion->materials (lambdas[i]));
+    // The DMatrix for the first wavelength has already been created
+    if (i != 0) {
+      ddaParams.lambda (static_cast<ftype> (lambdas[i]));
+      p1.reset (new Core::ProfileHandle (opt.prof, "Dmatrix"));
+      createDMatrix ();
+      p1.reset ();
+    }
+    boost::shared_ptr<const CoupleConstants<ftype> > cc1 = boost::make_shared<CoupleConstants<ftype> > (ddaParams, *beam, BEAMPOLARIZATION_1, *polDesc);
+    boost::shared_ptr<const CoupleConstants<ftype> > cc2 = boost::make_shared<CoupleConstants<ftype> > (ddaParams, *beam, BEAMPOLARIZATION_2, *polDesc);
+
+    std::stringstream name;
+    name << "Lambda-" << std::setw (4) << std::setfill ('0') << (i + 1);
+    DDAOptions lambdaOpt = opt;
+    lambdaOpt.outputDir = opt.outputDir / name.str ();
+    if (!boost::filesystem::exists (lambdaOpt.outputDir))
+      boost::filesystem::create_directory (lambdaOpt.outputDir);
+    EMSim::CrossSection cs1, cs2;
+    if (createResOutput (lambdaOpt, ddaParams, calculator, symmetric, solver, beam, cc1, cc2, res1, res2, &cs1, &cs2))
+      spectrumOut << lambdas[i] << " " << cs1.Cext << " " << cs1.Cabs << " " << cs2.Cext << " " << cs2.Cabs << std::endl;
+  }
+}
+
+static boost::shared_ptr<Core::ThreadPool> createThreadPool (const DDAOptions& opt) {
+  size_t threads = opt.map["threads"].as<uint32_t> ();
+  if (threads == 0)
+    threads = Core::ThreadPool::defaultThreadCount ();
+  opt.out << "Using " << threads << " thread(s)" << std::endl;
+  return boost::make_shared<Core::ThreadPool> (threads);
+}
+
+// All FFTW plans are executed by the workers of threadPool at the same time,
+// the number of threads per plan is limited so that threadPool and FFTW
+// together do not use more threads than the hardware provides
+static LinAlg::FFTWOptions getFFTWOptions (const DDAOptions& opt, const Core::ThreadPool& threadPool) {
+  LinAlg::FFTWOptions options;
+  options.rigor = LinAlg::FFTWOptions::parseRigor (opt.map["fftw-rigor"].as<std::string> ());
+  size_t maxThreads = std::max<size_t> (1, Core::ThreadPool::defaultThreadCount () / threadPool.threadCount ());
+  options.threads = opt.map["fftw-threads"].as<uint32_t> ();
+  if (options.threads == 0) {
+    options.threads = maxThreads;
+  } else if (options.threads > maxThreads) {
+    opt.out << "Reducing the number of FFTW threads from " << options.threads << " to " << maxThreads << " because every one of the " << threadPool.threadCount () << " thread(s) runs its own FFTW plans" << std::endl;
+    options.threads = maxThreads;
+  }
+  if (opt.map.count ("fftw-wisdom-dir"))
+    options.wisdomDirectory = opt.map["fftw-wisdom-dir"].as<std::string> ();
+  return options;
+}
+
+template <class ftype>
+static boost::shared_ptr<const DMatrixCache<ftype> > createDMatrixCache (const DDAOptions& opt) {
+  if (!opt.map.count ("dmatrix-cache"))
+    return boost::shared_ptr<const DMatrixCache<ftype> > ();
+  return boost::make_shared<DMatrixCache<ftype> > (opt.map["dmatrix-cache"].as<std::string> ());
+}
+
+template <class ftype>
+static csize_t getMaxIter (const DDAOptions& opt, const DDAParams<ftype>& g) {
+  if (opt.map.count ("maxiter"))
+    return opt.map["maxiter"].as<size_t> ();
+  else
+    return g.dipoleGeometry ().box ().x () * g.dipoleGeometry ().box ().y () * g.dipoleGeometry ().box ().z () * 3;
+}
+
+// Used for creating both DMatrices for --mixed-precision
+static void callBoth (const boost::function<void ()>& f1, const boost::function<void ()>& f2) {
+  f1 ();
+  f2 ();
+}
+
+// Create the single precision DDAParams and beam used by the inner solver for
+// --mixed-precision, the dipole and the FFT grid are the same as for g
+template <class ftype>
+static void createMixedPrecisionParams (const DDAOptions& opt, const DDAParams<ftype>& g, bool supportNonPot, boost::shared_ptr<DDAParams<float> >& innerParams, boost::shared_ptr<const Beam<float> >& innerBeam) {
+  innerParams.reset (new DDAParams<float> (g.geometryPtr (), g.geometryString (), g.dipoleGeometryPtr (), static_cast<float> (g.lambda ()), supportNonPot, g.procs (), opt.map["fft-grid"].as<Math::Vector3<uint32_t> > (), static_cast<float> (g.gamma ()), g.ewaldSum ()));
+  ASSERT_MSG (innerParams->gridSize () == g.gridSize (), "--mixed-precision: FFT grid of the single precision matrix-vector-product differs");
+  Math::Vector3<ldouble> propNotNorm = opt.map["prop"].as<Math::Vector3<ldouble> > ();
+  innerBeam = Beam<float>::parseBeam (static_cast<Math::Vector3<float> > (propNotNorm), opt.map["beam"].as<std::string> ());
+}
+
+template <class ftype>
+static void createDMatrixCpu (const DDAOptions& opt, const DDAParams<ftype>& g, const LinAlg::FFTPlanFactory<ftype>& planFactory, Core::ThreadPool& threadPool, boost::multi_array_ref<Math::SymMatrix3<std::complex<ftype> >, 3>& dMatrix, const boost::shared_ptr<const Beam<ftype> >& beam, const std::vector<uint32_t>* xIndices = NULL) {
+  boost::shared_ptr<const DMatrixCache<ftype> > cache = createDMatrixCache<ftype> (opt);
+  if (!cache) {
+    DMatrixCpu<ftype>::createDMatrix (g, planFactory, threadPool, dMatrix, beam, xIndices);
+  } else if (cache->loadOrCreate (g, planFactory, threadPool, dMatrix, beam)) {
+    opt.out << "Loaded DMatrix from " << cache->getFilename (cache->getKey (g, beam)) << std::endl;
+  } else {
+    opt.out << "Stored DMatrix in " << cache->getFilename (cache->getKey (g, beam)) << std::endl;
+  }
+}
+
+// Create the DMatrix and copy it into the layout used by MatVecCpu, the
+// DMatrix itself is only kept until it has been copied
+template <class ftype>
+static void createDMatrixPlanesCpu (const DDAOptions& opt, const DDAParams<ftype>& g, const LinAlg::FFTPlanFactory<ftype>& planFactory, Core::ThreadPool& threadPool, DMatrixPlanes<ftype>& planes, const boost::shared_ptr<const Beam<ftype> >& beam, const std::vector<uint32_t>* xIndices = NULL) {
+  boost::multi_array<Math::SymMatrix3<std::complex<ftype> >, 3> dMatrix (boost::extents[g.dMatrixY ()][g.dMatrixZ ()][planes.xCount ()], boost::fortran_storage_order ());
+  createDMatrixCpu<ftype> (opt, g, planFactory, threadPool, dMatrix, beam, xIndices);
+  planes.load (dMatrix, threadPool);
+}
+
+// Create the single precision DMatrix for --mixed-precision, takes the current
+// wavelength from g
+template <class ftype>
+static void createMixedPrecisionDMatrixCpu (const DDAOptions& opt, const DDAParams<ftype>& g, DDAParams<float>& innerParams, const LinAlg::FFTPlanFactory<float>& planFactory, Core::ThreadPool& threadPool, DMatrixPlanes<float>& dMatrix, const boost::shared_ptr<const Beam<float> >& beam) {
+  innerParams.lambda (static_cast<float> (g.lambda ()));
+  createDMatrixPlanesCpu<float> (opt, innerParams, planFactory, threadPool, dMatrix, beam);
+}
+
+template <class ftype>
+static boost::shared_ptr<IterativeSolverBase<ftype> > createCpuSolver (const DDAOptions& opt, const DDAParams<ftype>& g, MatVec<ftype>& matVec, csize_t maxIter) {
+  boost::shared_ptr<IterativeSolverBase<ftype> > solver;
+  if (opt.map["iter"].as<std::string> () == "qmr") {
+    solver.reset (new QmrCs<ftype> (g, matVec, maxIter));
+  } else if (opt.map["iter"].as<std::string> () == "cgnr") {
+    solver.reset (new Cgnr<ftype> (g, matVec, maxIter));
+  } else if (opt.map["iter"].as<std::string> () == "bicg") {
+    solver.reset (new BicgCs<ftype> (g, matVec, maxIter));
+  } else if (opt.map["iter"].as<std::string> () == "bicgstab") {
+    solver.reset (new BicgStab<ftype> (g, matVec, maxIter));
+  } else
+    ABORT_MSG ("Unknown iterative solver `" + opt.map["iter"].as<std::string> () + "'");
+  return solver;
 }
 
 template <class ftype>
@@ -498,53 +1061,125 @@ static void ddaCpu (const DDAOptions& opt) {
 
   boost::scoped_ptr<Core::ProfileHandle> p1;
 
-  const LinAlg::FFTPlanFactory<ftype>& planFactory = LinAlg::getFFTWPlanFactory<ftype> ();
+  boost::shared_ptr<Core::ThreadPool> threadPool = createThreadPool (opt);
+  boost::shared_ptr<const LinAlg::FFTPlanFactory<ftype> > planFactoryPtr = LinAlg::createFFTWPlanFactory<ftype> (getFFTWOptions (opt, *threadPool));
+  const LinAlg::FFTPlanFactory<ftype>& planFactory = *planFactoryPtr;
+
+  // With several MPI processes the dipoles are distributed over the
+  // processes, every process only stores its part of the vectors and of the
+  // DMatrix
+  const MpiComm* comm = MpiComm::world ().size () > 1 ? &MpiComm::world () : NULL;
 
   bool symmetric;
   boost::shared_ptr<DDAParams<ftype> > ddaParamsPtr;
   boost::shared_ptr<const Beam<ftype> > beam;
   boost::shared_ptr<const CoupleConstants<ftype> > cc1, cc2;
-  createGeometryDDAParams<ftype> (opt, ddaParamsPtr, beam, cc1, cc2, symmetric, planFactory.supportNonPOTSizes ());
+  createGeometryDDAParams<ftype> (opt, ddaParamsPtr, beam, cc1, cc2, symmetric, planFactory.supportNonPOTSizes (), comm ? (uint32_t) comm->size () : 1);
   const DDAParams<ftype>& g = *ddaParamsPtr;
 
+  boost::scoped_ptr<OrientationAverage> orientAvg;
+  if (opt.map.count ("orient-avg"))
+    orientAvg.reset (new OrientationAverage (OrientationAverage::parse (opt.map["orient-avg"].as<std::string> ())));
+  std::vector<ldouble> lambdas = getLambdas (opt);
+  ASSERT_MSG (!orientAvg || lambdas.size () == 0, "--orient-avg cannot be used together with --lambda-list or --lambda-range");
+
   boost::shared_ptr<IterativeSolverBase<ftype> > solver;
   boost::shared_ptr<MatVecCpu<ftype> > matVec;
-  boost::shared_ptr<boost::multi_array<Math::SymMatrix3<ctype>, 3> > dMatrix;
+  boost::shared_ptr<DMatrixPlanes<ftype> > dMatrix;
+  std::vector<uint32_t> dMatrixXIndices;
+  boost::shared_ptr<MatrixFreeDMatrix<ftype> > matrixFree;
+  // Single precision DMatrix, matrix-vector-product and solver for --mixed-precision
+  boost::shared_ptr<const LinAlg::FFTPlanFactory<float> > innerPlanFactory;
+  boost::shared_ptr<DDAParams<float> > innerParams;
+  boost::shared_ptr<const Beam<float> > innerBeam;
+  boost::shared_ptr<DMatrixPlanes<float> > innerDMatrix;
+  boost::shared_ptr<MatVecCpu<float> > innerMatVec;
+  boost::shared_ptr<IterativeSolverBase<float> > innerSolver;
+  boost::function<void ()> createDMatrix;
   if (!opt.map.count ("load-dip-pol")) {
+    csize_t maxIter = getMaxIter (opt, g);
+
     p1.reset (new Core::ProfileHandle (opt.prof, "Dmatrix"));
-    opt.out << "Size of DMatrix: " << (g.cgridY () * g.cgridZ () * g.cgridX () * 6 * sizeof (ctype) / 1024 / 1024) << "MB" << std::endl;
-    dMatrix.reset (new boost::multi_array<Math::SymMatrix3<ctype>, 3> (boost::extents[g.gridY ()][g.gridZ ()][g.gridX ()], boost::fortran_storage_order ()));
+    if (comm) {
+      dMatrixXIndices = MatVecCpu<ftype>::localDMatrixXIndices (g, comm->rank ());
+      opt.out << "Size of local DMatrix: " << (g.cdMatrixY () * g.cdMatrixZ () * dMatrixXIndices.size () * 6 * sizeof (ctype) / 1024 / 1024) << "MB" << std::endl;
+      dMatrix.reset (new DMatrixPlanes<ftype> (g, dMatrixXIndices.size ()));
+      createDMatrix = boost::bind (&createDMatrixPlanesCpu<ftype>, boost::cref (opt), boost::cref (g), boost::cref (planFactory), boost::ref (*threadPool), boost::ref (*dMatrix), boost::cref (beam), &dMatrixXIndices);
+    } else if (!opt.map.count ("matrix-free")) {
+      opt.out << "Size of DMatrix: " << (g.cdMatrixY () * g.cdMatrixZ () * g.cdMatrixX () * 6 * sizeof (ctype) / 1024 / 1024) << "MB" << std::endl;
+      dMatrix.reset (new DMatrixPlanes<ftype> (g, g.dMatrixX ()));
+      createDMatrix = boost::bind (&createDMatrixPlanesCpu<ftype>, boost::cref (opt), boost::cref (g), boost::cref (planFactory), boost::ref (*threadPool), boost::ref (*dMatrix), boost::cref (beam), (const std::vector<uint32_t>*) NULL);
+    } else {
+      matrixFree.reset (new MatrixFreeDMatrix<ftype> (g, planFactory, threadPool->threadCount ()));
+      opt.out << "Size of matrix-free DMatrix table: " << (matrixFree->tableSize () * sizeof (ctype) / 1024 / 1024) << "MB" << std::endl;
+      dMatrix.reset (new DMatrixPlanes<ftype> (g, 0));
+      createDMatrix = boost::bind (&MatrixFreeDMatrix<ftype>::create, matrixFree.get (), boost::ref (*threadPool), boost::cref (beam));
+    }
+    if (opt.map.count ("mixed-precision")) {
+      // The single precision DMatrix is used by the inner solver, the
+      // --ftype DMatrix (or matrix-free table) only for the residual of the
+      // refinement
+      innerPlanFactory = LinAlg::createFFTWPlanFactory<float> (getFFTWOptions (opt, *threadPool));
+      createMixedPrecisionParams (opt, g, innerPlanFactory->supportNonPOTSizes (), innerParams, innerBeam);
+      const DDAParams<float>& ig = *innerParams;
+      opt.out << "Size of single precision DMatrix: " << (ig.cdMatrixY () * ig.cdMatrixZ () * ig.cdMatrixX () * 6 * sizeof (std::complex<float>) / 1024 / 1024) << "MB" << std::endl;
+      innerDMatrix.reset (new DMatrixPlanes<float> (ig, ig.dMatrixX ()));
+      boost::function<void ()> createInnerDMatrix = boost::bind (&createMixedPrecisionDMatrixCpu<ftype>, boost::cref (opt), boost::cref (g), boost::ref (*innerParams), boost::cref (*innerPlanFactory), boost::ref (*threadPool), boost::ref (*innerDMatrix), boost::cref (innerBeam));
+      createDMatrix = boost::bind (&callBoth, createDMatrix, createInnerDMatrix);
+    }
     if (!opt.map.count ("profiling-run"))
-      DMatrixCpu<ftype>::createDMatrix (g, planFactory, *dMatrix, beam);
+      createDMatrix ();
     p1.reset ();
 
     p1.reset (new Core::ProfileHandle (opt.prof, "cr matvec"));
-    matVec.reset (new MatVecCpu<ftype> (g, *dMatrix, planFactory));
+    matVec.reset (new MatVecCpu<ftype> (g, *dMatrix, planFactory, threadPool, beam, matrixFree, comm));
+    if (opt.map.count ("mixed-precision"))
+      innerMatVec.reset (new MatVecCpu<float> (*innerParams, *innerDMatrix, *innerPlanFactory, threadPool, innerBeam));
     p1.reset ();
 
-    csize_t maxIter = 0;
-    if (opt.map.count ("maxiter"))
-      maxIter = opt.map["maxiter"].as<size_t> ();
-    else
-      maxIter = g.dipoleGeometry ().box ().x () * g.dipoleGeometry ().box ().y () * g.dipoleGeometry ().box ().z () * 3;
-
     p1.reset (new Core::ProfileHandle (opt.prof, "cr solver"));
-    if (opt.map["iter"].as<std::string> () == "qmr") {
-      solver.reset (new QmrCs<ftype> (g, *matVec, maxIter));
-    } else if (opt.map["iter"].as<std::string> () == "cgnr") {
-      solver.reset (new Cgnr<ftype> (g, *matVec, maxIter));
-    } else if (opt.map["iter"].as<std::string> () == "bicg") {
-      solver.reset (new BicgCs<ftype> (g, *matVec, maxIter));
-    } else if (opt.map["iter"].as<std::string> () == "bicgstab") {
-      solver.reset (new BicgStab<ftype> (g, *matVec, maxIter));
-    } else
-      ABORT_MSG ("Unknown iterative solver `" + opt.map["iter"].as<std::string> () + "'");
+    if (!opt.map.count ("mixed-precision")) {
+      solver = createCpuSolver<ftype> (opt, g, *matVec, maxIter);
+    } else {
+      innerSolver = createCpuSolver<float> (opt, *innerParams, *innerMatVec, maxIter);
+      solver.reset (new RefinementSolver<ftype> (g, *innerParams, *innerSolver, *matVec, maxIter));
+    }
     p1.reset ();
   }
 
   CpuFieldCalculator<ftype> calculator (g);
 
-  createResOutput (opt, g, calculator, symmetric, solver, beam, cc1, cc2);
+  std::vector<ctype> res1, res2;
+  if (orientAvg)
+    createOrientAvgOutput (opt, *ddaParamsPtr, calculator, solver, beam, *orientAvg);
+  else if (lambdas.size ())
+    createSpectrumOutput (opt, *ddaParamsPtr, calculator, symmetric, solver, beam, lambdas, createDMatrix);
+  else
+    createResOutput (opt, g, calculator, symmetric, solver, beam, cc1, cc2, res1, res2);
+}
+
+template <class ftype>
+static boost::shared_ptr<IterativeSolverBase<ftype> > createGpuSolver (const DDAOptions& opt, const OpenCL::StubPool& pool, const std::vector<cl::CommandQueue>& queues, const DDAParams<ftype>& g, GpuMatVec<ftype>& matVec, csize_t maxIter, OpenCL::VectorAccounting& accounting) {
+  boost::shared_ptr<IterativeSolverBase<ftype> > solver;
+  if (opt.map["iter"].as<std::string> () == "qmr") {
+    solver.reset (new GpuQmrCs<ftype> (pool, queues, g, matVec, maxIter, accounting));
+  } else if (opt.map["iter"].as<std::string> () == "cgnr") {
+    solver.reset (new GpuCgnr<ftype> (pool, queues, g, matVec, maxIter, accounting));
+  } else if (opt.map["iter"].as<std::string> () == "bicg") {
+    solver.reset (new GpuBicgCs<ftype> (pool, queues, g, matVec, maxIter, accounting));
+  } else if (opt.map["iter"].as<std::string> () == "bicgstab") {
+    solver.reset (new GpuBicgStab<ftype> (pool, queues, g, matVec, maxIter, accounting, opt.prof));
+  } else
+    ABORT_MSG ("Unknown iterative solver `" + opt.map["iter"].as<std::string> () + "'");
+  return solver;
+}
+
+// Create the single precision DMatrix on the GPU for --mixed-precision, takes
+// the current wavelength from g
+template <class ftype>
+static void createMixedPrecisionDMatrixGpu (const OpenCL::StubPool& pool, const std::vector<cl::CommandQueue>& queues, const DDAParams<ftype>& g, DDAParams<float>& innerParams, const LinAlg::FFTPlanFactory<float>& cpuPlanFactory, Core::ThreadPool& threadPool, OpenCL::MultiGpuVector<std::complex<float> >& dMatrix, const boost::shared_ptr<const Beam<float> >& beam, const boost::shared_ptr<const DMatrixCache<float> >& cache) {
+  innerParams.lambda (static_cast<float> (g.lambda ()));
+  DMatrixGpu<float>::createDMatrix (pool, queues, innerParams, cpuPlanFactory, threadPool, dMatrix, beam, cache);
 }
 
 template <class ftype>
@@ -560,19 +1195,45 @@ static void ddaCl (const DDAOptions& opt) {
   OpenCL::StubPool pool (context);
   if (opt.map.count ("sync"))
     pool.options ().enableSync (true);
+  if (opt.map.count ("opencl-cache"))
+    pool.options ().programCache (boost::make_shared<OpenCL::ProgramCache> (opt.map["opencl-cache"].as<std::string> ()));
+  if (opt.map.count ("work-size-cache"))
+    pool.options ().workSizeTuner (boost::make_shared<OpenCL::WorkSizeTuner> (opt.map["work-size-cache"].as<std::string> ()));
+  else if (opt.map.count ("tune-work-size"))
+    pool.options ().workSizeTuner (boost::make_shared<OpenCL::WorkSizeTuner> ());
 
   const LinAlg::GpuFFTPlanFactory<ftype>& planFactory = getPlanFactory<ftype> (opt.map, pool);
+  // Used for calculating the DMatrix on the host
+  boost::shared_ptr<Core::ThreadPool> threadPool = createThreadPool (opt);
+  boost::shared_ptr<const LinAlg::FFTPlanFactory<ftype> > cpuPlanFactoryPtr = LinAlg::createFFTWPlanFactory<ftype> (getFFTWOptions (opt, *threadPool));
+  const LinAlg::FFTPlanFactory<ftype>& cpuPlanFactory = *cpuPlanFactoryPtr;
+
+  std::vector<cl::CommandQueue> queues (context.getInfo<CL_CONTEXT_DEVICES> ().size ());
+  for (size_t i = 0; i < queues.size (); i++)
+    queues[i] = cl::CommandQueue (context, context.getInfo<CL_CONTEXT_DEVICES>()[i], 0);
+
+  // Returns the relative speed of the devices for the grid, no function =
+  // split the grid evenly
+  boost::function<std::vector<double> (const DDAParams<ftype>&)> getWeights;
+  if (opt.map.count ("calibrate-devices") && queues.size () > 1) {
+    boost::filesystem::path cacheDirectory;
+    if (opt.map.count ("calibration-cache"))
+      cacheDirectory = opt.map["calibration-cache"].as<std::string> ();
+    getWeights = boost::bind (&DeviceCalibration<ftype>::getWeights, boost::cref (pool), boost::cref (queues), boost::cref (planFactory), _1, cacheDirectory, opt.out);
+  }
 
   bool symmetric;
   boost::shared_ptr<DDAParams<ftype> > ddaParamsPtr;
   boost::shared_ptr<const Beam<ftype> > beam;
   boost::shared_ptr<const CoupleConstants<ftype> > cc1, cc2;
-  createGeometryDDAParams<ftype> (opt, ddaParamsPtr, beam, cc1, cc2, symmetric, planFactory.supportNonPOTSizes (), context.getInfo<CL_CONTEXT_DEVICES> ().size ());
+  createGeometryDDAParams<ftype> (opt, ddaParamsPtr, beam, cc1, cc2, symmetric, planFactory.supportNonPOTSizes (), queues.size (), getWeights);
   const DDAParams<ftype>& g = *ddaParamsPtr;
 
-  std::vector<cl::CommandQueue> queues (g.procs () ());
-  for (size_t i = 0; i < g.procs (); i++)
-    queues[i] = cl::CommandQueue (context, context.getInfo<CL_CONTEXT_DEVICES>()[i], 0);
+  boost::scoped_ptr<OrientationAverage> orientAvg;
+  if (opt.map.count ("orient-avg"))
+    orientAvg.reset (new OrientationAverage (OrientationAverage::parse (opt.map["orient-avg"].as<std::string> ())));
+  std::vector<ldouble> lambdas = getLambdas (opt);
+  ASSERT_MSG (!orientAvg || lambdas.size () == 0, "--orient-avg cannot be used together with --lambda-list or --lambda-range");
 
   Core::OStream memStream = Core::OStream::open (opt.outputDir / "meminfo");
   if (opt.map.count ("mem-info"))
@@ -606,63 +1267,101 @@ static void ddaCl (const DDAOptions& opt) {
   boost::scoped_ptr<boost::multi_array<Math::SymMatrix3<ctype>, 3> > dMatrixCpuInst;
   // boost::multi_array<T, n> does not inherit from boost::const_multi_array_ref<T, n> (which is equivalent to boost::const_multi_array_ref<T, n, const T*>) but from boost::const_multi_array_ref<T, n, T*>, so converting dMatrixCpuInst to const_multi_array_ref<> will create a new object which must be stored somewhere until createResOutput() is finished.
   boost::scoped_ptr<boost::const_multi_array_ref<Math::SymMatrix3<ctype>, 3> > dMatrixCpuRef;
+  // Single precision DMatrix, matrix-vector-product and solver for --mixed-precision
+  boost::shared_ptr<DDAParams<float> > innerParams;
+  boost::shared_ptr<const Beam<float> > innerBeam;
+  boost::shared_ptr<const LinAlg::FFTPlanFactory<float> > innerCpuPlanFactory;
+  boost::scoped_ptr<OpenCL::MultiGpuVector<std::complex<float> > > innerDMatrixInst;
+  boost::shared_ptr<GpuMatVec<float> > innerMatVecInst;
+  boost::scoped_ptr<MatVecGpu<ftype> > matVecResidual;
+  boost::shared_ptr<IterativeSolverBase<float> > innerSolver;
+  boost::function<void ()> createDMatrix;
   if (!opt.map.count ("load-dip-pol")) {
+    csize_t maxIter = getMaxIter (opt, g);
+
     if (opt.map.count ("dmatrix-host")) {
       p1.reset (new Core::ProfileHandle (opt.prof, "Dmatrix"));
-      opt.out << "Size of DMatrix: " << (g.cgridY () * g.cgridZ () * g.cgridX () * 6 * sizeof (ctype) / 1024 / 1024) << "MB" << std::endl;
-      dMatrixCpuInst.reset (new boost::multi_array<Math::SymMatrix3<ctype>, 3> (boost::extents[g.gridY ()][g.gridZ ()][g.gridX ()], boost::fortran_storage_order ()));
+      opt.out << "Size of DMatrix: " << (g.cdMatrixY () * g.cdMatrixZ () * g.cdMatrixX () * 6 * sizeof (ctype) / 1024 / 1024) << "MB" << std::endl;
+      dMatrixCpuInst.reset (new boost::multi_array<Math::SymMatrix3<ctype>, 3> (boost::extents[g.dMatrixY ()][g.dMatrixZ ()][g.dMatrixX ()], boost::fortran_storage_order ()));
       dMatrixCpuRef.reset (new boost::const_multi_array_ref<Math::SymMatrix3<ctype>, 3> (*dMatrixCpuInst));
-      const LinAlg::FFTPlanFactory<ftype>& cpuPlanFactory = LinAlg::getFFTWPlanFactory<ftype> ();
+      createDMatrix = boost::bind (&createDMatrixCpu<ftype>, boost::cref (opt), boost::cref (g), boost::cref (cpuPlanFactory), boost::ref (*threadPool), boost::ref (*dMatrixCpuInst), boost::cref (beam), (const std::vector<uint32_t>*) NULL);
       if (!opt.map.count ("profiling-run"))
-        DMatrixCpu<ftype>::createDMatrix (g, cpuPlanFactory, *dMatrixCpuInst, beam);
+        createDMatrix ();
       p1.reset ();
 
       p1.reset (new Core::ProfileHandle (opt.prof, "cr matvec"));
-      matVecInst = GpuMatVec<ftype>::create (queues, g, *dMatrixCpuRef, planFactory, pool, accounting, opt.prof);
+      matVecInst = GpuMatVec<ftype>::create (queues, g, *dMatrixCpuRef, beam, planFactory, pool, accounting, opt.prof);
       p1.reset ();
     } else {
       p1.reset (new Core::ProfileHandle (opt.prof, "Dmatrix"));
-      opt.out << "Size of DMatrix: " << (g.cgridY () * g.cgridZ () * g.cgridX () * 6 * sizeof (ctype) / 1024 / 1024) << "MB" << std::endl;
-      std::vector<size_t> dMatrixSizes (g.procs () ());
-      for (size_t i = 0; i < g.procs (); i++)
-        dMatrixSizes[i] = (g.cgridY () * g.cgridZ () * g.localCGridX (i) * 6) ();
+      opt.out << "Size of DMatrix: " << (g.cdMatrixY () * g.cdMatrixZ () * g.cdMatrixX () * 6 * sizeof (ctype) / 1024 / 1024) << "MB" << std::endl;
+      std::vector<size_t> dMatrixSizes = DMatrixGpu<ftype>::sizes (g);
       dMatrixInst.reset (new OpenCL::MultiGpuVector<ctype> (pool, queues, dMatrixSizes, accounting, "dMatrix"));
+      createDMatrix = boost::bind (&DMatrixGpu<ftype>::createDMatrix, boost::cref (pool), boost::cref (queues), boost::cref (g), boost::cref (cpuPlanFactory), boost::ref (*threadPool), boost::ref (*dMatrixInst), boost::cref (beam), createDMatrixCache<ftype> (opt));
       if (!opt.map.count ("profiling-run"))
-        DMatrixGpu<ftype>::createDMatrix (pool, queues, g, planFactory, *dMatrixInst, beam);
+        createDMatrix ();
       p1.reset ();
 
       p1.reset (new Core::ProfileHandle (opt.prof, "cr matvec"));
-      matVecInst = GpuMatVec<ftype>::create (queues, g, *dMatrixInst, planFactory, pool, accounting, opt.prof);
+      matVecInst = GpuMatVec<ftype>::create (queues, g, *dMatrixInst, beam, planFactory, pool, accounting, opt.prof);
       p1.reset ();
     }
-    GpuMatVec<ftype>& matVec = *matVecInst;
 
-    csize_t maxIter = 0;
-    if (opt.map.count ("maxiter"))
-      maxIter = opt.map["maxiter"].as<size_t> ();
-    else
-      maxIter = g.dipoleGeometry ().box ().x () * g.dipoleGeometry ().box ().y () * g.dipoleGeometry ().box ().z () * 3;
+    if (opt.map.count ("mixed-precision")) {
+      // The single precision DMatrix is used by the inner solver, the
+      // --ftype DMatrix only for the residual of the refinement
+      const LinAlg::GpuFFTPlanFactory<float>& innerPlanFactory = getPlanFactory<float> (opt.map, pool);
+      createMixedPrecisionParams (opt, g, innerPlanFactory.supportNonPOTSizes (), innerParams, innerBeam);
+      const DDAParams<float>& ig = *innerParams;
 
-    p1.reset (new Core::ProfileHandle (opt.prof, "cr solver"));
-    if (opt.map["iter"].as<std::string> () == "qmr") {
-      solver.reset (new GpuQmrCs<ftype> (pool, queues, g, matVec, maxIter, accounting));
-    } else if (opt.map["iter"].as<std::string> () == "cgnr") {
-      solver.reset (new GpuCgnr<ftype> (pool, queues, g, matVec, maxIter, accounting));
-    } else if (opt.map["iter"].as<std::string> () == "bicg") {
-      solver.reset (new GpuBicgCs<ftype> (pool, queues, g, matVec, maxIter, accounting));
-    } else if (opt.map["iter"].as<std::string> () == "bicgstab") {
-      solver.reset (new GpuBicgStab<ftype> (pool, queues, g, matVec, maxIter, accounting, opt.prof));
-    } else
-      ABORT_MSG ("Unknown iterative solver `" + opt.map["iter"].as<std::string> () + "'");
-    p1.reset ();
+      p1.reset (new Core::ProfileHandle (opt.prof, "Dmatrix"));
+      opt.out << "Size of single precision DMatrix: " << (ig.cdMatrixY () * ig.cdMatrixZ () * ig.cdMatrixX () * 6 * sizeof (std::complex<float>) / 1024 / 1024) << "MB" << std::endl;
+      std::vector<size_t> dMatrixSizes = DMatrixGpu<float>::sizes (ig);
+      innerDMatrixInst.reset (new OpenCL::MultiGpuVector<std::complex<float> > (pool, queues, dMatrixSizes, accounting, "innerDMatrix"));
+      innerCpuPlanFactory = LinAlg::createFFTWPlanFactory<float> (getFFTWOptions (opt, *threadPool));
+      boost::function<void ()> createInnerDMatrix = boost::bind (&createMixedPrecisionDMatrixGpu<ftype>, boost::cref (pool), boost::cref (queues), boost::cref (g), boost::ref (*innerParams), boost::cref (*innerCpuPlanFactory), boost::ref (*threadPool), boost::ref (*innerDMatrixInst), boost::cref (innerBeam), createDMatrixCache<float> (opt));
+      if (!opt.map.count ("profiling-run"))
+        createInnerDMatrix ();
+      createDMatrix = boost::bind (&callBoth, createDMatrix, createInnerDMatrix);
+      p1.reset ();
+
+      p1.reset (new Core::ProfileHandle (opt.prof, "cr matvec"));
+      innerMatVecInst = GpuMatVec<float>::create (queues, ig, *innerDMatrixInst, innerBeam, innerPlanFactory, pool, accounting, opt.prof);
+      // Used for the residual of the refinement
+      matVecResidual.reset (new MatVecGpu<ftype> (pool, queues[0], *matVecInst, accounting));
+      p1.reset ();
+
+      p1.reset (new Core::ProfileHandle (opt.prof, "cr solver"));
+      innerSolver = createGpuSolver<float> (opt, pool, queues, ig, *innerMatVecInst, maxIter, accounting);
+      solver.reset (new RefinementSolver<ftype> (g, ig, *innerSolver, *matVecResidual, maxIter));
+      p1.reset ();
+    } else {
+      p1.reset (new Core::ProfileHandle (opt.prof, "cr solver"));
+      solver = createGpuSolver<ftype> (opt, pool, queues, g, *matVecInst, maxIter, accounting);
+      p1.reset ();
+    }
   }
 
   GpuFieldCalculator<ftype> calculator (pool, accounting, g, opt.prof);
 
-  createResOutput (opt, g, calculator, symmetric, solver, beam, cc1, cc2);
+  std::vector<ctype> res1, res2;
+  if (orientAvg)
+    createOrientAvgOutput (opt, *ddaParamsPtr, calculator, solver, beam, *orientAvg);
+  else if (lambdas.size ())
+    createSpectrumOutput (opt, *ddaParamsPtr, calculator, symmetric, solver, beam, lambdas, createDMatrix);
+  else
+    createResOutput (opt, g, calculator, symmetric, solver, beam, cc1, cc2, res1, res2);
+}
+
+// If one MPI process fails, the others would wait forever for it
+static void abortMpi () {
+  if (MpiComm::world ().size () > 1)
+    MpiComm::world ().abort (1);
 }
 
 int ddaMain (int argc, char** argv) {
+  MpiComm::Init mpiInit (&argc, &argv);
+  const MpiComm& world = MpiComm::world ();
   Core::OStream excout = Core::OStream::getStdout ();
   try {
 #ifdef DDAMAIN_ADDITIONAL_STARTUP
@@ -681,14 +1380,19 @@ int ddaMain (int argc, char** argv) {
       return 0;
     }
 
+    if (map.count ("output-dir") && map.count ("tag")) {
+      Core::OStream::getStderr ().fprintf ("Error: Got both --output-dir and --tag\n");
+      return 1;
+    }
+
     boost::filesystem::path outputDir;
     boost::shared_ptr<EMSim::OutputDirectory> outputDirectory;
-    if (map.count ("output-dir")) {
-      if (map.count ("tag")) {
-        Core::OStream::getStderr ().fprintf ("Error: Got both --output-dir and --tag\n");
-        return 1;
-      }
-
+    if (!world.isRoot ()) {
+      // Only the first MPI process writes the output, the other processes
+      // use a temporary directory which is removed at the end
+      outputDir = boost::filesystem::temp_directory_path () / boost::filesystem::unique_path ("dda-%%%%-%%%%-%%%%-%%%%");
+      boost::filesystem::create_directory (outputDir);
+    } else if (map.count ("output-dir")) {
       outputDir = map["output-dir"].as<std::string> ();
 
       if (!boost::filesystem::exists (outputDir))
@@ -709,8 +1413,9 @@ int ddaMain (int argc, char** argv) {
     ASSERT (!map.count ("cpu") || !map.count ("opencl"));
 
     Core::OStream log = Core::OStream::open (outputDir / "log");
-    Core::OStream out = Core::OStream::tee (Core::OStream::getStdout (), log);
-    excout = out;
+    Core::OStream out = world.isRoot () ? Core::OStream::tee (Core::OStream::getStdout (), log) : log;
+    if (world.isRoot ())
+      excout = out;
 
     boost::filesystem::path absoluteOutputDir = boost::filesystem::system_complete (outputDir).normalize ();
     out << "Output directory: " << absoluteOutputDir << std::endl;
@@ -721,6 +1426,19 @@ int ddaMain (int argc, char** argv) {
     out << "Command: " << opt.cmdLine << std::endl;
 
     std::string ftypestr = map["ftype"].as<std::string> ();
+    if (map.count ("mixed-precision")) {
+      ASSERT_MSG (ftypestr != "float", "--mixed-precision needs --ftype double or --ftype ldouble");
+      ASSERT_MSG (!map.count ("profiling-run") && !map.count ("load-dip-pol"), "--mixed-precision cannot be used together with --profiling-run or --load-dip-pol");
+      ASSERT_MSG (!map.count ("dmatrix-host"), "--mixed-precision cannot be used together with --dmatrix-host");
+    }
+    if (map.count ("matrix-free")) {
+      ASSERT_MSG (map.count ("cpu"), "--matrix-free needs --cpu");
+      ASSERT_MSG (!map.count ("dmatrix-cache"), "--matrix-free cannot be used together with --dmatrix-cache");
+    }
+    if (world.size () > 1) {
+      ASSERT_MSG (map.count ("cpu"), "Running with several MPI processes needs --cpu");
+      ASSERT_MSG (!map.count ("mixed-precision") && !map.count ("matrix-free") && !map.count ("dmatrix-cache"), "--mixed-precision, --matrix-free and --dmatrix-cache cannot be used with several MPI processes");
+    }
     if (ftypestr == "float") {
       if (map.count ("cpu"))
         ddaCpu<float> (opt);
@@ -753,6 +1471,9 @@ int ddaMain (int argc, char** argv) {
 
     out << "Overall time " << prof.getOverallTimes ().toString () << std::endl;
     out << "Output directory: " << absoluteOutputDir << std::endl;
+
+    if (!world.isRoot ())
+      boost::filesystem::remove_all (outputDir);
   } catch (Core::HelpResultException& e) {
     excout << e.info ();
     return 0;
@@ -761,12 +1482,14 @@ int ddaMain (int argc, char** argv) {
     excout << Core::Type::getName (typeid (e)) << ": " << std::flush;
     e.writeTo (*excout);
     excout << std::endl;
+    abortMpi ();
     return 1;
   } catch (std::exception& e) {
     excout << "Error: ";
     excout << Core::Type::getName (typeid (e)) << ": ";
     excout << e.what () << std::endl;
     excout << Core::StackTrace (Core::StackTrace::createFromCurrentThread).toString () << std::endl;
+    abortMpi ();
     return 1;
   }
 
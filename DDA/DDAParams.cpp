@@ -25,6 +25,9 @@
 #include <DDA/Beam.hpp>
 
 #include <algorithm>
+#include <cmath>
+
+#include <boost/foreach.hpp>
 
 #include <DDA/PolarizabilityDescription.hpp>
 #include <DDA/Geometry.hpp>
@@ -88,6 +91,50 @@ namespace DDA {
         ret += 2;
       }
     }
+
+    // Returns the period (in grid units) along the axis if one of the
+    // periodicity vectors is parallel to the axis and its length is a
+    // multiple of the grid unit, 0 otherwise
+    uint32_t getAxisPeriod (const DipoleGeometry& dipoleGeometry, int axis) {
+      for (int i = 0; i < dipoleGeometry.periodicityDimension (); i++) {
+        Math::Vector3<ldouble> periodicity = i == 0 ? dipoleGeometry.periodicity1 () : dipoleGeometry.periodicity2 ();
+        if (periodicity[(axis + 1) % 3] != 0 || periodicity[(axis + 2) % 3] != 0)
+          continue;
+        ldouble period = std::abs (periodicity[axis]) / dipoleGeometry.gridUnit ();
+        ldouble rounded = std::floor (period + 0.5l);
+        if (rounded >= 1 && std::abs (period - rounded) <= 1e-6l * rounded)
+          return static_cast<uint32_t> (rounded);
+      }
+      return 0;
+    }
+  }
+
+  template <class F> std::vector<uint32_t> DDAParams<F>::partition (cuint32_t count, const std::vector<double>& weights) {
+    ASSERT (weights.size () > 0);
+    double sum = 0;
+    BOOST_FOREACH (double weight, weights) {
+      ASSERT (weight > 0);
+      sum += weight;
+    }
+
+    // Round the boundaries between the parts instead of the sizes of the
+    // parts, this way the sizes add up to count
+    std::vector<uint32_t> res (weights.size ());
+    double acc = 0;
+    uint32_t prev = 0;
+    for (size_t i = 0; i < weights.size (); i++) {
+      acc += weights[i];
+      uint32_t end = i + 1 == weights.size () ? count () : static_cast<uint32_t> (std::floor (acc / sum * count () + 0.5));
+      if (count () >= weights.size ()) {
+        end = std::max (end, prev + 1);
+        end = std::min (end, count () - static_cast<uint32_t> (weights.size () - i - 1));
+      }
+      end = std::max (std::min (end, count ()), prev);
+      res[i] = end - prev;
+      prev = end;
+    }
+    ASSERT (prev == count ());
+    return res;
   }
 
   template <class F> DDAParams<F>::DDAParams (const boost::shared_ptr<const Geometry>& geometry,
@@ -98,6 +145,7 @@ namespace DDA {
                                               cuint32_t procs,
                                               Math::Vector3<cuint32_t> gridSize,
                                               ftype gamma,
+                                              bool ewaldSum,
                                               const std::vector<uint32_t>& localGridXPar,
                                               const std::vector<uint32_t>& localBoxZPar)
     : geometry_ (geometry),
@@ -105,6 +153,7 @@ namespace DDA {
       dipoleGeometry_ (dipoleGeometry),
       lambda_ (lambda), 
       gamma_ (gamma),
+      ewaldSum_ (ewaldSum),
       procs_ (procs),
       gridUnit_ (static_cast<ftype> (dipoleGeometry->gridUnit ())),
       periodicity1_ (static_cast<Math::Vector3<ftype> > (dipoleGeometry->periodicity1 ())),
@@ -128,6 +177,18 @@ namespace DDA {
     ASSERT (lambda > 0);
     ASSERT (procs > 0);
 
+    for (int axis = 0; axis < 3; axis++) {
+      cuint32_t period = getAxisPeriod (*dipoleGeometry, axis);
+      bool candidate = gridSize[axis] == 0 && period != 0
+        && period >= dipoleGeometry->box ()[axis] && period < gridSize_[axis];
+      // The grid size has to be even and a size supported by the FFT
+      circulant_[axis] = candidate && period () % 2 == 0
+        && fftFit (period, 1, 0, supportNonPot) == period;
+      paddedPeriod_[axis] = candidate && !circulant_[axis] ? period () : 0;
+      if (circulant_[axis])
+        gridSize_[axis] = period;
+    }
+
     ASSERT (gridSize_.x () % 2 == 0);
     ASSERT (gridSize_.y () % 2 == 0);
     ASSERT (gridSize_.z () % 2 == 0);
@@ -213,6 +274,13 @@ namespace DDA {
     kd_ = waveNum_ * gridUnit ();
   }
 
+  template <class F> F DDAParams<F>::circulantPhaseShift (const Beam<ftype>& beam, int axis) const {
+    ASSERT (circulant (axis));
+    Math::Vector3<ftype> shift (0, 0, 0);
+    shift[axis] = gridUnit () * static_cast<ftype> (gridSize ()[axis] ());
+    return beam.getPhaseShift (*this, shift);
+  }
+
   template <class F> std::string DDAParams<F>::toString (const Beam<ftype>& beam, const CoupleConstants<ftype>& cc1, const CoupleConstants<ftype>& cc2) const {
     std::stringstream out;
 
@@ -264,7 +332,12 @@ namespace DDA {
       out << (i ? " + " : "") << localCGridX (i);
     out << " = " << cgridX ();
     out << ", " << cgridY () << ", " << cgridZ ();
+    if (anyCirculant ())
+      out << " (circulant along" << (circulant (0) ? " x" : "") << (circulant (1) ? " y" : "") << (circulant (2) ? " z" : "") << ")";
     out << std::endl;
+    for (int axis = 0; axis < 3; axis++)
+      if (paddedPeriod_[axis])
+        out << "Periodic axis " << "xyz"[axis] << " padded because the period " << paddedPeriod_[axis] << " is odd or not supported by the FFT" << std::endl;
     out << "Total dipoles   : ";
     for (uint32_t i = 0; i < procs (); i++)
       out << (i ? " + " : "") << localCCount (i);
@@ -44,6 +44,7 @@
 #include <algorithm>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
 
 namespace DDA {
   // Class containing all the parameters needed for creating the dmatrix and
@@ -66,6 +67,7 @@ namespace DDA {
     boost::shared_ptr<const DipoleGeometry> dipoleGeometry_;
     ftype lambda_;
     ftype gamma_;
+    bool ewaldSum_;
     cuint32_t procs_;
 
     ftype gridUnit_;
@@ -76,6 +78,9 @@ namespace DDA {
     cuint32_t vecStride_;
     cuint32_t vecSize_;
     Math::Vector3<cuint32_t> gridSize_;
+    bool circulant_[3];
+    // Period of a periodic axis which could not be made circulant, 0 if none
+    uint32_t paddedPeriod_[3];
     ftype waveNum_;
     ftype kd_;
 
@@ -104,24 +109,70 @@ namespace DDA {
                cuint32_t procs = 1,
                Math::Vector3<cuint32_t> gridSize = Math::Vector3<cuint32_t> (0, 0, 0),
                ftype gamma = 0.001,
+               bool ewaldSum = true,
                const std::vector<uint32_t>& localGridX = std::vector<uint32_t> (0),
                const std::vector<uint32_t>& localBoxZ = std::vector<uint32_t> (0));
 
+    // Split count into weights.size () parts proportional to the weights
+    // (e.g. the relative speed of the devices). Every part gets at least one
+    // element if count >= weights.size (). The result can be used for the
+    // localGridX and localBoxZ constructor arguments.
+    static std::vector<uint32_t> partition (cuint32_t count, const std::vector<double>& weights);
+
     const Geometry& geometry () const { return *geometry_; }
+    const boost::shared_ptr<const Geometry>& geometryPtr () const { return geometry_; }
     template <typename U> bool geometryIs () const { return dynamic_cast<const U*> (geometry_.get ()); }
     template <typename U> const U& geometryAs () const { return dynamic_cast<const U&> (geometry ()); }
     const std::string& geometryString () const { return geometryString_; }
     std::string& geometryString () { return geometryString_; }
     const DipoleGeometry& dipoleGeometry () const { return *dipoleGeometry_; }
+    const boost::shared_ptr<const DipoleGeometry>& dipoleGeometryPtr () const { return dipoleGeometry_; }
+    // Change the particle orientation. Only the beam and the couple constants
+    // depend on the orientation, the DMatrix stays valid for non-periodic
+    // targets.
+    void orientation (const EMSim::Rotation<ldouble>& value) {
+      boost::shared_ptr<DipoleGeometry> dipoleGeometry = boost::make_shared<DipoleGeometry> (*dipoleGeometry_);
+      dipoleGeometry->orientation (value);
+      dipoleGeometry_ = dipoleGeometry;
+    }
+    // Change the refractive indices of the materials. The DMatrix does not
+    // depend on the materials.
+    void materials (const std::vector<Math::DiagMatrix3<cldouble> >& value) {
+      ASSERT (value.size () >= dipoleGeometry ().matCount ());
+      boost::shared_ptr<DipoleGeometry> dipoleGeometry = boost::make_shared<DipoleGeometry> (*dipoleGeometry_);
+      dipoleGeometry->materials () = value;
+      dipoleGeometry_ = dipoleGeometry;
+    }
     ftype gridUnit () const { return gridUnit_; }
     ftype lambda () const { return lambda_; }
+    // Change the wavelength, the DMatrix has to be recalculated afterwards.
+    void lambda (ftype value) {
+      ASSERT (value > 0);
+      lambda_ = value;
+      waveNum_ = Const::two_pi / lambda_;
+      kd_ = waveNum_ * gridUnit ();
+    }
     Math::Vector3<ftype> periodicity1 () const { return periodicity1_; }
     Math::Vector3<ftype> periodicity2 () const { return periodicity2_; }
     ftype gamma () const { return gamma_; }
+    // Use EwaldSum instead of the damped sum (with cutoff parameter gamma) for
+    // the interaction terms of targets which are periodic in two dimensions
+    bool ewaldSum () const { return ewaldSum_; }
 
     ftype frequency () const { return Const::speed_of_light / lambda (); }
 
     const Math::Vector3<cuint32_t> gridSize () const { return gridSize_; }
+    // Along an axis parallel to a periodicity vector whose length is a
+    // multiple of the grid unit the FFT grid is not padded if the period is
+    // smaller than the padded size. The grid size is the period and the
+    // interaction terms repeat after one period up to the phase shift
+    // circulantPhaseShift (), so the convolution is circulant (see
+    // DMatrixCpu and MatVecCpu).
+    bool circulant (int axis) const { ASSERT (axis >= 0 && axis < 3); return circulant_[axis]; }
+    bool anyCirculant () const { return circulant_[0] || circulant_[1] || circulant_[2]; }
+    // The phase shift of the incident beam for a shift by the grid size along
+    // a circulant axis
+    ftype circulantPhaseShift (const Beam<ftype>& beam, int axis) const;
     ftype gridUnitVol () const { return static_cast<ftype> (dipoleGeometry ().gridUnitVol ()); }
     ftype waveNum () const { return waveNum_; }
     ftype kd () const { return kd_; }
@@ -143,6 +194,26 @@ namespace DDA {
     uint32_t gridY () const { return cgridY () (); }
     uint32_t gridZ () const { return cgridZ () (); }
 
+    // The DMatrix of non-periodic targets is symmetric or antisymmetric under
+    // reflection in every axis, therefore only the values with indices up to
+    // grid / 2 are stored and the others are obtained by reflection (see
+    // dMatrixIndex ()). For periodic targets the full DMatrix is stored.
+    bool dMatrixSymmetric () const { return periodicityDimension () == 0; }
+    cuint32_t cdMatrixX () const { return dMatrixSymmetric () ? cuint32_t (gridX () / 2 + 1) : cgridX (); }
+    cuint32_t cdMatrixY () const { return dMatrixSymmetric () ? cuint32_t (gridY () / 2 + 1) : cgridY (); }
+    cuint32_t cdMatrixZ () const { return dMatrixSymmetric () ? cuint32_t (gridZ () / 2 + 1) : cgridZ (); }
+    uint32_t dMatrixX () const { return cdMatrixX () (); }
+    uint32_t dMatrixY () const { return cdMatrixY () (); }
+    uint32_t dMatrixZ () const { return cdMatrixZ () (); }
+    // Returns the DMatrix index for the index i in a dimension with size n,
+    // reflected is set if the index has been reflected. The components ab, ac
+    // and bc change their sign if one (but not both) of their axes has been
+    // reflected.
+    uint32_t dMatrixIndex (uint32_t i, uint32_t n, bool& reflected) const {
+      reflected = dMatrixSymmetric () && i > n / 2;
+      return reflected ? n - i : i;
+    }
+
     cuint32_t localCCount (cuint32_t i) const { ASSERT (i < procs ()); return localCount_[i ()]; }
     cuint32_t localCNvCount (cuint32_t i) const { ASSERT (i < procs ()); return localNvCount_[i ()]; }
     cuint32_t localCVecSize (cuint32_t i) const { ASSERT (i < procs ()); return localVecSize_[i ()]; }
@@ -235,6 +306,14 @@ namespace DDA {
 
   public:
     CoupleConstants (const DDAParams<ftype>& ddaParams, const Beam<ftype>& beam, BeamPolarization pol, const PolarizabilityDescription<ftype>& polDesc);
+    // Convert the couple constants to a different precision
+    template <typename U> explicit CoupleConstants (const CoupleConstants<U>& other) {
+      for (size_t i = 0; i < other.cc ().size (); i++) {
+        cc_.push_back (static_cast<Math::DiagMatrix3<ctype> > (other.cc ()[i]));
+        cc_sqrt_.push_back (static_cast<Math::DiagMatrix3<ctype> > (other.cc_sqrt ()[i]));
+        chi_inv_.push_back (static_cast<Math::DiagMatrix3<ctype> > (other.chi_inv ()[i]));
+      }
+    }
 
     const std::vector<Math::DiagMatrix3<ctype> >& cc () const { return cc_; }
     const std::vector<Math::DiagMatrix3<ctype> >& cc_sqrt () const { return cc_sqrt_; }
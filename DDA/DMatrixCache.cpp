@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "DMatrixCache.hpp"
+
+#include <Core/BoostFilesystem.hpp>
+#include <Core/File.hpp>
+#include <Core/Hash.hpp>
+#include <Core/IStream.hpp>
+#include <Core/OStream.hpp>
+
+#include <DDA/DMatrixCpu.hpp>
+#include <DDA/Beam.hpp>
+#include <DDA/EwaldSum.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+
+namespace DDA {
+  namespace {
+    // Version 2: Only the first octant of a symmetric DMatrix is stored
+    const char magic[8] = { 'D', 'D', 'A', 'D', 'M', 'A', 'T', '2' };
+    // Offset of the data in the file, chosen so that the data could be mapped
+    // into memory directly
+    const uint64_t dataOffset = 4096;
+
+    void writeFile (const Core::OStream& file, const std::vector<char>& header, const char* data, size_t size) {
+      file->write (header.data (), header.size ());
+      file->write (data, size);
+    }
+  }
+
+  template <class T> DMatrixCache<T>::DMatrixCache (const boost::filesystem::path& directory) : directory_ (directory) {
+    boost::filesystem::create_directories (directory);
+  }
+
+  template <class T> std::string DMatrixCache<T>::getKey (const DDAParams<ftype>& ddaParams, const boost::shared_ptr<const Beam<ftype> >& beam) {
+    std::stringstream str;
+    str << std::setprecision (std::numeric_limits<ldouble>::digits10 + 2);
+    str << "ftype=" << sizeof (ftype) << "/" << std::numeric_limits<ftype>::digits;
+    str << " grid=" << ddaParams.gridX () << "," << ddaParams.gridY () << "," << ddaParams.gridZ ();
+    if (ddaParams.anyCirculant ())
+      str << " circulant=" << ddaParams.circulant (0) << "," << ddaParams.circulant (1) << "," << ddaParams.circulant (2);
+    str << " box=" << ddaParams.dipoleGeometry ().box ().x () << "," << ddaParams.dipoleGeometry ().box ().y () << "," << ddaParams.dipoleGeometry ().box ().z ();
+    str << " gridUnit=" << (ldouble) ddaParams.gridUnit ();
+    str << " waveNum=" << (ldouble) ddaParams.waveNum ();
+    str << " periodicityDimension=" << ddaParams.periodicityDimension ();
+    // At a Rayleigh anomaly DMatrixCpu falls back to the damped sum, which
+    // depends on gamma
+    if (ddaParams.periodicityDimension () == 2 && ddaParams.ewaldSum () && EwaldSum<ftype> (ddaParams, beam).applicable ())
+      str << " latticeSum=ewald";
+    else if (ddaParams.periodicityDimension () >= 1)
+      str << " gamma=" << (ldouble) ddaParams.gamma ();
+    if (ddaParams.periodicityDimension () >= 1) {
+      str << " periodicity1=" << (ldouble) ddaParams.periodicity1 ().x () << "," << (ldouble) ddaParams.periodicity1 ().y () << "," << (ldouble) ddaParams.periodicity1 ().z ();
+      str << " phaseShift1=" << (ldouble) beam->getPhaseShift (ddaParams, ddaParams.periodicity1 ());
+    }
+    if (ddaParams.periodicityDimension () >= 2) {
+      str << " periodicity2=" << (ldouble) ddaParams.periodicity2 ().x () << "," << (ldouble) ddaParams.periodicity2 ().y () << "," << (ldouble) ddaParams.periodicity2 ().z ();
+      str << " phaseShift2=" << (ldouble) beam->getPhaseShift (ddaParams, ddaParams.periodicity2 ());
+    }
+    return str.str ();
+  }
+
+  template <class T> boost::filesystem::path DMatrixCache<T>::getFilename (const std::string& key) const {
+    char name[64];
+    snprintf (name, sizeof (name), "dmatrix-%016llx.bin", (unsigned long long) Core::fnv1aHash (key));
+    return directory () / name;
+  }
+
+  template <class T> bool DMatrixCache<T>::load (const DDAParams<ftype>& ddaParams, const boost::shared_ptr<const Beam<ftype> >& beam, boost::multi_array_ref<Math::SymMatrix3<ctype>, 3>& dMatrix) const {
+    std::string key = getKey (ddaParams, beam);
+    boost::filesystem::path filename = getFilename (key);
+    if (!boost::filesystem::exists (filename))
+      return false;
+
+    Core::IStream file = Core::IStream::open (filename, std::ios_base::in | std::ios_base::binary);
+    std::vector<char> header (dataOffset);
+    file->read (header.data (), header.size ());
+    if (!file->good ())
+      return false;
+    if (memcmp (header.data (), magic, sizeof (magic)) != 0)
+      return false;
+    uint64_t keyLength;
+    memcpy (&keyLength, header.data () + sizeof (magic), sizeof (keyLength));
+    if (keyLength != key.length () || sizeof (magic) + sizeof (keyLength) + keyLength > dataOffset)
+      return false;
+    if (std::string (header.data () + sizeof (magic) + sizeof (keyLength), keyLength) != key)
+      return false;
+
+    file->read ((char*) dMatrix.data (), dMatrix.num_elements () * sizeof (Math::SymMatrix3<ctype>));
+    return file->good ();
+  }
+
+  template <class T> void DMatrixCache<T>::store (const DDAParams<ftype>& ddaParams, const boost::shared_ptr<const Beam<ftype> >& beam, const boost::const_multi_array_ref<Math::SymMatrix3<ctype>, 3>& dMatrix) const {
+    std::string key = getKey (ddaParams, beam);
+    boost::filesystem::path filename = getFilename (key);
+
+    std::vector<char> header (dataOffset, 0);
+    uint64_t keyLength = key.length ();
+    ASSERT (sizeof (magic) + sizeof (keyLength) + keyLength <= dataOffset);
+    memcpy (header.data (), magic, sizeof (magic));
+    memcpy (header.data () + sizeof (magic), &keyLength, sizeof (keyLength));
+    memcpy (header.data () + sizeof (magic) + sizeof (keyLength), key.data (), keyLength);
+
+    Core::writeFileAtomically (filename, boost::bind (writeFile, _1, boost::cref (header), (const char*) dMatrix.data (), dMatrix.num_elements () * sizeof (Math::SymMatrix3<ctype>)), std::ios_base::out | std::ios_base::binary);
+  }
+
+  template <class T> bool DMatrixCache<T>::loadOrCreate (const DDAParams<ftype>& ddaParams, const LinAlg::FFTPlanFactory<ftype>& planFactory, Core::ThreadPool& threadPool, boost::multi_array_ref<Math::SymMatrix3<ctype>, 3>& dMatrix, const boost::shared_ptr<const Beam<ftype> >& beam) const {
+    if (load (ddaParams, beam, dMatrix))
+      return true;
+    DMatrixCpu<ftype>::createDMatrix (ddaParams, planFactory, threadPool, dMatrix, beam);
+    store (ddaParams, beam, dMatrix);
+    return false;
+  }
+
+  CALL_MACRO_FOR_DEFAULT_FP_TYPES(CREATE_TEMPLATE_INSTANCE, DMatrixCache)
+}
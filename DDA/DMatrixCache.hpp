@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef DDA_DMATRIXCACHE_HPP_INCLUDED
+#define DDA_DMATRIXCACHE_HPP_INCLUDED
+
+// On-disk cache for the DMatrix
+//
+// The DMatrix only depends on the grid size, the dipole box, the grid unit,
+// the wave number, gamma (unless EwaldSum is used), the periodicity vectors
+// and (for periodic targets) the phase shifts of the beam. The cache directory
+// contains one file per set of these parameters, the file name is a hash of
+// the parameters. Every file contains a header with the full parameter string
+// (which is checked on loading) followed by the raw DMatrix data (page
+// aligned).
+
+#include <Core/ThreadPool.hpp>
+
+#include <DDA/DDAParams.hpp>
+
+#include <boost/filesystem/path.hpp>
+
+namespace DDA {
+  template <class T>
+  class DMatrixCache {
+    typedef T ftype;
+    typedef std::complex<ftype> ctype;
+    typedef FPConst<ftype> Const;
+
+    boost::filesystem::path directory_;
+
+  public:
+    DMatrixCache (const boost::filesystem::path& directory);
+
+    const boost::filesystem::path& directory () const { return directory_; }
+
+    // A string containing all parameters the DMatrix depends on
+    static std::string getKey (const DDAParams<ftype>& ddaParams, const boost::shared_ptr<const Beam<ftype> >& beam);
+    boost::filesystem::path getFilename (const std::string& key) const;
+
+    // Returns false if there is no entry for the parameters
+    bool load (const DDAParams<ftype>& ddaParams, const boost::shared_ptr<const Beam<ftype> >& beam, boost::multi_array_ref<Math::SymMatrix3<ctype>, 3>& dMatrix) const;
+    void store (const DDAParams<ftype>& ddaParams, const boost::shared_ptr<const Beam<ftype> >& beam, const boost::const_multi_array_ref<Math::SymMatrix3<ctype>, 3>& dMatrix) const;
+
+    // Load the DMatrix from the cache or, if it is not in the cache, create
+    // it using DMatrixCpu and store it in the cache. Returns true if the
+    // DMatrix was found in the cache.
+    bool loadOrCreate (const DDAParams<ftype>& ddaParams, const LinAlg::FFTPlanFactory<ftype>& planFactory, Core::ThreadPool& threadPool, boost::multi_array_ref<Math::SymMatrix3<ctype>, 3>& dMatrix, const boost::shared_ptr<const Beam<ftype> >& beam) const;
+  };
+
+  CALL_MACRO_FOR_DEFAULT_FP_TYPES(DISABLE_TEMPLATE_INSTANCE, DMatrixCache)
+}
+
+#endif // !DDA_DMATRIXCACHE_HPP_INCLUDED
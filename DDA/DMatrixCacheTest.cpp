@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+// Test that the DMatrixCache key contains gamma whenever the DMatrix depends
+// on it, including the case where EwaldSum is requested but DMatrixCpu falls
+// back to the damped lattice sum because of a Rayleigh anomaly
+
+#include <DDA/DMatrixCache.hpp>
+#include <DDA/DipoleGeometry.hpp>
+#include <DDA/Beam.hpp>
+
+#include <Core/Assert.hpp>
+#include <Core/OStream.hpp>
+
+#include <boost/make_shared.hpp>
+
+typedef Math::Vector3<ldouble> Vector;
+
+// Key for a single dipole on a lattice with the given periodicity vectors,
+// illuminated at normal incidence with wavelength 1
+static std::string getKey (const Vector& periodicity1, const Vector& periodicity2, double gamma, bool ewaldSum) {
+  boost::shared_ptr<DDA::DipoleGeometry> dipoleGeometry = boost::make_shared<DDA::DipoleGeometry> (0.125, periodicity1, periodicity2);
+  dipoleGeometry->addDipole (0, 0, 0, 0);
+  dipoleGeometry->moveToCenter ();
+  dipoleGeometry->materials ().push_back (Math::DiagMatrix3<cldouble> (1.5, 1.5, 1.5));
+  DDA::DDAParams<double> ddaParams (boost::shared_ptr<const DDA::Geometry> (), "", dipoleGeometry, 1, true, 1, Math::Vector3<cuint32_t> (0, 0, 0), gamma, ewaldSum);
+  boost::shared_ptr<const DDA::Beam<double> > beam = boost::make_shared<DDA::Beams::PlaneWave<double> > (Math::Vector3<double> (0, 0, 1));
+  return DDA::DMatrixCache<double>::getKey (ddaParams, beam);
+}
+
+int main () {
+  Core::OStream out = Core::OStream::getStdout ();
+
+  // EwaldSum is applicable, the DMatrix does not depend on gamma
+  std::string key1 = getKey (Vector (0.75, 0, 0), Vector (0, 1.25, 0), 0.001, true);
+  std::string key2 = getKey (Vector (0.75, 0, 0), Vector (0, 1.25, 0), 0.002, true);
+  out << key1 << std::endl;
+  ASSERT (key1.find (" latticeSum=ewald") != std::string::npos);
+  ASSERT (key1 == key2);
+
+  // The first diffraction order along periodicity1 propagates parallel to
+  // the lattice, the damped sum is used
+  std::string key3 = getKey (Vector (1, 0, 0), Vector (0, 1.25, 0), 0.001, true);
+  std::string key4 = getKey (Vector (1, 0, 0), Vector (0, 1.25, 0), 0.002, true);
+  out << key3 << std::endl;
+  ASSERT (key3.find (" latticeSum=ewald") == std::string::npos);
+  ASSERT (key3.find (" gamma=") != std::string::npos);
+  ASSERT (key3 != key4);
+  // The result is the same as with --lattice-sum damped
+  ASSERT (key3 == getKey (Vector (1, 0, 0), Vector (0, 1.25, 0), 0.001, false));
+
+  return 0;
+}
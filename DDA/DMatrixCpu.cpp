@@ -26,43 +26,64 @@
 #include <Core/OStream.hpp>
 #include <Core/Allocator.hpp>
 
+#include <LinAlg/Transpose.hpp>
+
 #include <DDA/Beam.hpp>
+#include <DDA/EwaldSum.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
 
 static const bool use128BitAlignment = true;
 
 namespace DDA {
   namespace {
-    template <typename T> static void transpose (const boost::const_multi_array_ref<T, 2>& in, boost::multi_array_ref<T, 2>& out) {
-      ASSERT (in.data () != out.data ());
-      ASSERT (in.shape ()[0] == out.shape ()[1]);
-      ASSERT (in.shape ()[1] == out.shape ()[0]);
-
-      for (size_t i = 0; i < in.shape ()[0]; i++)
-        for (size_t j = 0; j < in.shape ()[1]; j++)
-          out[j][i] = in[i][j];
-    }
     template <typename T, size_t dim> static void fill (boost::multi_array_ref<T, dim>& array, const T& value) {
       std::fill (array.data (), array.data () + array.num_elements (), value);
     }
+
+    // The range of the offsets along an axis which have nonzero interaction
+    // terms: (-box, box), for a circulant axis one period [-grid / 2, grid / 2)
+    template <class T> int minOffset (const DDAParams<T>& ddaParams, int axis) {
+      if (ddaParams.circulant (axis))
+        return -(int) (ddaParams.gridSize ()[axis] () / 2);
+      return 1 - (int) ddaParams.dipoleGeometry ().box ()[axis] ();
+    }
+    template <class T> int maxOffset (const DDAParams<T>& ddaParams, int axis) {
+      if (ddaParams.circulant (axis))
+        return (int) (ddaParams.gridSize ()[axis] () / 2) - 1;
+      return (int) ddaParams.dipoleGeometry ().box ()[axis] () - 1;
+    }
   }
 
-  template <class ftype> static inline std::complex<ftype> getSingleInteractionTerm (const DDAParams<ftype>& ddaParams, Math::Vector3<ftype> r, int mu, int nu) {
+  template <class ftype> static inline Math::SymMatrix3<std::complex<ftype> > getSingleInteractionTerm (const DDAParams<ftype>& ddaParams, Math::Vector3<ftype> r) {
     typedef std::complex<ftype> ctype;
 
     ftype rr = std::sqrt (r * r);
     Math::Vector3<ftype> q = r / rr;
     ftype kr = ddaParams.waveNum () * rr;
     ftype kr2 = kr * kr;
-    ftype qmunu = q[mu] * q[nu];
     ctype expval = exp (ctype (0, kr)) / ctype (std::pow (rr, FPConst<ftype>::three));
-    ctype br = ctype (3 - kr2, -3 * kr) * qmunu;
-    if (mu == nu)
-      br += ctype (kr2 - 1, kr);
+    Math::SymMatrix3<ctype> result;
+    int component = 0;
+    for (int mu = 0; mu < 3; mu++) {
+      for (int nu = mu; nu < 3; nu++) {
+        ftype qmunu = q[mu] * q[nu];
+        ctype br = ctype (3 - kr2, -3 * kr) * qmunu;
+        if (mu == nu)
+          br += ctype (kr2 - 1, kr);
+        result[component++] = expval * br;
+      }
+    }
+    return result;
+  }
 
-    return expval * br;
+  template <class ftype> static inline void addScaled (Math::SymMatrix3<std::complex<ftype> >& result, std::complex<ftype> factor, const Math::SymMatrix3<std::complex<ftype> >& value) {
+    for (int component = 0; component < 6; component++)
+      result[component] += factor * value[component];
   }
 
-  template <class T> inline std::complex<T> DMatrixCpu<T>::getInteractionTerm (const DDAParams<T>& ddaParams, int i, int j, int k, int mu, int nu, const boost::shared_ptr<const Beam<T> >& beam) {
+  template <class T> inline Math::SymMatrix3<std::complex<T> > DMatrixCpu<T>::getInteractionTerm (const DDAParams<T>& ddaParams, int i, int j, int k, const boost::shared_ptr<const Beam<T> >& beam) {
     ftype gamma = ddaParams.gamma ();
     ftype maxr = 2 / gamma / ddaParams.waveNum ();
     ftype maxr2 = maxr * maxr;
@@ -70,14 +91,14 @@ namespace DDA {
     Math::Vector3<ftype> r = Math::Vector3<ftype> (static_cast<ftype> (i), static_cast<ftype> (j), static_cast<ftype> (k)) * ddaParams.gridUnit ();
     if (ddaParams.periodicityDimension () == 0) {
       if (!i && !j && !k)
-        return ctype (0);
-      return getSingleInteractionTerm (ddaParams, r, mu, nu);
+        return Math::SymMatrix3<ctype> (0, 0, 0, 0, 0, 0);
+      return getSingleInteractionTerm (ddaParams, r);
     } else if (ddaParams.periodicityDimension () == 1) {
       // See doi:10.1364/josaa.25.002693 for information about periodic targets
       ftype phaseShift1 = beam->getPhaseShift (ddaParams, ddaParams.periodicity1 ());
       ftype periodicity1Length = std::sqrt (ddaParams.periodicity1 ().x () * ddaParams.periodicity1 ().x () + ddaParams.periodicity1 ().y () * ddaParams.periodicity1 ().y () + ddaParams.periodicity1 ().y () * ddaParams.periodicity1 ().z ());
       int64_t maxd = static_cast<int64_t> (maxr / periodicity1Length) + 1;
-      ctype result = 0;
+      Math::SymMatrix3<ctype> result (0, 0, 0, 0, 0, 0);
       for (int64_t m = -maxd; m <= maxd; m++) {
         Math::Vector3<ftype> r2 = r + static_cast<ftype> (m) * ddaParams.periodicity1 ();
         ftype rl = r2.x () * r2.x () + r2.y () * r2.y () + r2.z () * r2.z ();
@@ -86,7 +107,7 @@ namespace DDA {
           sup = -sup * sup; // -(gamma*waveNum*|r|)^4
           ctype factor = std::exp (ctype (sup, static_cast<ftype> (m) * phaseShift1));
           if (i || j || k || m)
-            result += factor * getSingleInteractionTerm (ddaParams, r2, mu, nu);
+            addScaled (result, factor, getSingleInteractionTerm (ddaParams, r2));
         }
       }
       return result;
@@ -98,7 +119,7 @@ namespace DDA {
       ftype periodicity2Length = std::sqrt (ddaParams.periodicity2 ().x () * ddaParams.periodicity2 ().x () + ddaParams.periodicity2 ().y () * ddaParams.periodicity2 ().y () + ddaParams.periodicity2 ().y () * ddaParams.periodicity2 ().z ());
       int64_t maxd1 = static_cast<int64_t> (maxr / periodicity1Length) + 1;
       int64_t maxd2 = static_cast<int64_t> (maxr / periodicity2Length) + 1;
-      ctype result = 0;
+      Math::SymMatrix3<ctype> result (0, 0, 0, 0, 0, 0);
       //Core::OStream::getStdout () << maxd1 << std::endl;
       //Core::OStream::getStdout () << maxd2 << std::endl;
       for (int64_t m = -maxd1; m <= maxd1; m++) {
@@ -110,7 +131,7 @@ namespace DDA {
             sup = -sup * sup; // -(gamma*waveNum*|r|)^4
             if (i || j || k || m || n) {
               ctype factor = std::exp (ctype (sup, static_cast<ftype> (m) * phaseShift1 + static_cast<ftype> (n) * phaseShift2));
-              result += factor * getSingleInteractionTerm (ddaParams, r2, mu, nu);
+              addScaled (result, factor, getSingleInteractionTerm (ddaParams, r2));
             }
           }
         }
@@ -130,79 +151,365 @@ namespace DDA {
       return n;
   }
 
-  template <typename T> void DMatrixCpu<T>::createDMatrix (const DDAParams<T>& ddaParams, const LinAlg::FFTPlanFactory<T>& planFactory, boost::multi_array_ref<Math::SymMatrix3<std::complex<T> >, 3>& dMatrix, const boost::shared_ptr<const Beam<T> >& beam) {
-    ASSERT (dMatrix.shape ()[0] == ddaParams.cgridY ());
-    ASSERT (dMatrix.shape ()[1] == ddaParams.cgridZ ());
-    ASSERT (dMatrix.shape ()[2] == ddaParams.cgridX ());
-    //boost::multi_array<Math::SymMatrix3<ctype>, 3> dMatrix (ddaParams.cgridY (), ddaParams.cgridZ (), ddaParams.cgridX ());
-
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
+  template <class T> class DMatrixCpu<T>::Context {
+  public:
     typedef Core::Allocator<ctype, MAX (boost::alignment_of<ctype>::value, 16)> Allocator;
+
+    const DDAParams<T>& ddaParams;
+    boost::multi_array_ref<Math::SymMatrix3<ctype>, 3>& dMatrix;
+    const boost::shared_ptr<const Beam<T> >& beam;
+    Core::ProgressBar& progress;
+    // The X indices stored in dMatrix, NULL for all
+    const std::vector<uint32_t>* xIndices;
+
+    // Only the coordinates in [minOffset (), maxOffset ()] have nonzero
+    // interaction terms, the Y and Z coordinates are stored at clip (y,
+    // countY) / clip (z, countZ)
+    int minX, maxX, minY, maxY, minZ, maxZ;
+    uint32_t countY;
+    uint32_t countZ;
+    // phaseShift / grid along a circulant axis, 0 otherwise. The terms along
+    // a circulant axis are multiplied by exp (i * offset * phaseShift / grid)
+    // which makes them periodic with the grid size (MatVecCpu applies the
+    // inverse factors to the dipoles).
+    Math::Vector3<ftype> circulantPhase;
+    // The X transformed interaction terms of all components, only for the X
+    // indices stored in dMatrix
+    boost::multi_array<ctype, 4, Allocator> d2Matrix; // [x][y][z][component]
+    // Lines along the X axis for every thread: the 6 components of up to 4
+    // (Y, Z) offsets which are transformed together
+    boost::multi_array<ctype, 4, Allocator> lines; // [x][component][line][thread]
+    // slice and slice_tr for every thread
+    boost::multi_array<ctype, 3, Allocator> slices;
+    boost::multi_array<ctype, 3, Allocator> slicesTr;
+
+    boost::shared_ptr<LinAlg::FFTPlan<ftype> > planX;
+    boost::shared_ptr<LinAlg::FFTPlan<ftype> > planZ;
+    boost::shared_ptr<LinAlg::FFTPlan<ftype> > planY;
+
+    // Used instead of getInteractionTerm () for targets periodic in two
+    // dimensions, NULL if the damped sum should be used
+    boost::scoped_ptr<EwaldSum<T> > ewaldSum;
+
+    Context (const DDAParams<T>& ddaParams, const LinAlg::FFTPlanFactory<T>& planFactory, size_t threadCount, boost::multi_array_ref<Math::SymMatrix3<ctype>, 3>& dMatrix, const boost::shared_ptr<const Beam<T> >& beam, Core::ProgressBar& progress, const std::vector<uint32_t>* xIndices) :
+      ddaParams (ddaParams), dMatrix (dMatrix), beam (beam), progress (progress), xIndices (xIndices),
+      minX (minOffset (ddaParams, 0)), maxX (maxOffset (ddaParams, 0)),
+      minY (minOffset (ddaParams, 1)), maxY (maxOffset (ddaParams, 1)),
+      minZ (minOffset (ddaParams, 2)), maxZ (maxOffset (ddaParams, 2)),
+      countY (maxY - minY + 1),
+      countZ (maxZ - minZ + 1),
+      circulantPhase (0, 0, 0),
+      d2Matrix (boost::extents[dMatrix.shape ()[2]][countY][countZ][6], boost::fortran_storage_order ()),
+      lines (boost::extents[ddaParams.gridX ()][6][4][threadCount], boost::fortran_storage_order ()),
+      slices (boost::extents[ddaParams.gridZ ()][ddaParams.gridY ()][threadCount], boost::fortran_storage_order ()),
+      slicesTr (boost::extents[ddaParams.gridY ()][ddaParams.gridZ ()][threadCount], boost::fortran_storage_order ()),
+      planX (planFactory.createPlan (ddaParams.cgridX (), 6, true, false, true, false, use128BitAlignment)),
+      planZ (planFactory.createPlan (ddaParams.cgridZ (), ddaParams.cgridY (), true, false, true, false, use128BitAlignment)),
+      planY (planFactory.createPlan (ddaParams.cgridY (), ddaParams.cgridZ (), true, false, true, false, use128BitAlignment))
+    {
+      fill<ctype> (d2Matrix, 0);
+      for (int axis = 0; axis < 3; axis++)
+        if (ddaParams.circulant (axis))
+          circulantPhase[axis] = ddaParams.circulantPhaseShift (*beam, axis) / static_cast<ftype> (ddaParams.gridSize ()[axis] ());
+      if (ddaParams.periodicityDimension () == 2 && ddaParams.ewaldSum ()) {
+        ewaldSum.reset (new EwaldSum<T> (ddaParams, beam));
+        if (!ewaldSum->applicable ()) {
+          Core::OStream::getStderr () << "Warning: Diffraction order parallel to the lattice plane, using the damped lattice sum" << std::endl;
+          ewaldSum.reset ();
+        }
+      }
+    }
+
+    ctype* line (size_t thread, int index) {
+      return lines.data () + ddaParams.gridX () * 6 * (index + 4 * thread);
+    }
+
+    void store (ctype* line, int i, const Math::SymMatrix3<ctype>& value) {
+      for (int component = 0; component < 6; component++)
+        line[clip (i, ddaParams.gridX ()) + ddaParams.gridX () * component] = value[component];
+    }
+
+    // Transforms the 6 components of a line and stores the X indices needed
+    // for dMatrix at the offsets j and k
+    void transformAndStore (ctype* line, int j, int k) {
+      planX->fftInPlace (line);
+      size_t gridX = ddaParams.gridX ();
+      for (size_t slot = 0; slot < d2Matrix.shape ()[0]; slot++) {
+        size_t x = xIndices ? (*xIndices)[slot] : slot;
+        for (int component = 0; component < 6; component++)
+          d2Matrix[slot][clip (j, countY)][clip (k, countZ)][component] = line[x + gridX * component];
+      }
+    }
+  };
 #undef MAX
 
-    boost::multi_array<ctype, 3, Allocator> d2Matrix (boost::extents[ddaParams.gridX ()][ddaParams.gridY ()][ddaParams.gridZ ()], boost::fortran_storage_order ());
-    boost::multi_array<ctype, 2, Allocator> slice (boost::extents[ddaParams.gridZ ()][ddaParams.gridY ()], boost::fortran_storage_order ());
-    boost::multi_array<ctype, 2, Allocator> slice_tr (boost::extents[ddaParams.gridY ()][ddaParams.gridZ ()], boost::fortran_storage_order ());
+  template <typename T> void DMatrixCpu<T>::calculateTerms (Context* c, size_t thread, size_t begin, size_t end) {
+    const DDAParams<T>& ddaParams = c->ddaParams;
+    int boxX = ddaParams.dipoleGeometry ().box ().x () ();
+    int boxY = ddaParams.dipoleGeometry ().box ().y () ();
+    typename EwaldSum<T>::Cache ewaldCache;
 
-    boost::shared_ptr<LinAlg::FFTPlan<ftype> > planXf_Dm = planFactory.createPlan (ddaParams.cgridX (), ddaParams.gridSize ().y () () * ddaParams.gridSize ().z () (), true, false, true, false, use128BitAlignment);
-    boost::shared_ptr<LinAlg::FFTPlan<ftype> >  planZf_Dm = planFactory.createPlan (ddaParams.cgridZ (), ddaParams.cgridY (), true, false, true, false, use128BitAlignment);
-    boost::shared_ptr<LinAlg::FFTPlan<ftype> >  planYf_Dm = planFactory.createPlan (ddaParams.cgridY (), ddaParams.cgridZ (), true, false, true, false, use128BitAlignment);
+    size_t lineSize = ddaParams.gridX () * 6;
 
-    cuint64_t overall = (ddaParams.dipoleGeometry ().box ().x () * 2 - 1) * (ddaParams.dipoleGeometry ().box ().y () * 2 - 1) * ddaParams.cgridZ ();
+    // The terms are calculated for one line along the X axis at a time and
+    // transformed immediately, so that only the X indices needed for dMatrix
+    // have to be kept
+    if (thread == 0 && end > begin)
+      c->progress.reset (end - begin, 0, 0.6);
+    for (size_t t = begin; t < end; t++) {
+      if (thread == 0 && end > begin)
+        c->progress.update (t - begin, "Interaction terms");
+      if (ddaParams.periodicityDimension () == 0) {
+        // The terms for negative coordinates are obtained by reflection:
+        // ab, ac and bc change their sign if exactly one of their
+        // coordinates is negated. Line sy + 2 * sz (with 0 for positive
+        // and 1 for negative signs) contains the offsets (sy * j, sz * k).
+        int k = (int) t;
+        for (int j = 0; j < boxY; j++) {
+          std::fill (c->line (thread, 0), c->line (thread, 0) + 4 * lineSize, ctype (0));
+          for (int i = 0; i < boxX; i++) {
+            Math::SymMatrix3<ctype> value = getInteractionTerm (ddaParams, i, j, k, c->beam);
+            for (int sx = 1; sx >= (i ? -1 : 1); sx -= 2) {
+              for (int sy = 1; sy >= (j ? -1 : 1); sy -= 2) {
+                for (int sz = 1; sz >= (k ? -1 : 1); sz -= 2) {
+                  Math::SymMatrix3<ctype> d = value;
+                  if (sx != sy)
+                    d[1] = -d[1];
+                  if (sx != sz)
+                    d[2] = -d[2];
+                  if (sy != sz)
+                    d[4] = -d[4];
+                  c->store (c->line (thread, (sy < 0) + 2 * (sz < 0)), sx * i, d);
+                }
+              }
+            }
+          }
+          for (int sy = 1; sy >= (j ? -1 : 1); sy -= 2)
+            for (int sz = 1; sz >= (k ? -1 : 1); sz -= 2)
+              c->transformAndStore (c->line (thread, (sy < 0) + 2 * (sz < 0)), sy * j, sz * k);
+        }
+      } else {
+        int k = (int) t <= c->maxZ ? (int) t : (int) t - (int) c->countZ;
+        for (int j = c->minY; j <= c->maxY; j++) {
+          std::fill (c->line (thread, 0), c->line (thread, 0) + lineSize, ctype (0));
+          for (int i = c->minX; i <= c->maxX; i++) {
+            Math::SymMatrix3<ctype> value = c->ewaldSum ? c->ewaldSum->getInteractionTerm (i, j, k, ewaldCache) : getInteractionTerm (ddaParams, i, j, k, c->beam);
+            if (ddaParams.anyCirculant ()) {
+              ctype factor = std::exp (ctype (0, c->circulantPhase * Math::Vector3<ftype> (static_cast<ftype> (i), static_cast<ftype> (j), static_cast<ftype> (k))));
+              for (int component = 0; component < 6; component++)
+                value[component] *= factor;
+            }
+            c->store (c->line (thread, 0), i, value);
+          }
+          c->transformAndStore (c->line (thread, 0), j, k);
+        }
+      }
+    }
+  }
+
+  template <typename T> void DMatrixCpu<T>::fftYZ (Context* c, size_t thread, size_t begin, size_t end) {
+    const DDAParams<T>& ddaParams = c->ddaParams;
+    uint32_t gridY = ddaParams.gridY ();
+    uint32_t gridZ = ddaParams.gridZ ();
+    boost::multi_array_ref<ctype, 2> slice (c->slices.data () + thread * gridZ * gridY, boost::extents[gridZ][gridY], boost::fortran_storage_order ());
+    boost::multi_array_ref<ctype, 2> slice_tr (c->slicesTr.data () + thread * gridY * gridZ, boost::extents[gridY][gridZ], boost::fortran_storage_order ());
+
+    if (thread == 0 && end > begin)
+      c->progress.reset (end - begin, 0.6, 1.0);
+    for (size_t t = begin; t < end; t++) {
+      if (thread == 0 && end > begin)
+        c->progress.update (t - begin, "FFT Y/Z");
+      // Only the part of the DMatrix which is actually stored is needed
+      size_t xCount = c->dMatrix.shape ()[2];
+      int component = (int) (t / xCount);
+      size_t slot = t % xCount;
+      fill<ctype> (slice, 0);
+      for (int j = c->minY; j <= c->maxY; j++)
+        for (int k = c->minZ; k <= c->maxZ; k++)
+          slice[clip (k, gridZ)][clip (j, gridY)] = c->d2Matrix[slot][clip (j, c->countY)][clip (k, c->countZ)][component];
+      c->planZ->fftInPlace (slice);
+      LinAlg::transpose<ctype> (gridZ, gridY, slice.data (), gridZ, slice_tr.data (), gridY);
+      c->planY->fftInPlace (slice_tr);
+      for (int k = 0; k < ddaParams.cdMatrixZ (); k++)
+        for (int j = 0; j < ddaParams.cdMatrixY (); j++)
+          c->dMatrix[j][k][slot][component] = slice_tr[j][k] / -(ftype)(ddaParams.gridSize ().x () () * ddaParams.gridSize ().y () () * ddaParams.gridSize ().z () ());
+    }
+  }
+
+  template <typename T> void DMatrixCpu<T>::createDMatrix (const DDAParams<T>& ddaParams, const LinAlg::FFTPlanFactory<T>& planFactory, Core::ThreadPool& threadPool, boost::multi_array_ref<Math::SymMatrix3<std::complex<T> >, 3>& dMatrix, const boost::shared_ptr<const Beam<T> >& beam, const std::vector<uint32_t>* xIndices) {
+    ASSERT (dMatrix.shape ()[0] == ddaParams.cdMatrixY ());
+    ASSERT (dMatrix.shape ()[1] == ddaParams.cdMatrixZ ());
+    ASSERT (dMatrix.shape ()[2] == (xIndices ? xIndices->size () : ddaParams.cdMatrixX ()));
 
     Core::ProgressBar progress (Core::OStream::getStderr (), 0);
+    Context c (ddaParams, planFactory, threadPool.threadCount (), dMatrix, beam, progress, xIndices);
+
+    // All six components of a term are calculated together, for a
+    // non-periodic target only for non-negative coordinates
+    threadPool.run (ddaParams.periodicityDimension () == 0 ? ddaParams.dipoleGeometry ().box ().z () () : c.countZ, boost::bind (&DMatrixCpu<T>::calculateTerms, &c, _1, _2, _3));
+
+    threadPool.run (dMatrix.shape ()[2] * 6, boost::bind (&DMatrixCpu<T>::fftYZ, &c, _1, _2, _3));
+
+    progress.finish ("DMatrix done");
+    progress.cleanup ();
+  }
+
+  namespace {
+    std::vector<LinAlg::FFTLoop> sliceLoops (csize_t count, csize_t stride, csize_t sliceSize) {
+      std::vector<LinAlg::FFTLoop> loops;
+      loops.push_back (LinAlg::FFTLoop (count, stride));
+      loops.push_back (LinAlg::FFTLoop (6, sliceSize));
+      return loops;
+    }
+
+    // The sign of a component for a reflection along an axis (see
+    // DDAParams::dMatrixIndex ())
+    template <class T> inline T reflectionSign (int component, int axis) {
+      static const bool flips[3][6] = {
+        { false, true, true, false, false, false },
+        { false, true, false, false, true, false },
+        { false, false, true, false, true, false },
+      };
+      return flips[axis][component] ? -1 : 1;
+    }
+  }
+
+  template <class T> MatrixFreeDMatrix<T>::MatrixFreeDMatrix (const DDAParams<T>& ddaParams, const LinAlg::FFTPlanFactory<T>& planFactory, size_t threadCount) :
+    ddaParams_ (ddaParams),
+    threadCount_ (threadCount),
+    table (boost::extents[ddaParams.dipoleGeometry ().box ().z () ()][ddaParams.dipoleGeometry ().box ().y () ()][6][ddaParams.dMatrixX ()], boost::fortran_storage_order ()),
+    lines (boost::extents[ddaParams.gridX ()][ddaParams.dipoleGeometry ().box ().y () () * 6][threadCount], boost::fortran_storage_order ()),
+    slices (boost::extents[ddaParams.gridZ ()][ddaParams.gridY ()][6][threadCount], boost::fortran_storage_order ()),
+    planX (planFactory.createPlan (ddaParams.cgridX (), ddaParams.dipoleGeometry ().box ().y () * 6, true, false, true, false, use128BitAlignment)),
+    planZ (planFactory.createStridedPlan (ddaParams.cgridZ (), 1, sliceLoops (ddaParams.dipoleGeometry ().box ().y (), ddaParams.cgridZ (), ddaParams.cgridY () * ddaParams.cgridZ ()), use128BitAlignment)),
+    planY (planFactory.createStridedPlan (ddaParams.cgridY (), ddaParams.cgridZ (), sliceLoops (ddaParams.cdMatrixZ (), 1, ddaParams.cgridY () * ddaParams.cgridZ ()), use128BitAlignment))
+  {
+    ASSERT_MSG (ddaParams.periodicityDimension () == 0, "The matrix-free DMatrix is only supported for non-periodic targets");
+    ASSERT (threadCount >= 1);
+    fill<ctype> (table, 0);
+  }
+  template <class T> MatrixFreeDMatrix<T>::~MatrixFreeDMatrix () {}
+
+  template <class T> void MatrixFreeDMatrix<T>::calculateTerms (const boost::shared_ptr<const Beam<T> >& beam, size_t thread, size_t begin, size_t end) {
+    const DDAParams<T>& g = ddaParams ();
+    uint32_t gridX = g.gridX ();
+    int boxX = g.dipoleGeometry ().box ().x () ();
+    int boxY = g.dipoleGeometry ().box ().y () ();
+    size_t boxZ = g.dipoleGeometry ().box ().z () ();
+    size_t lineCount = boxY * 6;
+    ctype* data = lines.data () + thread * gridX * lineCount;
+    // The normalization of the inverse FFTs in MatVecCpu
+    ftype scale = -1 / static_cast<ftype> (g.gridSize ().x () () * g.gridSize ().y () () * g.gridSize ().z () ());
+
+    for (size_t t = begin; t < end; t++) {
+      int k = (int) t;
+      std::fill (data, data + gridX * lineCount, ctype (0));
+      for (int j = 0; j < boxY; j++) {
+        for (int i = 0; i < boxX; i++) {
+          Math::SymMatrix3<ctype> value = DMatrixCpu<T>::getInteractionTerm (g, i, j, k, beam);
+          for (int component = 0; component < 6; component++) {
+            ctype* line = data + gridX * (j + boxY * component);
+            line[i] = scale * value[component];
+            if (i)
+              line[gridX - i] = reflectionSign<ftype> (component, 0) * line[i];
+          }
+        }
+      }
+      planX->fftInPlace (data);
+      for (size_t l = 0; l < lineCount; l++)
+        for (uint32_t x = 0; x < g.dMatrixX (); x++)
+          table.data ()[t + boxZ * (l + lineCount * x)] = data[x + gridX * l];
+    }
+  }
+
+  template <class T> void MatrixFreeDMatrix<T>::create (Core::ThreadPool& threadPool, const boost::shared_ptr<const Beam<T> >& beam) {
+    ASSERT (threadPool.threadCount () == threadCount ());
+    threadPool.run (ddaParams ().dipoleGeometry ().box ().z () (), boost::bind (&MatrixFreeDMatrix<T>::calculateTerms, this, boost::cref (beam), _1, _2, _3));
+  }
+
+  template <class T> void MatrixFreeDMatrix<T>::loadSlice (uint32_t x, size_t thread, ftype* planes) const {
+    const DDAParams<T>& g = ddaParams ();
+    ASSERT (x < g.dMatrixX ());
+    ASSERT (thread < threadCount ());
+    size_t gridY = g.gridY ();
+    size_t gridZ = g.gridZ ();
+    size_t boxY = g.dipoleGeometry ().box ().y () ();
+    size_t boxZ = g.dipoleGeometry ().box ().z () ();
+    size_t dMatrixY = g.dMatrixY ();
+    size_t dMatrixZ = g.dMatrixZ ();
+    ctype* data = slices.data () + thread * gridZ * gridY * 6;
+
+    // The columns y < boxY, negative Z offsets by reflection
     for (int component = 0; component < 6; component++) {
-      int mu, nu;
-      switch (component) {
-      case 0: mu = 0; nu = 0; break;
-      case 1: mu = 0; nu = 1; break;
-      case 2: mu = 0; nu = 2; break;
-      case 3: mu = 1; nu = 1; break;
-      case 4: mu = 1; nu = 2; break;
-      case 5: mu = 2; nu = 2; break;
-      default: ABORT ();
+      ftype sign = reflectionSign<ftype> (component, 2);
+      for (size_t j = 0; j < boxY; j++) {
+        const ctype* terms = table.data () + boxZ * (j + boxY * (component + 6 * x));
+        ctype* column = data + gridZ * (j + gridY * component);
+        std::copy (terms, terms + boxZ, column);
+        std::fill (column + boxZ, column + gridZ - boxZ + 1, ctype (0));
+        for (size_t k = 1; k < boxZ; k++)
+          column[gridZ - k] = sign * terms[k];
       }
-      fill<ctype> (d2Matrix, 0);
-      double prog = 1.0 / 6 * component;
-      cuint64_t current = 0;
-      progress.reset (overall (), prog, prog + 1.0 / 12);
-      for (int k = 0; k < ddaParams.cgridZ (); k++) {
-        int kcor = k > ddaParams.gridSize ().z () / 2 ? k - (int)ddaParams.gridZ () : k;
-        for (int j = 1 - ddaParams.dipoleGeometry ().box ().y () (); j < ddaParams.dipoleGeometry ().box ().y (); j++)
-          for (int i = 1 - ddaParams.dipoleGeometry ().box ().x () (); i < ddaParams.dipoleGeometry ().box ().x (); i++) {
-            current++;
-            if (current == 1 || current % 1000 == 0)
-              progress.update (current - 1, Core::sprintf ("%s / 6: %s / %s", component + 1, current, overall));
-            d2Matrix[clip (i, ddaParams.gridX ())][clip (j, ddaParams.gridY ())][k] = getInteractionTerm (ddaParams, i, j, kcor, mu, nu, beam);
-          }
+    }
+    planZ->fftInPlace (data);
+
+    // The FFT along Z commutes with the reflection along Y, only the rows
+    // z < dMatrixZ are used by the Y FFT
+    for (int component = 0; component < 6; component++) {
+      ftype sign = reflectionSign<ftype> (component, 1);
+      ctype* sl = data + gridZ * gridY * component;
+      for (size_t j = boxY; j <= gridY - boxY; j++)
+        std::fill (sl + gridZ * j, sl + gridZ * j + dMatrixZ, ctype (0));
+      for (size_t j = 1; j < boxY; j++)
+        for (size_t k = 0; k < dMatrixZ; k++)
+          sl[k + gridZ * (gridY - j)] = sign * sl[k + gridZ * j];
+    }
+    planY->fftInPlace (data);
+
+    size_t planeSize = dMatrixY * dMatrixZ;
+    for (int component = 0; component < 6; component++) {
+      for (size_t j = 0; j < dMatrixY; j++) {
+        for (size_t k = 0; k < dMatrixZ; k++) {
+          ctype value = data[k + gridZ * (j + gridY * component)];
+          planes[k + dMatrixZ * j + component * planeSize] = value.real ();
+          planes[k + dMatrixZ * j + (component + 6) * planeSize] = value.imag ();
+        }
       }
-      progress.reset (1, prog + 2.0 / 24, prog + 3.0 / 24);
-      progress.update (0, Core::sprintf ("%s / 6: FFT X", component + 1));
-      planXf_Dm->fftInPlace (d2Matrix.data ());
-      progress.reset (ddaParams.cgridX (), prog + 3.0 / 24, prog + 4.0 / 24);
-      for (int i = 0; i < ddaParams.cgridX (); i++) {
-        if (i == 0 || i % 10 == 9)
-          progress.update (i, Core::sprintf ("%s / 6: FFT Y/Z %d / %d", component + 1, i + 1, ddaParams.cgridX ()));
-        fill<ctype> (slice, 0);
-        for (int j = 1 - ddaParams.dipoleGeometry ().box ().y () (); j < ddaParams.dipoleGeometry ().box ().y (); j++) {
-          for (int k = 1 - ddaParams.dipoleGeometry ().box ().z () (); k < ddaParams.dipoleGeometry ().box ().z (); k++) {
-            int x = i;
-            int y = clip (j, ddaParams.gridY ());
-            int z = clip (k, ddaParams.gridZ ());
-            slice[z][y] = d2Matrix[x][y][z];
+    }
+  }
+
+  template <class T> DMatrixPlanes<T>::DMatrixPlanes (const DDAParams<T>& ddaParams, size_t xCount) :
+    dMatrixY_ (ddaParams.dMatrixY ()),
+    dMatrixZ_ (ddaParams.dMatrixZ ()),
+    planes_ (boost::extents[ddaParams.dMatrixY () * ddaParams.dMatrixZ ()][12][xCount], boost::fortran_storage_order ())
+  {
+  }
+  template <class T> DMatrixPlanes<T>::~DMatrixPlanes () {}
+
+  template <class T> void DMatrixPlanes<T>::loadSlices (const boost::const_multi_array_ref<Math::SymMatrix3<ctype>, 3>* dMatrix, UNUSED size_t thread, size_t begin, size_t end) {
+    for (size_t x = begin; x < end; x++) {
+      ftype* planes = planes_.data () + x * 12 * planeSize ();
+      for (size_t j = 0; j < dMatrixY_; j++) {
+        for (size_t k = 0; k < dMatrixZ_; k++) {
+          const Math::SymMatrix3<ctype>& d = (*dMatrix)[j][k][x];
+          for (int component = 0; component < 6; component++) {
+            planes[k + dMatrixZ_ * j + component * planeSize ()] = d[component].real ();
+            planes[k + dMatrixZ_ * j + (component + 6) * planeSize ()] = d[component].imag ();
           }
         }
-        planZf_Dm->fftInPlace (slice);
-        transpose<ctype> (slice, slice_tr);
-        planYf_Dm->fftInPlace (slice_tr);
-        for (int k = 0; k < ddaParams.cgridZ (); k++)
-          for (int j = 0; j < ddaParams.cgridY (); j++)
-            dMatrix[j][k][i][component] = slice_tr[j][k] / -(ftype)(ddaParams.gridSize ().x () () * ddaParams.gridSize ().y () () * ddaParams.gridSize ().z () ());
       }
     }
-    progress.finish ("DMatrix done");
-    progress.cleanup ();
+  }
+
+  template <class T> void DMatrixPlanes<T>::load (const boost::const_multi_array_ref<Math::SymMatrix3<ctype>, 3>& dMatrix, Core::ThreadPool& threadPool) {
+    ASSERT (dMatrix.shape ()[0] == dMatrixY_);
+    ASSERT (dMatrix.shape ()[1] == dMatrixZ_);
+    ASSERT (dMatrix.shape ()[2] == xCount ());
+    threadPool.run (xCount (), boost::bind (&DMatrixPlanes<T>::loadSlices, this, &dMatrix, _1, _2, _3));
   }
 
   CALL_MACRO_FOR_DEFAULT_FP_TYPES(CREATE_TEMPLATE_INSTANCE, DMatrixCpu)
+  CALL_MACRO_FOR_DEFAULT_FP_TYPES(CREATE_TEMPLATE_INSTANCE, DMatrixPlanes)
+  CALL_MACRO_FOR_DEFAULT_FP_TYPES(CREATE_TEMPLATE_INSTANCE, MatrixFreeDMatrix)
 }
@@ -25,24 +25,133 @@
 
 // DMatrix calculation on the CPU
 
+#include <Core/ThreadPool.hpp>
+#include <Core/Allocator.hpp>
+
 #include <DDA/DDAParams.hpp>
 
 namespace DDA {
+  template <class T> class MatrixFreeDMatrix;
+
   template <class T>
   class DMatrixCpu {
+    friend class MatrixFreeDMatrix<T>;
+
     typedef T ftype;
     typedef std::complex<ftype> ctype;
     typedef FPConst<ftype> Const;
 
   private:
-    static inline ctype getInteractionTerm (const DDAParams<T>& ddaParams, int i, int j, int k, int mu, int nu, const boost::shared_ptr<const Beam<T> >& beam);
+    // Data shared by the steps of createDMatrix ()
+    class Context;
+
+    static inline Math::SymMatrix3<ctype> getInteractionTerm (const DDAParams<T>& ddaParams, int i, int j, int k, const boost::shared_ptr<const Beam<T> >& beam);
     static inline uint32_t clip (int32_t n, uint32_t M);
 
+    // The individual steps of createDMatrix (), called by the thread pool for
+    // a range of the respective index
+    static void calculateTerms (Context* c, size_t thread, size_t begin, size_t end);
+    static void fftYZ (Context* c, size_t thread, size_t begin, size_t end);
+
   public:
-    static void createDMatrix (const DDAParams<T>& ddaParams, const LinAlg::FFTPlanFactory<T>& planFactory, boost::multi_array_ref<Math::SymMatrix3<std::complex<T> >, 3>& dMatrix, const boost::shared_ptr<const Beam<T> >& beam);
+    // If xIndices is given, only these X indices of the DMatrix are stored
+    // in dMatrix (in the given order, see MatVecCpu::localDMatrixXIndices ())
+    static void createDMatrix (const DDAParams<T>& ddaParams, const LinAlg::FFTPlanFactory<T>& planFactory, Core::ThreadPool& threadPool, boost::multi_array_ref<Math::SymMatrix3<std::complex<T> >, 3>& dMatrix, const boost::shared_ptr<const Beam<T> >& beam, const std::vector<uint32_t>* xIndices = NULL);
+  };
+
+  // The DMatrix in the layout used by MatVecCpu: for every stored X index 12
+  // planes (the real parts of aa, ab, ac, bb, bc, cc followed by the
+  // imaginary parts) of dMatrixZ * dMatrixY values at index z + dMatrixZ * y,
+  // so that the multiplication can use SIMD instructions. The planes are
+  // filled once after the DMatrix has been created or loaded, the signs for
+  // reflected frequencies are applied by MatVecCpu.
+  template <class T>
+  class DMatrixPlanes {
+    typedef T ftype;
+    typedef std::complex<ftype> ctype;
+
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
+    typedef Core::Allocator<ftype, MAX (boost::alignment_of<ftype>::value, 64)> RealAllocator;
+#undef MAX
+
+    size_t dMatrixY_, dMatrixZ_;
+    // Index (z + dMatrixZ * y, plane, x)
+    boost::multi_array<ftype, 3, RealAllocator> planes_;
+
+    void loadSlices (const boost::const_multi_array_ref<Math::SymMatrix3<ctype>, 3>* dMatrix, size_t thread, size_t begin, size_t end);
+
+  public:
+    // xCount is the number of stored X indices (see DMatrixCpu::createDMatrix ())
+    DMatrixPlanes (const DDAParams<T>& ddaParams, size_t xCount);
+    ~DMatrixPlanes ();
+
+    size_t dMatrixY () const { return dMatrixY_; }
+    size_t dMatrixZ () const { return dMatrixZ_; }
+    size_t planeSize () const { return dMatrixY_ * dMatrixZ_; }
+    size_t xCount () const { return planes_.shape ()[2]; }
+
+    // The 12 planes for the stored X index x
+    const ftype* slice (size_t x) const { ASSERT (x < xCount ()); return planes_.data () + x * 12 * planeSize (); }
+
+    // Copies a DMatrix (with the dimensions given to the constructor) into
+    // the planes
+    void load (const boost::const_multi_array_ref<Math::SymMatrix3<ctype>, 3>& dMatrix, Core::ThreadPool& threadPool);
+  };
+
+  // Compact representation of the DMatrix for --matrix-free (only for
+  // non-periodic targets): The interaction terms are stored only for
+  // non-negative Y and Z offsets and only transformed along X, which needs
+  // about box.y * box.z / (dMatrixY * dMatrixZ) of the memory of the DMatrix
+  // and avoids the large temporary array used by DMatrixCpu::createDMatrix ().
+  // The Y and Z FFTs of an X slice are redone every time MatVecCpu needs the
+  // slice, which roughly doubles the FFT work of a matrix-vector-product.
+  template <class T>
+  class MatrixFreeDMatrix {
+    typedef T ftype;
+    typedef std::complex<ftype> ctype;
+
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
+    typedef Core::Allocator<ctype, MAX (boost::alignment_of<ctype>::value, 16)> Allocator;
+#undef MAX
+
+    const DDAParams<T>& ddaParams_;
+    size_t threadCount_;
+
+    // The X transformed terms, index z + box.z * (y + box.y * (component + 6 * x))
+    boost::multi_array<ctype, 4, Allocator> table;
+    // Buffers for every thread: gridX values of box.y * 6 lines for create ()
+    // and a slice (gridZ * gridY * 6 values) for loadSlice ()
+    boost::multi_array<ctype, 3, Allocator> lines;
+    mutable boost::multi_array<ctype, 4, Allocator> slices;
+
+    boost::shared_ptr<LinAlg::FFTPlan<ftype> > planX;
+    // Columns y < box.y of all components of a slice
+    boost::shared_ptr<LinAlg::FFTPlan<ftype> > planZ;
+    // Rows z < dMatrixZ of all components of a slice, stride = gridZ
+    boost::shared_ptr<LinAlg::FFTPlan<ftype> > planY;
+
+    void calculateTerms (const boost::shared_ptr<const Beam<T> >& beam, size_t thread, size_t begin, size_t end);
+
+  public:
+    MatrixFreeDMatrix (const DDAParams<T>& ddaParams, const LinAlg::FFTPlanFactory<T>& planFactory, size_t threadCount);
+    ~MatrixFreeDMatrix ();
+
+    const DDAParams<T>& ddaParams () const { return ddaParams_; }
+    size_t threadCount () const { return threadCount_; }
+    size_t tableSize () const { return table.num_elements (); }
+
+    // Calculates the terms for the current wavelength of ddaParams ()
+    void create (Core::ThreadPool& threadPool, const boost::shared_ptr<const Beam<T> >& beam);
+
+    // Writes the DMatrix elements for the X index x (< dMatrixX) to planes in
+    // the layout of one X index of DMatrixPlanes, thread is the index of the
+    // calling thread
+    void loadSlice (uint32_t x, size_t thread, ftype* planes) const;
   };
 
   CALL_MACRO_FOR_DEFAULT_FP_TYPES(DISABLE_TEMPLATE_INSTANCE, DMatrixCpu)
+  CALL_MACRO_FOR_DEFAULT_FP_TYPES(DISABLE_TEMPLATE_INSTANCE, DMatrixPlanes)
+  CALL_MACRO_FOR_DEFAULT_FP_TYPES(DISABLE_TEMPLATE_INSTANCE, MatrixFreeDMatrix)
 }
 
 #endif // !DDA_DMATRIXCPU_HPP_INCLUDED
@@ -29,15 +29,18 @@
 namespace DDA {
   // TODO: Implement DMatrix generation on GPU
 
-  template <class T> void DMatrixGpu<T>::createDMatrix (UNUSED const OpenCL::StubPool& pool, const std::vector<cl::CommandQueue>& queues, const DDAParams<T>& ddaParams, const LinAlg::GpuFFTPlanFactory<T>& planFactory, OpenCL::MultiGpuVector<std::complex<T> >& dMatrix, const boost::shared_ptr<const Beam<T> >& beam) {
+  template <class T> void DMatrixGpu<T>::createDMatrix (UNUSED const OpenCL::StubPool& pool, const std::vector<cl::CommandQueue>& queues, const DDAParams<T>& ddaParams, const LinAlg::FFTPlanFactory<T>& cpuPlanFactory, Core::ThreadPool& threadPool, OpenCL::MultiGpuVector<std::complex<T> >& dMatrix, const boost::shared_ptr<const Beam<T> >& beam, const boost::shared_ptr<const DMatrixCache<T> >& cache) {
     ASSERT (dMatrix.vectorCount () == ddaParams.procs ());
+    std::vector<size_t> dMatrixSizes = sizes (ddaParams);
     for (size_t i = 0; i < ddaParams.procs (); i++)
-      ASSERT (dMatrix[i].size () == ddaParams.cgridY () * ddaParams.cgridZ () * ddaParams.localCGridX (i) * 6);
-    (void) planFactory;
-    boost::multi_array<Math::SymMatrix3<std::complex<T> >, 3> dMatrixCpu (boost::extents[ddaParams.gridY ()][ddaParams.gridZ ()][ddaParams.gridX ()], boost::fortran_storage_order ());
-    DMatrixCpu<T>::createDMatrix (ddaParams, LinAlg::getFFTWPlanFactory<T> (), dMatrixCpu, beam);
+      ASSERT (dMatrix[i].size () == dMatrixSizes[i]);
+    boost::multi_array<Math::SymMatrix3<std::complex<T> >, 3> dMatrixCpu (boost::extents[ddaParams.dMatrixY ()][ddaParams.dMatrixZ ()][ddaParams.dMatrixX ()], boost::fortran_storage_order ());
+    if (cache)
+      cache->loadOrCreate (ddaParams, cpuPlanFactory, threadPool, dMatrixCpu, beam);
+    else
+      DMatrixCpu<T>::createDMatrix (ddaParams, cpuPlanFactory, threadPool, dMatrixCpu, beam);
     for (size_t i = 0; i < ddaParams.procs (); i++)
-      dMatrix[i].write (queues[i], (const std::complex<T>*) (dMatrixCpu.data () + ddaParams.gridY () * ddaParams.gridZ () * ddaParams.localX0 (i)));
+      dMatrix[i].write (queues[i], (const std::complex<T>*) (dMatrixCpu.data () + ddaParams.dMatrixY () * ddaParams.dMatrixZ () * (ddaParams.dMatrixSymmetric () ? 0 : ddaParams.localX0 (i))));
   }
 
   CALL_MACRO_FOR_DEFAULT_FP_TYPES(CREATE_TEMPLATE_INSTANCE, DMatrixGpu)
@@ -23,8 +23,11 @@
 #ifndef DDA_DMATRIXGPU_HPP_INCLUDED
 #define DDA_DMATRIXGPU_HPP_INCLUDED
 
+#include <Core/ThreadPool.hpp>
+
 #include <DDA/DDAParams.hpp>
 #include <DDA/Beam.hpp>
+#include <DDA/DMatrixCache.hpp>
 
 #include <OpenCL/MultiGpuVector.hpp>
 
@@ -39,7 +42,22 @@ namespace DDA {
   template <class T>
   class DMatrixGpu {
   public:
-    static void createDMatrix (const OpenCL::StubPool& pool, const std::vector<cl::CommandQueue>& queue, const DDAParams<T>& ddaParams, const LinAlg::GpuFFTPlanFactory<T>& planFactory, OpenCL::MultiGpuVector<std::complex<T> >& dMatrix, const boost::shared_ptr<const Beam<T> >& beam);
+    // Number of DMatrix slices stored on GPU i: All slices for a symmetric
+    // DMatrix (they are needed for the reflected X coordinates), otherwise the
+    // local slices
+    static cuint32_t sliceCount (const DDAParams<T>& ddaParams, cuint32_t i) {
+      return ddaParams.dMatrixSymmetric () ? ddaParams.cdMatrixX () : ddaParams.localCGridX (i);
+    }
+    static std::vector<size_t> sizes (const DDAParams<T>& ddaParams) {
+      std::vector<size_t> res (ddaParams.procs () ());
+      for (size_t i = 0; i < ddaParams.procs (); i++)
+        res[i] = (ddaParams.cdMatrixY () * ddaParams.cdMatrixZ () * sliceCount (ddaParams, i) * 6) ();
+      return res;
+    }
+
+    // The DMatrix is calculated on the host using threadPool and
+    // cpuPlanFactory
+    static void createDMatrix (const OpenCL::StubPool& pool, const std::vector<cl::CommandQueue>& queue, const DDAParams<T>& ddaParams, const LinAlg::FFTPlanFactory<T>& cpuPlanFactory, Core::ThreadPool& threadPool, OpenCL::MultiGpuVector<std::complex<T> >& dMatrix, const boost::shared_ptr<const Beam<T> >& beam, const boost::shared_ptr<const DMatrixCache<T> >& cache = boost::shared_ptr<const DMatrixCache<T> > ());
   };
 
   CALL_MACRO_FOR_DEFAULT_FP_TYPES(DISABLE_TEMPLATE_INSTANCE, DMatrixGpu)
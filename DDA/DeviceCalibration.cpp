@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "DeviceCalibration.hpp"
+
+#include <Core/BoostFilesystem.hpp>
+#include <Core/File.hpp>
+#include <Core/Hash.hpp>
+#include <Core/IStream.hpp>
+#include <Core/Time.hpp>
+
+#include <OpenCL/Vector.hpp>
+
+#include <cstdio>
+#include <limits>
+#include <sstream>
+
+#include <boost/filesystem.hpp>
+
+namespace DDA {
+  namespace {
+    // Number of X slices transformed at once and number of repetitions
+    const uint32_t calibrationSlices = 8;
+    const uint32_t calibrationRuns = 10;
+  }
+
+  template <class T> std::string DeviceCalibration<T>::getKey (const cl::Device& device, const DDAParams<T>& g) {
+    std::stringstream str;
+    str << "ftype=" << sizeof (T) << "/" << std::numeric_limits<T>::digits;
+    str << " size=" << g.gridY () << "," << g.gridZ () << "," << g.dipoleGeometry ().box ().y () << "," << calibrationSlices;
+    str << " device=" << device.getInfo<CL_DEVICE_NAME> ();
+    str << " vendor=" << device.getInfo<CL_DEVICE_VENDOR> ();
+    str << " driver=" << device.getInfo<CL_DRIVER_VERSION> ();
+    return str.str ();
+  }
+
+  template <class T> double DeviceCalibration<T>::measure (const OpenCL::StubPool& pool, const cl::CommandQueue& queue, const LinAlg::GpuFFTPlanFactory<T>& planFactory, const DDAParams<T>& g) {
+    // The same plans as in GpuMatVec: only the boxY columns containing
+    // dipoles need a Z FFT, the Y FFT is done for the entire slice
+    OpenCL::Vector<std::complex<T> > data (pool, (g.cgridZ () * g.cgridY () * 3 * calibrationSlices) ());
+    data.setToZero (queue);
+    boost::shared_ptr<LinAlg::GpuFFTPlan<T> > planZ = planFactory.createPlan (pool, queue.getInfo<CL_QUEUE_DEVICE> (), g.cgridZ (), g.dipoleGeometry ().box ().y () * 3 * calibrationSlices, true, false, true, true);
+    boost::shared_ptr<LinAlg::GpuFFTPlan<T> > planY = planFactory.createPlan (pool, queue.getInfo<CL_QUEUE_DEVICE> (), g.cgridY (), g.cgridZ () * 3 * calibrationSlices, true, false, true, true);
+
+    // The first run includes the kernel compilation
+    planZ->fftInPlace (queue, data);
+    planY->fftInPlace (queue, data);
+    planY->ifftInPlace (queue, data);
+    planZ->ifftInPlace (queue, data);
+    queue.finish ();
+
+    Core::TimeSpan start = Core::getCurrentTime ();
+    for (uint32_t i = 0; i < calibrationRuns; i++) {
+      planZ->fftInPlace (queue, data);
+      planY->fftInPlace (queue, data);
+      planY->ifftInPlace (queue, data);
+      planZ->ifftInPlace (queue, data);
+    }
+    queue.finish ();
+    double seconds = (Core::getCurrentTime () - start).getSeconds ();
+    return calibrationRuns * calibrationSlices / std::max (seconds, 1e-6);
+  }
+
+  template <class T> std::vector<double> DeviceCalibration<T>::getWeights (const OpenCL::StubPool& pool, const std::vector<cl::CommandQueue>& queues, const LinAlg::GpuFFTPlanFactory<T>& planFactory, const DDAParams<T>& g, const boost::filesystem::path& cacheDirectory, const Core::OStream& out) {
+    if (!cacheDirectory.empty ())
+      boost::filesystem::create_directories (cacheDirectory);
+
+    std::vector<double> res (queues.size ());
+    for (size_t i = 0; i < queues.size (); i++) {
+      std::string key = getKey (queues[i].getInfo<CL_QUEUE_DEVICE> (), g);
+      char name[64];
+      snprintf (name, sizeof (name), "calibration-%016llx.txt", (unsigned long long) Core::fnv1aHash (key));
+      boost::filesystem::path filename = cacheDirectory / name;
+
+      // The file contains the key in the first line and the value in the
+      // second line
+      res[i] = 0;
+      if (!cacheDirectory.empty () && boost::filesystem::exists (filename)) {
+        Core::IStream file = Core::IStream::open (filename);
+        std::string fileKey;
+        double value;
+        std::getline (*file, fileKey);
+        *file >> value;
+        if (!file->fail () && fileKey == key && value > 0)
+          res[i] = value;
+      }
+
+      if (res[i] > 0) {
+        out << "Device " << i << ": " << res[i] << " slices/s (loaded from " << filename << ")" << std::endl;
+      } else {
+        res[i] = measure (pool, queues[i], planFactory, g);
+        out << "Device " << i << ": " << res[i] << " slices/s" << std::endl;
+        if (!cacheDirectory.empty ()) {
+          std::stringstream str;
+          str << key << std::endl << res[i] << std::endl;
+          Core::writeFileAtomically (filename, str.str ());
+        }
+      }
+    }
+    return res;
+  }
+
+  CALL_MACRO_FOR_OPENCL_FP_TYPES(CREATE_TEMPLATE_INSTANCE, DeviceCalibration)
+}
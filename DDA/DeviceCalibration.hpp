@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef DDA_DEVICECALIBRATION_HPP_INCLUDED
+#define DDA_DEVICECALIBRATION_HPP_INCLUDED
+
+// Measure the relative speed of several OpenCL devices
+//
+// The result is used for splitting the grid between the devices (see
+// DDAParams::partition ()) so that devices of different speed need about the
+// same time for their part of the matrix-vector-product. The measurement
+// times the Z and Y FFTs for a few X slices of the actual grid, which is the
+// largest part of the work in GpuMatVec::apply (). The result depends on the
+// device and on the grid size and can be stored in a cache directory.
+
+#include <Core/OStream.hpp>
+
+#include <Math/FPTemplateInstances.hpp>
+
+#include <OpenCL/Bindings.hpp>
+#include <OpenCL/StubPool.hpp>
+
+#include <LinAlg/GpuFFTPlan.hpp>
+
+#include <DDA/DDAParams.hpp>
+
+#include <boost/filesystem/path.hpp>
+
+namespace DDA {
+  template <class T>
+  class DeviceCalibration {
+  public:
+    // A string identifying the device, the floating point type and the grid
+    static std::string getKey (const cl::Device& device, const DDAParams<T>& g);
+
+    // Returns the number of X slices of the grid of g per second the device
+    // can process
+    static double measure (const OpenCL::StubPool& pool, const cl::CommandQueue& queue, const LinAlg::GpuFFTPlanFactory<T>& planFactory, const DDAParams<T>& g);
+
+    // Measure every device or load the value from cacheDirectory (if it is
+    // not empty). New values are stored in cacheDirectory.
+    static std::vector<double> getWeights (const OpenCL::StubPool& pool, const std::vector<cl::CommandQueue>& queues, const LinAlg::GpuFFTPlanFactory<T>& planFactory, const DDAParams<T>& g, const boost::filesystem::path& cacheDirectory, const Core::OStream& out);
+  };
+
+  CALL_MACRO_FOR_OPENCL_FP_TYPES(DISABLE_TEMPLATE_INSTANCE, DeviceCalibration)
+}
+
+#endif // !DDA_DEVICECALIBRATION_HPP_INCLUDED
@@ -131,6 +131,15 @@ namespace DDA {
     }
   }
 
+  std::vector<uint8_t> DipoleGeometry::occupiedLines () const {
+    std::vector<uint8_t> lines ((box ().y () * box ().z ()) (), 0);
+    for (uint32_t i = 0; i < nvCount (); i++) {
+      Math::Vector3<uint32_t> coords = getGridCoordinates (i);
+      lines[coords.y () + box ().y () () * coords.z ()] = 1;
+    }
+    return lines;
+  }
+
   void DipoleGeometry::check () const {
     ASSERT (nvCount () == positions_.size ());
     ASSERT (nvCount () == materialIndices_.size ());
@@ -127,6 +127,10 @@ namespace DDA {
       return valid ()[index];
     }
 
+    // Returns for every line of the box parallel to the x axis whether it
+    // contains at least one dipole, line (y, z) has the index y + box.y * z
+    std::vector<uint8_t> occupiedLines () const;
+
     // Move the center of the particle to the center of the coordinate system
     void moveToCenter ();
 
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "DispersionTable.hpp"
+
+#include <Core/Assert.hpp>
+#include <Core/IStream.hpp>
+#include <Core/StringUtil.hpp>
+
+#include <EMSim/Parse.hpp>
+#include <EMSim/Length.hpp>
+
+#include <algorithm>
+#include <sstream>
+
+#include <boost/foreach.hpp>
+
+namespace DDA {
+  DispersionTable::DispersionTable (const std::vector<ldouble>& lambdas, const std::vector<std::vector<cldouble> >& refractiveIndices) : lambdas_ (lambdas), refractiveIndices_ (refractiveIndices) {
+    ASSERT_MSG (lambdas.size () > 0, "Empty dispersion table");
+    ASSERT (lambdas.size () == refractiveIndices.size ());
+    for (size_t i = 0; i < lambdas.size (); i++) {
+      ASSERT (lambdas[i] > 0);
+      ASSERT_MSG (i == 0 || lambdas[i - 1] < lambdas[i], "Wavelengths in dispersion table are not sorted");
+      ASSERT_MSG (refractiveIndices[i].size () == refractiveIndices[0].size () && refractiveIndices[i].size () > 0, "Different number of refractive indices in dispersion table");
+    }
+  }
+  DispersionTable::~DispersionTable () {}
+
+  std::vector<Math::DiagMatrix3<cldouble> > DispersionTable::materials (ldouble lambda) const {
+    // Allow small rounding errors at the ends of the table
+    ldouble eps = 1e-9l * maxLambda ();
+    if (!(lambda >= minLambda () - eps && lambda <= maxLambda () + eps)) {
+      std::stringstream str;
+      str << "Wavelength " << lambda << " m is outside of the dispersion table (" << minLambda () << " m - " << maxLambda () << " m)";
+      ABORT_MSG (str.str ());
+    }
+
+    size_t i = std::upper_bound (lambdas_.begin (), lambdas_.end (), lambda) - lambdas_.begin ();
+    std::vector<Math::DiagMatrix3<cldouble> > result;
+    if (i == 0 || i == lambdas_.size ()) {
+      BOOST_FOREACH (cldouble value, refractiveIndices_[i == 0 ? 0 : i - 1])
+        result.push_back (Math::DiagMatrix3<cldouble> (value));
+    } else {
+      ldouble t = (lambda - lambdas_[i - 1]) / (lambdas_[i] - lambdas_[i - 1]);
+      for (size_t j = 0; j < materialCount (); j++) {
+        cldouble value = (1 - t) * refractiveIndices_[i - 1][j] + t * refractiveIndices_[i][j];
+        result.push_back (Math::DiagMatrix3<cldouble> (value));
+      }
+    }
+    return result;
+  }
+
+  DispersionTable DispersionTable::load (const boost::filesystem::path& filename) {
+    Core::IStream in = Core::IStream::open (filename);
+    std::vector<ldouble> lambdas;
+    std::vector<std::vector<cldouble> > refractiveIndices;
+    std::string line;
+    while (std::getline (*in, line)) {
+      std::vector<std::string> values;
+      std::istringstream str (line);
+      std::string value;
+      while (str >> value)
+        values.push_back (value);
+      if (values.size () == 0 || values[0][0] == '#')
+        continue;
+      ASSERT_MSG (values.size () >= 2, "Invalid line `" + line + "' in dispersion table");
+      EMSim::Length lambda;
+      EMSim::parse (values[0], lambda);
+      lambdas.push_back (lambda.valueAs<ldouble> ());
+      refractiveIndices.push_back (std::vector<cldouble> (values.size () - 1));
+      for (size_t i = 1; i < values.size (); i++)
+        EMSim::parse (values[i], refractiveIndices.back ()[i - 1]);
+    }
+    ASSERT (in->eof ());
+    return DispersionTable (lambdas, refractiveIndices);
+  }
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef DDA_DISPERSIONTABLE_HPP_INCLUDED
+#define DDA_DISPERSIONTABLE_HPP_INCLUDED
+
+// Refractive indices of the materials as a function of the wavelength
+//
+// The table is read from a text file where every line contains a wavelength
+// followed by the refractive indices of all materials (e.g.
+// "500nm 1.5+0.1i 1.33"). Empty lines and lines starting with '#' are
+// ignored. Refractive indices between two wavelengths are interpolated
+// linearly.
+
+#include <Math/DiagMatrix3.hpp>
+#include <Math/Float.hpp>
+
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+namespace DDA {
+  class DispersionTable {
+    std::vector<ldouble> lambdas_;
+    std::vector<std::vector<cldouble> > refractiveIndices_;
+
+  public:
+    // lambdas must be sorted, refractiveIndices[i] are the refractive indices
+    // of all materials for lambdas[i]
+    DispersionTable (const std::vector<ldouble>& lambdas, const std::vector<std::vector<cldouble> >& refractiveIndices);
+    ~DispersionTable ();
+
+    const std::vector<ldouble>& lambdas () const { return lambdas_; }
+    size_t materialCount () const { return refractiveIndices_[0].size (); }
+
+    ldouble minLambda () const { return lambdas_.front (); }
+    ldouble maxLambda () const { return lambdas_.back (); }
+
+    // Get the refractive indices of all materials for the wavelength lambda
+    std::vector<Math::DiagMatrix3<cldouble> > materials (ldouble lambda) const;
+
+    static DispersionTable load (const boost::filesystem::path& filename);
+  };
+}
+
+#endif // !DDA_DISPERSIONTABLE_HPP_INCLUDED
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "EwaldSum.hpp"
+
+#include <DDA/Beam.hpp>
+
+#include <limits>
+
+namespace DDA {
+  namespace {
+    typedef FPConst<ldouble> Const;
+
+    // Both sums are truncated where erfc (x) < 1e-20 (x > 6.7)
+    const ldouble cutoff = 6.7l;
+
+    // exp (z^2) * erfc (z) for Re (z) >= 0
+    cldouble erfcxPositive (cldouble z) {
+      if (z.real () < 1.5l) {
+        // Taylor series of erf (z), loses at most a factor of exp (2 Re (z)^2)
+        // in precision
+        cldouble z2 = z * z;
+        cldouble term = z;
+        cldouble sum = z;
+        for (int n = 1; ; n++) {
+          ASSERT (n < 10000);
+          term *= -z2 / static_cast<ldouble> (n);
+          cldouble value = term / static_cast<ldouble> (2 * n + 1);
+          sum += value;
+          if (std::abs (value) <= std::numeric_limits<ldouble>::epsilon () / 16 * std::abs (sum))
+            break;
+        }
+        return std::exp (z2) * (Const::one - sum * (Const::two / Const::sqrt_pi));
+      } else {
+        // Laplace continued fraction
+        // erfcx (z) = 1 / sqrt (pi) / (z + 1/2 / (z + 1 / (z + 3/2 / (z + ...))))
+        // evaluated with the modified Lentz method
+        const ldouble tiny = std::numeric_limits<ldouble>::min ();
+        cldouble f = z;
+        cldouble c = z;
+        cldouble d = 0;
+        for (int n = 1; ; n++) {
+          ASSERT (n < 10000);
+          ldouble a = static_cast<ldouble> (n) / 2;
+          d = z + a * d;
+          if (d == Const::zero)
+            d = tiny;
+          d = Const::one / d;
+          c = z + a / c;
+          if (c == Const::zero)
+            c = tiny;
+          cldouble delta = c * d;
+          f *= delta;
+          if (std::abs (delta - Const::one) <= std::numeric_limits<ldouble>::epsilon ())
+            break;
+        }
+        return Const::one / (Const::sqrt_pi * f);
+      }
+    }
+
+    // exp (a) * erfc (b) without overflow in the intermediate values
+    cldouble expErfc (cldouble a, cldouble b) {
+      if (b.real () >= 0)
+        return std::exp (a - b * b) * erfcxPositive (b);
+      else // erfc (b) = 2 - erfc (-b)
+        return Const::two * std::exp (a) - std::exp (a - b * b) * erfcxPositive (-b);
+    }
+
+    ldouble length (const Math::Vector3<ldouble>& v) {
+      return std::sqrt (v * v);
+    }
+  }
+
+  template <class T> EwaldSum<T>::EwaldSum (const DDAParams<ftype>& ddaParams, const boost::shared_ptr<const Beam<ftype> >& beam) :
+    waveNum_ (ddaParams.waveNum ()),
+    gridUnit_ (ddaParams.gridUnit ()),
+    periodicity1_ (static_cast<Math::Vector3<ldouble> > (ddaParams.periodicity1 ())),
+    periodicity2_ (static_cast<Math::Vector3<ldouble> > (ddaParams.periodicity2 ())),
+    phaseShift1_ (beam->getPhaseShift (ddaParams, ddaParams.periodicity1 ())),
+    phaseShift2_ (beam->getPhaseShift (ddaParams, ddaParams.periodicity2 ()))
+  {
+    ASSERT (ddaParams.periodicityDimension () == 2);
+    init ();
+  }
+
+  template <class T> EwaldSum<T>::EwaldSum (ldouble waveNum, ldouble gridUnit, const Math::Vector3<ldouble>& periodicity1, const Math::Vector3<ldouble>& periodicity2, ldouble phaseShift1, ldouble phaseShift2) :
+    waveNum_ (waveNum),
+    gridUnit_ (gridUnit),
+    periodicity1_ (periodicity1),
+    periodicity2_ (periodicity2),
+    phaseShift1_ (phaseShift1),
+    phaseShift2_ (phaseShift2)
+  {
+    init ();
+  }
+
+  template <class T> void EwaldSum<T>::init () {
+    ldouble k = waveNum_;
+
+    Math::Vector3<ldouble> normal = Math::crossProduct (periodicity1_, periodicity2_);
+    area_ = length (normal);
+    ASSERT (area_ > 0);
+    normal_ = normal / area_;
+    Math::Vector3<ldouble> c1 = Math::crossProduct (periodicity2_, normal_);
+    Math::Vector3<ldouble> c2 = Math::crossProduct (normal_, periodicity1_);
+    reciprocal1_ = c1 * (Const::two_pi / (periodicity1_ * c1));
+    reciprocal2_ = c2 * (Const::two_pi / (periodicity2_ * c2));
+
+    // eta = sqrt (pi / area) balances the two sums. For large unit cells eta
+    // is increased to keep k / (2 eta) small, the terms of the two sums grow
+    // like exp (k^2 / (4 eta^2)) and cancel each other.
+    eta_ = std::max (Const::sqrt_pi / std::sqrt (area_), k / 6);
+    maxr_ = cutoff / eta_;
+
+    // The phase shift of the image at m * periodicity1 + n * periodicity2 is
+    // m * phaseShift1 + n * phaseShift2 = -kappa0 * (m * periodicity1 + n * periodicity2)
+    Math::Vector3<ldouble> kappa0 = (phaseShift1_ * reciprocal1_ + phaseShift2_ * reciprocal2_) / -Const::two_pi;
+    ldouble maxKappa = std::sqrt (4 * cutoff * cutoff * eta_ * eta_ + k * k);
+    ldouble length1 = length (periodicity1_);
+    ldouble length2 = length (periodicity2_);
+    int64_t g1Min = static_cast<int64_t> (std::floor ((phaseShift1_ - maxKappa * length1) / Const::two_pi));
+    int64_t g1Max = static_cast<int64_t> (std::ceil ((phaseShift1_ + maxKappa * length1) / Const::two_pi));
+    int64_t g2Min = static_cast<int64_t> (std::floor ((phaseShift2_ - maxKappa * length2) / Const::two_pi));
+    int64_t g2Max = static_cast<int64_t> (std::ceil ((phaseShift2_ + maxKappa * length2) / Const::two_pi));
+    applicable_ = true;
+    for (int64_t g1 = g1Min; g1 <= g1Max; g1++) {
+      for (int64_t g2 = g2Min; g2 <= g2Max; g2++) {
+        Order order;
+        order.kappa = kappa0 + static_cast<ldouble> (g1) * reciprocal1_ + static_cast<ldouble> (g2) * reciprocal2_;
+        ldouble kappa2 = order.kappa * order.kappa;
+        if (kappa2 > maxKappa * maxKappa)
+          continue;
+        if (std::abs (kappa2 - k * k) <= 1e-6l * k * k)
+          applicable_ = false;
+        if (kappa2 >= k * k)
+          order.gamma = cldouble (std::sqrt (kappa2 - k * k), 0);
+        else
+          order.gamma = cldouble (0, -std::sqrt (k * k - kappa2));
+        orders_.push_back (order);
+      }
+    }
+
+    // The real space term of the dipole itself without the singular part,
+    // h(R) = (f(R) - exp (i k R) / R) = h0 + h2 R^2 + O(R^4), is
+    // (phi(R) - phi(-R)) / (2 R) with phi(R) = exp (-i k R) erfc (eta R - i k / (2 eta)).
+    // The term is (k^2 + grad grad) h(R) = (k^2 h0 + 2 h2) I at R = 0.
+    cldouble ik (0, k);
+    cldouble c = ik / (2 * eta_);
+    cldouble v0 = expErfc (0, -c);
+    ldouble w0 = std::exp (k * k / (4 * eta_ * eta_));
+    ldouble s = -2 * eta_ / Const::sqrt_pi;
+    cldouble v1 = s * w0;
+    cldouble v2 = s * 2 * eta_ * c * w0;
+    cldouble v3 = s * (-2 * eta_ * eta_ * w0 + 4 * eta_ * eta_ * c * c * w0);
+    cldouble h0 = -ik * v0 + v1;
+    cldouble phi3 = ik * k * k * v0 - 3 * k * k * v1 - Const::three * ik * v2 + v3;
+    selfTerm_ = k * k * h0 + phi3 / Const::three;
+  }
+
+  template <class T> Math::SymMatrix3<std::complex<T> > EwaldSum<T>::getInteractionTerm (int i, int j, int k, Cache& cache) const {
+    static const int mus[6] = { 0, 0, 0, 1, 1, 2 };
+    static const int nus[6] = { 0, 1, 2, 1, 2, 2 };
+    ldouble wn = waveNum_;
+    ldouble eta = eta_;
+    Math::Vector3<ldouble> r = Math::Vector3<ldouble> (i, j, k) * gridUnit_;
+    cldouble result[6] = { 0, 0, 0, 0, 0, 0 };
+
+    // Real space sum over the images at r + m * periodicity1 + n * periodicity2
+    // with |r + m * periodicity1 + n * periodicity2| < maxr. The term of every
+    // image is (k^2 + grad grad) f(R) with
+    // f(R) = (exp (i k R) erfc (eta R + i k / (2 eta)) + exp (-i k R) erfc (eta R - i k / (2 eta))) / (2 R)
+    // which is real.
+    ldouble r1 = (r * reciprocal1_) / Const::two_pi;
+    ldouble r2 = (r * reciprocal2_) / Const::two_pi;
+    ldouble d1 = maxr_ * length (reciprocal1_) / Const::two_pi;
+    ldouble d2 = maxr_ * length (reciprocal2_) / Const::two_pi;
+    int64_t mMin = static_cast<int64_t> (std::floor (-r1 - d1));
+    int64_t mMax = static_cast<int64_t> (std::ceil (-r1 + d1));
+    int64_t nMin = static_cast<int64_t> (std::floor (-r2 - d2));
+    int64_t nMax = static_cast<int64_t> (std::ceil (-r2 + d2));
+    for (int64_t m = mMin; m <= mMax; m++) {
+      for (int64_t n = nMin; n <= nMax; n++) {
+        if (!i && !j && !k && !m && !n)
+          continue;
+        Math::Vector3<ldouble> rImg = r + static_cast<ldouble> (m) * periodicity1_ + static_cast<ldouble> (n) * periodicity2_;
+        ldouble rr = length (rImg);
+        if (rr > maxr_)
+          continue;
+        cldouble x = erfcxPositive (cldouble (eta * rr, wn / (2 * eta)));
+        ldouble q = std::exp (-rr * rr * eta * eta + wn * wn / (4 * eta * eta));
+        ldouble f = q * x.real () / rr;
+        ldouble g = 2 * eta / Const::sqrt_pi * q;
+        ldouble fd = (-2 * wn * q * x.imag () - 2 * g) / (2 * rr) - f / rr; // f'(R)
+        // f''(R) = -k^2 f + 2 eta^2 g - 2 f' / R
+        ldouble diag = wn * wn * f + fd / rr;
+        ldouble offDiag = -wn * wn * f + 2 * eta * eta * g - 3 * fd / rr;
+        cldouble phase = std::exp (cldouble (0, static_cast<ldouble> (m) * phaseShift1_ + static_cast<ldouble> (n) * phaseShift2_));
+        for (int component = 0; component < 6; component++) {
+          ldouble value = offDiag * rImg[mus[component]] * rImg[nus[component]] / (rr * rr);
+          if (mus[component] == nus[component])
+            value += diag;
+          result[component] += phase * value;
+        }
+      }
+    }
+    if (!i && !j && !k) {
+      result[0] += selfTerm_;
+      result[3] += selfTerm_;
+      result[5] += selfTerm_;
+    }
+
+    // Reciprocal space sum over the diffraction orders, the term of every
+    // order is pi / area * (k^2 + grad grad) exp (i kappa r) f(z) with z the
+    // distance from the lattice plane and
+    // f(z) = (exp (gamma z) erfc (gamma / (2 eta) + eta z) + exp (-gamma z) erfc (gamma / (2 eta) - eta z)) / gamma
+    ldouble z = r * normal_;
+    if (!cache.valid || cache.z != z) {
+      cache.f.resize (orders_.size ());
+      cache.fd.resize (orders_.size ());
+      cache.fdd.resize (orders_.size ());
+      for (size_t o = 0; o < orders_.size (); o++) {
+        cldouble gamma = orders_[o].gamma;
+        cldouble ep = expErfc (gamma * z, gamma / (2 * eta) + eta * z);
+        cldouble em = expErfc (-gamma * z, gamma / (2 * eta) - eta * z);
+        cache.f[o] = (ep + em) / gamma;
+        cache.fd[o] = ep - em;
+        cache.fdd[o] = gamma * gamma * cache.f[o] - 4 * eta / Const::sqrt_pi * std::exp (-gamma * gamma / (4 * eta * eta) - eta * eta * z * z);
+      }
+      cache.z = z;
+      cache.valid = true;
+    }
+    for (size_t o = 0; o < orders_.size (); o++) {
+      const Math::Vector3<ldouble>& kappa = orders_[o].kappa;
+      cldouble phase = std::exp (cldouble (0, kappa * r)) * (Const::pi / area_);
+      cldouble f = phase * cache.f[o];
+      cldouble ifd = phase * cldouble (0, 1) * cache.fd[o];
+      cldouble fdd = phase * cache.fdd[o];
+      for (int component = 0; component < 6; component++) {
+        int mu = mus[component];
+        int nu = nus[component];
+        cldouble value = -kappa[mu] * kappa[nu] * f + (kappa[mu] * normal_[nu] + normal_[mu] * kappa[nu]) * ifd + normal_[mu] * normal_[nu] * fdd;
+        if (mu == nu)
+          value += wn * wn * f;
+        result[component] += value;
+      }
+    }
+
+    return Math::SymMatrix3<ctype> (static_cast<ctype> (result[0]), static_cast<ctype> (result[1]), static_cast<ctype> (result[2]), static_cast<ctype> (result[3]), static_cast<ctype> (result[4]), static_cast<ctype> (result[5]));
+  }
+
+  CALL_MACRO_FOR_DEFAULT_FP_TYPES(CREATE_TEMPLATE_INSTANCE, EwaldSum)
+}
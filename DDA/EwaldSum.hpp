@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef DDA_EWALDSUM_HPP_INCLUDED
+#define DDA_EWALDSUM_HPP_INCLUDED
+
+// Ewald summation of the interaction terms of targets which are periodic in
+// two dimensions
+//
+// The lattice sum of the interaction terms (sum over all images of
+// exp (i * phase) * (k^2 + grad grad) exp (i k r) / r) is split into a sum in
+// real space which contains only the images near the dipole and a sum over
+// the diffraction orders of the lattice, both converge exponentially (see
+// e.g. C. M. Linton, Lattice sums for the Helmholtz equation, SIAM Review 52
+// (2010)). The result is the limit gamma -> 0 of the damped sum used in
+// DMatrixCpu::getInteractionTerm (), it does not depend on gamma.
+//
+// All calculations are done with ldouble.
+
+#include <DDA/DDAParams.hpp>
+
+#include <vector>
+
+namespace DDA {
+  template <class T>
+  class EwaldSum {
+    typedef T ftype;
+    typedef std::complex<ftype> ctype;
+    typedef FPConst<ldouble> Const;
+
+    ldouble waveNum_;
+    ldouble gridUnit_;
+    Math::Vector3<ldouble> periodicity1_;
+    Math::Vector3<ldouble> periodicity2_;
+    ldouble phaseShift1_;
+    ldouble phaseShift2_;
+    // Normal of the lattice plane
+    Math::Vector3<ldouble> normal_;
+    // Area of a unit cell
+    ldouble area_;
+    // Reciprocal lattice vectors
+    Math::Vector3<ldouble> reciprocal1_;
+    Math::Vector3<ldouble> reciprocal2_;
+    // Ewald splitting parameter
+    ldouble eta_;
+    // Radius of the real space sum
+    ldouble maxr_;
+    // Contribution of the images of the dipole itself to the term for (0, 0, 0)
+    cldouble selfTerm_;
+    bool applicable_;
+
+    struct Order {
+      // Tangential wave vector of the order
+      Math::Vector3<ldouble> kappa;
+      // sqrt (kappa^2 - k^2), negative imaginary part for propagating orders
+      cldouble gamma;
+    };
+    std::vector<Order> orders_;
+
+    void init ();
+
+  public:
+    // The parts of the reciprocal space sum which only depend on the distance
+    // from the lattice plane. They are reused as long as consecutive calls of
+    // getInteractionTerm () have the same distance, every thread needs its own
+    // Cache.
+    class Cache {
+      friend class EwaldSum;
+
+      bool valid;
+      ldouble z;
+      std::vector<cldouble> f;   // f(z)
+      std::vector<cldouble> fd;  // f'(z)
+      std::vector<cldouble> fdd; // f''(z)
+
+    public:
+      Cache () : valid (false), z (0) {}
+    };
+
+    EwaldSum (const DDAParams<ftype>& ddaParams, const boost::shared_ptr<const Beam<ftype> >& beam);
+    // phaseShift1 and phaseShift2 are the phase shifts of the incident field
+    // between two images along periodicity1 and periodicity2
+    EwaldSum (ldouble waveNum, ldouble gridUnit, const Math::Vector3<ldouble>& periodicity1, const Math::Vector3<ldouble>& periodicity2, ldouble phaseShift1, ldouble phaseShift2);
+
+    // False if a diffraction order propagates (almost) parallel to the
+    // lattice plane (a Rayleigh anomaly). The lattice sum diverges in this
+    // case and only the damped sum can be used.
+    bool applicable () const { return applicable_; }
+
+    // The interaction term for the offset (i, j, k) * gridUnit, including all
+    // lattice images
+    Math::SymMatrix3<ctype> getInteractionTerm (int i, int j, int k, Cache& cache) const;
+  };
+
+  CALL_MACRO_FOR_DEFAULT_FP_TYPES(DISABLE_TEMPLATE_INSTANCE, EwaldSum)
+}
+
+#endif // !DDA_EWALDSUM_HPP_INCLUDED
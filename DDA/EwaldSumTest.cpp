@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Test DDA::EwaldSum against the damped lattice sum (the sum used by
+// DMatrixCpu::getInteractionTerm (), which converges to the lattice sum for
+// gamma -> 0)
+
+#include <DDA/EwaldSum.hpp>
+
+#include <Core/Assert.hpp>
+#include <Core/OStream.hpp>
+
+#include <Math/Vector3IOS.hpp>
+
+#include <cmath>
+
+typedef Math::Vector3<ldouble> Vector;
+
+static const int mus[6] = { 0, 0, 0, 1, 1, 2 };
+static const int nus[6] = { 0, 1, 2, 1, 2, 2 };
+
+// Sum over all images at r + m * periodicity1 + n * periodicity2 (except r = 0)
+// of exp (i (m * phaseShift1 + n * phaseShift2)) * exp (-(gamma k R)^4) *
+// (k^2 + grad grad) exp (i k R) / R. The sum is truncated at gamma k R = 3
+// (where the damping is exp (-81)), so the error is dominated by the damping.
+static void dampedSum (ldouble k, ldouble gamma, const Vector& r, const Vector& periodicity1, const Vector& periodicity2, ldouble phaseShift1, ldouble phaseShift2, cldouble* result) {
+  for (int component = 0; component < 6; component++)
+    result[component] = 0;
+  ldouble maxr = 3 / gamma / k;
+  int64_t maxd1 = static_cast<int64_t> (maxr / std::sqrt (periodicity1 * periodicity1)) + 2;
+  int64_t maxd2 = static_cast<int64_t> (maxr / std::sqrt (periodicity2 * periodicity2)) + 2;
+  for (int64_t m = -maxd1; m <= maxd1; m++) {
+    for (int64_t n = -maxd2; n <= maxd2; n++) {
+      Vector rImg = r + static_cast<ldouble> (m) * periodicity1 + static_cast<ldouble> (n) * periodicity2;
+      ldouble rr = std::sqrt (rImg * rImg);
+      if (rr == 0 || rr > maxr)
+        continue;
+      ldouble sup = gamma * gamma * k * k * rr * rr;
+      cldouble factor = std::exp (cldouble (-sup * sup, static_cast<ldouble> (m) * phaseShift1 + static_cast<ldouble> (n) * phaseShift2)) * std::exp (cldouble (0, k * rr)) / (rr * rr * rr);
+      ldouble kr = k * rr;
+      for (int component = 0; component < 6; component++) {
+        cldouble value = cldouble (3 - kr * kr, -3 * kr) * (rImg[mus[component]] * rImg[nus[component]] / (rr * rr));
+        if (mus[component] == nus[component])
+          value += cldouble (kr * kr - 1, kr);
+        result[component] += factor * value;
+      }
+    }
+  }
+}
+
+// Maximum difference between the Ewald sum and the damped sum relative to
+// the largest component of the Ewald sum, for some offsets
+static ldouble test (const Core::OStream& out, ldouble k, const Vector& periodicity1, const Vector& periodicity2, ldouble phaseShift1, ldouble phaseShift2, ldouble gamma) {
+  const ldouble gridUnit = 0.5;
+  const int offsets[][3] = { { 0, 0, 0 }, { 1, 0, 1 }, { 2, 1, -1 }, { 0, 0, 3 } };
+  DDA::EwaldSum<double> ewaldSum (k, gridUnit, periodicity1, periodicity2, phaseShift1, phaseShift2);
+  ASSERT (ewaldSum.applicable ());
+  DDA::EwaldSum<double>::Cache cache;
+  ldouble error = 0;
+  for (size_t i = 0; i < sizeof (offsets) / sizeof (*offsets); i++) {
+    Math::SymMatrix3<std::complex<double> > value = ewaldSum.getInteractionTerm (offsets[i][0], offsets[i][1], offsets[i][2], cache);
+    cldouble ref[6];
+    dampedSum (k, gamma, Vector (offsets[i][0], offsets[i][1], offsets[i][2]) * gridUnit, periodicity1, periodicity2, phaseShift1, phaseShift2, ref);
+    ldouble maxValue = 0, maxDiff = 0;
+    for (int component = 0; component < 6; component++) {
+      maxValue = std::max (maxValue, std::abs (static_cast<cldouble> (value[component])));
+      maxDiff = std::max (maxDiff, std::abs (static_cast<cldouble> (value[component]) - ref[component]));
+    }
+    error = std::max (error, maxDiff / maxValue);
+  }
+  out << "periodicity " << periodicity1 << " " << periodicity2 << " phase shift " << phaseShift1 << " " << phaseShift2 << ": " << error << std::endl;
+  return error;
+}
+
+int main () {
+  Core::OStream out = Core::OStream::getStdout ();
+  const ldouble k = 1;
+  const ldouble gamma = 0.0025;
+  const ldouble pi = DDA::FPConst<ldouble>::pi;
+
+  // Rectangular and oblique lattices, at normal and oblique incidence
+  ASSERT (test (out, k, Vector (2, 0, 0), Vector (0, 2.6, 0), 0, 0, gamma) < 1e-7);
+  ASSERT (test (out, k, Vector (2, 0, 0), Vector (0, 2.6, 0), 0.3, 0, gamma) < 1e-7);
+  ASSERT (test (out, k, Vector (3, 0, 0), Vector (1.5, 2.5, 0), 1, -0.5, gamma) < 1e-7);
+  // A lattice which is not parallel to the XY plane
+  ASSERT (test (out, k, Vector (2, 0, 1), Vector (0, 2.5, 0), 0.5, 0.2, gamma) < 1e-7);
+
+  // Near a Rayleigh anomaly (a diffraction order propagates almost parallel
+  // to the lattice) the damped sum converges much more slowly, a smaller
+  // gamma is needed
+  ASSERT (test (out, k, Vector (2 * pi * 1.02, 0, 0), Vector (0, 2 * pi * 1.3, 0), 0, 0, gamma / 4) < 1e-4);
+
+  // At the Rayleigh anomaly the lattice sum diverges
+  ASSERT (!DDA::EwaldSum<double> (k, 0.5, Vector (2 * pi, 0, 0), Vector (0, 2 * pi * 1.3, 0), 0, 0).applicable ());
+
+  return 0;
+}
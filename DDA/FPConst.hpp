@@ -36,6 +36,7 @@ namespace DDA {
   D (pi,                     3.1415926535897932384626433832795028);     \
   D (two_pi,                 6.2831853071795864769252867665590056);     \
   D (four_pi,               12.5663706143591729538505735331180112);     \
+  D (sqrt_pi,                1.7724538509055160272981674833411452);     \
   D (three_over_four_pi,     0.23873241463784300365332564505877);       \
   D (speed_of_light, 299792458.0);                                      \
   D (one,                    1.0);                                      \
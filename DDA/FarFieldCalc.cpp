@@ -33,6 +33,8 @@
 #include <DDA/Beam.hpp>
 #include <DDA/DataFilesDDAUtil.hpp>
 
+#include <algorithm>
+
 #include <boost/make_shared.hpp>
 #include <boost/foreach.hpp>
 
@@ -127,17 +129,17 @@ namespace DDA {
     size_t count = angles.count ();
     boost::shared_ptr<std::vector<EMSim::FarFieldEntry<ftype> > > result = boost::make_shared<std::vector<EMSim::FarFieldEntry<ftype> > > (count);
 
+    // The fields are calculated in chunks of chunkSize directions, this
+    // allows the calculator to process many directions at once
+    const size_t chunkSize = calculator.fieldsBatchSize ();
+    std::vector<Math::Vector3<ftype> > directions;
+    std::vector<Math::Vector3<ftype> > incPolPerpendicular;
+    std::vector<Math::Vector3<ftype> > incPolParallel;
+    std::vector<Math::Vector3<ctype> > fields;
+
     Core::ProgressBar progress (Core::OStream::getStderr (), count);
-    for (size_t i = 0; i < count; i++) {
-      if (i % 1000 == 0)
-        progress.update (i, Core::sprintf ("EField %s / %s", i, count));
-      std::pair<ldouble, ldouble> thetaPhi = angles.getThetaPhi (i);
-      ftype sinTheta = std::sin (static_cast<ftype> (thetaPhi.first));
-      ftype cosTheta = std::cos (static_cast<ftype> (thetaPhi.first));
-      ftype sinPhi = std::sin (static_cast<ftype> (thetaPhi.second));
-      ftype cosPhi = std::cos (static_cast<ftype> (thetaPhi.second));
-      Math::Vector3<ftype> scatteringDirection = cosTheta * prop + sinTheta * (cosPhi * incPolX + sinPhi * incPolY);
-      Math::Vector3<ctype> ebuff = calculator.calcField (scatteringDirection); // scattered electric field
+    for (size_t start = 0; start < count; start += chunkSize) {
+      progress.update (start, Core::sprintf ("EField %s / %s", start, count));
       if (ddaParams.periodicityDimension () == 0) {
       } else if (ddaParams.periodicityDimension () == 1) {
         ABORT_MSG ("Far field output for periodic structures not implemented"); // TODO: implement
@@ -146,12 +148,27 @@ namespace DDA {
       } else {
         ABORT ();
       }
-      // split into perpendicular and parallel components
-      Math::Vector3<ftype> incPolPerpendicular = sinPhi * incPolX - cosPhi * incPolY;
-      Math::Vector3<ftype> incPolParallel = -sinTheta * prop + cosTheta * (cosPhi * incPolX + sinPhi * incPolY);
-      //Core::OStream::getStdout () << prop << " " << incPolPerpendicular << " " << incPolParallel << " " << scatteringDirection << std::endl;
-      (*result)[i].perpendicular () = ebuff * Math::Vector3<ctype> (incPolPerpendicular); // ebuff projected onto perpendicular polarization vector
-      (*result)[i].parallel () = ebuff * Math::Vector3<ctype> (incPolParallel); // ebuff projected onto parallel polarization vector;
+      size_t chunkCount = std::min (chunkSize, count - start);
+      directions.resize (chunkCount);
+      incPolPerpendicular.resize (chunkCount);
+      incPolParallel.resize (chunkCount);
+      for (size_t i = 0; i < chunkCount; i++) {
+        std::pair<ldouble, ldouble> thetaPhi = angles.getThetaPhi (start + i);
+        ftype sinTheta = std::sin (static_cast<ftype> (thetaPhi.first));
+        ftype cosTheta = std::cos (static_cast<ftype> (thetaPhi.first));
+        ftype sinPhi = std::sin (static_cast<ftype> (thetaPhi.second));
+        ftype cosPhi = std::cos (static_cast<ftype> (thetaPhi.second));
+        directions[i] = cosTheta * prop + sinTheta * (cosPhi * incPolX + sinPhi * incPolY);
+        // split into perpendicular and parallel components
+        incPolPerpendicular[i] = sinPhi * incPolX - cosPhi * incPolY;
+        incPolParallel[i] = -sinTheta * prop + cosTheta * (cosPhi * incPolX + sinPhi * incPolY);
+      }
+      calculator.calcFields (directions, fields); // scattered electric field
+      for (size_t i = 0; i < chunkCount; i++) {
+        //Core::OStream::getStdout () << prop << " " << incPolPerpendicular[i] << " " << incPolParallel[i] << " " << directions[i] << std::endl;
+        (*result)[start + i].perpendicular () = fields[i] * Math::Vector3<ctype> (incPolPerpendicular[i]); // ebuff projected onto perpendicular polarization vector
+        (*result)[start + i].parallel () = fields[i] * Math::Vector3<ctype> (incPolParallel[i]); // ebuff projected onto parallel polarization vector;
+      }
     }
     progress.finish (Core::sprintf ("EField %s / %s", count, count));
     progress.cleanup ();
@@ -161,14 +178,19 @@ namespace DDA {
 
 
   template <class ftype>
-  void FarFieldCalc<ftype>::calcAndStore (const boost::filesystem::path& outputPrefix, const DDAParams<ftype>& ddaParams, FieldCalculator<ftype>& calculator, const boost::shared_ptr<EMSim::DataFiles::Parameters<EMSim::DataFiles::DDAParameters> >& parameters, const std::vector<std::complex<ftype> >& res1, const std::vector<std::complex<ftype> >& res2, bool symmetric, const Beam<ftype>& beam, const EMSim::AngleList& angleList, const std::vector<FarFieldOption>& options, bool writeTxt) {
+  boost::shared_ptr<EMSim::DataFiles::JonesFarField<ftype> > FarFieldCalc<ftype>::calcJonesFarField (const DDAParams<ftype>& ddaParams, FieldCalculator<ftype>& calculator, const std::vector<std::complex<ftype> >& res1, const std::vector<std::complex<ftype> >& res2, bool symmetric, const Beam<ftype>& beam, const EMSim::AngleList& angleList) {
     boost::shared_ptr<std::vector<EMSim::FarFieldEntry<ftype> > > eField1 = FarFieldCalc<ftype>::calcEField (ddaParams, calculator, angleList, res1, ddaParams.dipoleGeometry ().orientationInverse () * beam.prop (), beam.getIncPolP (ddaParams.dipoleGeometry (), BEAMPOLARIZATION_2), beam.getIncPolP (ddaParams.dipoleGeometry (), BEAMPOLARIZATION_1));
     boost::shared_ptr<std::vector<EMSim::FarFieldEntry<ftype> > > eField2;
     if (symmetric)
       eField2 = calcEField (ddaParams, calculator, angleList, res1, ddaParams.dipoleGeometry ().orientationInverse () * beam.prop (), beam.getIncPolP (ddaParams.dipoleGeometry (), BEAMPOLARIZATION_1), -beam.getIncPolP (ddaParams.dipoleGeometry (), BEAMPOLARIZATION_2));
     else
       eField2 = calcEField (ddaParams, calculator, angleList, res2, ddaParams.dipoleGeometry ().orientationInverse () * beam.prop (), beam.getIncPolP (ddaParams.dipoleGeometry (), BEAMPOLARIZATION_2), beam.getIncPolP (ddaParams.dipoleGeometry (), BEAMPOLARIZATION_1));
-    boost::shared_ptr<EMSim::DataFiles::JonesFarField<ftype> > farField = EMSim::JonesCalculus<ftype>::computeJonesFarField (angleList, *eField1, *eField2, ddaParams.frequency ());
+    return EMSim::JonesCalculus<ftype>::computeJonesFarField (angleList, *eField1, *eField2, ddaParams.frequency ());
+  }
+
+  template <class ftype>
+  void FarFieldCalc<ftype>::calcAndStore (const boost::filesystem::path& outputPrefix, const DDAParams<ftype>& ddaParams, FieldCalculator<ftype>& calculator, const boost::shared_ptr<EMSim::DataFiles::Parameters<EMSim::DataFiles::DDAParameters> >& parameters, const std::vector<std::complex<ftype> >& res1, const std::vector<std::complex<ftype> >& res2, bool symmetric, const Beam<ftype>& beam, const EMSim::AngleList& angleList, const std::vector<FarFieldOption>& options, bool writeTxt) {
+    boost::shared_ptr<EMSim::DataFiles::JonesFarField<ftype> > farField = calcJonesFarField (ddaParams, calculator, res1, res2, symmetric, beam, angleList);
     BOOST_FOREACH (const FarFieldOption& option, options)
       store (outputPrefix, DataFiles::createDDADipoleListGeometry (ddaParams.dipoleGeometry (), false), parameters, farField, option, writeTxt);
   }
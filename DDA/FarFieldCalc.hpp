@@ -72,8 +72,13 @@ namespace DDA {
   public:
     static boost::shared_ptr<std::vector<EMSim::FarFieldEntry<ftype> > > calcEField (const DDAParams<ftype>& ddaParams, FieldCalculator<ftype>& calculator, const EMSim::AngleList& angles, const std::vector<std::complex<ftype> >& pvec, Math::Vector3<ldouble> prop, Math::Vector3<ftype> incPolX, Math::Vector3<ftype> incPolY);
 
+    static boost::shared_ptr<EMSim::DataFiles::JonesFarField<ftype> > calcJonesFarField (const DDAParams<ftype>& ddaParams, FieldCalculator<ftype>& calculator, const std::vector<std::complex<ftype> >& res1, const std::vector<std::complex<ftype> >& res2, bool symmetric, const Beam<ftype>& beam, const EMSim::AngleList& angleList);
+
     template <typename MethodType, typename GeometryType>
     static void store (const boost::filesystem::path& outputPrefix, const boost::shared_ptr<GeometryType>& geometry, const boost::shared_ptr<EMSim::DataFiles::Parameters<MethodType> >& parameters, const boost::shared_ptr<EMSim::DataFiles::JonesFarField<ftype> >& farField, const FarFieldOption& option, bool writeTxt);
+    // Store only the mueller matrix (e.g. for orientation averaged results where no jones matrix exists)
+    template <typename MethodType, typename GeometryType>
+    static void storeMueller (const boost::filesystem::path& outputPrefix, const boost::shared_ptr<GeometryType>& geometry, const boost::shared_ptr<EMSim::DataFiles::Parameters<MethodType> >& parameters, const boost::shared_ptr<EMSim::DataFiles::MuellerFarField<ftype> >& muellerFarField, const FarFieldOption& option, bool writeTxt);
     static void calcAndStore (const boost::filesystem::path& outputPrefix, const DDAParams<ftype>& ddaParams, FieldCalculator<ftype>& calculator, const boost::shared_ptr<EMSim::DataFiles::Parameters<EMSim::DataFiles::DDAParameters> >& parameters, const std::vector<std::complex<ftype> >& res1, const std::vector<std::complex<ftype> >& res2, bool symmetric, const Beam<ftype>& beam, const EMSim::AngleList& angleList, const std::vector<FarFieldOption>& options, bool writeTxt);
   };
 
@@ -85,12 +90,16 @@ namespace DDA {
       if (writeTxt)
         EMSim::JonesCalculus<ftype>::storeTxt (outputPrefix.parent_path () / (outputPrefix.BOOST_FILENAME_STRING + option.outputName () + ".txt"), farField, !option.noPhi ());
     }
-    if (option.storeMueller ()) {
-      boost::shared_ptr<EMSim::DataFiles::MuellerFarField<ftype> > muellerFarField = EMSim::MuellerCalculus<ftype>::computeMuellerFarField (farField);
-      EMSim::MuellerCalculus<ftype>::store (outputPrefix.parent_path () / (outputPrefix.BOOST_FILENAME_STRING + option.outputName () + ".mueller.hdf5"), geometry, parameters, muellerFarField);
-      if (writeTxt)
-        EMSim::MuellerCalculus<ftype>::storeTxt (outputPrefix.parent_path () / (outputPrefix.BOOST_FILENAME_STRING + option.outputName () + ".mueller.txt"), muellerFarField, option.noPhi ());
-    }
+    if (option.storeMueller ())
+      storeMueller (outputPrefix, geometry, parameters, EMSim::MuellerCalculus<ftype>::computeMuellerFarField (farField), option, writeTxt);
+  }
+
+  template <typename ftype>
+  template <typename MethodType, typename GeometryType>
+  void FarFieldCalc<ftype>::storeMueller (const boost::filesystem::path& outputPrefix, const boost::shared_ptr<GeometryType>& geometry, const boost::shared_ptr<EMSim::DataFiles::Parameters<MethodType> >& parameters, const boost::shared_ptr<EMSim::DataFiles::MuellerFarField<ftype> >& muellerFarField, const FarFieldOption& option, bool writeTxt) {
+    EMSim::MuellerCalculus<ftype>::store (outputPrefix.parent_path () / (outputPrefix.BOOST_FILENAME_STRING + option.outputName () + ".mueller.hdf5"), geometry, parameters, muellerFarField);
+    if (writeTxt)
+      EMSim::MuellerCalculus<ftype>::storeTxt (outputPrefix.parent_path () / (outputPrefix.BOOST_FILENAME_STRING + option.outputName () + ".mueller.txt"), muellerFarField, option.noPhi ());
   }
 
   CALL_MACRO_FOR_DEFAULT_FP_TYPES(DISABLE_TEMPLATE_INSTANCE, FarFieldCalc)
@@ -22,6 +22,8 @@
 
 #include "FieldCalculator.hpp"
 
+#include <Math/Vector3.hpp>
+
 namespace DDA {
   template <class T>
   FieldCalculator<T>::FieldCalculator (const DDAParams<ftype>& ddaParams) : ddaParams_ (ddaParams) {}
@@ -29,5 +31,12 @@ namespace DDA {
   template <class T>
   FieldCalculator<T>::~FieldCalculator () {}
 
+  template <class T>
+  void FieldCalculator<T>::calcFields (const std::vector<Math::Vector3<ftype> >& directions, std::vector<Math::Vector3<ctype> >& fields) {
+    fields.resize (directions.size ());
+    for (size_t i = 0; i < directions.size (); i++)
+      fields[i] = calcField (directions[i]);
+  }
+
   CALL_MACRO_FOR_DEFAULT_FP_TYPES (CREATE_TEMPLATE_INSTANCE, FieldCalculator)
 }
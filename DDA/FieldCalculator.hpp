@@ -53,9 +53,16 @@ namespace DDA {
 
     const DDAParams<ftype>& ddaParams () const { return ddaParams_; }
 
+    // Number of directions callers should pass to calcFields () at once, the
+    // GPU implementation allocates its buffers for this many directions
+    static size_t fieldsBatchSize () { return 4096; }
+
     // pvec must remain valid while the FieldCalculator is used
     virtual void setPVec (const std::vector<ctype>& pvec) = 0;
     virtual Math::Vector3<ctype> calcField (Math::Vector3<ftype> n) = 0;
+    // Calculate the fields for several directions at once, the default
+    // implementation calls calcField () for every direction
+    virtual void calcFields (const std::vector<Math::Vector3<ftype> >& directions, std::vector<Math::Vector3<ctype> >& fields);
   };
 
   CALL_MACRO_FOR_DEFAULT_FP_TYPES (DISABLE_TEMPLATE_INSTANCE, FieldCalculator)
@@ -38,6 +38,10 @@ namespace DDA {
   }
   template <typename F> GpuBicgCs<F>::~GpuBicgCs () {}
 
+  template <typename F> boost::shared_ptr<GpuIterativeSolver<F> > GpuBicgCs<F>::createLane () {
+    return boost::shared_ptr<GpuIterativeSolver<ftype> > (new GpuBicgCs<ftype> (this->pool (), this->queues (), g (), this->matVec (), this->maxIterations (), this->accounting ()));
+  }
+
   template <typename F> void GpuBicgCs<F>::init (UNUSED std::ostream& log, UNUSED Core::ProfilingDataPtr prof) {
   }
 
@@ -62,13 +66,17 @@ namespace DDA {
     }
   }
 
-  template <typename F> F GpuBicgCs<F>::iteration (csize_t nr, UNUSED std::ostream& log, UNUSED bool profilingRun, Core::ProfilingDataPtr prof) {
+  template <typename F> F GpuBicgCs<F>::iteration (csize_t nr, UNUSED std::ostream& log, bool profilingRun, Core::ProfilingDataPtr prof) {
+    const DipVector<ftype>& pvec = iterationBegin (nr, profilingRun);
+    this->matVec ().apply (this->queues (), pvec, this->Avecbuffer (), false, prof);
+    return iterationEnd (nr, profilingRun);
+  }
+
+  template <typename F> const DipVector<F>& GpuBicgCs<F>::iterationBegin (csize_t nr, bool profilingRun) {
     const std::vector<cl::CommandQueue>& queues = this->queues ();
     const cl::CommandQueue& queue = queues[0];
 
     DipVector<ftype>& rvec = this->rvec ();
-    DipVector<ftype>& Avecbuffer = this->Avecbuffer ();
-    DipVector<ftype>& xvec = this->xvec ();
     DipVector<ftype>& pvec = this->tmpVec1 ();
 
     (vars + &Vars::ro_new).write (queue, vecProdConj (queues, rvec, rvec));
@@ -81,7 +89,18 @@ namespace DDA {
       (vars + &Vars::beta).write (queue, (vars + &Vars::ro_new).read (queue) / (vars + &Vars::ro_old).read (queue));
       this->linComb.linComb (queues, pvec, vars + &Vars::beta, rvec, pvec);
     }
-    this->matVec ().apply (queues, pvec, Avecbuffer, false, prof);
+    return pvec;
+  }
+
+  template <typename F> F GpuBicgCs<F>::iterationEnd (UNUSED csize_t nr, bool profilingRun) {
+    const std::vector<cl::CommandQueue>& queues = this->queues ();
+    const cl::CommandQueue& queue = queues[0];
+
+    DipVector<ftype>& rvec = this->rvec ();
+    DipVector<ftype>& Avecbuffer = this->Avecbuffer ();
+    DipVector<ftype>& xvec = this->xvec ();
+    DipVector<ftype>& pvec = this->tmpVec1 ();
+
     ctype mu_k = vecProdConj (queues, pvec, Avecbuffer);
     ftype dtmp2 = std::abs (mu_k) / (vars + &Vars::abs_ro_new).read (queue);
     ASSERT (!(dtmp2 < 10e-10) || profilingRun);
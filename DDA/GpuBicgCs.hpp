@@ -31,7 +31,7 @@
 
 namespace DDA {
   template <typename T>
-  class GpuBicgCs : public GpuIterativeSolver<T> {
+  class GpuBicgCs : public GpuIterativeSolver<T>, public GpuSolverLane<T> {
     typedef T ftype;
     typedef std::complex<ftype> ctype;
     typedef FPConst<ftype> Const;
@@ -60,6 +60,10 @@ namespace DDA {
 
     virtual void init (std::ostream& log, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
     virtual ftype iteration (csize_t nr, std::ostream& log, bool profilingRun, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
+
+    virtual boost::shared_ptr<GpuIterativeSolver<ftype> > createLane ();
+    virtual const DipVector<ftype>& iterationBegin (csize_t nr, bool profilingRun);
+    virtual ftype iterationEnd (csize_t nr, bool profilingRun);
   };
 
   CALL_MACRO_FOR_OPENCL_FP_TYPES(DISABLE_TEMPLATE_INSTANCE, GpuBicgCs)
@@ -24,10 +24,15 @@
 
 #include "GpuFieldCalculator.stub.hpp"
 
+#include <Core/CheckedCast.hpp>
+
 #include <Math/Vector3.hpp>
 
 #include <DDA/DDAParams.hpp>
 
+#include <algorithm>
+#include <sstream>
+
 namespace DDA {
   template <class T>
   GpuFieldCalculator<T>::GpuFieldCalculator (const OpenCL::StubPool& pool, OpenCL::VectorAccounting& accounting, const DDAParams<ftype>& ddaParams, Core::ProfilingDataPtr prof)
@@ -40,8 +45,19 @@ namespace DDA {
       queue (cl::CommandQueue (stub->context (), device, 0)),
       workGroups (device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS> () * 8),
       gpuRes (pool, workGroups * 3, accounting, "GpuFieldCalculator.gpuRes"),
-      cpuRes (workGroups * 3)
+      cpuRes (workGroups * 3),
+      options (pool.options ()),
+      workSizeCandidates (OpenCL::WorkSizeTuner::getLocalCandidates (device, workGroups, 32)),
+      directionsGpu (pool, fieldsBatchSize () * 3, accounting, "GpuFieldCalculator.directions"),
+      fieldsGpu (pool, fieldsBatchSize () * 3, accounting, "GpuFieldCalculator.fields"),
+      directionsCpu (fieldsBatchSize () * 3),
+      fieldsCpu (fieldsBatchSize () * 3)
   {
+    {
+      std::stringstream str;
+      str << sizeof (ftype) << "/" << ddaParams.nvCount () << "/" << workGroups;
+      workSizeShape = str.str ();
+    }
     {
       std::vector<uint32_t> pos (ddaParams.vecSize ());
       for (int i = 0; i < 3; i++)
@@ -62,11 +78,34 @@ namespace DDA {
 
   template <class T>
   Math::Vector3<std::complex<T> > GpuFieldCalculator<T>::calcField (Math::Vector3<ftype> n) {
-    stub->calcField<T> (queue, workGroups * 32, 32, valid, positions, pvec, ddaParams ().nvCount (), ddaParams ().vecStride (), gpuRes, ddaParams ().kd (), n.x (), n.y (), n.z ());
+    for (OpenCL::WorkSizeTuning tuning (options, queue, "calcField", workSizeShape, workSizeCandidates); tuning.next (); )
+      stub->calcField<T> (queue, tuning.global (), tuning.local (), valid, positions, pvec, ddaParams ().nvCount (), ddaParams ().vecStride (), gpuRes, ddaParams ().kd (), n.x (), n.y (), n.z ());
     gpuRes.read (queue, cpuRes.data ());
     Math::Vector3<ctype> sum (0, 0, 0);
     for (size_t i = 0; i < workGroups; i++)
       sum += Math::Vector3<ctype> (cpuRes[i], cpuRes[i + workGroups], cpuRes[i + 2 * workGroups]);
+    return getField (n, sum);
+  }
+
+  template <class T>
+  void GpuFieldCalculator<T>::calcFields (const std::vector<Math::Vector3<ftype> >& directions, std::vector<Math::Vector3<ctype> >& fields) {
+    fields.resize (directions.size ());
+    size_t tileSize = Core::checked_cast<size_t> (stub->calcFields_tileSize<T> ());
+    for (size_t start = 0; start < directions.size (); start += fieldsBatchSize ()) {
+      size_t count = std::min (fieldsBatchSize (), directions.size () - start);
+      for (size_t i = 0; i < count; i++)
+        for (int j = 0; j < 3; j++)
+          directionsCpu[i + j * count] = directions[start + i][j];
+      directionsGpu.write (queue, directionsCpu.data (), 0, count * 3);
+      stub->calcFields<T> (queue, cl::NDRange ((count + tileSize - 1) / tileSize * tileSize), cl::NDRange (tileSize), valid, positions, pvec, ddaParams ().nvCount (), ddaParams ().vecStride (), directionsGpu, Core::checked_cast<uint32_t> (count), fieldsGpu, ddaParams ().kd ());
+      fieldsGpu.read (queue, fieldsCpu.data (), 0, count * 3);
+      for (size_t i = 0; i < count; i++)
+        fields[start + i] = getField (directions[start + i], Math::Vector3<ctype> (fieldsCpu[i], fieldsCpu[i + count], fieldsCpu[i + 2 * count]));
+    }
+  }
+
+  template <class T>
+  Math::Vector3<std::complex<T> > GpuFieldCalculator<T>::getField (Math::Vector3<ftype> n, const Math::Vector3<ctype>& sum) const {
     Math::Vector3<ctype> tbuff = sum - n * (n * sum);
     return (ctype (0, std::pow (ddaParams ().waveNum (), FPConst<ftype>::two)) * std::polar<ftype> (1, -ddaParams ().waveNum () * (static_cast<Math::Vector3<ftype> > (ddaParams ().dipoleGeometry ().origin ()) * n))) * tbuff;
   }
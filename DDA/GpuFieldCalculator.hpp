@@ -27,6 +27,7 @@
 
 #include <OpenCL/StubPool.hpp>
 #include <OpenCL/Vector.hpp>
+#include <OpenCL/WorkSizeTuner.hpp>
 
 #include <DDA/FieldCalculator.hpp>
 
@@ -40,6 +41,7 @@ namespace DDA {
     typedef FPConst<ftype> Const;
 
     using FieldCalculator<T>::ddaParams;
+    using FieldCalculator<T>::fieldsBatchSize;
 
     boost::shared_ptr<class GpuFieldCalculatorStub> stub;
     OpenCL::Vector<uint32_t> positions;
@@ -50,6 +52,21 @@ namespace DDA {
     size_t workGroups;
     OpenCL::Vector<ctype> gpuRes;
     std::vector<ctype> cpuRes;
+    OpenCL::Options options;
+    // Only the local size is tuned, the number of work groups is fixed
+    std::vector<OpenCL::WorkSize> workSizeCandidates;
+    std::string workSizeShape;
+
+    // Buffers for calcFields (), the directions are processed in batches of
+    // at most fieldsBatchSize (). The components of the directions and of the
+    // sums are stored one after another.
+    OpenCL::Vector<ftype> directionsGpu;
+    OpenCL::Vector<ctype> fieldsGpu;
+    std::vector<ftype> directionsCpu;
+    std::vector<ctype> fieldsCpu;
+
+    // Calculate the field from the sum over all dipoles
+    Math::Vector3<ctype> getField (Math::Vector3<ftype> n, const Math::Vector3<ctype>& sum) const;
 
   public:
     GpuFieldCalculator (const OpenCL::StubPool& pool, OpenCL::VectorAccounting& accounting, const DDAParams<ftype>& ddaParams, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
@@ -57,6 +74,7 @@ namespace DDA {
 
     virtual void setPVec (const std::vector<ctype>& pvec);
     virtual Math::Vector3<ctype> calcField (Math::Vector3<ftype> n);
+    virtual void calcFields (const std::vector<Math::Vector3<ftype> >& directions, std::vector<Math::Vector3<ctype> >& fields);
   };
 
   CALL_MACRO_FOR_OPENCL_FP_TYPES (DISABLE_TEMPLATE_INSTANCE, GpuFieldCalculator)
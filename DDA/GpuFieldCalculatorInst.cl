@@ -68,6 +68,65 @@ __kernel void CL_CONCAT(calcField__, FLOAT) (__global const uchar* valid, __glob
   barrier (CLK_LOCAL_MEM_FENCE);
 }
 
+// Every work item calculates the sums for one direction, the dipoles are
+// loaded tile by tile into local memory by the whole work group
+GLOBAL_CONSTANT (CL_CONCAT(calcFields_tileSize__, FLOAT), size_t, 64);
+#define TILE_SIZE CL_CONCAT(calcFields_tileSize__, FLOAT)
+
+__kernel void CL_CONCAT(calcFields__, FLOAT) (__global const uchar* valid, __global const uint* positionsX, __global const CFLOAT* pvecX, uint nvCount, uint stride, __global const FLOAT* directionsX, uint count, __global CFLOAT* resX, FLOAT kd) {
+  __global const uint* positionsY = positionsX + stride;
+  __global const uint* positionsZ = positionsY + stride;
+  __global const CFLOAT* pvecY = pvecX + stride;
+  __global const CFLOAT* pvecZ = pvecY + stride;
+
+  __local uint lPositionsX[TILE_SIZE], lPositionsY[TILE_SIZE], lPositionsZ[TILE_SIZE];
+  __local CFLOAT lPvecX[TILE_SIZE], lPvecY[TILE_SIZE], lPvecZ[TILE_SIZE];
+
+  uint dir = get_global_id (0);
+  FLOAT nx = 0, ny = 0, nz = 0;
+  if (dir < count) {
+    nx = directionsX[dir];
+    ny = directionsX[dir + count];
+    nz = directionsX[dir + 2 * count];
+  }
+  CFLOAT sumX = CFLOAT_(new) (0, 0);
+  CFLOAT sumY = CFLOAT_(new) (0, 0);
+  CFLOAT sumZ = CFLOAT_(new) (0, 0);
+  for (uint start = 0; start < nvCount; start += TILE_SIZE) {
+    uint i = start + get_local_id (0);
+    // Invalid dipoles are loaded with a zero polarization
+    barrier (CLK_LOCAL_MEM_FENCE);
+    if (i < nvCount && valid[i]) {
+      lPositionsX[get_local_id (0)] = positionsX[i];
+      lPositionsY[get_local_id (0)] = positionsY[i];
+      lPositionsZ[get_local_id (0)] = positionsZ[i];
+      lPvecX[get_local_id (0)] = pvecX[i];
+      lPvecY[get_local_id (0)] = pvecY[i];
+      lPvecZ[get_local_id (0)] = pvecZ[i];
+    } else {
+      lPositionsX[get_local_id (0)] = lPositionsY[get_local_id (0)] = lPositionsZ[get_local_id (0)] = 0;
+      lPvecX[get_local_id (0)] = lPvecY[get_local_id (0)] = lPvecZ[get_local_id (0)] = CFLOAT_(new) (0, 0);
+    }
+    barrier (CLK_LOCAL_MEM_FENCE);
+
+    uint n = min ((uint) TILE_SIZE, nvCount - start);
+    for (uint j = 0; j < n; j++) {
+      FLOAT arg = -kd * (nx * lPositionsX[j] + ny * lPositionsY[j] + nz * lPositionsZ[j]);
+      CFLOAT a = CFLOAT_(new) (cos (arg), sin (arg));
+      sumX = CFLOAT_(add) (sumX, CFLOAT_(mul) (lPvecX[j], a));
+      sumY = CFLOAT_(add) (sumY, CFLOAT_(mul) (lPvecY[j], a));
+      sumZ = CFLOAT_(add) (sumZ, CFLOAT_(mul) (lPvecZ[j], a));
+    }
+  }
+
+  if (dir < count) {
+    resX[dir] = sumX;
+    resX[dir + count] = sumY;
+    resX[dir + 2 * count] = sumZ;
+  }
+}
+#undef TILE_SIZE
+
 #include <OpenCL/FloatSuffix.h>
 
 // Local Variables: 
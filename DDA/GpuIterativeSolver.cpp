@@ -28,6 +28,8 @@
 
 #include <DDA/Debug.hpp>
 
+#include <boost/lexical_cast.hpp>
+
 //#define INFO(x) Debug::info (#x, this->queues (), x)
 #define INFO(x) do { } while (0)
 
@@ -57,6 +59,7 @@ namespace DDA {
     IterativeSolverBase<ftype> (ddaParams, maxResIncrease, maxIter),
     pool_ (pool),
     queues_ (queues),
+    accounting_ (accounting),
     linComb (pool, queues, accounting, prof),
     matVec_ (matVec),
     Avecbuffer_ (pool, queues, g (), accounting, "Avecbuffer"),
@@ -142,6 +145,77 @@ namespace DDA {
 
     return pvec.read (queues ());
   }
+
+  template <class F> std::vector<boost::shared_ptr<std::vector<std::complex<F> > > > GpuIterativeSolver<F>::getPolVecs (const std::vector<boost::shared_ptr<const CoupleConstants<ftype> > >& ccs, const std::vector<const std::vector<ctype>*>& eincs, ftype eps, std::ostream& log, const std::vector<const std::vector<ctype>*>& starts, Core::ProfilingDataPtr prof) {
+    ASSERT (ccs.size () == eincs.size () && eincs.size () == starts.size ());
+
+    GpuSolverLane<ftype>* self = dynamic_cast<GpuSolverLane<ftype>*> (this);
+    if (!self || eincs.size () < 2)
+      return IterativeSolverBase<ftype>::getPolVecs (ccs, eincs, eps, log, starts, prof);
+
+    std::vector<GpuIterativeSolver<ftype>*> lanes (1, this);
+    std::vector<GpuSolverLane<ftype>*> laneIfs (1, self);
+    for (size_t i = 1; i < eincs.size (); i++) {
+      if (lanes_.size () < i)
+        lanes_.push_back (self->createLane ());
+      GpuSolverLane<ftype>* laneIf = dynamic_cast<GpuSolverLane<ftype>*> (lanes_[i - 1].get ());
+      ASSERT (laneIf);
+      lanes.push_back (lanes_[i - 1].get ());
+      laneIfs.push_back (laneIf);
+    }
+
+    for (size_t i = 0; i < lanes.size (); i++) {
+      setCoupleConstants (ccs[i]);
+      lanes[i]->initSolve (*eincs[i], eps, log, *starts[i], prof);
+    }
+
+    {
+      Core::ProfileHandle _p1 (prof, "itsolv");
+      for (size_t i = 0; i < lanes.size (); i++)
+        lanes[i]->init (log, prof);
+      for (;;) {
+        std::vector<GpuIterativeSolver<ftype>*> active;
+        std::vector<GpuSolverLane<ftype>*> activeIfs;
+        std::vector<size_t> activeIndices;
+        std::vector<boost::shared_ptr<const CoupleConstants<ftype> > > activeCcs;
+        std::vector<const DipVector<ftype>*> args;
+        std::vector<DipVector<ftype>*> results;
+        for (size_t i = 0; i < lanes.size (); i++) {
+          if (lanes[i]->converged ())
+            continue;
+          lanes[i]->checkIteration ();
+          active.push_back (lanes[i]);
+          activeIfs.push_back (laneIfs[i]);
+          activeIndices.push_back (i);
+          activeCcs.push_back (ccs[i]);
+          args.push_back (&laneIfs[i]->iterationBegin (lanes[i]->iterationCount (), false));
+          results.push_back (&lanes[i]->Avecbuffer ());
+        }
+        if (active.empty ())
+          break;
+        {
+          Core::ProfileHandle _p2 (prof, "matvec");
+          matVec ().applyBlock (queues (), activeCcs, args, results, false, prof);
+        }
+        // One progress line for all lanes, each prefixed by its polarization
+        std::string progress;
+        for (size_t i = 0; i < active.size (); i++) {
+          ftype inprodRplus1 = activeIfs[i]->iterationEnd (active[i]->iterationCount (), false);
+          std::string label = "Pol" + boost::lexical_cast<std::string> (activeIndices[i] + 1) + ": ";
+          progress += (i ? " | " : "") + active[i]->updateIteration (inprodRplus1, log, label);
+        }
+        this->showProgress (progress);
+      }
+      Core::OStream::getStderr () << std::endl;
+    }
+
+    std::vector<boost::shared_ptr<std::vector<ctype> > > results;
+    for (size_t i = 0; i < lanes.size (); i++) {
+      setCoupleConstants (ccs[i]);
+      results.push_back (lanes[i]->getResult (log, prof));
+    }
+    return results;
+  }
   
   CALL_MACRO_FOR_OPENCL_FP_TYPES(CREATE_TEMPLATE_INSTANCE, GpuIterativeSolver)
 }
@@ -45,6 +45,7 @@ namespace DDA {
 
     OpenCL::StubPool pool_;
     std::vector<cl::CommandQueue> queues_;
+    OpenCL::VectorAccounting& accounting_;
   protected:
     LinAlg::MultiGpuLinComb<ftype> linComb;
   private:
@@ -59,6 +60,9 @@ namespace DDA {
 
     OpenCL::Vector<ftype> tempVec;
 
+    // Additional solvers used by getPolVecs (), created on demand
+    std::vector<boost::shared_ptr<GpuIterativeSolver<ftype> > > lanes_;
+
   public:
     GpuIterativeSolver (const OpenCL::StubPool& pool, const std::vector<cl::CommandQueue>& queues, const DDAParams<ftype>& ddaParams, GpuMatVec<ftype>& matVec, csize_t maxResIncrease, csize_t maxIter, OpenCL::VectorAccounting& accounting, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
     virtual ~GpuIterativeSolver ();
@@ -68,9 +72,16 @@ namespace DDA {
     GpuMatVec<ftype>& matVec () { return matVec_; }
 
     const std::vector<cl::CommandQueue>& queues () { return queues_; }
+    const OpenCL::StubPool& pool () { return pool_; }
+    OpenCL::VectorAccounting& accounting () { return accounting_; }
 
     virtual void setCoupleConstants (const boost::shared_ptr<const CoupleConstants<ftype> >& cc);
 
+    // Runs the solves in lockstep, the matrix-vector-products of all solves
+    // are done with one GpuMatVec::applyBlock () call. Falls back to solving
+    // one after the other if the solver does not implement GpuSolverLane.
+    virtual std::vector<boost::shared_ptr<std::vector<ctype> > > getPolVecs (const std::vector<boost::shared_ptr<const CoupleConstants<ftype> > >& ccs, const std::vector<const std::vector<ctype>*>& eincs, ftype eps, std::ostream& log, const std::vector<const std::vector<ctype>*>& starts, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
+
   protected:
     DipVector<ftype>& Avecbuffer () { return Avecbuffer_; }
     DipVector<ftype>& rvec () { return rvec_; }
@@ -81,6 +92,22 @@ namespace DDA {
     virtual boost::shared_ptr<std::vector<ctype> > getResult (std::ostream& log, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
   };
 
+  // Interface for solvers which need exactly one matrix-vector-product per
+  // iteration, these can be run in lockstep by GpuIterativeSolver::getPolVecs ()
+  template <typename T>
+  class GpuSolverLane {
+  public:
+    virtual ~GpuSolverLane () {}
+
+    // Returns a new solver of the same type using the same GpuMatVec
+    virtual boost::shared_ptr<GpuIterativeSolver<T> > createLane () = 0;
+    // The part of iteration () before the product, returns the argument of
+    // the product, the result has to go to Avecbuffer ()
+    virtual const DipVector<T>& iterationBegin (csize_t nr, bool profilingRun) = 0;
+    // The part of iteration () after the product, returns the new inprodR
+    virtual T iterationEnd (csize_t nr, bool profilingRun) = 0;
+  };
+
   CALL_MACRO_FOR_OPENCL_FP_TYPES(DISABLE_TEMPLATE_INSTANCE, GpuIterativeSolver)
 }
 
@@ -27,6 +27,8 @@
 #include <DDA/GpuTransposePlan.hpp>
 #include <DDA/Debug.hpp>
 
+#include <sstream>
+
 namespace DDA {
   //#define INFO(x) Debug::info (#x, queues, x)
 #define INFO(x) do { } while (0)
@@ -47,7 +49,7 @@ namespace DDA {
     template <class F> std::vector<size_t> getDMSize (const DDAParams<F>& ddaParams, size_t slicesCount) {
       std::vector<size_t> res (ddaParams.procs () ());
       for (size_t i = 0; i < ddaParams.procs (); i++)
-        res[i] = (ddaParams.cgridY () * ddaParams.cgridZ () * /*ddaParams.cgridX ()*/slicesCount * 6) ();
+        res[i] = (ddaParams.cdMatrixY () * ddaParams.cdMatrixZ () * /*ddaParams.cgridX ()*/slicesCount * 6) ();
       return res;
     }
     template <class F> std::vector<size_t> getXMSize (const DDAParams<F>& ddaParams) {
@@ -77,20 +79,22 @@ namespace DDA {
     }
   }
 
-  template <class F> boost::shared_ptr<GpuMatVec<F> > GpuMatVec<F>::create (const std::vector<cl::CommandQueue>& queues, const DDAParams<ftype>& ddaParams, const boost::const_multi_array_ref<Math::SymMatrix3<ctype>, 3>& Dmatrix, const LinAlg::GpuFFTPlanFactory<ftype>& gpuPlanFactory, const OpenCL::StubPool& pool, OpenCL::VectorAccounting& accounting, Core::ProfilingDataPtr prof) {
-    return boost::shared_ptr<GpuMatVec> (new GpuMatVec (queues, ddaParams, &Dmatrix, NULL, gpuPlanFactory, pool, accounting, prof));
+  template <class F> boost::shared_ptr<GpuMatVec<F> > GpuMatVec<F>::create (const std::vector<cl::CommandQueue>& queues, const DDAParams<ftype>& ddaParams, const boost::const_multi_array_ref<Math::SymMatrix3<ctype>, 3>& Dmatrix, const boost::shared_ptr<const Beam<ftype> >& beam, const LinAlg::GpuFFTPlanFactory<ftype>& gpuPlanFactory, const OpenCL::StubPool& pool, OpenCL::VectorAccounting& accounting, Core::ProfilingDataPtr prof) {
+    return boost::shared_ptr<GpuMatVec> (new GpuMatVec (queues, ddaParams, &Dmatrix, NULL, beam, gpuPlanFactory, pool, accounting, prof));
   }
 
-  template <class F> boost::shared_ptr<GpuMatVec<F> > GpuMatVec<F>::create (const std::vector<cl::CommandQueue>& queues, const DDAParams<ftype>& ddaParams, const OpenCL::MultiGpuVector<ctype>& dMatrixGpu, const LinAlg::GpuFFTPlanFactory<ftype>& gpuPlanFactory, const OpenCL::StubPool& pool, OpenCL::VectorAccounting& accounting, Core::ProfilingDataPtr prof) {
-    return boost::shared_ptr<GpuMatVec> (new GpuMatVec (queues, ddaParams, NULL, &dMatrixGpu, gpuPlanFactory, pool, accounting, prof));
+  template <class F> boost::shared_ptr<GpuMatVec<F> > GpuMatVec<F>::create (const std::vector<cl::CommandQueue>& queues, const DDAParams<ftype>& ddaParams, const OpenCL::MultiGpuVector<ctype>& dMatrixGpu, const boost::shared_ptr<const Beam<ftype> >& beam, const LinAlg::GpuFFTPlanFactory<ftype>& gpuPlanFactory, const OpenCL::StubPool& pool, OpenCL::VectorAccounting& accounting, Core::ProfilingDataPtr prof) {
+    return boost::shared_ptr<GpuMatVec> (new GpuMatVec (queues, ddaParams, NULL, &dMatrixGpu, beam, gpuPlanFactory, pool, accounting, prof));
   }
 
-  template <class F> GpuMatVec<F>::GpuMatVec (const std::vector<cl::CommandQueue>& queues, const DDAParams<ftype>& ddaParams, const boost::const_multi_array_ref<Math::SymMatrix3<ctype>, 3>* dMatrixCpu, const OpenCL::MultiGpuVector<ctype>* dMatrixGpu, const LinAlg::GpuFFTPlanFactory<ftype>& gpuPlanFactory, const OpenCL::StubPool& pool, OpenCL::VectorAccounting& accounting, Core::ProfilingDataPtr prof) :
+  template <class F> GpuMatVec<F>::GpuMatVec (const std::vector<cl::CommandQueue>& queues, const DDAParams<ftype>& ddaParams, const boost::const_multi_array_ref<Math::SymMatrix3<ctype>, 3>* dMatrixCpu, const OpenCL::MultiGpuVector<ctype>* dMatrixGpu, const boost::shared_ptr<const Beam<ftype> >& beam, const LinAlg::GpuFFTPlanFactory<ftype>& gpuPlanFactory, const OpenCL::StubPool& pool, OpenCL::VectorAccounting& accounting, Core::ProfilingDataPtr prof) :
     memoryAccessSize (32 * sizeof (F)),
     slicesCount (memoryAccessSize / sizeof (ctype) * 4),
     ddaParams_ (ddaParams),
+    beam_ (beam),
     pool (pool),
     options (pool.options ()),
+    accounting (accounting),
     materialsGpu (pool, queues, getNvCount (g ()), accounting, "materials"),
     positionsGpu (pool, queues, g (), accounting, "positions"),
     ccSqrtGpuSet (false),
@@ -100,9 +104,10 @@ namespace DDA {
     dMatrixGpu (dMatrixCpu ? *dMatrixGpuInst : *dMatrixGpu),
     xMatrixGpu (pool, queues, getXMSize (g ()), accounting, "xMatrix"),
     xMatrixGpu2 (pool, queues, g ().procs () > 1 ? getXMBSize (g ()) : getZero (g ()), accounting, "xMatrix2"),
-    xMatrixCpu (g ().procs () > 1 ? (g ().cgridX () * g ().dipoleGeometry ().box ().y () * g ().dipoleGeometry ().box ().z () * 3) () : 0),
-    slicesGpu (pool, queues, getSlicesSize (g (), slicesCount), accounting, "slices"),
-    slicesTrGpu (pool, queues, getSlicesSize (g (), slicesCount), accounting, "slicesTr"),
+    slicesGpu (new OpenCL::MultiGpuVector<ctype> (pool, queues, getSlicesSize (g (), slicesCount), accounting, "slices")),
+    slicesTrGpu (new OpenCL::MultiGpuVector<ctype> (pool, queues, getSlicesSize (g (), slicesCount), accounting, "slicesTr")),
+    blockCapacity (1),
+    staging (NULL),
     planX (g ().procs () ()),
     planZFull (g ().procs () ()),
     planZLast (g ().procs () ()),
@@ -113,6 +118,7 @@ namespace DDA {
     //Core::OStream::getStderr () << "D-C, slicesCount = " << slicesCount << ", gridX = " << g ().gridX () << std::endl;
 
     ASSERT ((slicesCount & (slicesCount - 1)) == 0); // slicesCount must be POT
+    ASSERT (beam || !g ().anyCirculant ());
     for (size_t i = 0; i < g ().procs (); i++)
       materialsGpu[i].write (queues[i], g ().dipoleGeometry ().materialIndices ().data () +  g ().localVec0 (i), 0, g ().localNvCount (i));
     {
@@ -122,104 +128,293 @@ namespace DDA {
           pos[j + i * g ().vecStride ()] = g ().dipoleGeometry ().getGridCoordinates (j)[i];
       positionsGpu.write (queues, pos);
     }
+    if (g ().procs () > 1) {
+      size_t stagingSize = 0;
+      for (size_t i = 0; i < g ().procs (); i++) {
+        transferQueues.push_back (cl::CommandQueue (pool.context (), queues[i].getInfo<CL_QUEUE_DEVICE> ()));
+        stagingOffset.push_back (stagingSize);
+        stagingSize += g ().localBlocksSize (i);
+      }
+      stagingBuffer = cl::Buffer (pool.context (), CL_MEM_ALLOC_HOST_PTR, stagingSize * sizeof (ctype));
+      staging = (ctype*) transferQueues[0].enqueueMapBuffer (stagingBuffer, true, CL_MAP_READ | CL_MAP_WRITE, 0, stagingSize * sizeof (ctype));
+      stagingWritten.resize ((g ().procs () * g ().procs () * 3) ());
+    }
     for (size_t i = 0; i < g ().procs (); i++) {
-      planX[i] = gpuPlanFactory.createPlan (pool, queues[i].getInfo<CL_QUEUE_DEVICE> (), g ().cgridX (), g ().dipoleGeometry ().box ().y () * g ().localCBoxZ (i) * 3, true, false, true, true, accounting);
-      // times = 3, stride = gridY * gridZ
-      // Do the entire slice at once. This means a useless FFT on
-      // the padding is done, but there are fewer calls to the FFT plan
-      planZFull[i] = gpuPlanFactory.createPlan (pool, queues[i].getInfo<CL_QUEUE_DEVICE> (), g ().cgridZ (), g ().cgridY () * 3 * slicesCount, true, false, true, true, accounting);
-      planZLast[i] = gpuPlanFactory.createPlan (pool, queues[i].getInfo<CL_QUEUE_DEVICE> (), g ().cgridZ (), g ().cgridY () * 3 * (g ().localGridX (i) % slicesCount), true, false, true, true, accounting);
+      workSizeCandidates.push_back (OpenCL::WorkSizeTuner::getCandidates (queues[i].getInfo<CL_QUEUE_DEVICE> ()));
+      std::stringstream str;
+      str << sizeof (ftype) << "/" << g ().localNvCount (i) << "/" << g ().localVecStride (i) << "/" << g ().dipoleGeometry ().box ().y () << "/" << g ().localBoxZ (i);
+      workSizeShape.push_back (str.str ());
+    }
+    for (size_t i = 0; i < g ().procs (); i++) {
+      // With several GPUs the components are transformed one by one, see apply ()
+      planX[i] = gpuPlanFactory.createPlan (pool, queues[i].getInfo<CL_QUEUE_DEVICE> (), g ().cgridX (), g ().dipoleGeometry ().box ().y () * g ().localCBoxZ (i) * (g ().procs () > 1 ? 1 : 3), true, false, true, true, accounting);
+      // Do the entire slice at once. Only the boxY columns containing
+      // dipoles are stored in slicesGpu, the padding is all zero and
+      // needs no FFT
+      planZFull[i] = gpuPlanFactory.createPlan (pool, queues[i].getInfo<CL_QUEUE_DEVICE> (), g ().cgridZ (), g ().dipoleGeometry ().box ().y () * 3 * slicesCount, true, false, true, true, accounting);
+      planZLast[i] = gpuPlanFactory.createPlan (pool, queues[i].getInfo<CL_QUEUE_DEVICE> (), g ().cgridZ (), g ().dipoleGeometry ().box ().y () * 3 * (g ().localGridX (i) % slicesCount), true, false, true, true, accounting);
       // times = 1
       planYFull[i] = gpuPlanFactory.createPlan (pool, queues[i].getInfo<CL_QUEUE_DEVICE> (), g ().cgridY (), g ().cgridZ () * 3 * slicesCount, true, false, true, true, accounting);
       planYLast[i] = gpuPlanFactory.createPlan (pool, queues[i].getInfo<CL_QUEUE_DEVICE> (), g ().cgridY (), g ().cgridZ () * 3 * (g ().localGridX (i) % slicesCount), true, false, true, true, accounting);
     }
   }
-  template <class F> GpuMatVec<F>::~GpuMatVec () {}
+  template <class F> GpuMatVec<F>::~GpuMatVec () {
+    if (staging) {
+      for (size_t i = 0; i < transferQueues.size (); i++)
+        transferQueues[i].finish ();
+      transferQueues[0].enqueueUnmapMemObject (stagingBuffer, staging);
+      transferQueues[0].finish ();
+    }
+  }
+
+  template <class F> csize_t GpuMatVec<F>::blockComponentOffset (size_t proc, size_t block, size_t comp) const {
+    size_t begin = g ().localBlockOffset (proc, block);
+    size_t blockSize = g ().localBlockOffset (proc, block + 1) - begin;
+    ASSERT (blockSize % 3 == 0);
+    return begin + blockSize / 3 * comp;
+  }
+
+  template <class F> void GpuMatVec<F>::exchangeBlocks (size_t comp, bool forward, const std::vector<cl::Event>& ready, std::vector<std::vector<cl::Event> >& written) {
+    const DDAParams<ftype>& g = this->ddaParams ();
+
+    // GPU=>CPU
+    std::vector<cl::Event> read ((g.procs () * g.procs ()) ());
+    for (size_t i = 0; i < g.procs (); i++) {
+      for (size_t j = 0; j < g.procs (); j++) {
+        if (j == i)
+          continue;
+        // Block i->j, forward it contains the part of the Z slab of i going
+        // to the X slab of j, backward the other way round
+        csize_t size = (forward ? g.localCGridX (j) * g.localCBoxZ (i) : g.localCGridX (i) * g.localCBoxZ (j)) * g.dipoleGeometry ().box ().y ();
+        csize_t offset = blockComponentOffset (i, j, comp);
+        size_t region = (i * g.procs () () + j) * 3 + comp;
+        std::vector<cl::Event> wait (1, ready[i]);
+        if (stagingWritten[region] ())
+          wait.push_back (stagingWritten[region]);
+        transferQueues[i].enqueueReadBuffer (xMatrixGpu2[i].getData (), false, (offset * sizeof (ctype)) (), (size * sizeof (ctype)) (), staging + stagingOffset[i] + offset (), &wait, &read[i * g.procs () () + j]);
+      }
+      transferQueues[i].flush ();
+    }
+
+    // CPU=>GPU, block i->j replaces block j->i which has been read before on
+    // the same queue
+    for (size_t j = 0; j < g.procs (); j++) {
+      for (size_t i = 0; i < g.procs (); i++) {
+        if (j == i)
+          continue;
+        csize_t size = (forward ? g.localCGridX (j) * g.localCBoxZ (i) : g.localCGridX (i) * g.localCBoxZ (j)) * g.dipoleGeometry ().box ().y ();
+        size_t region = (i * g.procs () () + j) * 3 + comp;
+        // Also wait for ready[j]: the previous vector of applyBlock () might
+        // still be copied out of the block on GPU j
+        std::vector<cl::Event> wait (1, read[i * g.procs () () + j]);
+        wait.push_back (ready[j]);
+        transferQueues[j].enqueueWriteBuffer (xMatrixGpu2[j].getDataWritable (), false, (blockComponentOffset (j, i, comp) * sizeof (ctype)) (), (size * sizeof (ctype)) (), staging + stagingOffset[i] + blockComponentOffset (i, j, comp) (), &wait, &stagingWritten[region]);
+        written[j].push_back (stagingWritten[region]);
+      }
+      transferQueues[j].flush ();
+    }
+  }
 
   template <class F> void GpuMatVec<F>::setCoupleConstants (const std::vector<cl::CommandQueue>& queues, const boost::shared_ptr<const CoupleConstants<ftype> >& cc) {
     ccSqrtGpu.writeCopies (queues, (const ctype*) cc->cc_sqrt ().data ());
     ccSqrtGpuSet = true;
   }
 
-  template <class F> void GpuMatVec<F>::apply (const std::vector<cl::CommandQueue>& queues, const DipVector<ftype>& argGpu, DipVector<ftype>& resultGpu, bool conj, Core::ProfilingDataPtr prof) {
-    const DDAParams<ftype>& g = this->ddaParams ();
-
-    ASSERT (ccSqrtGpuSet);
+  template <class F> OpenCL::MultiGpuVector<std::complex<F> >& GpuMatVec<F>::xMatrix (size_t index) {
+    if (index == 0)
+      return xMatrixGpu;
+    ASSERT (index - 1 < blockXMatrixGpu.size ());
+    return *blockXMatrixGpu[index - 1];
+  }
 
-    if (options.enableSync ()) {
-      Core::ProfileHandle _p (prof, "i");
-      for (size_t i = 0; i < g.procs (); i++)
-        queues[i].finish ();
+  template <class F> void GpuMatVec<F>::reserveBlock (const std::vector<cl::CommandQueue>& queues, size_t count) {
+    while (blockXMatrixGpu.size () + 1 < count)
+      blockXMatrixGpu.push_back (boost::shared_ptr<OpenCL::MultiGpuVector<ctype> > (new OpenCL::MultiGpuVector<ctype> (pool, queues, getXMSize (g ()), accounting, "xMatrixBlock")));
+    while (blockCcSqrtGpu.size () < count) {
+      blockCcSqrtGpu.push_back (boost::shared_ptr<OpenCL::MultiGpuVector<ctype> > (new OpenCL::MultiGpuVector<ctype> (pool, queues, g ().dipoleGeometry ().materials ().size () * 3, accounting, "ccSqrtBlock")));
+      blockCcs.push_back (boost::shared_ptr<const CoupleConstants<ftype> > ());
+    }
+    if (count > blockCapacity) {
+      // Free the old buffers first
+      slicesGpu.reset ();
+      slicesTrGpu.reset ();
+      slicesGpu.reset (new OpenCL::MultiGpuVector<ctype> (pool, queues, getSlicesSize (g (), slicesCount * count), accounting, "slices"));
+      slicesTrGpu.reset (new OpenCL::MultiGpuVector<ctype> (pool, queues, getSlicesSize (g (), slicesCount * count), accounting, "slicesTr"));
+      blockCapacity = count;
     }
+  }
 
-    {
-      Core::ProfileHandle _p (prof, "initXMatrix");
-      xMatrixGpu.setToZero (queues);
-      for (size_t i = 0; i < g.procs (); i++)
-        stub->initXMatrix<ftype> (queues[i], OpenCL::getDefaultWorkItemCount (queues[i]), xMatrixGpu[i], materialsGpu[i], positionsGpu[i], ccSqrtGpu[i], argGpu[i], conj, g.localCZ0 (i), g.gridX (), g.dipoleGeometry ().box ().y (), g.localCBoxZ (i), g.localCNvCount (i), g.localCVecStride (i));
-      if (options.enableSync ()) {
-        //Core::ProfileHandle _p (prof, "s");
-        for (size_t i = 0; i < g.procs (); i++)
-          queues[i].finish ();
+  template <class F> void GpuMatVec<F>::apply (const std::vector<cl::CommandQueue>& queues, const DipVector<ftype>& argGpu, DipVector<ftype>& resultGpu, bool conj, Core::ProfilingDataPtr prof) {
+    ASSERT (ccSqrtGpuSet);
+    applyImpl (queues, std::vector<const OpenCL::MultiGpuVector<ctype>*> (1, &ccSqrtGpu), std::vector<const DipVector<ftype>*> (1, &argGpu), std::vector<DipVector<ftype>*> (1, &resultGpu), conj, prof);
+  }
+
+  template <class F> void GpuMatVec<F>::applyBlock (const std::vector<cl::CommandQueue>& queues, const std::vector<boost::shared_ptr<const CoupleConstants<ftype> > >& ccs, const std::vector<const DipVector<ftype>*>& args, const std::vector<DipVector<ftype>*>& results, bool conj, Core::ProfilingDataPtr prof) {
+    ASSERT (ccs.size () == args.size () && args.size () == results.size ());
+    reserveBlock (queues, args.size ());
+    std::vector<const OpenCL::MultiGpuVector<ctype>*> ccSqrts;
+    for (size_t r = 0; r < ccs.size (); r++) {
+      if (blockCcs[r] != ccs[r]) {
+        blockCcSqrtGpu[r]->writeCopies (queues, (const ctype*) ccs[r]->cc_sqrt ().data ());
+        blockCcs[r] = ccs[r];
       }
+      ccSqrts.push_back (blockCcSqrtGpu[r].get ());
     }
+    applyImpl (queues, ccSqrts, args, results, conj, prof);
+  }
 
-    //for (size_t j = 0; j < g.dipoleGeometry ().box ().z () * 3; j++) {
-    { size_t j = 0;
-      Core::ProfileHandle _p1 (prof, "fft" /* "planXf" */);
-      for (size_t i = 0; i < g.procs (); i++)
-        planX[i]->fftInPlace (queues[i], xMatrixGpu[i], g.dipoleGeometry ().box ().y () * g.cgridX () * j);
-    }
+  template <class F> void GpuMatVec<F>::fftX (const std::vector<cl::CommandQueue>& queues, OpenCL::MultiGpuVector<ctype>& xMatrix, bool forward, Core::ProfilingDataPtr prof) {
+    const DDAParams<ftype>& g = this->ddaParams ();
 
-    if (g.procs () != 1) {
+    if (g.procs () == 1) {
+      Core::ProfileHandle _p1 (prof, "fft" /* "planXf" / "planXb" */);
+      if (forward)
+        planX[0]->fftInPlace (queues[0], xMatrix[0], 0);
+      else
+        planX[0]->ifftInPlace (queues[0], xMatrix[0], 0);
+    } else if (forward) {
       if (options.enableSync ()) {
         Core::ProfileHandle _p (prof, "trans1_s");
         for (size_t i = 0; i < g.procs (); i++)
           queues[i].finish ();
       }
       Core::ProfileHandle _p (prof, "trans1");
-      for (size_t i = 0; i < g.procs (); i++)
-        for (size_t j = 0; j < g.procs (); j++)
-          GpuTransposePlan<ctype>
-            (pool,
-             GpuTransposeDimension (g.localCGridX (j), 1, 1),
-             GpuTransposeDimension (g.dipoleGeometry ().box ().y (), g.cgridX (), g.localCGridX (j)),
-             GpuTransposeDimension (g.localCBoxZ (i), g.cgridX () * g.dipoleGeometry ().box ().y (), g.localCGridX (j) * g.dipoleGeometry ().box ().y ()),
-             GpuTransposeDimension (3, g.cgridX () * g.dipoleGeometry ().box ().y () * g.localCBoxZ (i), g.localCGridX (j) * g.dipoleGeometry ().box ().y () * g.localCBoxZ (i))
-             ).transpose (queues[i],
-                          xMatrixGpu[i], g.localX0 (j),
-                          xMatrixGpu2[i], g.localCBlockOffset (i, j), prof);
-      for (size_t i = 0; i < g.procs (); i++) {
-        for (size_t j = i + 1; j < g.procs (); j++) {
-          // Exchange (i, j) and (j, i)
-          csize_t size1 = g.localCBlockOffset (i, j + 1) - g.localCBlockOffset (i, j); // block i->j
-          csize_t size2 = g.localCBlockOffset (j, i + 1) - g.localCBlockOffset (j, i); // block j->i
-          ASSERT (size1 == size2);
-
-          // GPU=>CPU
-          ASSERT (size1 + size2 <= xMatrixCpu.size ());
-          xMatrixGpu2[i].read (queues[i], xMatrixCpu.data (), g.localCBlockOffset (i, j), size1);
-          xMatrixGpu2[j].read (queues[j], xMatrixCpu.data () + size1 (), g.localCBlockOffset (j, i), size2);
-
-          // CPU=>GPU
-          xMatrixGpu2[i].write (queues[i], xMatrixCpu.data () + size1 (), g.localCBlockOffset (i, j), size2);
-          xMatrixGpu2[j].write (queues[j], xMatrixCpu.data (), g.localCBlockOffset (j, i), size1);
+      // Every component is transposed into the blocks as soon as its X-FFT
+      // is done, the exchange of the blocks between the GPUs then overlaps
+      // with the X-FFT of the next component
+      std::vector<cl::Event> ready (g.procs () ());
+      std::vector<std::vector<cl::Event> > written (g.procs () ());
+      for (size_t comp = 0; comp < 3; comp++) {
+        for (size_t i = 0; i < g.procs (); i++) {
+          csize_t offset = g.cgridX () * g.dipoleGeometry ().box ().y () * g.localCBoxZ (i) * comp;
+          {
+            Core::ProfileHandle _p1 (prof, "fft" /* "planXf" */);
+            planX[i]->fftInPlace (queues[i], xMatrix[i], offset);
+          }
+          for (size_t j = 0; j < g.procs (); j++)
+            GpuTransposePlan<ctype>
+              (pool,
+               GpuTransposeDimension (g.localCGridX (j), 1, 1),
+               GpuTransposeDimension (g.dipoleGeometry ().box ().y (), g.cgridX (), g.localCGridX (j)),
+               GpuTransposeDimension (g.localCBoxZ (i), g.cgridX () * g.dipoleGeometry ().box ().y (), g.localCGridX (j) * g.dipoleGeometry ().box ().y ())
+               ).transpose (queues[i],
+                            xMatrix[i], offset + g.localX0 (j),
+                            xMatrixGpu2[i], blockComponentOffset (i, j, comp), prof);
+          queues[i].enqueueMarker (&ready[i]);
+          queues[i].flush ();
         }
+        exchangeBlocks (comp, true, ready, written);
       }
-      for (size_t i = 0; i < g.procs (); i++)
+      for (size_t i = 0; i < g.procs (); i++) {
+        queues[i].enqueueWaitForEvents (written[i]);
         for (size_t j = 0; j < g.procs (); j++)
           for (size_t comp = 0; comp < 3; comp++)
             queues[i].enqueueCopyBuffer (xMatrixGpu2[i].getData (), 
-                                         xMatrixGpu[i].getDataWritable (),
-                                         ((g.localCBlockOffset (i, j) + g.localCGridX (i) * g.dipoleGeometry ().box ().y () * g.localCBoxZ (j) * comp) * sizeof (ctype)) (),
+                                         xMatrix[i].getDataWritable (),
+                                         (blockComponentOffset (i, j, comp) * sizeof (ctype)) (),
                                          ((g.localCGridX (i) * g.dipoleGeometry ().box ().y () * (g.localCZ0 (j) + g.dipoleGeometry ().box ().z () * comp)) * sizeof (ctype)) (),
                                          ((g.localCGridX (i) * g.dipoleGeometry ().box ().y () * g.localCBoxZ (j)) * sizeof (ctype)) ());
+      }
       if (options.enableSync ()) {
+        for (size_t i = 0; i < g.procs (); i++) {
+          transferQueues[i].finish ();
+          queues[i].finish ();
+        }
+      }
+    } else {
+      if (options.enableSync ()) {
+        Core::ProfileHandle _p (prof, "trans2_s");
         for (size_t i = 0; i < g.procs (); i++)
           queues[i].finish ();
       }
+      Core::ProfileHandle _p (prof, "trans2");
+      std::vector<cl::Event> ready (g.procs () ());
+      for (size_t i = 0; i < g.procs (); i++) {
+        for (size_t j = 0; j < g.procs (); j++)
+          for (size_t comp = 0; comp < 3; comp++)
+            queues[i].enqueueCopyBuffer (xMatrix[i].getData (), 
+                                         xMatrixGpu2[i].getDataWritable (),
+                                         ((g.localCGridX (i) * g.dipoleGeometry ().box ().y () * (g.localCZ0 (j) + g.dipoleGeometry ().box ().z () * comp)) * sizeof (ctype)) (),
+                                         (blockComponentOffset (i, j, comp) * sizeof (ctype)) (),
+                                         ((g.localCGridX (i) * g.dipoleGeometry ().box ().y () * g.localCBoxZ (j)) * sizeof (ctype)) ());
+        queues[i].enqueueMarker (&ready[i]);
+        queues[i].flush ();
+      }
+      // The transfers of the next component overlap with the transpose and
+      // the inverse X-FFT of the current one
+      std::vector<std::vector<std::vector<cl::Event> > > written (3, std::vector<std::vector<cl::Event> > (g.procs () ()));
+      for (size_t comp = 0; comp < 3; comp++)
+        exchangeBlocks (comp, false, ready, written[comp]);
+      for (size_t comp = 0; comp < 3; comp++) {
+        for (size_t i = 0; i < g.procs (); i++) {
+          csize_t offset = g.cgridX () * g.dipoleGeometry ().box ().y () * g.localCBoxZ (i) * comp;
+          queues[i].enqueueWaitForEvents (written[comp][i]);
+          for (size_t j = 0; j < g.procs (); j++)
+            GpuTransposePlan<ctype>
+              (pool,
+               GpuTransposeDimension (g.localCGridX (j), 1, 1),
+               GpuTransposeDimension (g.dipoleGeometry ().box ().y (), g.localCGridX (j), g.cgridX ()),
+               GpuTransposeDimension (g.localCBoxZ (i), g.localCGridX (j) * g.dipoleGeometry ().box ().y (), g.cgridX () * g.dipoleGeometry ().box ().y ())
+               ).transpose (queues[i],
+                            xMatrixGpu2[i], blockComponentOffset (i, j, comp),
+                            xMatrix[i], offset + g.localX0 (j), prof);
+          {
+            Core::ProfileHandle _p1 (prof, "fft" /* "planXb" */);
+            planX[i]->ifftInPlace (queues[i], xMatrix[i], offset);
+          }
+          queues[i].flush ();
+        }
+      }
+      if (options.enableSync ()) {
+        for (size_t i = 0; i < g.procs (); i++) {
+          transferQueues[i].finish ();
+          queues[i].finish ();
+        }
+      }
     }
+  }
+
+  template <class F> void GpuMatVec<F>::applyImpl (const std::vector<cl::CommandQueue>& queues, const std::vector<const OpenCL::MultiGpuVector<ctype>*>& ccSqrts, const std::vector<const DipVector<ftype>*>& args, const std::vector<DipVector<ftype>*>& results, bool conj, Core::ProfilingDataPtr prof) {
+    const DDAParams<ftype>& g = this->ddaParams ();
+
+    size_t count = args.size ();
+    ASSERT (count >= 1 && count <= blockCapacity && count <= blockXMatrixGpu.size () + 1);
+    ASSERT (ccSqrts.size () == count && results.size () == count);
 
+    // The dipoles are multiplied by exp (i * coordinate * phase) before the
+    // convolution and the result by the inverse afterwards, see
+    // MatVecCpu::circulantFactors
+    Math::Vector3<ftype> circulantPhase (0, 0, 0);
+    for (int axis = 0; axis < 3; axis++)
+      if (g.circulant (axis))
+        circulantPhase[axis] = g.circulantPhaseShift (*beam_, axis) / static_cast<ftype> (g.gridSize ()[axis] ());
+
+    if (options.enableSync ()) {
+      Core::ProfileHandle _p (prof, "i");
+      for (size_t i = 0; i < g.procs (); i++)
+        queues[i].finish ();
+    }
+
+    {
+      Core::ProfileHandle _p (prof, "initXMatrix");
+      for (size_t r = 0; r < count; r++) {
+        xMatrix (r).setToZero (queues);
+        for (size_t i = 0; i < g.procs (); i++)
+          for (OpenCL::WorkSizeTuning tuning (options, queues[i], "initXMatrix", workSizeShape[i], workSizeCandidates[i]); tuning.next (); )
+            stub->initXMatrix<ftype> (queues[i], tuning.global (), tuning.local (), xMatrix (r)[i], materialsGpu[i], positionsGpu[i], (*ccSqrts[r])[i], (*args[r])[i], conj, g.anyCirculant (), circulantPhase.x (), circulantPhase.y (), circulantPhase.z (), g.localCZ0 (i), g.gridX (), g.dipoleGeometry ().box ().y (), g.localCBoxZ (i), g.localCNvCount (i), g.localCVecStride (i));
+      }
+      if (options.enableSync ()) {
+        //Core::ProfileHandle _p (prof, "s");
+        for (size_t i = 0; i < g.procs (); i++)
+          queues[i].finish ();
+      }
+    }
+
+    for (size_t r = 0; r < count; r++)
+      fftX (queues, xMatrix (r), true, prof);
+
+    OpenCL::MultiGpuVector<ctype>& slicesGpu = *this->slicesGpu;
+    OpenCL::MultiGpuVector<ctype>& slicesTrGpu = *this->slicesTrGpu;
     std::vector<size_t> slicesCountCur (g.procs () ());
     {
       Core::ProfileHandle _p_ (prof, "il");
@@ -228,200 +423,168 @@ namespace DDA {
         for (size_t i = 0; i < g.procs (); i++)
           slicesCountCur[i] = (si >= g.localCGridX (i) ? cuint32_t (0) : (si + slicesCount > g.localCGridX (i) ? g.localCGridX (i) () - si : slicesCount)) ();
         if (dMatrixCpu) {
-          for (size_t i = 0; i < g.procs (); i++)
-            (*dMatrixGpuInst)[i].write (queues[i], (const ctype*) dMatrixCpu->data () + g.gridY () * g.gridZ () * (si + g.localX0 (i)) * 6, 0, g.gridY () * g.gridZ () * slicesCountCur[i] * 6);
+          size_t dmSliceSize = g.dMatrixY () * g.dMatrixZ () * 6;
+          for (size_t i = 0; i < g.procs (); i++) {
+            if (g.dMatrixSymmetric ()) {
+              // Copy the (reflected) slices one by one
+              for (size_t j = 0; j < slicesCountCur[i]; j++) {
+                bool reflected;
+                uint32_t x = g.dMatrixIndex ((uint32_t) (si + j + g.localX0 (i)), g.gridX (), reflected);
+                (*dMatrixGpuInst)[i].write (queues[i], (const ctype*) dMatrixCpu->data () + dmSliceSize * x, dmSliceSize * j, dmSliceSize);
+              }
+            } else {
+              (*dMatrixGpuInst)[i].write (queues[i], (const ctype*) dMatrixCpu->data () + dmSliceSize * (si + g.localX0 (i)), 0, dmSliceSize * slicesCountCur[i]);
+            }
+          }
         }
         slicesGpu.setToZero (queues);
-        {
-          Core::ProfileHandle _p (prof, "tr");
-          Core::ProfileHandle _p2 (prof, "1");
-          for (size_t i = 0; i < g.procs (); i++)
-            GpuTransposePlan<ctype>
-              (pool,
-               GpuTransposeDimension (slicesCountCur[i], 1, g.cgridZ () * g.cgridY () * 3),
-               GpuTransposeDimension (g.dipoleGeometry ().box ().y (), g.localCGridX (i), g.cgridZ ()),
-               GpuTransposeDimension (g.dipoleGeometry ().box ().z (), g.localCGridX (i) * g.dipoleGeometry ().box ().y (), 1),
-               GpuTransposeDimension (3, g.localCGridX (i) * g.dipoleGeometry ().box ().y () * g.dipoleGeometry ().box ().z (), g.cgridZ () * g.cgridY ())
-               ).transpose (queues[i],
-                            xMatrixGpu[i], si,
-                            slicesGpu[i], 0, prof);
-        }
-        //for (size_t i = si; i < g.cgridX () && i < si + slicesCount; i++) {
-        //csize_t offset = g.cgridZ () * g.cgridY () * 3 * (i - si);
-        for (size_t i = 0; i < g.procs (); i++) {
-          //for (size_t j = 0; j < slicesCountCur[i]; j++) {
-          //for (size_t comp = 0; comp < 3; comp++) {
-          { size_t comp = 0;
+        for (size_t r = 0; r < count; r++) {
+          csize_t offset = sliceBlockSize () * r;
+          {
+            Core::ProfileHandle _p (prof, "tr");
+            Core::ProfileHandle _p2 (prof, "1");
+            for (size_t i = 0; i < g.procs (); i++)
+              GpuTransposePlan<ctype>
+                (pool,
+                 GpuTransposeDimension (slicesCountCur[i], 1, g.cgridZ () * g.dipoleGeometry ().box ().y () * 3),
+                 GpuTransposeDimension (g.dipoleGeometry ().box ().y (), g.localCGridX (i), g.cgridZ ()),
+                 GpuTransposeDimension (g.dipoleGeometry ().box ().z (), g.localCGridX (i) * g.dipoleGeometry ().box ().y (), 1),
+                 GpuTransposeDimension (3, g.localCGridX (i) * g.dipoleGeometry ().box ().y () * g.dipoleGeometry ().box ().z (), g.cgridZ () * g.dipoleGeometry ().box ().y ())
+                 ).transpose (queues[i],
+                              xMatrix (r)[i], si,
+                              slicesGpu[i], offset, prof);
+          }
+          for (size_t i = 0; i < g.procs (); i++) {
             Core::ProfileHandle _p1 (prof, "fft" /* "planZf" */);
             if (slicesCountCur[i] == slicesCount) {
-              planZFull[i]->fftInPlace (queues[i], slicesGpu[i], comp * g.gridY () * g.gridZ ());
+              planZFull[i]->fftInPlace (queues[i], slicesGpu[i], offset);
             } else {
               ASSERT (slicesCountCur[i] == g.localGridX (i) % slicesCount);
-              planZLast[i]->fftInPlace (queues[i], slicesGpu[i], comp * g.gridY () * g.gridZ ());
+              planZLast[i]->fftInPlace (queues[i], slicesGpu[i], offset);
             }
           }
-          //}
-        }
-        {
-          Core::ProfileHandle _p (prof, "tr");
-          Core::ProfileHandle _p2 (prof, "2");
-          for (size_t i = 0; i < g.procs (); i++)
-            GpuTransposePlan<ctype>
-              (pool,
-               GpuTransposeDimension (g.cgridZ (), 1, g.cgridY ()),
-               GpuTransposeDimension (g.cgridY (), g.cgridZ (), 1),
-               GpuTransposeDimension (3, g.cgridZ () * g.cgridY (), g.cgridZ () * g.cgridY ()),
-               GpuTransposeDimension (slicesCountCur[i], g.cgridZ () * g.cgridY () * 3, g.cgridZ () * g.cgridY () * 3)
-               ).transpose (queues[i],
-                            slicesGpu[i], 0/*offset*/,
-                            slicesTrGpu[i], 0, prof);
         }
-        for (size_t i = 0; i < g.procs (); i++) {
-          //for (size_t j = 0; j < slicesCountCur[i]; j++) {
+        slicesTrGpu.setToZero (queues);
+        for (size_t r = 0; r < count; r++) {
+          csize_t offset = sliceBlockSize () * r;
           {
+            Core::ProfileHandle _p (prof, "tr");
+            Core::ProfileHandle _p2 (prof, "2");
+            for (size_t i = 0; i < g.procs (); i++)
+              GpuTransposePlan<ctype>
+                (pool,
+                 GpuTransposeDimension (g.cgridZ (), 1, g.cgridY ()),
+                 GpuTransposeDimension (g.dipoleGeometry ().box ().y (), g.cgridZ (), 1),
+                 GpuTransposeDimension (3, g.cgridZ () * g.dipoleGeometry ().box ().y (), g.cgridZ () * g.cgridY ()),
+                 GpuTransposeDimension (slicesCountCur[i], g.cgridZ () * g.dipoleGeometry ().box ().y () * 3, g.cgridZ () * g.cgridY () * 3)
+                 ).transpose (queues[i],
+                              slicesGpu[i], offset,
+                              slicesTrGpu[i], offset, prof);
+          }
+          for (size_t i = 0; i < g.procs (); i++) {
             Core::ProfileHandle _p1 (prof, "fft" /* "planYf" */);
             if (slicesCountCur[i] == slicesCount) {
-              planYFull[i]->fftInPlace (queues[i], slicesTrGpu[i], 0);
+              planYFull[i]->fftInPlace (queues[i], slicesTrGpu[i], offset);
             } else {
               ASSERT (slicesCountCur[i] == g.localGridX (i) % slicesCount);
-              planYLast[i]->fftInPlace (queues[i], slicesTrGpu[i], 0);
+              planYLast[i]->fftInPlace (queues[i], slicesTrGpu[i], offset);
             }
           }
-          //}
         }
         {
           Core::ProfileHandle _p1 (prof, "iil");
-          for (size_t i = 0; i < g.procs (); i++)
-            stub->innerLoop<ftype> (queues[i],
-                                    cl::NDRange (g.gridY (), g.gridZ (), slicesCountCur [i]),
-                                    slicesTrGpu[i], dMatrixGpu[i],
-                                    dMatrixCpu ? 0 : cuint32_t (si /*i*/),
-                                    g.gridX (), g.gridY (), g.gridZ ());
+          for (size_t i = 0; i < g.procs (); i++) {
+            if (count == 1)
+              stub->innerLoop<ftype> (queues[i],
+                                      cl::NDRange (g.gridY (), g.gridZ (), slicesCountCur [i]),
+                                      slicesTrGpu[i], dMatrixGpu[i],
+                                      cuint32_t (si + g.localX0 (i)),
+                                      dMatrixCpu ? 0 : cuint32_t (si /*i*/),
+                                      g.dMatrixSymmetric (),
+                                      !dMatrixCpu && g.dMatrixSymmetric (),
+                                      g.gridX (), g.gridY (), g.gridZ (),
+                                      g.dMatrixY (), g.dMatrixZ ());
+            else
+              // Every DMatrix element is loaded once for all vectors
+              stub->innerLoopBlock<ftype> (queues[i],
+                                           cl::NDRange (g.gridY (), g.gridZ (), slicesCountCur [i]),
+                                           slicesTrGpu[i],
+                                           Core::checked_cast<uint32_t> (count), Core::checked_cast<uint32_t> (sliceBlockSize ()),
+                                           dMatrixGpu[i],
+                                           cuint32_t (si + g.localX0 (i)),
+                                           dMatrixCpu ? 0 : cuint32_t (si /*i*/),
+                                           g.dMatrixSymmetric (),
+                                           !dMatrixCpu && g.dMatrixSymmetric (),
+                                           g.gridX (), g.gridY (), g.gridZ (),
+                                           g.dMatrixY (), g.dMatrixZ ());
+          }
           if (options.enableSync ()) {
             //Core::ProfileHandle _p (prof, "s");
             for (size_t i = 0; i < g.procs (); i++)
               queues[i].finish ();
           }
         }
-        for (size_t i = 0; i < g.procs (); i++) {
-          //for (size_t j = 0; j < slicesCountCur[i]; j++) {
-          {
+        for (size_t r = 0; r < count; r++) {
+          csize_t offset = sliceBlockSize () * r;
+          for (size_t i = 0; i < g.procs (); i++) {
             Core::ProfileHandle _p1 (prof, "fft" /* "planYb" */);
             if (slicesCountCur[i] == slicesCount) {
-              planYFull[i]->ifftInPlace (queues[i], slicesTrGpu[i], 0);
+              planYFull[i]->ifftInPlace (queues[i], slicesTrGpu[i], offset);
             } else {
               ASSERT (slicesCountCur[i] == g.localGridX (i) % slicesCount);
-              planYLast[i]->ifftInPlace (queues[i], slicesTrGpu[i], 0);
+              planYLast[i]->ifftInPlace (queues[i], slicesTrGpu[i], offset);
             }
           }
-          //}
-        }
-        {
-          Core::ProfileHandle _p (prof, "tr");
-          Core::ProfileHandle _p2 (prof, "3");
-          for (size_t i = 0; i < g.procs (); i++)
-            GpuTransposePlan<ctype>
-              (pool,
-               GpuTransposeDimension (g.cgridZ (), g.cgridY (), 1),
-               GpuTransposeDimension (g.cgridY (), 1, g.cgridZ ()),
-               GpuTransposeDimension (3, g.cgridZ () * g.cgridY (), g.cgridZ () * g.cgridY ()),
-               GpuTransposeDimension (slicesCountCur[i], g.cgridZ () * g.cgridY () * 3, g.cgridZ () * g.cgridY () * 3)
-               ).transpose (queues[i],
-                            slicesTrGpu[i], 0,
-                            slicesGpu[i], 0 /*offset*/, prof);
-        }
-        for (size_t i = 0; i < g.procs (); i++) {
-          //for (size_t j = 0; j < slicesCountCur[i]; j++) {
-          //for (size_t comp = 0; comp < 3; comp++) {
-          { // size_t comp = 0;
+          {
+            Core::ProfileHandle _p (prof, "tr");
+            Core::ProfileHandle _p2 (prof, "3");
+            for (size_t i = 0; i < g.procs (); i++)
+              GpuTransposePlan<ctype>
+                (pool,
+                 GpuTransposeDimension (g.cgridZ (), g.cgridY (), 1),
+                 GpuTransposeDimension (g.dipoleGeometry ().box ().y (), 1, g.cgridZ ()),
+                 GpuTransposeDimension (3, g.cgridZ () * g.cgridY (), g.cgridZ () * g.dipoleGeometry ().box ().y ()),
+                 GpuTransposeDimension (slicesCountCur[i], g.cgridZ () * g.cgridY () * 3, g.cgridZ () * g.dipoleGeometry ().box ().y () * 3)
+                 ).transpose (queues[i],
+                              slicesTrGpu[i], offset,
+                              slicesGpu[i], offset, prof);
+          }
+          for (size_t i = 0; i < g.procs (); i++) {
             Core::ProfileHandle _p1 (prof, "fft" /* "planZb" */);
             if (slicesCountCur[i] == slicesCount) {
-              planZFull[i]->ifftInPlace (queues[i], slicesGpu[i], 0);
+              planZFull[i]->ifftInPlace (queues[i], slicesGpu[i], offset);
             } else {
               ASSERT (slicesCountCur[i] == g.localGridX (i) % slicesCount);
-              planZLast[i]->ifftInPlace (queues[i], slicesGpu[i], 0);
+              planZLast[i]->ifftInPlace (queues[i], slicesGpu[i], offset);
             }
           }
-          //}
-        }
-        //}
-        {
-          Core::ProfileHandle _p (prof, "tr");
-          Core::ProfileHandle _p2 (prof, "4");
-          for (size_t i = 0; i < g.procs (); i++)
-            GpuTransposePlan<ctype>
-              (pool,
-               GpuTransposeDimension (slicesCountCur[i], g.cgridZ () * g.cgridY () * 3, 1),
-               GpuTransposeDimension (g.dipoleGeometry ().box ().y (), g.cgridZ (), g.localCGridX (i)),
-               GpuTransposeDimension (g.dipoleGeometry ().box ().z (), 1, g.localCGridX (i) * g.dipoleGeometry ().box ().y ()),
-               GpuTransposeDimension (3, g.cgridZ () * g.cgridY (), g.localCGridX (i) * g.dipoleGeometry ().box ().y () * g.dipoleGeometry ().box ().z ())
-               ).transpose (queues[i],
-                            slicesGpu[i], 0,
-                            xMatrixGpu[i], si, prof);
-        }
-      }
-    }
-
-    if (g.procs () != 1) {
-      if (options.enableSync ()) {
-        Core::ProfileHandle _p (prof, "trans2_s");
-        for (size_t i = 0; i < g.procs (); i++)
-          queues[i].finish ();
-      }
-      Core::ProfileHandle _p (prof, "trans2");
-      for (size_t i = 0; i < g.procs (); i++)
-        for (size_t j = 0; j < g.procs (); j++)
-          for (size_t comp = 0; comp < 3; comp++)
-            queues[i].enqueueCopyBuffer (xMatrixGpu[i].getData (), 
-                                         xMatrixGpu2[i].getDataWritable (),
-                                         ((g.localCGridX (i) * g.dipoleGeometry ().box ().y () * (g.localCZ0 (j) + g.dipoleGeometry ().box ().z () * comp)) * sizeof (ctype)) (),
-                                         ((g.localCBlockOffset (i, j) + g.localCGridX (i) * g.dipoleGeometry ().box ().y () * g.localCBoxZ (j) * comp) * sizeof (ctype)) (),
-                                         ((g.localCGridX (i) * g.dipoleGeometry ().box ().y () * g.localCBoxZ (j)) * sizeof (ctype)) ());
-      for (size_t i = 0; i < g.procs (); i++) {
-        for (size_t j = i + 1; j < g.procs (); j++) {
-          // Exchange (i, j) and (j, i)
-          csize_t size1 = g.localCBlockOffset (i, j + 1) - g.localCBlockOffset (i, j); // block i->j
-          csize_t size2 = g.localCBlockOffset (j, i + 1) - g.localCBlockOffset (j, i); // block j->i
-          ASSERT (size1 == size2);
-
-          // GPU=>CPU
-          ASSERT (size1 + size2 <= xMatrixCpu.size ());
-          xMatrixGpu2[i].read (queues[i], xMatrixCpu.data (), g.localCBlockOffset (i, j), size1);
-          xMatrixGpu2[j].read (queues[j], xMatrixCpu.data () + size1 (), g.localCBlockOffset (j, i), size2);
-
-          // CPU=>GPU
-          xMatrixGpu2[i].write (queues[i], xMatrixCpu.data () + size1 (), g.localCBlockOffset (i, j), size2);
-          xMatrixGpu2[j].write (queues[j], xMatrixCpu.data (), g.localCBlockOffset (j, i), size1);
+          {
+            Core::ProfileHandle _p (prof, "tr");
+            Core::ProfileHandle _p2 (prof, "4");
+            for (size_t i = 0; i < g.procs (); i++)
+              GpuTransposePlan<ctype>
+                (pool,
+                 GpuTransposeDimension (slicesCountCur[i], g.cgridZ () * g.dipoleGeometry ().box ().y () * 3, 1),
+                 GpuTransposeDimension (g.dipoleGeometry ().box ().y (), g.cgridZ (), g.localCGridX (i)),
+                 GpuTransposeDimension (g.dipoleGeometry ().box ().z (), 1, g.localCGridX (i) * g.dipoleGeometry ().box ().y ()),
+                 GpuTransposeDimension (3, g.cgridZ () * g.dipoleGeometry ().box ().y (), g.localCGridX (i) * g.dipoleGeometry ().box ().y () * g.dipoleGeometry ().box ().z ())
+                 ).transpose (queues[i],
+                              slicesGpu[i], offset,
+                              xMatrix (r)[i], si, prof);
+          }
         }
       }
-      for (size_t i = 0; i < g.procs (); i++)
-        for (size_t j = 0; j < g.procs (); j++)
-          GpuTransposePlan<ctype>
-            (pool,
-             GpuTransposeDimension (g.localCGridX (j), 1, 1),
-             GpuTransposeDimension (g.dipoleGeometry ().box ().y (), g.localCGridX (j), g.cgridX ()),
-             GpuTransposeDimension (g.localCBoxZ (i), g.localCGridX (j) * g.dipoleGeometry ().box ().y (), g.cgridX () * g.dipoleGeometry ().box ().y ()),
-             GpuTransposeDimension (3, g.localCGridX (j) * g.dipoleGeometry ().box ().y () * g.localCBoxZ (i), g.cgridX () * g.dipoleGeometry ().box ().y () * g.localCBoxZ (i))
-             ).transpose (queues[i],
-                          xMatrixGpu2[i], g.localCBlockOffset (i, j),
-                          xMatrixGpu[i], g.localX0 (j), prof);
-      if (options.enableSync ()) {
-        for (size_t i = 0; i < g.procs (); i++)
-          queues[i].finish ();
-      }
     }
 
-    //for (size_t j = 0; j < g.dipoleGeometry ().box ().z () * 3; j++) {
-    { size_t j = 0;
-      Core::ProfileHandle _p1 (prof, "fft" /* "planXb" */);
-      for (size_t i = 0; i < g.procs (); i++)
-        planX[i]->ifftInPlace (queues[i], xMatrixGpu[i], g.dipoleGeometry ().box ().y () * g.cgridX () * j);
-    }
+    for (size_t r = 0; r < count; r++)
+      fftX (queues, xMatrix (r), false, prof);
 
     {
       Core::ProfileHandle _p1 (prof, "createResVec");
-      for (size_t i = 0; i < g.procs (); i++)
-        stub->createResVec<ftype> (queues[i], OpenCL::getDefaultWorkItemCount (queues[i]), xMatrixGpu[i], materialsGpu[i], positionsGpu[i], ccSqrtGpu[i], argGpu[i], resultGpu[i], conj, g.localCZ0 (i), g.gridX (), g.dipoleGeometry ().box ().y (), g.localCBoxZ (i), g.localCNvCount (i), g.localCVecStride (i));
+      for (size_t r = 0; r < count; r++)
+        for (size_t i = 0; i < g.procs (); i++)
+          for (OpenCL::WorkSizeTuning tuning (options, queues[i], "createResVec", workSizeShape[i], workSizeCandidates[i]); tuning.next (); )
+            stub->createResVec<ftype> (queues[i], tuning.global (), tuning.local (), xMatrix (r)[i], materialsGpu[i], positionsGpu[i], (*ccSqrts[r])[i], (*args[r])[i], (*results[r])[i], conj, g.anyCirculant (), circulantPhase.x (), circulantPhase.y (), circulantPhase.z (), g.localCZ0 (i), g.gridX (), g.dipoleGeometry ().box ().y (), g.localCBoxZ (i), g.localCNvCount (i), g.localCVecStride (i));
       if (options.enableSync ()) {
         //Core::ProfileHandle _p (prof, "s");
         for (size_t i = 0; i < g.procs (); i++)
@@ -30,6 +30,7 @@
 #include <OpenCL/Bindings.hpp>
 #include <OpenCL/Vector.hpp>
 #include <OpenCL/StubPool.hpp>
+#include <OpenCL/WorkSizeTuner.hpp>
 
 #include <LinAlg/GpuFFTPlan.hpp>
 
@@ -49,10 +50,14 @@ namespace DDA {
     const size_t slicesCount;
 
     const DDAParams<ftype>& ddaParams_;
+    // Only used for the phase shifts along circulant axes (see
+    // DDAParams::circulant ())
+    boost::shared_ptr<const Beam<ftype> > beam_;
 
     OpenCL::StubPool pool;
     boost::shared_ptr<class GpuMatVecStub> stub;
     OpenCL::Options options;
+    OpenCL::VectorAccounting& accounting;
 
     // Data structures and FFT plans for matVec
     OpenCL::MultiGpuVector<uint8_t> materialsGpu;
@@ -65,11 +70,35 @@ namespace DDA {
     const OpenCL::MultiGpuVector<ctype>& dMatrixGpu;
     OpenCL::MultiGpuVector<ctype> xMatrixGpu;
     OpenCL::MultiGpuVector<ctype> xMatrixGpu2;
-    std::vector<ctype> xMatrixCpu;
-    OpenCL::MultiGpuVector<ctype> slicesGpu;
-    OpenCL::MultiGpuVector<ctype> slicesTrGpu;
-
-    // times = Xmatrix.sizeZ () * 3, stride = Xmatrix.sizeY * Xmatrix.sizeX
+    // The slices of blockCapacity vectors, sliceBlockSize () values apart
+    boost::scoped_ptr<OpenCL::MultiGpuVector<ctype> > slicesGpu;
+    boost::scoped_ptr<OpenCL::MultiGpuVector<ctype> > slicesTrGpu;
+    size_t blockCapacity;
+
+    // xMatrix for every vector of applyBlock () except the first one (which
+    // uses xMatrixGpu) and ccSqrt for every vector of applyBlock () together
+    // with the couple constants currently stored in it
+    std::vector<boost::shared_ptr<OpenCL::MultiGpuVector<ctype> > > blockXMatrixGpu;
+    std::vector<boost::shared_ptr<OpenCL::MultiGpuVector<ctype> > > blockCcSqrtGpu;
+    std::vector<boost::shared_ptr<const CoupleConstants<ftype> > > blockCcs;
+
+    // Used for exchanging the blocks in xMatrixGpu2 between the GPUs: one
+    // additional queue per GPU for the transfers and a pinned host buffer
+    // which stays mapped as long as the object exists
+    std::vector<cl::CommandQueue> transferQueues;
+    cl::Buffer stagingBuffer;
+    ctype* staging;
+    std::vector<size_t> stagingOffset;
+    // The last transfer out of each component of each block in the staging
+    // buffer, the block must not be overwritten before it is finished
+    std::vector<cl::Event> stagingWritten;
+
+    // Work sizes tried for initXMatrix and createResVec on each GPU and the
+    // problem shape used for looking up the result of the tuning
+    std::vector<std::vector<OpenCL::WorkSize> > workSizeCandidates;
+    std::vector<std::string> workSizeShape;
+
+    // times = Xmatrix.sizeZ () * 3 (only Xmatrix.sizeZ () if procs > 1), stride = Xmatrix.sizeY * Xmatrix.sizeX
     std::vector<boost::shared_ptr<LinAlg::GpuFFTPlan<ftype> > > planX;
     //// times = 3, stride = gridY * gridZ
     // times = 1
@@ -79,11 +108,29 @@ namespace DDA {
     std::vector<boost::shared_ptr<LinAlg::GpuFFTPlan<ftype> > > planYFull;
     std::vector<boost::shared_ptr<LinAlg::GpuFFTPlan<ftype> > > planYLast;
 
-    GpuMatVec (const std::vector<cl::CommandQueue>& queues, const DDAParams<ftype>& ddaParams, const boost::const_multi_array_ref<Math::SymMatrix3<ctype>, 3>* dMatrixCpu, const OpenCL::MultiGpuVector<ctype>* dMatrixGpu, const LinAlg::GpuFFTPlanFactory<ftype>& gpuPlanFactory, const OpenCL::StubPool& pool, OpenCL::VectorAccounting& accounting, Core::ProfilingDataPtr prof);
+    // Offset of component comp of block (proc, block) in xMatrixGpu2. The
+    // components are stored at a fixed distance to each other so that blocks
+    // of different size can be exchanged one component at a time.
+    csize_t blockComponentOffset (size_t proc, size_t block, size_t comp) const;
+    // Start copying component comp of all blocks in xMatrixGpu2 to the other
+    // GPUs. The transfers from GPU i start after ready[i], the events of the
+    // transfers to GPU i are appended to written[i].
+    void exchangeBlocks (size_t comp, bool forward, const std::vector<cl::Event>& ready, std::vector<std::vector<cl::Event> >& written);
+
+    csize_t sliceBlockSize () const { return g ().cgridZ () * g ().cgridY () * 3 * slicesCount; }
+    OpenCL::MultiGpuVector<ctype>& xMatrix (size_t index);
+    void reserveBlock (const std::vector<cl::CommandQueue>& queues, size_t count);
+    // The X-FFT of xMatrix, with several GPUs together with the transpose
+    // between the Z slabs and the X slabs
+    void fftX (const std::vector<cl::CommandQueue>& queues, OpenCL::MultiGpuVector<ctype>& xMatrix, bool forward, Core::ProfilingDataPtr prof);
+    // Vector i uses the couple constants in ccSqrts[i]
+    void applyImpl (const std::vector<cl::CommandQueue>& queues, const std::vector<const OpenCL::MultiGpuVector<ctype>*>& ccSqrts, const std::vector<const DipVector<ftype>*>& args, const std::vector<DipVector<ftype>*>& results, bool conj, Core::ProfilingDataPtr prof);
+
+    GpuMatVec (const std::vector<cl::CommandQueue>& queues, const DDAParams<ftype>& ddaParams, const boost::const_multi_array_ref<Math::SymMatrix3<ctype>, 3>* dMatrixCpu, const OpenCL::MultiGpuVector<ctype>* dMatrixGpu, const boost::shared_ptr<const Beam<ftype> >& beam, const LinAlg::GpuFFTPlanFactory<ftype>& gpuPlanFactory, const OpenCL::StubPool& pool, OpenCL::VectorAccounting& accounting, Core::ProfilingDataPtr prof);
 
   public:
-    static boost::shared_ptr<GpuMatVec> create (const std::vector<cl::CommandQueue>& queues, const DDAParams<ftype>& ddaParams, const boost::const_multi_array_ref<Math::SymMatrix3<ctype>, 3>& Dmatrix, const LinAlg::GpuFFTPlanFactory<ftype>& gpuPlanFactory, const OpenCL::StubPool& pool, OpenCL::VectorAccounting& accounting, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
-    static boost::shared_ptr<GpuMatVec> create (const std::vector<cl::CommandQueue>& queues, const DDAParams<ftype>& ddaParams, const OpenCL::MultiGpuVector<ctype>& dMatrixGpu, const LinAlg::GpuFFTPlanFactory<ftype>& gpuPlanFactory, const OpenCL::StubPool& pool, OpenCL::VectorAccounting& accounting, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
+    static boost::shared_ptr<GpuMatVec> create (const std::vector<cl::CommandQueue>& queues, const DDAParams<ftype>& ddaParams, const boost::const_multi_array_ref<Math::SymMatrix3<ctype>, 3>& Dmatrix, const boost::shared_ptr<const Beam<ftype> >& beam, const LinAlg::GpuFFTPlanFactory<ftype>& gpuPlanFactory, const OpenCL::StubPool& pool, OpenCL::VectorAccounting& accounting, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
+    static boost::shared_ptr<GpuMatVec> create (const std::vector<cl::CommandQueue>& queues, const DDAParams<ftype>& ddaParams, const OpenCL::MultiGpuVector<ctype>& dMatrixGpu, const boost::shared_ptr<const Beam<ftype> >& beam, const LinAlg::GpuFFTPlanFactory<ftype>& gpuPlanFactory, const OpenCL::StubPool& pool, OpenCL::VectorAccounting& accounting, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
     ~GpuMatVec ();
 
     void setCoupleConstants (const std::vector<cl::CommandQueue>& queues, const boost::shared_ptr<const CoupleConstants<ftype> >& cc);
@@ -97,6 +144,11 @@ namespace DDA {
     const OpenCL::MultiGpuVector<ctype>& ccSqrtGpuG () const { return ccSqrtGpu; }
   
     void apply (const std::vector<cl::CommandQueue>& queue, const DipVector<ftype>& arg, DipVector<ftype>& result, bool conj, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
+    // Like MatVec::applyBlock (): calculates results[i] = A_i * args[i]
+    // where A_i is the matrix for the couple constants ccs[i]. All vectors
+    // are processed in one pass over the DMatrix, this needs memory for the
+    // FFT data of every vector.
+    void applyBlock (const std::vector<cl::CommandQueue>& queues, const std::vector<boost::shared_ptr<const CoupleConstants<ftype> > >& ccs, const std::vector<const DipVector<ftype>*>& args, const std::vector<DipVector<ftype>*>& results, bool conj, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
   };
 
   CALL_MACRO_FOR_OPENCL_FP_TYPES(DISABLE_TEMPLATE_INSTANCE, GpuMatVec)
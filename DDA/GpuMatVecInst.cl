@@ -28,11 +28,19 @@ inline CFLOAT CL_CONCAT(maybeConj__, FLOAT) (CFLOAT f, bool conj) {
   return conj ? CFLOAT_(conj) (f) : f;
 }
 
+// exp (i * (phaseX * x + phaseY * y + phaseZ * z)), see
+// MatVecCpu::circulantFactors
+inline CFLOAT CL_CONCAT(circulantFactor__, FLOAT) (uint x, uint y, uint z, FLOAT phaseX, FLOAT phaseY, FLOAT phaseZ) {
+  FLOAT arg = phaseX * x + phaseY * y + phaseZ * z;
+  return CFLOAT_(new) (cos (arg), sin (arg));
+}
+
 __kernel void CL_CONCAT(initXMatrix__, FLOAT) (__global CFLOAT* xMatrixX,
                            __global const uchar* materials,
                            __global const uint* positionsX,
                            __constant CFLOAT* ccSqrt,
                            __global const CFLOAT* arg, uchar conj,
+                           uchar circulant, FLOAT phaseX, FLOAT phaseY, FLOAT phaseZ,
                            uint z0, uint gridX, uint boxY, uint boxZ,
                            uint nvCount, uint stride) {
   __global const uint* positionsY = positionsX + stride;
@@ -53,6 +61,12 @@ __kernel void CL_CONCAT(initXMatrix__, FLOAT) (__global CFLOAT* xMatrixX,
     CFLOAT resX = CFLOAT_(mul) (argX, matX);
     CFLOAT resY = CFLOAT_(mul) (argY, matY);
     CFLOAT resZ = CFLOAT_(mul) (argZ, matZ);
+    if (circulant) {
+      CFLOAT factor = CL_CONCAT(circulantFactor__, FLOAT) (x, y, z, phaseX, phaseY, phaseZ);
+      resX = CFLOAT_(mul) (resX, factor);
+      resY = CFLOAT_(mul) (resY, factor);
+      resZ = CFLOAT_(mul) (resZ, factor);
+    }
     uint index = x + gridX * (y + boxY * (z - z0));
     xMatrixX[index] = resX; // these memory accesses not coalesced
     xMatrixY[index] = resY;
@@ -66,6 +80,7 @@ __kernel void CL_CONCAT(createResVec__, FLOAT) (__global const CFLOAT* xMatrixX,
                             __constant CFLOAT* ccSqrt,
                             __global const CFLOAT* arg,
                             __global CFLOAT* res, uchar conj,
+                            uchar circulant, FLOAT phaseX, FLOAT phaseY, FLOAT phaseZ,
                             uint z0, uint gridX, uint boxY, uint boxZ,
                             uint nvCount, uint stride) {
   __global const uint* positionsY = positionsX + stride;
@@ -86,6 +101,12 @@ __kernel void CL_CONCAT(createResVec__, FLOAT) (__global const CFLOAT* xMatrixX,
     CFLOAT xvalX = xMatrixX[index]; // these memory accesses not coalesced
     CFLOAT xvalY = xMatrixY[index];
     CFLOAT xvalZ = xMatrixZ[index];
+    if (circulant) {
+      CFLOAT factor = CFLOAT_(conj) (CL_CONCAT(circulantFactor__, FLOAT) (x, y, z, phaseX, phaseY, phaseZ));
+      xvalX = CFLOAT_(mul) (xvalX, factor);
+      xvalY = CFLOAT_(mul) (xvalY, factor);
+      xvalZ = CFLOAT_(mul) (xvalZ, factor);
+    }
     CFLOAT matX = ccSqrt[material * 3];
     CFLOAT matY = ccSqrt[material * 3 + 1];
     CFLOAT matZ = ccSqrt[material * 3 + 2];
@@ -101,23 +122,69 @@ __kernel void CL_CONCAT(createResVec__, FLOAT) (__global const CFLOAT* xMatrixX,
   }
 }
 
-__kernel void CL_CONCAT(innerLoop__, FLOAT) (__global CFLOAT* slicesTr, __global const CFLOAT* dMatrix, uint si, uint gridX, uint gridY, uint gridZ) {
-  uint j = get_global_id (0);
-  uint k = get_global_id (1);
-  uint slice = get_global_id (2);
+// Loads the DMatrix element for the point (j, k) of slice slice into dm.
+// x0 is the X coordinate of the first slice. If mirrorX is set dMatrix
+// contains all stored slices of the DMatrix and the slice is chosen by the X
+// coordinate, otherwise dMatrix contains the slices starting at dmSlice0 (the
+// reflection for a symmetric DMatrix has already been done).
+inline void CL_CONCAT(loadDMatrix__, FLOAT) (CFLOAT* dm, __global const CFLOAT* dMatrix, uint j, uint k, uint slice, uint x0, uint dmSlice0, uchar symmetric, uchar mirrorX, uint gridX, uint gridY, uint gridZ, uint dmY, uint dmZ) {
+  // See DDAParams::dMatrixIndex ()
+  uint x = x0 + slice;
+  uint xr = x, jr = j, kr = k;
+  bool xRefl = false, jRefl = false, kRefl = false;
+  if (symmetric) {
+    if (x > gridX / 2) { xr = gridX - x; xRefl = true; }
+    if (j > gridY / 2) { jr = gridY - j; jRefl = true; }
+    if (k > gridZ / 2) { kr = gridZ - k; kRefl = true; }
+  }
+  uint dmSlice = mirrorX ? xr : dmSlice0 + slice;
 
+  for (int comp = 0; comp < 6; comp++)
+    dm[comp] = dMatrix[comp + 6 * (jr + dmY * (kr + dmZ * dmSlice))];
+  if (xRefl != jRefl)
+    dm[1] = CFLOAT_(mul_real) (dm[1], -1);
+  if (xRefl != kRefl)
+    dm[2] = CFLOAT_(mul_real) (dm[2], -1);
+  if (jRefl != kRefl)
+    dm[4] = CFLOAT_(mul_real) (dm[4], -1);
+}
+
+// x = dm * x, the components of x are compStride values apart
+inline void CL_CONCAT(multiplyDMatrix__, FLOAT) (__global CFLOAT* x, const CFLOAT* dm, uint compStride) {
   CFLOAT xv[3];
   for (int comp = 0; comp < 3; comp++)
-    xv[comp] = slicesTr[j + gridY * (k + gridZ * (comp + 3 * slice))];
-  CFLOAT dm[6];
-  for (int comp = 0; comp < 6; comp++)
-    dm[comp] = dMatrix[comp + 6 * (j + gridY * (k + gridZ * (si + slice)))];
+    xv[comp] = x[comp * compStride];
   CFLOAT yv[3];
   yv[0] = CFLOAT_(add) (CFLOAT_(add) (CFLOAT_(mul) (dm[0], xv[0]), CFLOAT_(mul) (dm[1], xv[1])), CFLOAT_(mul) (dm[2], xv[2]));
   yv[1] = CFLOAT_(add) (CFLOAT_(add) (CFLOAT_(mul) (dm[1], xv[0]), CFLOAT_(mul) (dm[3], xv[1])), CFLOAT_(mul) (dm[4], xv[2]));
   yv[2] = CFLOAT_(add) (CFLOAT_(add) (CFLOAT_(mul) (dm[2], xv[0]), CFLOAT_(mul) (dm[4], xv[1])), CFLOAT_(mul) (dm[5], xv[2]));
   for (int comp = 0; comp < 3; comp++)
-    slicesTr[j + gridY * (k + gridZ * (comp + 3 * slice))] = yv[comp];
+    x[comp * compStride] = yv[comp];
+}
+
+// For the parameters see loadDMatrix
+__kernel void CL_CONCAT(innerLoop__, FLOAT) (__global CFLOAT* slicesTr, __global const CFLOAT* dMatrix, uint x0, uint dmSlice0, uchar symmetric, uchar mirrorX, uint gridX, uint gridY, uint gridZ, uint dmY, uint dmZ) {
+  uint j = get_global_id (0);
+  uint k = get_global_id (1);
+  uint slice = get_global_id (2);
+
+  CFLOAT dm[6];
+  CL_CONCAT(loadDMatrix__, FLOAT) (dm, dMatrix, j, k, slice, x0, dmSlice0, symmetric, mirrorX, gridX, gridY, gridZ, dmY, dmZ);
+  CL_CONCAT(multiplyDMatrix__, FLOAT) (slicesTr + j + gridY * (k + gridZ * 3 * slice), dm, gridY * gridZ);
+}
+
+// Like innerLoop, but for vectorCount vectors whose slices are vectorStride
+// values apart in slicesTr. Every DMatrix element is loaded only once for
+// all vectors.
+__kernel void CL_CONCAT(innerLoopBlock__, FLOAT) (__global CFLOAT* slicesTr, uint vectorCount, uint vectorStride, __global const CFLOAT* dMatrix, uint x0, uint dmSlice0, uchar symmetric, uchar mirrorX, uint gridX, uint gridY, uint gridZ, uint dmY, uint dmZ) {
+  uint j = get_global_id (0);
+  uint k = get_global_id (1);
+  uint slice = get_global_id (2);
+
+  CFLOAT dm[6];
+  CL_CONCAT(loadDMatrix__, FLOAT) (dm, dMatrix, j, k, slice, x0, dmSlice0, symmetric, mirrorX, gridX, gridY, gridZ, dmY, dmZ);
+  for (uint vec = 0; vec < vectorCount; vec++)
+    CL_CONCAT(multiplyDMatrix__, FLOAT) (slicesTr + vec * vectorStride + j + gridY * (k + gridZ * 3 * slice), dm, gridY * gridZ);
 }
 
 #include <OpenCL/FloatSuffix.h>
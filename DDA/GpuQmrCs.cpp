@@ -53,6 +53,10 @@ namespace DDA {
   }
   template <typename F> GpuQmrCs<F>::~GpuQmrCs () {}
 
+  template <typename F> boost::shared_ptr<GpuIterativeSolver<F> > GpuQmrCs<F>::createLane () {
+    return boost::shared_ptr<GpuIterativeSolver<ftype> > (new GpuQmrCs<ftype> (this->pool (), this->queues (), g (), this->matVec (), this->maxIterations (), this->accounting ()));
+  }
+
   namespace {
     template <typename F> std::complex<F> vecProdConj (const std::vector<cl::CommandQueue>& queues, const DipVector<F>& v1, const DipVector<F>& v2) {
       ASSERT (v1.vectorCount () == v2.vectorCount ());
@@ -99,10 +103,33 @@ namespace DDA {
     INFO (v);
   }
 
-  template <typename F> F GpuQmrCs<F>::iteration (csize_t nr, UNUSED std::ostream& log, UNUSED bool profilingRun, Core::ProfilingDataPtr prof) {
+  template <typename F> F GpuQmrCs<F>::iteration (csize_t nr, UNUSED std::ostream& log, bool profilingRun, Core::ProfilingDataPtr prof) {
+    const DipVector<ftype>& v = iterationBegin (nr, profilingRun);
+    {
+      Core::ProfileHandle _p1 (prof, "matvec");
+      this->matVec ().apply (this->queues (), v, this->Avecbuffer (), false, prof);
+    }
+    return iterationEnd (nr, profilingRun);
+  }
+
+  template <typename F> const DipVector<F>& GpuQmrCs<F>::iterationBegin (csize_t nr, bool profilingRun) {
+    const cl::CommandQueue& queue = this->queues ()[0];
+    INFO ("");
+
+    ftype rtmp1 = norm ((vars + &Vars::beta).read (queue)) * this->residScale;
+    if (nr == 0)
+      ASSERT (!(rtmp1 > 1e+38f) || profilingRun); // Allow very low beta values (seen e.g. when using --load-start-dip-pol)
+    else
+      ASSERT (!(rtmp1 < 1e-10f || rtmp1 > 1e+38f) || profilingRun);
+
+    INFO (rtmp1);
+
+    return this->tmpVec1 ();
+  }
+
+  template <typename F> F GpuQmrCs<F>::iterationEnd (csize_t nr, UNUSED bool profilingRun) {
     const std::vector<cl::CommandQueue>& queues = this->queues ();
     const cl::CommandQueue& queue = queues[0];
-    INFO ("");
 
     DipVector<ftype>& rvec = this->rvec ();
     DipVector<ftype>& Avecbuffer = this->Avecbuffer ();
@@ -113,19 +140,6 @@ namespace DDA {
     DipVector<ftype>& p_old = this->tmpVec3 ();
     DipVector<ftype>& p_new = this->tmpVec4 ();
 
-    ftype rtmp1 = norm ((vars + &Vars::beta).read (queue)) * this->residScale;
-    if (nr == 0)
-      ASSERT (!(rtmp1 > 1e+38f) || profilingRun); // Allow very low beta values (seen e.g. when using --load-start-dip-pol)
-    else
-      ASSERT (!(rtmp1 < 1e-10f || rtmp1 > 1e+38f) || profilingRun);
-
-    INFO (rtmp1);
-
-    {
-      Core::ProfileHandle _p1 (prof, "matvec");
-      this->matVec ().apply (queues, v, Avecbuffer, false, prof);
-    }
-
     ctype alpha = vecProdConj (queues, v, Avecbuffer);
 
     (vars + &Vars::mAlpha).write (queue, -alpha);
@@ -37,7 +37,7 @@ namespace DDA {
   }
   template <class F> IterativeSolverBase<F>::~IterativeSolverBase () {}
 
-  template <class F> boost::shared_ptr<std::vector<std::complex<F> > > IterativeSolverBase<F>::getPolVec (const std::vector<ctype>& einc, ftype eps, std::ostream& log, const std::vector<ctype>& start, Core::ProfilingDataPtr prof) {
+  template <class F> void IterativeSolverBase<F>::initSolve (const std::vector<ctype>& einc, ftype eps, std::ostream& log, const std::vector<ctype>& start, Core::ProfilingDataPtr prof) {
     this->inprodR_ = initGeneral (einc, log, start, prof);
     log << "inprodR = " << this->inprodR_ << std::endl;
 
@@ -49,52 +49,67 @@ namespace DDA {
     this->inprodRInit = this->inprodR_;
     this->needNewline = false;
     this->initTime = Core::getCurrentTime ();
+  }
+
+  template <class F> void IterativeSolverBase<F>::checkIteration () const {
+    if (this->count >= maxIter) {
+      ABORT_MSG ("Too many iterations");
+    } else if (this->counter > this->maxResIncrease) {
+      ABORT_MSG ("Too many iterations w/o increase");
+    }
+  }
+
+  template <class F> std::string IterativeSolverBase<F>::updateIteration (ftype inprodRplus1, std::ostream& log, const std::string& label) {
+    count++;
+    if (inprodRplus1 <= inprodR_) {
+      inprodR_ = inprodRplus1;
+      counter = 0;
+    } else {
+      counter++;
+    }
+    ftype err = std::sqrt (residScale * inprodRplus1);
+    ftype progr = 1 - err / prev_err;
+    std::stringstream progStr;
+    progStr << label;
+    ftype prog = (std::log (this->inprodR_) - std::log (this->inprodRInit)) / (std::log (epsB) - std::log (this->inprodRInit));
+    Core::TimeSpan now = Core::getCurrentTime ();
+    Core::TimeSpan remain = (now - this->initTime) * static_cast<double> ((1 - prog) / prog);
+    progStr << "RE_" << std::setfill ('0') << std::setw (5) << count << " = " << std::scientific << std::setfill (' ') << std::setw (12) << err << "  ";
+    if (counter == 0)
+      progStr << "+ ";
+    else if (progr > 0)
+      progStr << "-+";
+    else
+      progStr << "- ";
+    progStr << "  [" << std::fixed << std::setprecision (2) << std::setw (6) << prog * 100 << "%]  [" << std::setfill (' ') << std::setw (12) << remain.toString () << "]";
+    log << progStr.str () << std::endl;
+    prev_err = err;
+    return progStr.str ();
+  }
+
+  template <class F> void IterativeSolverBase<F>::showProgress (const std::string& progress) {
+    if (this->needNewline)
+      Core::OStream::getStderr () << "\n";
+    Core::OStream::getStderr () << progress;
+    /*
+      this->needNewline = count <= 1
+      || (count < 100 && count % 10 == 0)
+      || (count <= 1000 && count % 100 == 0);
+    */
+    this->needNewline = false;
+    Core::OStream::getStderr () << "\r" << std::flush;
+  }
+
+  template <class F> boost::shared_ptr<std::vector<std::complex<F> > > IterativeSolverBase<F>::getPolVec (const std::vector<ctype>& einc, ftype eps, std::ostream& log, const std::vector<ctype>& start, Core::ProfilingDataPtr prof) {
+    initSolve (einc, eps, log, start, prof);
 
     {
       Core::ProfileHandle _p1 (prof, "itsolv");
       init (log, prof);
-      while (inprodR_ >= epsB /* && count + 1 <= maxIter && counter <= maxResIncrease */) {
-        if (this->count >= maxIter) {
-          ABORT_MSG ("Too many iterations");
-        } else if (this->counter > this->maxResIncrease) {
-          ABORT_MSG ("Too many iterations w/o increase");
-        }
+      while (!converged () /* && count + 1 <= maxIter && counter <= maxResIncrease */) {
+        checkIteration ();
         ftype inprodRplus1 = iteration (count, log, false, prof);
-        count++;
-        { // LoopUpdate
-          if (inprodRplus1 <= inprodR_) {
-            inprodR_ = inprodRplus1;
-            counter = 0;
-          } else {
-            counter++;
-          }
-          ftype err = std::sqrt (residScale * inprodRplus1);
-          ftype progr = 1 - err / prev_err;
-          std::stringstream progStr;
-          ftype prog = (std::log (this->inprodR_) - std::log (this->inprodRInit)) / (std::log (epsB) - std::log (this->inprodRInit));
-          Core::TimeSpan now = Core::getCurrentTime ();
-          Core::TimeSpan remain = (now - this->initTime) * static_cast<double> ((1 - prog) / prog);
-          progStr << "RE_" << std::setfill ('0') << std::setw (5) << count << " = " << std::scientific << std::setfill (' ') << std::setw (12) << err << "  ";
-          if (counter == 0)
-            progStr << "+ ";
-          else if (progr > 0)
-            progStr << "-+";
-          else
-            progStr << "- ";
-          progStr << "  [" << std::fixed << std::setprecision (2) << std::setw (6) << prog * 100 << "%]  [" << std::setfill (' ') << std::setw (12) << remain.toString () << "]";
-          if (this->needNewline)
-            Core::OStream::getStderr () << "\n";
-          Core::OStream::getStderr () << progStr.str ();
-          /*
-            this->needNewline = count <= 1
-            || (count < 100 && count % 10 == 0)
-            || (count <= 1000 && count % 100 == 0);
-          */
-          this->needNewline = false;
-          Core::OStream::getStderr () << "\r" << std::flush;
-          log << progStr.str () << std::endl;
-          prev_err = err;
-        }
+        showProgress (updateIteration (inprodRplus1, log));
       }
       Core::OStream::getStderr () << std::endl;
     }
@@ -102,6 +117,16 @@ namespace DDA {
     return getResult (log, prof);
   }
 
+  template <class F> std::vector<boost::shared_ptr<std::vector<std::complex<F> > > > IterativeSolverBase<F>::getPolVecs (const std::vector<boost::shared_ptr<const CoupleConstants<ftype> > >& ccs, const std::vector<const std::vector<ctype>*>& eincs, ftype eps, std::ostream& log, const std::vector<const std::vector<ctype>*>& starts, Core::ProfilingDataPtr prof) {
+    ASSERT (ccs.size () == eincs.size () && eincs.size () == starts.size ());
+    std::vector<boost::shared_ptr<std::vector<ctype> > > results;
+    for (size_t i = 0; i < eincs.size (); i++) {
+      setCoupleConstants (ccs[i]);
+      results.push_back (getPolVec (*eincs[i], eps, log, *starts[i], prof));
+    }
+    return results;
+  }
+
   template <class F> void IterativeSolverBase<F>::profilingRun (std::ostream& out, std::ostream& log, Core::ProfilingDataPtr prof) {
     this->epsB = 1;
     this->prev_err = 1;
@@ -57,6 +57,10 @@ namespace DDA {
     const DipoleGeometry& dipoleGeometry () const { return ddaParams ().dipoleGeometry (); }
 
     boost::shared_ptr<std::vector<ctype> > getPolVec (const std::vector<ctype>& einc, ftype eps, std::ostream& log, const std::vector<ctype>& start = std::vector<ctype> (), Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
+    // Solve for several incident fields, eincs[i] uses the couple constants
+    // ccs[i] and the start value *starts[i] (may be empty). The default
+    // implementation solves one after the other.
+    virtual std::vector<boost::shared_ptr<std::vector<ctype> > > getPolVecs (const std::vector<boost::shared_ptr<const CoupleConstants<ftype> > >& ccs, const std::vector<const std::vector<ctype>*>& eincs, ftype eps, std::ostream& log, const std::vector<const std::vector<ctype>*>& starts, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
     void profilingRun (std::ostream& out, std::ostream& log, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
 
     virtual void setCoupleConstants (const boost::shared_ptr<const CoupleConstants<ftype> >& cc) = 0;
@@ -68,6 +72,20 @@ namespace DDA {
     ftype residScale;
     ftype epsB;
 
+    csize_t maxIterations () const { return maxIter; }
+
+    // The individual steps of getPolVec (), used by implementations which
+    // run several solves at the same time
+    void initSolve (const std::vector<ctype>& einc, ftype eps, std::ostream& log, const std::vector<ctype>& start, Core::ProfilingDataPtr prof);
+    bool converged () const { return !(inprodR_ >= epsB); }
+    csize_t iterationCount () const { return count; }
+    // Aborts if the maximum number of iterations is exceeded
+    void checkIteration () const;
+    // Writes the progress to log (prefixed by label) and returns it
+    std::string updateIteration (ftype inprodRplus1, std::ostream& log, const std::string& label = "");
+    // Shows the progress on stderr, replacing the previous progress line
+    void showProgress (const std::string& progress);
+
     virtual ftype initGeneral (const std::vector<ctype>& einc, std::ostream& log, const std::vector<ctype>& start, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ()) = 0;
     virtual void init (std::ostream& log, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ()) = 0;
     virtual ftype iteration (csize_t nr, std::ostream& log, bool profilingRun, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ()) = 0;
@@ -23,10 +23,12 @@
 #include "MatVec.hpp"
 
 namespace DDA {
-  template <class F> MatVec<F>::MatVec (const DDAParams<ftype>& ddaParams) :
-    ddaParams_ (ddaParams)
+  template <class F> MatVec<F>::MatVec (const DDAParams<ftype>& ddaParams, const MpiComm* comm) :
+    ddaParams_ (ddaParams),
+    comm_ (comm),
+    proc_ (comm ? comm->rank () : 0)
   {
-    ASSERT (g ().procs () == 1);
+    ASSERT (g ().procs () == (comm ? (uint32_t) comm->size () : 1));
   }
   template <class F> MatVec<F>::~MatVec () {}
 
@@ -34,5 +36,68 @@ namespace DDA {
     cc_ = cc;
   }
 
+  template <class F> Core::ThreadPool* MatVec<F>::vectorThreadPool () const {
+    return NULL;
+  }
+
+  template <class F> void MatVec<F>::applyBlock (const std::vector<boost::shared_ptr<const CoupleConstants<ftype> > >& ccs, const std::vector<const std::vector<ctype>*>& args, const std::vector<std::vector<ctype>*>& results, bool conj, Core::ProfilingDataPtr prof) {
+    ASSERT (ccs.size () == args.size () && args.size () == results.size ());
+    boost::shared_ptr<const CoupleConstants<ftype> > oldCc = ccPtr ();
+    for (size_t i = 0; i < args.size (); i++) {
+      setCoupleConstants (ccs[i]);
+      apply (*args[i], *results[i], conj, prof);
+    }
+    setCoupleConstants (oldCc);
+  }
+
+  template <class F> void MatVec<F>::multMatLocal (const std::vector<Math::DiagMatrix3<ctype> >& matrix, const std::vector<ctype>& vector, std::vector<ctype>& result, bool inverse) const {
+    if (!distributed ()) {
+      if (inverse)
+        g ().multMatInv (matrix, vector, result);
+      else
+        g ().multMat (matrix, vector, result);
+      return;
+    }
+
+    ASSERT (matrix.size () == g ().dipoleGeometry ().materials ().size ());
+    ASSERT (vector.size () == g ().vecSize ());
+    ASSERT (result.size () == localVecSize ());
+    size_t stride = localVecStride ();
+    for (uint32_t i = 0; i < localNvCount (); i++) {
+      uint32_t index = localVec0 () + i;
+      Math::DiagMatrix3<ctype> m = matrix[g ().dipoleGeometry ().getMaterialIndex (index)];
+      Math::Vector3<ctype> r = (inverse ? m.inverse () : m) * g ().get (vector, index);
+      for (int comp = 0; comp < 3; comp++)
+        result[i + comp * stride] = r[comp];
+    }
+  }
+
+  template <class F> void MatVec<F>::multMatGlobal (const std::vector<Math::DiagMatrix3<ctype> >& matrix, const std::vector<ctype>& vector, std::vector<ctype>& result) const {
+    if (!distributed ()) {
+      g ().multMat (matrix, vector, result);
+      return;
+    }
+
+    ASSERT (matrix.size () == g ().dipoleGeometry ().materials ().size ());
+    ASSERT (vector.size () == localVecSize ());
+    ASSERT (result.size () == g ().vecSize ());
+    size_t stride = localVecStride ();
+    for (uint32_t i = 0; i < localNvCount (); i++) {
+      uint32_t index = localVec0 () + i;
+      Math::Vector3<ctype> v (vector[i], vector[i + stride], vector[i + 2 * stride]);
+      g ().set (result, index, matrix[g ().dipoleGeometry ().getMaterialIndex (index)] * v);
+    }
+
+    // Collect the parts of the other processes, one component at a time
+    std::vector<size_t> counts (g ().procs () ()), offsets (g ().procs () ());
+    for (int comp = 0; comp < 3; comp++) {
+      for (uint32_t proc = 0; proc < g ().procs (); proc++) {
+        counts[proc] = g ().localNvCount (proc);
+        offsets[proc] = g ().localVec0 (proc) + comp * g ().vecStride ();
+      }
+      comm ().allGather (sizeof (ctype), &result[0], counts, offsets);
+    }
+  }
+
   CALL_MACRO_FOR_DEFAULT_FP_TYPES(CREATE_TEMPLATE_INSTANCE, MatVec)
 }
@@ -26,8 +26,10 @@
 // Base class for the matrix-vector-product
 
 #include <Core/Profiling.hpp>
+#include <Core/ThreadPool.hpp>
 
 #include <DDA/DDAParams.hpp>
+#include <DDA/MpiComm.hpp>
 
 namespace DDA {
   template <typename T>
@@ -38,9 +40,17 @@ namespace DDA {
 
     const DDAParams<ftype>& ddaParams_;
     boost::shared_ptr<const CoupleConstants<ftype> > cc_;
+    // NULL if the vectors are not distributed
+    const MpiComm* comm_;
+    uint32_t proc_;
 
   public:
-    MatVec (const DDAParams<ftype>& ddaParams);
+    // If comm is given, the vectors passed to apply () are distributed over
+    // the processes of comm using the slab decomposition of ddaParams
+    // (ddaParams.procs () must be comm->size ()): every process only stores
+    // the localNvCount () dipoles starting at localVec0 () with a stride of
+    // localVecStride ().
+    MatVec (const DDAParams<ftype>& ddaParams, const MpiComm* comm = NULL);
     virtual ~MatVec ();
 
     virtual void setCoupleConstants (const boost::shared_ptr<const CoupleConstants<ftype> >& cc);
@@ -51,7 +61,36 @@ namespace DDA {
     const boost::shared_ptr<const CoupleConstants<ftype> >& ccPtr () const { return cc_; }
     const CoupleConstants<ftype>& cc () const { return *ccPtr (); }
 
+    bool distributed () const { return comm_; }
+    const MpiComm& comm () const { ASSERT (distributed ()); return *comm_; }
+    // The part of the vectors stored by this process, the whole vector if
+    // the vectors are not distributed
+    uint32_t localVec0 () const { return distributed () ? g ().localVec0 (proc_) : 0; }
+    uint32_t localNvCount () const { return distributed () ? g ().localNvCount (proc_) : g ().nvCount (); }
+    uint32_t localVecStride () const { return distributed () ? g ().localVecStride (proc_) : g ().vecStride (); }
+    uint32_t localVecSize () const { return distributed () ? g ().localVecSize (proc_) : g ().vecSize (); }
+
+    // The thread pool the solvers use for the operations on the local
+    // vectors, NULL if they should run in the calling thread
+    virtual Core::ThreadPool* vectorThreadPool () const;
+
+    // Sums the results of a reduction over the local vectors of all processes
+    template <typename U> U sum (U value) const { return distributed () ? comm ().allReduceSum (value) : value; }
+
+    // Like DDAParams::multMat () (or multMatInv () if inverse is true), but
+    // vector is a whole vector and result the local part
+    void multMatLocal (const std::vector<Math::DiagMatrix3<ctype> >& matrix, const std::vector<ctype>& vector, std::vector<ctype>& result, bool inverse = false) const;
+    // Like DDAParams::multMat (), but vector is the local part and result is
+    // the whole vector on every process
+    void multMatGlobal (const std::vector<Math::DiagMatrix3<ctype> >& matrix, const std::vector<ctype>& vector, std::vector<ctype>& result) const;
+
     virtual void apply (const std::vector<ctype>& arg, std::vector<ctype>& result, bool conj, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ()) = 0;
+
+    // Calculate results[i] = A_i * args[i] where A_i is the matrix for the
+    // couple constants ccs[i]. The default implementation calls apply () for
+    // every vector, implementations can override this to process all vectors
+    // in one pass over the DMatrix.
+    virtual void applyBlock (const std::vector<boost::shared_ptr<const CoupleConstants<ftype> > >& ccs, const std::vector<const std::vector<ctype>*>& args, const std::vector<std::vector<ctype>*>& results, bool conj, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
   };
 
   CALL_MACRO_FOR_DEFAULT_FP_TYPES(DISABLE_TEMPLATE_INSTANCE, MatVec)
@@ -22,131 +22,496 @@
 
 #include "MatVecCpu.hpp"
 
+#include <boost/bind.hpp>
+
+#include <limits>
+
 namespace DDA {
   static const bool use128BitAlignment = true;
 
   namespace {
-    template <typename T> static void transpose (const boost::const_multi_array_ref<T, 3>& in, boost::multi_array_ref<T, 3>& out, size_t index) {
-      ASSERT (in.data () != out.data ());
-      ASSERT (in.shape ()[0] == out.shape ()[1]);
-      ASSERT (in.shape ()[1] == out.shape ()[0]);
-      ASSERT (index < in.shape ()[2]);
-      ASSERT (index < out.shape ()[2]);
-
-      for (size_t i = 0; i < in.shape ()[0]; i++)
-        for (size_t j = 0; j < in.shape ()[1]; j++)
-          out[j][i][index] = in[i][j][index];
+    // x = d * x for count points of a row of a slice. d contains the real
+    // parts of aa, ab, ac, bb, bc, cc followed by the imaginary parts, every
+    // one a plane of values which are dStride values apart (see
+    // DMatrixPlanes), point j uses the values at kIndex[j]. ab is multiplied
+    // by sAB, ac by sI * kSign[j] and bc by sJ * kSign[j] (the signs for
+    // reflected frequencies). x0, x1 and x2 are the components of x
+    // (interleaved real and imaginary parts).
+    template <typename F> SIMD_CLONES_ATTRIBUTE void multiplyDMatrix (size_t count, const F* RESTRICT d, size_t dStride, const uint32_t* RESTRICT kIndex, const F* RESTRICT kSign, F sAB, F sI, F sJ, F* RESTRICT x0, F* RESTRICT x1, F* RESTRICT x2) {
+      const F* aar = d;
+      const F* abr = d + dStride;
+      const F* acr = d + 2 * dStride;
+      const F* bbr = d + 3 * dStride;
+      const F* bcr = d + 4 * dStride;
+      const F* ccr = d + 5 * dStride;
+      const F* aai = d + 6 * dStride;
+      const F* abi = d + 7 * dStride;
+      const F* aci = d + 8 * dStride;
+      const F* bbi = d + 9 * dStride;
+      const F* bci = d + 10 * dStride;
+      const F* cci = d + 11 * dStride;
+      for (size_t j = 0; j < count; j++) {
+        size_t m = kIndex[j];
+        F sAC = sI * kSign[j];
+        F sBC = sJ * kSign[j];
+        F daar = aar[m], daai = aai[m];
+        F dabr = sAB * abr[m], dabi = sAB * abi[m];
+        F dacr = sAC * acr[m], daci = sAC * aci[m];
+        F dbbr = bbr[m], dbbi = bbi[m];
+        F dbcr = sBC * bcr[m], dbci = sBC * bci[m];
+        F dccr = ccr[m], dcci = cci[m];
+        F x0r = x0[2 * j], x0i = x0[2 * j + 1];
+        F x1r = x1[2 * j], x1i = x1[2 * j + 1];
+        F x2r = x2[2 * j], x2i = x2[2 * j + 1];
+        x0[2 * j] = daar * x0r - daai * x0i + dabr * x1r - dabi * x1i + dacr * x2r - daci * x2i;
+        x0[2 * j + 1] = daar * x0i + daai * x0r + dabr * x1i + dabi * x1r + dacr * x2i + daci * x2r;
+        x1[2 * j] = dabr * x0r - dabi * x0i + dbbr * x1r - dbbi * x1i + dbcr * x2r - dbci * x2i;
+        x1[2 * j + 1] = dabr * x0i + dabi * x0r + dbbr * x1i + dbbi * x1r + dbcr * x2i + dbci * x2r;
+        x2[2 * j] = dacr * x0r - daci * x0i + dbcr * x1r - dbci * x1i + dccr * x2r - dcci * x2i;
+        x2[2 * j + 1] = dacr * x0i + daci * x0r + dbcr * x1i + dbci * x1r + dccr * x2i + dcci * x2r;
+      }
     }
-    template <typename T, size_t dim> static void fill (boost::multi_array_ref<T, dim>& array, const T& value) {
-      std::fill (array.data (), array.data () + array.num_elements (), value);
+  }
+
+  namespace {
+    // Two nested loops for strided FFT plans
+    std::vector<LinAlg::FFTLoop> sliceLoops (csize_t count1, csize_t stride1, csize_t count2, csize_t stride2) {
+      std::vector<LinAlg::FFTLoop> loops;
+      loops.push_back (LinAlg::FFTLoop (count1, stride1));
+      loops.push_back (LinAlg::FFTLoop (count2, stride2));
+      return loops;
     }
   }
 
-  template <class F> MatVecCpu<F>::MatVecCpu (const DDAParams<ftype>& ddaParams, const boost::const_multi_array_ref<Math::SymMatrix3<ctype>, 3>& Dmatrix, const LinAlg::FFTPlanFactory<ftype>& planFactory) :
-    MatVec<F> (ddaParams),
-    Dmatrix_ (Dmatrix),
-    Xmatrix (boost::extents[g ().gridX ()][g ().dipoleGeometry ().box ().y () ()][g ().dipoleGeometry ().box ().z () ()][3], boost::fortran_storage_order ()),
-    slices (boost::extents[g ().gridZ ()][g ().gridY ()][3], boost::fortran_storage_order ()),
-    slices_tr (boost::extents[g ().gridY ()][g ().gridZ ()][3], boost::fortran_storage_order ()),
+  template <class F> MatVecCpu<F>::MatVecCpu (const DDAParams<ftype>& ddaParams, const DMatrixPlanes<ftype>& dMatrix, const LinAlg::FFTPlanFactory<ftype>& planFactory, const boost::shared_ptr<Core::ThreadPool>& threadPool, const boost::shared_ptr<const Beam<ftype> >& beam, const boost::shared_ptr<const MatrixFreeDMatrix<ftype> >& matrixFree, const MpiComm* comm) :
+    MatVec<F> (ddaParams, comm),
+    dMatrix_ (dMatrix),
+    threadPool_ (threadPool),
+    beam_ (beam),
+    matrixFree_ (matrixFree),
+    localX0_ (comm ? g ().localX0 (comm->rank ()) : 0),
+    localGridX_ (comm ? g ().localGridX (comm->rank ()) : g ().gridX ()),
+    localZ0_ (comm ? g ().localZ0 (comm->rank ()) : 0),
+    localBoxZ_ (comm ? g ().localBoxZ (comm->rank ()) : g ().dipoleGeometry ().box ().z () ()),
+    Xmatrix (boost::extents[g ().gridX ()][g ().dipoleGeometry ().box ().y () ()][localBoxZ_][3][1], boost::fortran_storage_order ()),
+    slicesBuffer (boost::extents[g ().gridZ ()][g ().gridY ()][3][threadPool->threadCount ()], boost::fortran_storage_order ()),
+    sendBuffer (boost::extents[comm ? g ().localBlocksSize (comm->rank ()) : 0]),
+    recvBuffer (boost::extents[comm ? g ().localBlocksSize (comm->rank ()) : 0]),
+    blockCapacity (1),
+    matrixFreePlanes (boost::extents[matrixFree ? g ().dMatrixY () * g ().dMatrixZ () : 0][12][threadPool->threadCount ()], boost::fortran_storage_order ()),
     // times = Xmatrix.shape ()[2] * 3, stride = Xmatrix.sizeY * Xmatrix.sizeX
-    planX (planFactory.createPlan (g ().cgridX (), g ().dipoleGeometry ().box ().y (), true, false, true, true, use128BitAlignment)),
-    // times = 3, stride = gridY * gridZ
-    planZ (planFactory.createPlan (g ().cgridZ (), g ().dipoleGeometry ().box ().y (), true, false, true, true, use128BitAlignment)),
-    // times = 1
-    planY (planFactory.createPlan (g ().cgridY (), g ().cgridZ () * 3, true, false, true, true, use128BitAlignment))
+    planX (planFactory.createPrunedPlan (g ().cgridX (), g ().dipoleGeometry ().box ().x (), g ().dipoleGeometry ().box ().y (), use128BitAlignment)),
+    // columns j < boxY, stride = 1, for each of the 3 components
+    planZ (planFactory.createPrunedStridedPlan (g ().cgridZ (), g ().dipoleGeometry ().box ().z (), 1, sliceLoops (g ().dipoleGeometry ().box ().y (), g ().cgridZ (), 3, g ().cgridY () * g ().cgridZ ()), use128BitAlignment)),
+    // all rows, stride = gridZ, for each of the 3 components
+    planY (planFactory.createPrunedStridedPlan (g ().cgridY (), g ().dipoleGeometry ().box ().y (), g ().cgridZ (), sliceLoops (g ().cgridZ (), 1, 3, g ().cgridY () * g ().cgridZ ()), use128BitAlignment)),
+    occupiedLines (g ().dipoleGeometry ().occupiedLines ()),
+    occupiedLineCount (g ().dipoleGeometry ().box ().z () (), 0),
+    occupiedColumns (g ().dipoleGeometry ().box ().y () (), 0),
+    allColumnsOccupied (true)
   {
+    if (matrixFree) {
+      ASSERT (!comm);
+      ASSERT (&matrixFree->ddaParams () == &ddaParams);
+      ASSERT (matrixFree->threadCount () == threadPool->threadCount ());
+    } else {
+      std::vector<uint32_t> xIndices;
+      if (comm) {
+        xIndices = localDMatrixXIndices (ddaParams, comm->rank ());
+      } else {
+        for (uint32_t x = 0; x < g ().dMatrixX (); x++)
+          xIndices.push_back (x);
+      }
+      dMatrixXSlot.resize (g ().dMatrixX (), std::numeric_limits<uint32_t>::max ());
+      for (size_t slot = 0; slot < xIndices.size (); slot++)
+        dMatrixXSlot[xIndices[slot]] = (uint32_t) slot;
+      ASSERT (dMatrix.dMatrixY () == g ().dMatrixY ());
+      ASSERT (dMatrix.dMatrixZ () == g ().dMatrixZ ());
+      ASSERT (dMatrix.xCount () == xIndices.size ());
+    }
+    ASSERT (beam || !g ().anyCirculant ());
+
+    size_t boxY = g ().dipoleGeometry ().box ().y () ();
+    size_t boxZ = g ().dipoleGeometry ().box ().z () ();
+    bool allLinesOccupied = true;
+    for (size_t k = 0; k < boxZ; k++) {
+      for (size_t j = 0; j < boxY; j++) {
+        if (occupiedLines[j + boxY * k]) {
+          occupiedLineCount[k]++;
+          occupiedColumns[j] = 1;
+        } else {
+          allLinesOccupied = false;
+        }
+      }
+    }
+    for (size_t j = 0; j < boxY; j++)
+      if (!occupiedColumns[j])
+        allColumnsOccupied = false;
+    if (!allLinesOccupied)
+      planX1 = planFactory.createPrunedPlan (g ().cgridX (), g ().dipoleGeometry ().box ().x (), 1, use128BitAlignment);
+    if (!allColumnsOccupied)
+      planZ1 = planFactory.createPrunedPlan (g ().cgridZ (), g ().dipoleGeometry ().box ().z (), 1, use128BitAlignment);
   }
   template <class F> MatVecCpu<F>::~MatVecCpu () {}
 
+  template <class F> std::vector<uint32_t> MatVecCpu<F>::localDMatrixXIndices (const DDAParams<ftype>& g, uint32_t proc) {
+    // Same decision as in the constructor of planX
+    bool pruned = LinAlg::PrunedFFTPlan<ftype>::isPruned (g.cgridX (), g.dipoleGeometry ().box ().x ());
+    std::vector<uint8_t> used (g.dMatrixX (), 0);
+    for (uint32_t x = g.localX0 (proc); x < g.localX0 (proc) + g.localGridX (proc); x++) {
+      bool reflected;
+      used[g.dMatrixIndex ((uint32_t) LinAlg::PrunedFFTPlan<ftype>::frequency (g.cgridX (), pruned, x), g.gridX (), reflected)] = 1;
+    }
+    std::vector<uint32_t> indices;
+    for (uint32_t x = 0; x < g.dMatrixX (); x++)
+      if (used[x])
+        indices.push_back (x);
+    return indices;
+  }
+
   namespace {
     template <class F> inline F maybeConj (F f, bool c) {
       return c ? conj (f) : f;
     }
   }
 
-  template <class F> void MatVecCpu<F>::apply (const std::vector<ctype>& arg, std::vector<ctype>& result, bool conj, Core::ProfilingDataPtr prof) {
+  template <class F> boost::multi_array_ref<std::complex<F>, 4> MatVecCpu<F>::xMatrix (size_t index) {
+    ASSERT (index < Xmatrix.shape ()[4]);
+    return boost::multi_array_ref<ctype, 4> (Xmatrix.data () + index * xMatrixBlockSize (), boost::extents[Xmatrix.shape ()[0]][Xmatrix.shape ()[1]][Xmatrix.shape ()[2]][3], boost::fortran_storage_order ());
+  }
+
+  template <class F> void MatVecCpu<F>::reserveBlock (size_t count) {
+    if (count <= blockCapacity)
+      return;
     const DDAParams<ftype>& g = this->ddaParams ();
+    Xmatrix.resize (boost::extents[g.gridX ()][g.dipoleGeometry ().box ().y () ()][localBoxZ_][3][count]);
+    slicesBuffer.resize (boost::extents[g.gridZ ()][g.gridY ()][3][threadPool ().threadCount () * count]);
+    if (this->distributed ()) {
+      sendBuffer.resize (boost::extents[g.localBlocksSize (this->comm ().rank ()) * count]);
+      recvBuffer.resize (boost::extents[g.localBlocksSize (this->comm ().rank ()) * count]);
+    }
+    blockCapacity = count;
+  }
+
+  template <class F> void MatVecCpu<F>::updateCirculantFactors () {
+    const DDAParams<ftype>& g = this->ddaParams ();
+    for (int axis = 0; axis < 3; axis++) {
+      if (!g.circulant (axis))
+        continue;
+      ftype phase = g.circulantPhaseShift (*beam_, axis) / static_cast<ftype> (g.gridSize ()[axis] ());
+      circulantFactors[axis].resize (g.dipoleGeometry ().box ()[axis] ());
+      for (size_t i = 0; i < circulantFactors[axis].size (); i++)
+        circulantFactors[axis][i] = std::exp (ctype (0, phase * static_cast<ftype> (i)));
+    }
+  }
+
+  template <class F> inline std::complex<F> MatVecCpu<F>::circulantFactor (Math::Vector3<uint32_t> pos) const {
+    ctype factor = 1;
+    for (int axis = 0; axis < 3; axis++)
+      if (!circulantFactors[axis].empty ())
+        factor *= circulantFactors[axis][pos[axis]];
+    return factor;
+  }
 
-    fill<ctype> (Xmatrix, 0);
-  
-    for (uint32_t i = 0; i < g.cnvCount (); i++) {
-      Math::Vector3<uint32_t> pos = dipoleGeometry ().getGridCoordinates (i);
-      Math::DiagMatrix3<ctype> cc = this->cc ().cc_sqrt ()[dipoleGeometry ().getMaterialIndex (i)];
-      Math::Vector3<ctype> r = cc * maybeConj (g.get (arg, i), conj);
+  template <class F> void MatVecCpu<F>::clearXMatrix (UNUSED size_t thread, size_t begin, size_t end) {
+    // begin and end are line indices, only occupied lines are used
+    size_t gridX = Xmatrix.shape ()[0];
+    size_t boxY = Xmatrix.shape ()[1];
+    for (size_t l = begin; l < end; l++)
+      if (occupiedLines[l % (boxY * localBoxZ_) + boxY * localZ0_])
+        std::fill (Xmatrix.data () + l * gridX, Xmatrix.data () + (l + 1) * gridX, ctype (0));
+  }
+
+  template <class F> void MatVecCpu<F>::scatter (size_t index, const CoupleConstants<ftype>* cc, const std::vector<ctype>* arg, bool conj, UNUSED size_t thread, size_t begin, size_t end) {
+    const DDAParams<ftype>& g = this->ddaParams ();
+    boost::multi_array_ref<ctype, 4> Xmatrix = xMatrix (index);
+    size_t stride = this->localVecStride ();
+    uint32_t vec0 = this->localVec0 ();
+
+    // begin and end are local dipole indices
+    for (uint32_t i = (uint32_t) begin; i < end; i++) {
+      Math::Vector3<uint32_t> pos = dipoleGeometry ().getGridCoordinates (vec0 + i);
+      Math::DiagMatrix3<ctype> ccSqrt = cc->cc_sqrt ()[dipoleGeometry ().getMaterialIndex (vec0 + i)];
+      Math::Vector3<ctype> a ((*arg)[i], (*arg)[i + stride], (*arg)[i + 2 * stride]);
+      Math::Vector3<ctype> r = ccSqrt * maybeConj (a, conj);
+      if (g.anyCirculant ())
+        r = circulantFactor (pos) * r;
       for (int comp = 0; comp < 3; comp++)
-        Xmatrix[pos.x ()][pos.y ()][pos.z ()][comp] = r[comp];
+        Xmatrix[pos.x ()][pos.y ()][pos.z () - localZ0_][comp] = r[comp];
     }
+  }
 
-    for (size_t i = 0; i < Xmatrix.shape ()[2] * 3; i++) {
-      Core::ProfileHandle _p1 (prof, "fft" /* "planXf" */);
-      planX->fftInPlace (Xmatrix.data () + Xmatrix.shape ()[1] * Xmatrix.shape ()[0] * i);
+  template <class F> void MatVecCpu<F>::fftX (bool forward, UNUSED size_t thread, size_t begin, size_t end) {
+    size_t gridX = Xmatrix.shape ()[0];
+    size_t boxY = Xmatrix.shape ()[1];
+    for (size_t i = begin; i < end; i++) {
+      ctype* data = Xmatrix.data () + boxY * gridX * i;
+      size_t z = i % Xmatrix.shape ()[2] + localZ0_;
+      if (occupiedLineCount[z] == boxY) {
+        planX->executeInPlace (data, forward);
+      } else {
+        for (size_t y = 0; y < boxY; y++)
+          if (occupiedLines[y + boxY * z])
+            planX1->executeInPlace (data + gridX * y, forward);
+      }
     }
+  }
 
-    {
-      Core::ProfileHandle _p_ (prof, "il");
-      for (size_t i = 0; i < g.cgridX (); i++) {
-        fill<ctype> (slices, 0);
-        for (size_t j = 0; j < g.dipoleGeometry ().box ().y (); j++)
-          for (size_t k = 0; k < g.dipoleGeometry ().box ().z (); k++)
-            for (int comp = 0; comp < 3; comp++)
-              slices[k][j][comp] = Xmatrix[i][j][k][comp];
-        for (size_t comp = 0; comp < 3; comp++) {
+  template <class F> void MatVecCpu<F>::packLines (bool pack, size_t count, UNUSED size_t thread, size_t begin, size_t end) {
+    const DDAParams<ftype>& g = this->ddaParams ();
+    uint32_t rank = this->comm ().rank ();
+    size_t gridX = Xmatrix.shape ()[0];
+    size_t boxY = Xmatrix.shape ()[1];
+    // Line l of Xmatrix is line l of the block of every process, only the X
+    // range differs
+    for (size_t l = begin; l < end; l++) {
+      if (!occupiedLines[l % (boxY * localBoxZ_) + boxY * localZ0_])
+        continue;
+      ctype* line = Xmatrix.data () + gridX * l;
+      for (uint32_t proc = 0; proc < g.procs (); proc++) {
+        size_t x0 = g.localX0 (proc);
+        size_t lgx = g.localGridX (proc);
+        ctype* block = sendBuffer.data () + g.localBlockOffset (rank, proc) * count + lgx * l;
+        if (pack)
+          std::copy (line + x0, line + x0 + lgx, block);
+        else
+          std::copy (block, block + lgx, line + x0);
+      }
+    }
+  }
+
+  template <class F> void MatVecCpu<F>::transpose (bool forward, size_t count, Core::ProfilingDataPtr prof) {
+    const DDAParams<ftype>& g = this->ddaParams ();
+    uint32_t rank = this->comm ().rank ();
+    size_t lineCount = Xmatrix.shape ()[1] * localBoxZ_ * 3 * count;
+    std::vector<size_t> sendCounts (g.procs () ()), recvCounts (g.procs () ()), offsets (g.procs () ());
+    for (uint32_t proc = 0; proc < g.procs (); proc++) {
+      sendCounts[proc] = (size_t) g.localGridX (proc) * g.dipoleGeometry ().box ().y () () * localBoxZ_ * 3 * count;
+      recvCounts[proc] = (size_t) localGridX_ * g.dipoleGeometry ().box ().y () () * g.localBoxZ (proc) * 3 * count;
+      offsets[proc] = (size_t) g.localBlockOffset (rank, proc) * count;
+    }
+
+    if (forward) {
+      threadPool ().run (lineCount, boost::bind (&MatVecCpu<F>::packLines, this, true, count, _1, _2, _3));
+      Core::ProfileHandle _p1 (prof, "transpose");
+      this->comm ().allToAll (sizeof (ctype), sendBuffer.data (), sendCounts, offsets, recvBuffer.data (), recvCounts, offsets);
+    } else {
+      {
+        Core::ProfileHandle _p1 (prof, "transpose");
+        this->comm ().allToAll (sizeof (ctype), recvBuffer.data (), recvCounts, offsets, sendBuffer.data (), sendCounts, offsets);
+      }
+      threadPool ().run (lineCount, boost::bind (&MatVecCpu<F>::packLines, this, false, count, _1, _2, _3));
+    }
+  }
+
+  template <class F> void MatVecCpu<F>::fftZ (ctype* data, bool forward) {
+    if (allColumnsOccupied) {
+      planZ->executeInPlace (data, forward);
+    } else {
+      size_t gridZ = this->ddaParams ().gridZ ();
+      size_t sliceSize = gridZ * this->ddaParams ().gridY ();
+      for (int comp = 0; comp < 3; comp++)
+        for (size_t j = 0; j < occupiedColumns.size (); j++)
+          if (occupiedColumns[j])
+            planZ1->executeInPlace (data + comp * sliceSize + gridZ * j, forward);
+    }
+  }
+
+  template <class F> void MatVecCpu<F>::processSlices (Core::ProfilingDataPtr prof, size_t count, size_t thread, size_t begin, size_t end) {
+    const DDAParams<ftype>& g = this->ddaParams ();
+    size_t sliceSize = g.gridZ () * g.gridY () * 3;
+    size_t planeSize = g.dMatrixY () * g.dMatrixZ ();
+    size_t boxY = g.dipoleGeometry ().box ().y () ();
+    size_t boxZ = g.dipoleGeometry ().box ().z () ();
+
+    // The X transformed data for the local X range: Xmatrix or, if the
+    // vectors are distributed, the blocks received from the other processes.
+    // The element (i, j, k, comp) of vector r is at
+    // source[kOffset[k] + i + localGridX_ * j + kStride[k] * (comp + 3 * r)].
+    ctype* source;
+    std::vector<size_t> kOffset (boxZ), kStride (boxZ);
+    if (this->distributed ()) {
+      source = recvBuffer.data ();
+      for (uint32_t proc = 0; proc < g.procs (); proc++) {
+        for (size_t k = g.localZ0 (proc); k < g.localZ0 (proc) + g.localBoxZ (proc); k++) {
+          kOffset[k] = g.localBlockOffset (this->comm ().rank (), proc) * count + localGridX_ * boxY * (k - g.localZ0 (proc));
+          kStride[k] = localGridX_ * boxY * g.localBoxZ (proc);
+        }
+      }
+    } else {
+      source = Xmatrix.data ();
+      for (size_t k = 0; k < boxZ; k++) {
+        kOffset[k] = localGridX_ * boxY * k;
+        kStride[k] = localGridX_ * boxY * boxZ;
+      }
+    }
+
+    std::vector<boost::multi_array_ref<ctype, 3> > slices;
+    for (size_t r = 0; r < count; r++) {
+      slices.push_back (boost::multi_array_ref<ctype, 3> (slicesBuffer.data () + (thread * count + r) * sliceSize, boost::extents[g.gridZ ()][g.gridY ()][3], boost::fortran_storage_order ()));
+    }
+
+    // DMatrix indices for the Y and Z coordinates of the FFT data and the
+    // signs for reflected frequencies (-1 if reflected): the off-diagonal
+    // element for two axes changes its sign if exactly one of the two
+    // frequencies is reflected
+    std::vector<uint32_t> jIndex (g.gridY ()), kIndex (g.gridZ ());
+    std::vector<ftype> jSign (g.gridY ()), kSign (g.gridZ ());
+    for (uint32_t j = 0; j < g.gridY (); j++) {
+      bool reflected;
+      jIndex[j] = g.dMatrixIndex ((uint32_t) planY->frequency (j), g.gridY (), reflected);
+      jSign[j] = reflected ? -1 : 1;
+    }
+    for (uint32_t k = 0; k < g.gridZ (); k++) {
+      bool reflected;
+      kIndex[k] = g.dMatrixIndex ((uint32_t) planZ->frequency (k), g.gridZ (), reflected);
+      kSign[k] = reflected ? -1 : 1;
+    }
+
+    for (size_t i = begin; i < end; i++) {
+      bool iReflected;
+      uint32_t iIndex = g.dMatrixIndex ((uint32_t) planX->frequency (localX0_ + i), g.gridX (), iReflected);
+      ftype iSign = iReflected ? -1 : 1;
+      for (size_t r = 0; r < count; r++) {
+        // Only the columns j < boxY are used by the Z FFT, the columns
+        // j >= boxY are the zero padding for the Y FFT.
+        // The Y and Z FFTs cannot work directly on Xmatrix (as the X FFT
+        // does): Xmatrix only stores the box and is ordered by X, the FFTs
+        // need the padded slice (the pruned plans use the padding as scratch
+        // space and leave it undefined after a backward transform). Copying
+        // the slice also makes the Z FFT and the DMatrix multiplication work
+        // on contiguous data, so the copy and the zero fill stay.
+        for (int comp = 0; comp < 3; comp++) {
+          ctype* slice = slices[r].data () + comp * g.gridY () * g.gridZ ();
+          for (size_t j = 0; j < boxY; j++) {
+            ctype* column = slice + g.gridZ () * j;
+            for (size_t k = 0; k < boxZ; k++)
+              column[k] = occupiedLines[j + boxY * k] ? source[kOffset[k] + i + localGridX_ * j + kStride[k] * (comp + 3 * r)] : ctype (0);
+            std::fill (column + boxZ, column + g.gridZ (), ctype (0));
+          }
+          std::fill (slice + g.gridZ () * boxY, slice + g.gridZ () * g.gridY (), ctype (0));
+        }
+        {
           Core::ProfileHandle _p1 (prof, "fft" /* "planZf" */);
-          planZ->fftInPlace (slices.data () + comp * g.gridY () * g.gridZ ());
+          fftZ (slices[r].data (), true);
         }
-        for (int comp = 0; comp < 3; comp++)
-          transpose<ctype> (slices, slices_tr, comp);
         {
           Core::ProfileHandle _p1 (prof, "fft" /* "planYf" */);
-          planY->fftInPlace (slices_tr.data ());
+          planY->fftInPlace (slices[r].data ());
         }
-        {
-          Core::ProfileHandle _p1 (prof, "iil");
-          for (size_t k = 0; k < g.cgridZ (); k++) {
-            for (size_t j = 0; j < g.cgridY (); j++) {
-              Math::Vector3<ctype> xv;
-              for (int comp = 0; comp < 3; comp++)
-                xv[comp] = slices_tr[j][k][comp];
-              Math::Vector3<ctype> yv = dMatrix ()[j][k][i] * xv;
-              for (int comp = 0; comp < 3; comp++)
-                slices_tr[j][k][comp] = yv[comp];
-            }
-          }
+      }
+      {
+        // Multiply all vectors with a row of the DMatrix planes before
+        // moving to the next row, so the row is read from memory only once
+        Core::ProfileHandle _p1 (prof, "iil");
+        const ftype* planes;
+        if (matrixFree_) {
+          ftype* threadPlanes = matrixFreePlanes.data () + thread * 12 * planeSize;
+          matrixFree_->loadSlice (iIndex, thread, threadPlanes);
+          planes = threadPlanes;
+        } else {
+          planes = dMatrix_.slice (dMatrixXSlot[iIndex]);
         }
+        for (size_t j = 0; j < g.cgridY (); j++)
+          for (size_t r = 0; r < count; r++)
+            multiplyDMatrix<ftype> (g.cgridZ () (), planes + g.dMatrixZ () * jIndex[j], planeSize, &kIndex[0], &kSign[0], iSign * jSign[j], iSign, jSign[j], reinterpret_cast<ftype*> (&slices[r][0][j][0]), reinterpret_cast<ftype*> (&slices[r][0][j][1]), reinterpret_cast<ftype*> (&slices[r][0][j][2]));
+      }
+      for (size_t r = 0; r < count; r++) {
         {
           Core::ProfileHandle _p1 (prof, "fft" /* "planYb" */);
-          planY->ifftInPlace (slices_tr.data ());
+          planY->ifftInPlace (slices[r].data ());
         }
-        for (int comp = 0; comp < 3; comp++)
-          transpose<ctype> (slices_tr, slices, comp);
-        for (size_t comp = 0; comp < 3; comp++) {
+        {
           Core::ProfileHandle _p1 (prof, "fft" /* "planZb" */);
-          planZ->ifftInPlace (slices.data () + comp * g.gridY () * g.gridZ ());
+          fftZ (slices[r].data (), false);
+        }
+        // Only the columns j < boxY of the result are needed
+        for (int comp = 0; comp < 3; comp++) {
+          const ctype* slice = slices[r].data () + comp * g.gridY () * g.gridZ ();
+          for (size_t j = 0; j < boxY; j++) {
+            const ctype* column = slice + g.gridZ () * j;
+            for (size_t k = 0; k < boxZ; k++)
+              if (occupiedLines[j + boxY * k])
+                source[kOffset[k] + i + localGridX_ * j + kStride[k] * (comp + 3 * r)] = column[k];
+          }
         }
-        for (size_t j = 0; j < g.dipoleGeometry ().box ().y (); j++)
-          for (size_t k = 0; k < g.dipoleGeometry ().box ().z (); k++)
-            for (int comp = 0; comp < 3; comp++)
-              Xmatrix[i][j][k][comp] = slices[k][j][comp];
       }
     }
+  }
 
-    for (size_t i = 0; i < Xmatrix.shape ()[2] * 3; i++) {
-      Core::ProfileHandle _p1 (prof, "fft" /* "planXb" */);
-      planX->ifftInPlace (Xmatrix.data () + Xmatrix.shape ()[1] * Xmatrix.shape ()[0] * i);
+  template <class F> void MatVecCpu<F>::gather (size_t index, const CoupleConstants<ftype>* cc, const std::vector<ctype>* arg, std::vector<ctype>* result, bool conj, UNUSED size_t thread, size_t begin, size_t end) {
+    const DDAParams<ftype>& g = this->ddaParams ();
+    boost::multi_array_ref<ctype, 4> Xmatrix = xMatrix (index);
+    size_t stride = this->localVecStride ();
+    uint32_t vec0 = this->localVec0 ();
+    uint32_t nvCount = this->localNvCount ();
+
+    // begin and end are local dipole indices
+    for (uint32_t i = (uint32_t) begin; i < end; i++) {
+      Math::Vector3<ctype> r2 (0, 0, 0);
+      if (i < nvCount) {
+        Math::Vector3<uint32_t> pos = dipoleGeometry ().getGridCoordinates (vec0 + i);
+        Math::Vector3<ctype> r;
+        for (int comp = 0; comp < 3; comp++)
+          r[comp] = Xmatrix[pos.x ()][pos.y ()][pos.z () - localZ0_][comp];
+        if (g.anyCirculant ())
+          r = std::conj (circulantFactor (pos)) * r;
+        Math::Vector3<ctype> a ((*arg)[i], (*arg)[i + stride], (*arg)[i + 2 * stride]);
+        r2 = maybeConj (cc->cc_sqrt ()[dipoleGeometry ().getMaterialIndex (vec0 + i)] * r + maybeConj (a, conj), conj);
+      }
+      for (int comp = 0; comp < 3; comp++)
+        (*result)[i + comp * stride] = r2[comp];
+    }
+  }
+
+  template <class F> void MatVecCpu<F>::apply (const std::vector<ctype>& arg, std::vector<ctype>& result, bool conj, Core::ProfilingDataPtr prof) {
+    std::vector<boost::shared_ptr<const CoupleConstants<ftype> > > ccs (1, this->ccPtr ());
+    std::vector<const std::vector<ctype>*> args (1, &arg);
+    std::vector<std::vector<ctype>*> results (1, &result);
+    applyBlock (ccs, args, results, conj, prof);
+  }
+
+  template <class F> void MatVecCpu<F>::applyBlock (const std::vector<boost::shared_ptr<const CoupleConstants<ftype> > >& ccs, const std::vector<const std::vector<ctype>*>& args, const std::vector<std::vector<ctype>*>& results, bool conj, Core::ProfilingDataPtr prof) {
+    const DDAParams<ftype>& g = this->ddaParams ();
+    size_t count = args.size ();
+    ASSERT (count > 0);
+    ASSERT (ccs.size () == count && results.size () == count);
+
+    reserveBlock (count);
+    if (g.anyCirculant ())
+      updateCirculantFactors ();
+
+    // Core::ProfilingData is not thread safe, only record the inner steps
+    // when everything runs in the current thread
+    Core::ProfilingDataPtr threadProf = threadPool ().threadCount () == 1 ? prof : Core::ProfilingDataPtr ();
+
+    threadPool ().run (Xmatrix.shape ()[1] * Xmatrix.shape ()[2] * 3 * count, boost::bind (&MatVecCpu<F>::clearXMatrix, this, _1, _2, _3));
+    for (size_t r = 0; r < count; r++)
+      threadPool ().run (this->localNvCount (), boost::bind (&MatVecCpu<F>::scatter, this, r, ccs[r].get (), args[r], conj, _1, _2, _3));
+
+    {
+      Core::ProfileHandle _p1 (prof, "fft" /* "planXf" */);
+      threadPool ().run (Xmatrix.shape ()[2] * 3 * count, boost::bind (&MatVecCpu<F>::fftX, this, true, _1, _2, _3));
     }
 
-    for (uint32_t i = g.nvCount (); i < g.vecStride (); i++) {
-      g.set (result, i, Math::Vector3<ctype> (0, 0, 0));
+    if (this->distributed ())
+      transpose (true, count, prof);
+
+    {
+      Core::ProfileHandle _p_ (prof, "il");
+      threadPool ().run (localGridX_, boost::bind (&MatVecCpu<F>::processSlices, this, threadProf, count, _1, _2, _3));
     }
-    for (uint32_t i = 0; i < g.cnvCount (); i++) {
-      Math::Vector3<uint32_t> pos = dipoleGeometry ().getGridCoordinates (i);
-      Math::Vector3<ctype> r;
-      for (int comp = 0; comp < 3; comp++)
-        r[comp] = Xmatrix[pos.x ()][pos.y ()][pos.z ()][comp];
-      Math::Vector3<ctype> a = maybeConj (g.get (arg, i), conj);
-      Math::Vector3<ctype> r2 = this->cc ().cc_sqrt ()[dipoleGeometry ().getMaterialIndex (i)] * r + a;
-      g.set (result, i, maybeConj (r2, conj));
+
+    if (this->distributed ())
+      transpose (false, count, prof);
+
+    {
+      Core::ProfileHandle _p1 (prof, "fft" /* "planXb" */);
+      threadPool ().run (Xmatrix.shape ()[2] * 3 * count, boost::bind (&MatVecCpu<F>::fftX, this, false, _1, _2, _3));
     }
+
+    for (size_t r = 0; r < count; r++)
+      threadPool ().run (this->localVecStride (), boost::bind (&MatVecCpu<F>::gather, this, r, ccs[r].get (), args[r], results[r], conj, _1, _2, _3));
   }
 
 
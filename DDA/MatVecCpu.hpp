@@ -27,8 +27,10 @@
 
 #include <Core/Profiling.hpp>
 #include <Core/Allocator.hpp>
+#include <Core/ThreadPool.hpp>
 
 #include <DDA/MatVec.hpp>
+#include <DDA/DMatrixCpu.hpp>
 
 namespace DDA {
   template <typename T>
@@ -37,34 +39,114 @@ namespace DDA {
     typedef std::complex<ftype> ctype;
     typedef FPConst<ftype> Const;
 
-    boost::const_multi_array_ref<Math::SymMatrix3<ctype>, 3> Dmatrix_;
+    const DMatrixPlanes<ftype>& dMatrix_;
+    boost::shared_ptr<Core::ThreadPool> threadPool_;
+    boost::shared_ptr<const Beam<ftype> > beam_;
+    // If set, dMatrix_ is not used and the DMatrix slices are regenerated by
+    // matrixFree_ for every X frequency
+    boost::shared_ptr<const MatrixFreeDMatrix<ftype> > matrixFree_;
+
+    // The part of the grid handled by this process: Xmatrix contains the
+    // box Z coordinates localZ0_ ... localZ0_ + localBoxZ_ - 1, processSlices
+    // () the X indices localX0_ ... localX0_ + localGridX_ - 1 (the whole
+    // grid if the vectors are not distributed)
+    size_t localX0_, localGridX_, localZ0_, localBoxZ_;
+    // The position of every DMatrix X index in dMatrix_. If the vectors are
+    // distributed, only the X indices needed by this process are stored
+    // there (see localDMatrixXIndices ()).
+    std::vector<uint32_t> dMatrixXSlot;
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
     typedef Core::Allocator<ctype, MAX (boost::alignment_of<ctype>::value, 16)> Allocator;
+    typedef Core::Allocator<ftype, MAX (boost::alignment_of<ftype>::value, 64)> RealAllocator;
 #undef MAX
 
     // Data structures and FFT plans for matVec
-    boost::multi_array<ctype, 4, Allocator> Xmatrix;
-    boost::multi_array<ctype, 3, Allocator> slices;
-    boost::multi_array<ctype, 3, Allocator> slices_tr;
+    // Xmatrix for every vector of the block (box Z coordinates localZ0_ ...)
+    boost::multi_array<ctype, 5, Allocator> Xmatrix;
+    // slices for every thread and every vector of the block, the Y and Z
+    // FFTs work on them in place using strided plans
+    boost::multi_array<ctype, 4, Allocator> slicesBuffer;
+    // Buffers for the all-to-all transpose if the vectors are distributed:
+    // sendBuffer contains the lines of Xmatrix split into the X ranges of
+    // the processes, recvBuffer the local X range of the lines of all
+    // processes. Block p starts at ddaParams.localBlockOffset (rank, p) *
+    // blockCapacity.
+    boost::multi_array<ctype, 1, Allocator> sendBuffer;
+    boost::multi_array<ctype, 1, Allocator> recvBuffer;
+    // Number of vectors the buffers can hold
+    size_t blockCapacity;
+    // The DMatrix slice for the current X frequency for every thread in the
+    // layout of DMatrixPlanes, only used with matrixFree_
+    boost::multi_array<ftype, 3, RealAllocator> matrixFreePlanes;
+    // The plans only transform the part of the grid containing the dipoles,
+    // the FFT data is stored in the order given by frequency ()
     // times = Xmatrix.sizeZ () * 3, stride = Xmatrix.sizeY * Xmatrix.sizeX
-    boost::shared_ptr<LinAlg::FFTPlan<ftype> >  planX;
-    // times = 3, stride = gridY * gridZ
-    boost::shared_ptr<LinAlg::FFTPlan<ftype> >  planZ;
-    // times = 1
-    boost::shared_ptr<LinAlg::FFTPlan<ftype> >  planY;
+    boost::shared_ptr<LinAlg::PrunedFFTPlan<ftype> >  planX;
+    // Columns j < boxY of the 3 components of a slice
+    boost::shared_ptr<LinAlg::PrunedFFTPlan<ftype> >  planZ;
+    // Rows of the 3 components of a slice, stride = gridZ
+    boost::shared_ptr<LinAlg::PrunedFFTPlan<ftype> >  planY;
+
+    // Which lines of Xmatrix parallel to the x axis and which columns of the
+    // slices parallel to the z axis contain dipoles. Empty lines and columns
+    // are zero before and unused after the FFTs, they are skipped.
+    std::vector<uint8_t> occupiedLines; // Index y + boxY * z
+    std::vector<uint32_t> occupiedLineCount; // For every z
+    std::vector<uint8_t> occupiedColumns; // For every y
+    bool allColumnsOccupied;
+    // Plans for a single line / column, only created if there are empty ones
+    boost::shared_ptr<LinAlg::PrunedFFTPlan<ftype> >  planX1;
+    boost::shared_ptr<LinAlg::PrunedFFTPlan<ftype> >  planZ1;
+
+    // exp (i * coordinate * phaseShift / grid) for the box coordinates along
+    // every circulant axis (see DDAParams::circulant ()), empty for the other
+    // axes. The dipoles are multiplied by these factors before the
+    // convolution and the result by the inverse afterwards, the phase shift
+    // depends on the wavelength and is updated by applyBlock ().
+    std::vector<ctype> circulantFactors[3];
+    void updateCirculantFactors ();
+    ctype circulantFactor (Math::Vector3<uint32_t> pos) const;
 
-    const boost::const_multi_array_ref<Math::SymMatrix3<ctype>, 3>& dMatrix () const { return Dmatrix_; }
+    size_t xMatrixBlockSize () const { return Xmatrix.shape ()[0] * Xmatrix.shape ()[1] * Xmatrix.shape ()[2] * Xmatrix.shape ()[3]; }
+    boost::multi_array_ref<ctype, 4> xMatrix (size_t index);
+    void reserveBlock (size_t count);
+
+    // The individual steps of applyBlock (), called by the thread pool for a
+    // range of the respective index
+    void clearXMatrix (size_t thread, size_t begin, size_t end);
+    void scatter (size_t index, const CoupleConstants<ftype>* cc, const std::vector<ctype>* arg, bool conj, size_t thread, size_t begin, size_t end);
+    void fftX (bool forward, size_t thread, size_t begin, size_t end);
+    void packLines (bool pack, size_t count, size_t thread, size_t begin, size_t end);
+    void transpose (bool forward, size_t count, Core::ProfilingDataPtr prof);
+    void fftZ (ctype* data, bool forward);
+    void processSlices (Core::ProfilingDataPtr prof, size_t count, size_t thread, size_t begin, size_t end);
+    void gather (size_t index, const CoupleConstants<ftype>* cc, const std::vector<ctype>* arg, std::vector<ctype>* result, bool conj, size_t thread, size_t begin, size_t end);
 
   public:
-    MatVecCpu (const DDAParams<ftype>& ddaParams, const boost::const_multi_array_ref<Math::SymMatrix3<ctype>, 3>& Dmatrix, const LinAlg::FFTPlanFactory<ftype>& planFactory);
+    // beam is only used for the phase shifts along circulant axes
+    // If matrixFree is given, dMatrix is ignored (and can be empty) and
+    // matrixFree must use the same thread count as threadPool
+    // If comm is given, the vectors are distributed (see MatVec) and dMatrix
+    // only contains the X indices returned by localDMatrixXIndices () for
+    // this process. comm cannot be used together with matrixFree.
+    MatVecCpu (const DDAParams<ftype>& ddaParams, const DMatrixPlanes<ftype>& dMatrix, const LinAlg::FFTPlanFactory<ftype>& planFactory, const boost::shared_ptr<Core::ThreadPool>& threadPool, const boost::shared_ptr<const Beam<ftype> >& beam, const boost::shared_ptr<const MatrixFreeDMatrix<ftype> >& matrixFree = boost::shared_ptr<const MatrixFreeDMatrix<ftype> > (), const MpiComm* comm = NULL);
     virtual ~MatVecCpu ();
 
     const DDAParams<ftype>& ddaParams () const { return MatVec<T>::ddaParams(); }
     const DDAParams<ftype>& g () const { return MatVec<T>::ddaParams(); }
     const DipoleGeometry& dipoleGeometry () const { return ddaParams ().dipoleGeometry (); }
+    Core::ThreadPool& threadPool () const { return *threadPool_; }
+    virtual Core::ThreadPool* vectorThreadPool () const { return threadPool_.get (); }
+
+    // The DMatrix X indices used by process proc of a distributed
+    // matrix-vector-product, in ascending order
+    static std::vector<uint32_t> localDMatrixXIndices (const DDAParams<ftype>& ddaParams, uint32_t proc);
 
     virtual void apply (const std::vector<ctype>& arg, std::vector<ctype>& result, bool conj, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
+    // Processes all vectors in one pass over the DMatrix, needs memory for
+    // the FFT data of every vector
+    virtual void applyBlock (const std::vector<boost::shared_ptr<const CoupleConstants<ftype> > >& ccs, const std::vector<const std::vector<ctype>*>& args, const std::vector<std::vector<ctype>*>& results, bool conj, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
   };
 
   CALL_MACRO_FOR_DEFAULT_FP_TYPES(DISABLE_TEMPLATE_INSTANCE, MatVecCpu)
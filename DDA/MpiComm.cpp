@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include "MpiComm.hpp"
+
+#include <Core/CheckedCast.hpp>
+
+#include <cstring>
+
+#if USE_MPI
+#include <mpi.h>
+#endif
+
+namespace DDA {
+#if USE_MPI
+  namespace {
+    template <typename T> struct MpiType;
+    template <> struct MpiType<float> { static MPI_Datatype get () { return MPI_FLOAT; } };
+    template <> struct MpiType<double> { static MPI_Datatype get () { return MPI_DOUBLE; } };
+    template <> struct MpiType<long double> { static MPI_Datatype get () { return MPI_LONG_DOUBLE; } };
+
+    // Real and imaginary parts are summed separately
+    template <typename T> struct MpiReal { typedef T type; static const int count = 1; };
+    template <typename T> struct MpiReal<std::complex<T> > { typedef T type; static const int count = 2; };
+
+    void check (int ret, const char* function) {
+      ASSERT_MSG (ret == MPI_SUCCESS, std::string (function) + " failed");
+    }
+
+    std::vector<int> toInt (const std::vector<size_t>& values) {
+      std::vector<int> result (values.size ());
+      for (size_t i = 0; i < values.size (); i++)
+        result[i] = Core::checked_cast<int> (values[i]);
+      return result;
+    }
+
+    // A datatype for elements of elementSize bytes, so that the counts and
+    // offsets fit into an int for larger arrays
+    class ElementType : boost::noncopyable {
+      MPI_Datatype type_;
+
+    public:
+      ElementType (size_t elementSize) {
+        check (MPI_Type_contiguous (Core::checked_cast<int> (elementSize), MPI_BYTE, &type_), "MPI_Type_contiguous");
+        check (MPI_Type_commit (&type_), "MPI_Type_commit");
+      }
+      ~ElementType () {
+        MPI_Type_free (&type_);
+      }
+
+      MPI_Datatype get () const { return type_; }
+    };
+  }
+
+  MpiComm::Init::Init (int* argc, char*** argv) {
+    int provided;
+    check (MPI_Init_thread (argc, argv, MPI_THREAD_FUNNELED, &provided), "MPI_Init_thread");
+  }
+  MpiComm::Init::~Init () {
+    MPI_Finalize ();
+  }
+
+  MpiComm::MpiComm () {
+    int initialized;
+    check (MPI_Initialized (&initialized), "MPI_Initialized");
+    ASSERT_MSG (initialized, "MPI has not been initialized");
+    check (MPI_Comm_rank (MPI_COMM_WORLD, &rank_), "MPI_Comm_rank");
+    check (MPI_Comm_size (MPI_COMM_WORLD, &size_), "MPI_Comm_size");
+  }
+
+  void MpiComm::abort (int errorCode) const {
+    MPI_Abort (MPI_COMM_WORLD, errorCode);
+  }
+
+  template <typename T> void MpiComm::allReduceSum (T* values, size_t count) const {
+    if (size () == 1)
+      return;
+    typedef typename MpiReal<T>::type Real;
+    check (MPI_Allreduce (MPI_IN_PLACE, values, Core::checked_cast<int> (count * MpiReal<T>::count), MpiType<Real>::get (), MPI_SUM, MPI_COMM_WORLD), "MPI_Allreduce");
+  }
+
+  void MpiComm::allToAll (size_t elementSize, const void* send, const std::vector<size_t>& sendCounts, const std::vector<size_t>& sendOffsets, void* recv, const std::vector<size_t>& recvCounts, const std::vector<size_t>& recvOffsets) const {
+    ASSERT (sendCounts.size () == (size_t) size () && sendOffsets.size () == (size_t) size ());
+    ASSERT (recvCounts.size () == (size_t) size () && recvOffsets.size () == (size_t) size ());
+    ElementType type (elementSize);
+    std::vector<int> sc = toInt (sendCounts), so = toInt (sendOffsets), rc = toInt (recvCounts), ro = toInt (recvOffsets);
+    check (MPI_Alltoallv (const_cast<void*> (send), &sc[0], &so[0], type.get (), recv, &rc[0], &ro[0], type.get (), MPI_COMM_WORLD), "MPI_Alltoallv");
+  }
+
+  void MpiComm::allGather (size_t elementSize, void* data, const std::vector<size_t>& counts, const std::vector<size_t>& offsets) const {
+    ASSERT (counts.size () == (size_t) size () && offsets.size () == (size_t) size ());
+    if (size () == 1)
+      return;
+    ElementType type (elementSize);
+    std::vector<int> c = toInt (counts), o = toInt (offsets);
+    check (MPI_Allgatherv (MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, data, &c[0], &o[0], type.get (), MPI_COMM_WORLD), "MPI_Allgatherv");
+  }
+#else
+  MpiComm::Init::Init (UNUSED int* argc, UNUSED char*** argv) {}
+  MpiComm::Init::~Init () {}
+
+  MpiComm::MpiComm () : rank_ (0), size_ (1) {}
+
+  void MpiComm::abort (UNUSED int errorCode) const {
+    ABORT_MSG ("MpiComm::abort () called without MPI");
+  }
+
+  template <typename T> void MpiComm::allReduceSum (UNUSED T* values, UNUSED size_t count) const {
+  }
+
+  void MpiComm::allToAll (size_t elementSize, const void* send, const std::vector<size_t>& sendCounts, const std::vector<size_t>& sendOffsets, void* recv, const std::vector<size_t>& recvCounts, const std::vector<size_t>& recvOffsets) const {
+    ASSERT (sendCounts.size () == 1 && recvCounts.size () == 1 && sendCounts[0] == recvCounts[0]);
+    memcpy ((char*) recv + recvOffsets[0] * elementSize, (const char*) send + sendOffsets[0] * elementSize, sendCounts[0] * elementSize);
+  }
+
+  void MpiComm::allGather (UNUSED size_t elementSize, UNUSED void* data, const std::vector<size_t>& counts, UNUSED const std::vector<size_t>& offsets) const {
+    ASSERT (counts.size () == 1);
+  }
+#endif
+
+  const MpiComm& MpiComm::world () {
+    static MpiComm comm;
+    return comm;
+  }
+
+#define INST(T) template void MpiComm::allReduceSum<T> (T* values, size_t count) const;
+  INST (float)
+  INST (double)
+  INST (long double)
+  INST (std::complex<float>)
+  INST (std::complex<double>)
+  INST (std::complex<long double>)
+#undef INST
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef DDA_MPICOMM_HPP_INCLUDED
+#define DDA_MPICOMM_HPP_INCLUDED
+
+// Wrapper for the MPI operations used by the distributed CPU backend
+//
+// MPI is only used if the code is compiled with USE_MPI=1 (see
+// OMake/LibMPI.om). Without MPI or when the program is not started by mpirun
+// there is a single process and all operations are local.
+
+#include <Core/Assert.hpp>
+
+#include <vector>
+#include <complex>
+
+#include <boost/noncopyable.hpp>
+
+#ifndef USE_MPI
+#define USE_MPI 0
+#endif
+
+namespace DDA {
+  class MpiComm : boost::noncopyable {
+    int rank_;
+    int size_;
+
+    MpiComm ();
+
+  public:
+    // Initializes MPI in the constructor and finalizes it in the destructor.
+    // Only the main thread calls MPI functions.
+    class Init : boost::noncopyable {
+    public:
+      Init (int* argc, char*** argv);
+      ~Init ();
+    };
+
+    // MPI_COMM_WORLD, only valid while an Init object exists
+    static const MpiComm& world ();
+
+    int rank () const { return rank_; }
+    int size () const { return size_; }
+    bool isRoot () const { return rank () == 0; }
+
+    // Terminates all processes, used when one process fails so that the
+    // others do not wait forever for it
+    void abort (int errorCode) const;
+
+    // Replaces values[i] by the sum over all processes, T can be float,
+    // double, long double or std::complex<> of one of them
+    template <typename T> void allReduceSum (T* values, size_t count) const;
+    template <typename T> T allReduceSum (T value) const {
+      if (size () != 1)
+        allReduceSum (&value, 1);
+      return value;
+    }
+
+    // Sends sendCounts[p] elements of elementSize bytes starting at element
+    // sendOffsets[p] of send to process p and stores the recvCounts[p]
+    // elements received from process p at element recvOffsets[p] of recv
+    void allToAll (size_t elementSize, const void* send, const std::vector<size_t>& sendCounts, const std::vector<size_t>& sendOffsets, void* recv, const std::vector<size_t>& recvCounts, const std::vector<size_t>& recvOffsets) const;
+
+    // Process p provides counts[p] elements of elementSize bytes at element
+    // offsets[p] of data, afterwards data contains the elements of all
+    // processes
+    void allGather (size_t elementSize, void* data, const std::vector<size_t>& counts, const std::vector<size_t>& offsets) const;
+  };
+}
+
+#endif // !DDA_MPICOMM_HPP_INCLUDED
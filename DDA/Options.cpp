@@ -46,10 +46,14 @@ namespace DDA {
       ("verbose", "Be verbose")
 
       ("lambda", boost::program_options::value<EMSim::Length> ()->default_value (EMSim::Length::fromMicroM (FPConst<ldouble>::two_pi)), "Wavelength of the incident light")
+      ("lambda-list", boost::program_options::value<std::string> (), "Solve for a list of wavelengths (lambda1,lambda2,...)")
+      ("lambda-range", boost::program_options::value<std::string> (), "Solve for count equally spaced wavelengths (min,max,count)")
+      ("dispersion", boost::program_options::value<std::string> (), "Text file with the refractive indices for --lambda-list / --lambda-range (lines with a wavelength followed by the refractive indices of all materials)")
       ("prop", boost::program_options::value<Math::Vector3<ldouble> > ()->default_value (Math::Vector3<ldouble> (0, 0, 1)), "Direction of the incident beam")
       ("beam", boost::program_options::value<std::string> ()->default_value ("plane"), "Incident beam shape, see '--beam help' for more information")
       ("pol", boost::program_options::value<std::string> ()->default_value ("ldr"), "Polarizability description, see '--pol help' for more information")
       ("orient", boost::program_options::value<Math::Vector3<ldouble> > ()->default_value (Math::Vector3<ldouble> (0, 0, 0)), "Particle orientation (zyz-notation)")
+      ("orient-avg", boost::program_options::value<std::string> (), "Average over particle orientations, see '--orient-avg help' for more information")
 
       ("geometry", boost::program_options::value<std::string> ()->default_value ("sphere:3.35103um,1.5"), "Geometry, see '--geometry help' for more information")
       ("grid-unit", boost::program_options::value<EMSim::Length> (), "Distance between two dipoles")
@@ -59,6 +63,7 @@ namespace DDA {
       ("periodicity-1", boost::program_options::value<Math::Vector3<EMSim::Length> > ()->default_value (Math::Vector3<EMSim::Length> (EMSim::Length::fromM (0), EMSim::Length::fromM (0), EMSim::Length::fromM (0))), "First periodicity vector")
       ("periodicity-2", boost::program_options::value<Math::Vector3<EMSim::Length> > ()->default_value (Math::Vector3<EMSim::Length> (EMSim::Length::fromM (0), EMSim::Length::fromM (0), EMSim::Length::fromM (0))), "Second periodicity vector")
       ("gamma", boost::program_options::value<ldouble> ()->default_value (0.001l), "Cutoff parameter for periodic particles")
+      ("lattice-sum", boost::program_options::value<std::string> ()->default_value ("ewald"), "Summation of the interaction terms for particles periodic in two dimensions, can be ewald or direct (damped sum with cutoff parameter --gamma)")
 
       ("far-field", boost::program_options::value<std::vector<std::string> > (), "Output far field, see '--far-field help' for more information")
       ("efield", "Output electric far field in YZ plane")
@@ -71,14 +76,27 @@ namespace DDA {
       ("epsilon", boost::program_options::value<ldouble> ()->default_value (5), "Stopping criterion for the solver (use 10^-<value> as stopping criterion)")
       ("maxiter", boost::program_options::value<size_t> ()->default_value (-1), "Maximum number of iterations)")
       ("iter", boost::program_options::value<std::string> ()->default_value ("qmr"), "The iterative algorithm to use (qmr, cgnr, bicg, bicgstab)")
+      ("block-solver", "Solve both polarizations at the same time with one matrix-vector-product for both (needs more memory, only qmr and bicg)")
+      ("mixed-precision", "Run the iterative solver with a single precision DMatrix and matrix-vector-product and refine the solution in --ftype precision (the residual needs an additional --ftype DMatrix, use --matrix-free with --cpu to avoid storing it)")
+      ("matrix-free", "Do not store the DMatrix but recalculate its slices in every matrix-vector-product from a smaller table (only with --cpu and non-periodic targets)")
 
       ("ftype", boost::program_options::value<std::string> ()->default_value ("double"), "Floating point type, can be float, double or ldouble")
       ("cpu", "Run on the CPU")
+      ("threads", boost::program_options::value<uint32_t> ()->default_value (0), "Number of threads to use with --cpu and for calculating the DMatrix (0 = number of hardware threads)")
+      ("fftw-rigor", boost::program_options::value<std::string> ()->default_value ("estimate"), "FFTW planner rigor with --cpu and for calculating the DMatrix on the host, can be estimate, measure or patient")
+      ("fftw-threads", boost::program_options::value<uint32_t> ()->default_value (1), "Number of threads used by every FFTW plan (0 = number of hardware threads divided by --threads). Every one of the --threads threads runs its own plans, values above the number of hardware threads divided by --threads are reduced to that")
+      ("fftw-wisdom-dir", boost::program_options::value<std::string> (), "Directory for loading and storing FFTW wisdom")
       ("opencl", "Run with OpenCL")
       ("device", boost::program_options::value<std::string> ()->default_value ("auto"), "Choose the OpenCL device, use `list' to show available devices")
       ("sync", "Sync after every step")
       ("dmatrix-host", "Put DMatrix into Host RAM")
+      ("calibrate-devices", "Measure the speed of every OpenCL device and split the grid according to it (only with several devices)")
+      ("calibration-cache", boost::program_options::value<std::string> (), "Directory for loading and storing the results of --calibrate-devices")
+      ("dmatrix-cache", boost::program_options::value<std::string> (), "Directory for loading and storing the DMatrix")
       ("opencl-fft", boost::program_options::value<std::string> (), "The OpenCL FFT implementation to use")
+      ("opencl-cache", boost::program_options::value<std::string> (), "Directory for loading and storing compiled OpenCL programs")
+      ("tune-work-size", "Measure the best work sizes for some OpenCL kernels on first use")
+      ("work-size-cache", boost::program_options::value<std::string> (), "Directory for loading and storing the results of --tune-work-size (implies --tune-work-size)")
 
       ("output-dir", boost::program_options::value<std::string> (), "Directory for output files")
       ("output-parent-dir", boost::program_options::value<std::vector<std::string> > (), "Directory for creating the output directory (ignored when --output-dir is given)")
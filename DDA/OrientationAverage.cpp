@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "OrientationAverage.hpp"
+
+#include <Core/Assert.hpp>
+#include <Core/StringUtil.hpp>
+#include <Core/HelpResultException.hpp>
+
+#include <EMSim/Parse.hpp>
+
+#include <sstream>
+#include <cmath>
+#include <map>
+
+#include <boost/foreach.hpp>
+#include <boost/math/constants/constants.hpp>
+
+namespace DDA {
+  OrientationAverage::OrientationAverage (const std::vector<Entry>& entries) : adaptive_ (false), entries_ (entries), tolerance_ (0), alphaCount_ (0), maxBetaLevel_ (0), maxGammaLevel_ (0) {
+    ASSERT (entries.size () > 0);
+    ldouble sum = 0;
+    BOOST_FOREACH (const Entry& entry, entries_) {
+      ASSERT (entry.weight >= 0);
+      sum += entry.weight;
+    }
+    ASSERT (sum > 0);
+    BOOST_FOREACH (Entry& entry, entries_)
+      entry.weight /= sum;
+  }
+  OrientationAverage::OrientationAverage (ldouble tolerance, uint32_t alphaCount, uint32_t maxBetaLevel, uint32_t maxGammaLevel) : adaptive_ (true), tolerance_ (tolerance), alphaCount_ (alphaCount), maxBetaLevel_ (maxBetaLevel), maxGammaLevel_ (maxGammaLevel) {
+    ASSERT (tolerance > 0);
+    ASSERT (alphaCount > 0);
+    // Romberg integration needs at least 3 levels, the limit for the levels
+    // makes sure that the indices fit into an uint32_t
+    ASSERT (maxBetaLevel >= 2 && maxBetaLevel <= 16);
+    ASSERT (maxGammaLevel >= 2 && maxGammaLevel <= 16);
+  }
+  OrientationAverage::~OrientationAverage () {}
+
+  namespace {
+    // result = a * x + b * y
+    void linComb (std::vector<ldouble>& result, ldouble a, const std::vector<ldouble>& x, ldouble b, const std::vector<ldouble>& y) {
+      ASSERT (x.size () == y.size ());
+      result.resize (x.size ());
+      for (size_t i = 0; i < x.size (); i++)
+        result[i] = a * x[i] + b * y[i];
+    }
+
+    class Integrator {
+      const OrientationAverage& avg;
+      const OrientationAverage::Function& f;
+      const OrientationAverage::ErrorFunction& error;
+      const Core::OStream& out;
+
+      // Values of f, the key are the indices of beta and gamma on the finest grid
+      std::map<std::pair<uint32_t, uint32_t>, std::vector<ldouble> > cache;
+
+      uint32_t betaCount () const { return 1u << avg.maxBetaLevel (); }
+      uint32_t gammaCount () const { return 1u << avg.maxGammaLevel (); }
+
+      const std::vector<ldouble>& eval (uint32_t betaIndex, uint32_t gammaIndex) {
+        std::pair<uint32_t, uint32_t> key (betaIndex, gammaIndex);
+        std::map<std::pair<uint32_t, uint32_t>, std::vector<ldouble> >::iterator it = cache.find (key);
+        if (it == cache.end ()) {
+          // cos (beta) is distributed uniformly over [-1, 1]
+          ldouble beta = std::acos (1 - 2 * static_cast<ldouble> (betaIndex) / betaCount ()) * 180 / boost::math::constants::pi<ldouble> ();
+          ldouble gamma = 360.0l * gammaIndex / gammaCount ();
+          it = cache.insert (std::make_pair (key, std::vector<ldouble> ())).first;
+          f (beta, gamma, it->second);
+        }
+        return it->second;
+      }
+
+      // Average over gamma for the given beta
+      void gammaAverage (uint32_t betaIndex, std::vector<ldouble>& result) {
+        // For beta = 0 or beta = 180 deg a rotation by gamma is a rotation by alpha
+        if (betaIndex == 0 || betaIndex == betaCount ()) {
+          result = eval (betaIndex, 0);
+          return;
+        }
+
+        std::vector<ldouble> previous = eval (betaIndex, 0);
+        std::vector<ldouble> sum;
+        for (uint32_t level = 1; level <= avg.maxGammaLevel (); level++) {
+          // Add the new points of this level
+          uint32_t step = 1u << (avg.maxGammaLevel () - level);
+          sum.assign (previous.size (), 0);
+          for (uint32_t i = step; i < gammaCount (); i += 2 * step)
+            linComb (sum, 1, sum, 1, eval (betaIndex, i));
+          linComb (result, 0.5l, previous, 0.5l / (1u << (level - 1)), sum);
+          if (level >= 2 && error (result, previous) <= avg.tolerance ())
+            return;
+          previous = result;
+        }
+        out << "Warning: Integration over gamma did not converge for beta index " << betaIndex << std::endl;
+      }
+
+    public:
+      Integrator (const OrientationAverage& avg, const OrientationAverage::Function& f, const OrientationAverage::ErrorFunction& error, const Core::OStream& out) : avg (avg), f (f), error (error), out (out) {}
+
+      size_t evaluations () const { return cache.size (); }
+
+      void integrate (std::vector<ldouble>& result) {
+        // Romberg integration over x = cos (beta), romberg[i] is the i-th
+        // entry of the last row of the romberg table
+        std::vector<std::vector<ldouble> > romberg (1);
+        std::vector<ldouble> value1, value2;
+        gammaAverage (0, value1);
+        gammaAverage (betaCount (), value2);
+        linComb (romberg[0], 0.5l, value1, 0.5l, value2);
+        for (uint32_t level = 1; level <= avg.maxBetaLevel (); level++) {
+          // Trapezoidal rule with 2^level intervals
+          uint32_t step = 1u << (avg.maxBetaLevel () - level);
+          std::vector<ldouble> sum (romberg[0].size (), 0);
+          for (uint32_t i = step; i < betaCount (); i += 2 * step) {
+            gammaAverage (i, value1);
+            linComb (sum, 1, sum, 1, value1);
+          }
+          std::vector<std::vector<ldouble> > row (level + 1);
+          linComb (row[0], 0.5l, romberg[0], 1.0l / (1u << level), sum);
+          // Richardson extrapolation
+          ldouble factor = 1;
+          for (uint32_t j = 1; j <= level; j++) {
+            factor *= 4;
+            linComb (row[j], factor / (factor - 1), row[j - 1], -1 / (factor - 1), romberg[j - 1]);
+          }
+          bool converged = level >= 2 && error (row[level], romberg[level - 1]) <= avg.tolerance ();
+          swap (romberg, row);
+          if (converged) {
+            result = romberg[level];
+            return;
+          }
+        }
+        out << "Warning: Integration over beta did not converge" << std::endl;
+        result = romberg.back ();
+      }
+    };
+  }
+
+  size_t OrientationAverage::integrate (const Function& f, const ErrorFunction& error, std::vector<ldouble>& result, const Core::OStream& out) const {
+    ASSERT (adaptive ());
+    Integrator integrator (*this, f, error, out);
+    integrator.integrate (result);
+    return integrator.evaluations ();
+  }
+
+  OrientationAverage OrientationAverage::parse (const std::string& str) {
+    if (str == "help") {
+      std::stringstream str;
+      str
+        << "Values for --orient-avg option:" << std::endl
+        << "grid:nalpha,nbeta,ngamma" << std::endl
+        << "    Use a grid with nalpha * nbeta * ngamma orientations (zyz-notation)." << std::endl
+        << "    alpha and gamma are distributed uniformly over [0, 360)," << std::endl
+        << "    beta is chosen so that cos(beta) is distributed uniformly over [-1, 1]." << std::endl
+        << "list:(alpha,beta,gamma);(alpha,beta,gamma);..." << std::endl
+        << "    Use the given orientations (zyz-notation, in deg) with equal weights." << std::endl
+        << "adaptive:tolerance[,nalpha[,maxbetalevel,maxgammalevel]]" << std::endl
+        << "    Refine the orientations until the cross sections and mueller matrices" << std::endl
+        << "    have converged to the relative tolerance. Uses at most 2^maxbetalevel + 1" << std::endl
+        << "    values for beta and 2^maxgammalevel values for gamma (default 5)." << std::endl
+        << "    alpha is averaged without additional solves using nalpha values" << std::endl
+        << "    (default 16) for the mueller matrix. Needs --prop (0,0,1)." << std::endl
+        << "    The weight column of OrientCrossSec.txt is nan in this mode." << std::endl;
+      throw Core::HelpResultException (str.str ());
+    }
+
+    std::vector<Entry> entries;
+    if (str.substr (0, 5) == "grid:") {
+      std::vector<std::string> values = Core::split (str.substr (5), ",");
+      ASSERT_MSG (values.size () == 3, "Expected `grid:nalpha,nbeta,ngamma' for --orient-avg");
+      uint32_t nAlpha, nBeta, nGamma;
+      EMSim::parse (values[0], nAlpha);
+      EMSim::parse (values[1], nBeta);
+      EMSim::parse (values[2], nGamma);
+      ASSERT (nAlpha > 0 && nBeta > 0 && nGamma > 0);
+      for (uint32_t j = 0; j < nBeta; j++) {
+        // Midpoint rule in cos(beta)
+        ldouble beta = std::acos (1 - (2 * j + 1) / static_cast<ldouble> (nBeta)) * 180 / boost::math::constants::pi<ldouble> ();
+        for (uint32_t k = 0; k < nGamma; k++)
+          for (uint32_t i = 0; i < nAlpha; i++)
+            entries.push_back (Entry (Math::Vector3<ldouble> (360.0l * i / nAlpha, beta, 360.0l * k / nGamma), 1));
+      }
+    } else if (str.substr (0, 5) == "list:") {
+      BOOST_FOREACH (const std::string& value, Core::split (str.substr (5), ";")) {
+        Math::Vector3<ldouble> angles;
+        EMSim::parse (value, angles);
+        entries.push_back (Entry (angles, 1));
+      }
+    } else if (str.substr (0, 9) == "adaptive:") {
+      std::vector<std::string> values = Core::split (str.substr (9), ",");
+      ASSERT_MSG (values.size () == 1 || values.size () == 2 || values.size () == 4, "Expected `adaptive:tolerance[,nalpha[,maxbetalevel,maxgammalevel]]' for --orient-avg");
+      ldouble tolerance;
+      uint32_t alphaCount = 16;
+      uint32_t maxBetaLevel = 5;
+      uint32_t maxGammaLevel = 5;
+      EMSim::parse (values[0], tolerance);
+      if (values.size () >= 2)
+        EMSim::parse (values[1], alphaCount);
+      if (values.size () >= 4) {
+        EMSim::parse (values[2], maxBetaLevel);
+        EMSim::parse (values[3], maxGammaLevel);
+      }
+      return OrientationAverage (tolerance, alphaCount, maxBetaLevel, maxGammaLevel);
+    } else {
+      ABORT_MSG ("Invalid value `" + str + "' for --orient-avg, see `--orient-avg help' for more information");
+    }
+
+    return OrientationAverage (entries);
+  }
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef DDA_ORIENTATIONAVERAGE_HPP_INCLUDED
+#define DDA_ORIENTATIONAVERAGE_HPP_INCLUDED
+
+// A weighted set of particle orientations used for orientation averaging
+//
+// The set is either a fixed list of orientations or is determined adaptively
+// by integrate(): Romberg integration over cos(beta) and the trapezoidal rule
+// over gamma, both refined until the result has converged. Integration over
+// alpha (the rotation around the propagation direction) is left to the
+// integrand because it needs no additional solves.
+
+#include <Core/Assert.hpp>
+#include <Core/OStream.hpp>
+
+#include <Math/Vector3.hpp>
+#include <Math/Float.hpp>
+
+#include <EMSim/Rotation.hpp>
+
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+
+namespace DDA {
+  class OrientationAverage {
+  public:
+    struct Entry {
+      Math::Vector3<ldouble> angles; // zyz-notation, in deg
+      ldouble weight;
+
+      Entry (Math::Vector3<ldouble> angles, ldouble weight) : angles (angles), weight (weight) {}
+
+      EMSim::Rotation<ldouble> rotation () const {
+        return EMSim::Rotation<ldouble>::fromZYZDeg (angles.x (), angles.y (), angles.z ());
+      }
+    };
+
+    // Calculates the values for the orientation (alpha, beta, gamma) averaged
+    // over alpha (beta and gamma in deg)
+    typedef boost::function<void (ldouble beta, ldouble gamma, std::vector<ldouble>& values)> Function;
+    // Returns the relative difference between two results
+    typedef boost::function<ldouble (const std::vector<ldouble>& values1, const std::vector<ldouble>& values2)> ErrorFunction;
+
+  private:
+    bool adaptive_;
+    std::vector<Entry> entries_;
+    ldouble tolerance_;
+    uint32_t alphaCount_;
+    uint32_t maxBetaLevel_;
+    uint32_t maxGammaLevel_;
+
+  public:
+    // The weights are normalized so that they add up to 1
+    OrientationAverage (const std::vector<Entry>& entries);
+    // Adaptive integration, at most 2^maxBetaLevel + 1 values of beta and
+    // 2^maxGammaLevel values of gamma will be used
+    OrientationAverage (ldouble tolerance, uint32_t alphaCount, uint32_t maxBetaLevel, uint32_t maxGammaLevel);
+    ~OrientationAverage ();
+
+    bool adaptive () const { return adaptive_; }
+    const std::vector<Entry>& entries () const { ASSERT (!adaptive ()); return entries_; }
+    ldouble tolerance () const { ASSERT (adaptive ()); return tolerance_; }
+    uint32_t alphaCount () const { ASSERT (adaptive ()); return alphaCount_; }
+    uint32_t maxBetaLevel () const { ASSERT (adaptive ()); return maxBetaLevel_; }
+    uint32_t maxGammaLevel () const { ASSERT (adaptive ()); return maxGammaLevel_; }
+
+    // Calculate the average of f over all orientations. Returns the number of
+    // evaluations of f.
+    size_t integrate (const Function& f, const ErrorFunction& error, std::vector<ldouble>& result, const Core::OStream& out) const;
+
+    static OrientationAverage parse (const std::string& str);
+  };
+}
+
+#endif // !DDA_ORIENTATIONAVERAGE_HPP_INCLUDED
@@ -37,13 +37,17 @@ namespace DDA {
 
   template <typename F> QmrCs<F>::QmrCs (const DDAParams<ftype>& ddaParams, MatVec<ftype>& matVec, csize_t maxIter) : 
     CpuIterativeSolver<F> (ddaParams, matVec, 50000, maxIter),
-    tmpVec2_ (g ().vecSize ()),
-    tmpVec3_ (g ().vecSize ()),
-    tmpVec4_ (g ().vecSize ())
+    tmpVec2_ (matVec.localVecSize ()),
+    tmpVec3_ (matVec.localVecSize ()),
+    tmpVec4_ (matVec.localVecSize ())
   {
   }
   template <typename F> QmrCs<F>::~QmrCs () {}
 
+  template <typename F> boost::shared_ptr<CpuIterativeSolver<F> > QmrCs<F>::createLane () {
+    return boost::shared_ptr<CpuIterativeSolver<ftype> > (new QmrCs<ftype> (g (), this->matVec (), this->maxIterations ()));
+  }
+
   namespace {
     template <typename F> std::complex<F> vecProdConj (const std::vector<std::complex<F> >& v1, const std::vector<std::complex<F> >& v2) {
       ASSERT (v1.size () == v2.size ());
@@ -58,7 +62,7 @@ namespace DDA {
   template <typename F> void QmrCs<F>::init (UNUSED std::ostream& log, UNUSED Core::ProfilingDataPtr prof) {
     std::vector<ctype>& v = this->tmpVec1 ();
 
-    ctype rvec2 = vecProdConj (this->rvec (), this->rvec ());
+    ctype rvec2 = this->matVec ().sum (vecProdConj (this->rvec (), this->rvec ()));
     vars.omega_old = 0;
     vars.beta = std::sqrt (rvec2);
     vars.mBeta = -vars.beta;
@@ -75,17 +79,17 @@ namespace DDA {
     INFO (v);
   }
 
-  template <typename F> F QmrCs<F>::iteration (csize_t nr, UNUSED std::ostream& log, UNUSED bool profilingRun, Core::ProfilingDataPtr prof) {
-    INFO ("");
-    std::vector<ctype>& rvec = this->rvec ();
-    std::vector<ctype>& Avecbuffer = this->Avecbuffer ();
-    std::vector<ctype>& xvec = this->xvec ();
-
-    std::vector<ctype>& v = this->tmpVec1 ();
-    std::vector<ctype>& vtilda = this->tmpVec2 ();
-    std::vector<ctype>& p_old = this->tmpVec3 ();
-    std::vector<ctype>& p_new = this->tmpVec4 ();
+  template <typename F> F QmrCs<F>::iteration (csize_t nr, UNUSED std::ostream& log, bool profilingRun, Core::ProfilingDataPtr prof) {
+    const std::vector<ctype>& v = iterationBegin (nr, profilingRun);
+    {
+      Core::ProfileHandle _p1 (prof, "matvec");
+      this->matVec ().apply (v, this->Avecbuffer (), false, prof);
+    }
+    return iterationEnd (nr, profilingRun);
+  }
 
+  template <typename F> const std::vector<std::complex<F> >& QmrCs<F>::iterationBegin (csize_t nr, bool profilingRun) {
+    INFO ("");
     ftype rtmp1 = norm (vars.beta) * this->residScale;
     if (nr == 0)
       ASSERT (!(rtmp1 > 1e+38f) || profilingRun); // Allow very low beta values (seen e.g. when using --load-start-dip-pol)
@@ -94,25 +98,34 @@ namespace DDA {
   
     INFO (rtmp1);
 
-    {
-      Core::ProfileHandle _p1 (prof, "matvec");
-      this->matVec ().apply (v, Avecbuffer, false, prof);
-    }
+    return this->tmpVec1 ();
+  }
 
-    ctype alpha = vecProdConj (v, Avecbuffer);
+  template <typename F> F QmrCs<F>::iterationEnd (csize_t nr, UNUSED bool profilingRun) {
+    std::vector<ctype>& rvec = this->rvec ();
+    std::vector<ctype>& Avecbuffer = this->Avecbuffer ();
+    std::vector<ctype>& xvec = this->xvec ();
+
+    std::vector<ctype>& v = this->tmpVec1 ();
+    std::vector<ctype>& vtilda = this->tmpVec2 ();
+    std::vector<ctype>& p_old = this->tmpVec3 ();
+    std::vector<ctype>& p_new = this->tmpVec4 ();
+
+    ctype alpha = this->matVec ().sum (vecProdConj (v, Avecbuffer));
 
     INFO (vtilda);
     
+    ctype ctmp3;
+    ftype rtmp2;
     if (nr == 0)
-      LinAlg::linComb (v, -alpha, Avecbuffer, vtilda);
+      rtmp2 = LinAlg::linCombProdNorm (v, -alpha, Avecbuffer, vtilda, ctmp3, this->matVec ().vectorThreadPool ());
     else
-      LinAlg::linComb (vtilda, vars.mBeta, v, -alpha, Avecbuffer, vtilda);
+      rtmp2 = LinAlg::linCombProdNorm (vtilda, vars.mBeta, v, -alpha, Avecbuffer, vtilda, ctmp3, this->matVec ().vectorThreadPool ());
+    rtmp2 = this->matVec ().sum (rtmp2);
+    ctmp3 = this->matVec ().sum (ctmp3);
 
     INFO (-alpha); INFO (vars.mBeta); INFO (v); INFO (Avecbuffer); INFO (vtilda);
 
-    ctype ctmp3 = vecProdConj (vtilda, vtilda);
-    ftype rtmp2 = LinAlg::norm (vtilda);
-
 
     ctype ctmp1 = vars.omega_old * vars.beta;
     ctype ctmp2 = vars.omega_new * alpha;
@@ -162,9 +175,9 @@ namespace DDA {
     LinAlg::linComb (p_new, tau, xvec, xvec);
     LinAlg::linComb (vtilda, betaInv, vtilda);
     swap (v, vtilda);
-    LinAlg::linComb (rvec, ctype (normSNew), v, cNewOmegaNewTautilda, rvec);
+    ftype inprodRplus1 = this->matVec ().sum (LinAlg::linCombNorm (rvec, ctype (normSNew), v, cNewOmegaNewTautilda, rvec, this->matVec ().vectorThreadPool ()));
     INFO (p_new); INFO (p_old); INFO (xvec); INFO (vtilda); INFO (v); INFO (rvec);
-    return LinAlg::norm (rvec);
+    return inprodRplus1;
   }
 
 
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include "RefinementSolver.hpp"
+
+#include <LinAlg/LinComb.hpp>
+
+namespace DDA {
+  template <class F> RefinementSolver<F>::RefinementSolver (const DDAParams<ftype>& ddaParams, const DDAParams<itype>& innerParams, IterativeSolverBase<itype>& innerSolver, MatVec<ftype>& matVec, csize_t maxIter, ftype innerEps) :
+    IterativeSolverBase<ftype> (ddaParams, 3, maxIter),
+    innerParams_ (innerParams),
+    innerSolver_ (innerSolver),
+    matVec_ (matVec),
+    innerEps_ (innerEps),
+    bvec_ (g ().vecSize ()),
+    xvec_ (g ().vecSize ()),
+    rvec_ (g ().vecSize ()),
+    tmpVec_ (g ().vecSize ()),
+    innerArg_ (g ().vecSize ())
+  {
+    ASSERT (g ().procs () == 1);
+    ASSERT (&ddaParams == &matVec.ddaParams ());
+    ASSERT (innerParams.vecSize () == g ().vecSize ());
+    ASSERT (innerParams.gridSize () == g ().gridSize ());
+  }
+  template <class F> RefinementSolver<F>::~RefinementSolver () {}
+
+  template <class F> void RefinementSolver<F>::setCoupleConstants (const boost::shared_ptr<const CoupleConstants<ftype> >& cc) {
+    cc_ = cc;
+    boost::shared_ptr<const CoupleConstants<itype> > innerCc = boost::make_shared<CoupleConstants<itype> > (*cc);
+    innerSolver_.setCoupleConstants (innerCc);
+    matVec_.setCoupleConstants (cc);
+  }
+
+  template <class F> F RefinementSolver<F>::updateResidual (Core::ProfilingDataPtr prof) {
+    matVec_.apply (xvec_, tmpVec_, false, prof);
+    return LinAlg::linCombNorm (tmpVec_, ctype (-1), bvec_, rvec_, matVec_.vectorThreadPool ());
+  }
+
+  template <class F> F RefinementSolver<F>::initGeneral (const std::vector<ctype>& einc, std::ostream& log, const std::vector<ctype>& start, Core::ProfilingDataPtr prof) {
+    ASSERT (cc_);
+
+    LinAlg::fill<ctype> (bvec_, 0);
+    g ().multMat (cc_->cc_sqrt (), einc, bvec_);
+    ftype temp = LinAlg::norm (bvec_);
+    this->residScale = 1 / temp;
+
+    LinAlg::fill<ctype> (xvec_, 0);
+    if (start.size () != 0) {
+      g ().multMatInv (cc_->cc_sqrt (), start, xvec_); // xvec = start / cc_sqrt
+      log << "Use loaded start value" << std::endl;
+    }
+    ftype inprodR = updateResidual (prof);
+
+    log << "|r_0|^2: " << temp << std::endl;
+    return inprodR;
+  }
+
+  template <class F> void RefinementSolver<F>::init (UNUSED std::ostream& log, UNUSED Core::ProfilingDataPtr prof) {
+  }
+
+  template <class F> F RefinementSolver<F>::iteration (UNUSED csize_t nr, std::ostream& log, UNUSED bool profilingRun, Core::ProfilingDataPtr prof) {
+    // The inner solver multiplies its argument by cc_sqrt and returns the
+    // solution multiplied by cc_sqrt. The residual is normalized before it is
+    // converted to itype, otherwise it would underflow once it gets small.
+    ftype scale = std::sqrt (this->inprodR ());
+    LinAlg::fill<ctype> (tmpVec_, 0);
+    g ().multMatInv (cc_->cc_sqrt (), rvec_, tmpVec_);
+    for (size_t i = 0; i < tmpVec_.size (); i++)
+      innerArg_[i] = static_cast<ictype> (tmpVec_[i] / scale);
+
+    // Solve only as far as needed to reach the outer stopping criterion
+    ftype eps = std::max (innerEps_, std::sqrt (this->epsB / this->inprodR ()));
+    log << "Inner solve with eps = " << eps << std::endl;
+    boost::shared_ptr<std::vector<ictype> > result = innerSolver_.getPolVec (innerArg_, static_cast<itype> (eps), log, std::vector<ictype> (), prof);
+
+    for (size_t i = 0; i < tmpVec_.size (); i++)
+      tmpVec_[i] = static_cast<ctype> ((*result)[i]) * scale;
+    LinAlg::fill<ctype> (rvec_, 0);
+    g ().multMatInv (cc_->cc_sqrt (), tmpVec_, rvec_);
+    for (size_t i = 0; i < xvec_.size (); i++)
+      xvec_[i] += rvec_[i];
+
+    return updateResidual (prof);
+  }
+
+  template <class F> boost::shared_ptr<std::vector<std::complex<F> > > RefinementSolver<F>::getResult (UNUSED std::ostream& log, UNUSED Core::ProfilingDataPtr prof) {
+    LinAlg::fill<ctype> (tmpVec_, 0);
+    g ().multMat (cc_->cc_sqrt (), xvec_, tmpVec_);
+    return boost::make_shared<std::vector<ctype> > (tmpVec_);
+  }
+
+  CALL_MACRO_FOR_DEFAULT_FP_TYPES(CREATE_TEMPLATE_INSTANCE, RefinementSolver)
+}
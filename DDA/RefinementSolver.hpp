@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef DDA_REFINEMENTSOLVER_HPP_INCLUDED
+#define DDA_REFINEMENTSOLVER_HPP_INCLUDED
+
+// Mixed precision solver: iterative refinement in ftype around an inner solver
+// which uses a single precision matrix-vector-product and DMatrix
+//
+// Every iteration solves A d = r for the current residual r with the inner
+// solver, adds d to the solution x and recalculates r = b - A x. x, r and the
+// matrix-vector-product for r are calculated in ftype, so the final accuracy
+// is the same as for a solver running completely in ftype.
+
+#include <DDA/IterativeSolverBase.hpp>
+#include <DDA/MatVec.hpp>
+
+namespace DDA {
+  template <typename T>
+  class RefinementSolver : public IterativeSolverBase<T> {
+    typedef T ftype;
+    typedef std::complex<ftype> ctype;
+    typedef FPConst<ftype> Const;
+    typedef float itype;
+    typedef std::complex<itype> ictype;
+
+    const DDAParams<itype>& innerParams_;
+    IterativeSolverBase<itype>& innerSolver_;
+    MatVec<ftype>& matVec_;
+    // Relative residual the inner solver has to reach (unless less is needed
+    // for the outer stopping criterion)
+    ftype innerEps_;
+
+    boost::shared_ptr<const CoupleConstants<ftype> > cc_;
+
+    std::vector<ctype> bvec_;
+    std::vector<ctype> xvec_;
+    std::vector<ctype> rvec_;
+    std::vector<ctype> tmpVec_;
+    std::vector<ictype> innerArg_;
+
+    // rvec = bvec - A xvec, returns norm (rvec)
+    ftype updateResidual (Core::ProfilingDataPtr prof);
+
+  public:
+    // innerSolver has to use innerParams, matVec (which is only used for the
+    // residual) ddaParams
+    RefinementSolver (const DDAParams<ftype>& ddaParams, const DDAParams<itype>& innerParams, IterativeSolverBase<itype>& innerSolver, MatVec<ftype>& matVec, csize_t maxIter, ftype innerEps = static_cast<ftype> (1e-3));
+    virtual ~RefinementSolver ();
+
+    using IterativeSolverBase<T>::g;
+
+    virtual void setCoupleConstants (const boost::shared_ptr<const CoupleConstants<ftype> >& cc);
+
+  protected:
+    virtual ftype initGeneral (const std::vector<ctype>& einc, std::ostream& log, const std::vector<ctype>& start, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
+    virtual void init (std::ostream& log, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
+    virtual ftype iteration (csize_t nr, std::ostream& log, bool profilingRun, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
+    virtual boost::shared_ptr<std::vector<ctype> > getResult (std::ostream& log, Core::ProfilingDataPtr prof = Core::ProfilingDataPtr ());
+  };
+
+  CALL_MACRO_FOR_DEFAULT_FP_TYPES(DISABLE_TEMPLATE_INSTANCE, RefinementSolver)
+}
+
+#endif // !DDA_REFINEMENTSOLVER_HPP_INCLUDED
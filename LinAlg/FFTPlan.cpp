@@ -22,12 +22,80 @@
 
 #include "FFTPlan.hpp"
 
+#include <Math/Float.hpp>
+
+#include <cmath>
+
+#include <boost/math/constants/constants.hpp>
+
 namespace LinAlg {
   template <typename F> FFTPlan<F>::~FFTPlan () {}
   template <typename F> FFTPlanPair<F>::~FFTPlanPair () {}
+
+  template <typename F> PrunedFFTPlan<F>::PrunedFFTPlan (const boost::shared_ptr<FFTPlan<F> >& plan, csize_t size, csize_t dataSize, csize_t stride, const std::vector<FFTLoop>& loops, bool pruned, bool has128BitAlignment) : FFTPlan<F> (size, FFTPlanFactory<F>::batchCount (loops), true, false, true, true, has128BitAlignment), dataSize_ (dataSize), pruned_ (pruned), stride_ (stride ()), plan_ (plan) {
+    ASSERT (plan);
+    ASSERT (plan->inPlace ());
+    ASSERT (plan->forward () && plan->backward ());
+    if (pruned) {
+      ASSERT (plan->size () * 2 == size);
+      ASSERT (plan->batchCount () == this->batchCount () * 2);
+      twiddle_.resize (dataSize ());
+      for (size_t n = 0; n < dataSize; n++) {
+        ldouble phi = -2 * boost::math::constants::pi<ldouble> () * n / size ();
+        twiddle_[n] = std::complex<F> (static_cast<F> (std::cos (phi)), static_cast<F> (std::sin (phi)));
+      }
+    } else {
+      ASSERT (plan->size () == size);
+      ASSERT (plan->batchCount () == this->batchCount ());
+    }
+
+    offsets_.push_back (0);
+    for (size_t i = loops.size (); i-- > 0; ) {
+      std::vector<size_t> offsets;
+      for (size_t j = 0; j < loops[i].count; j++)
+        for (size_t k = 0; k < offsets_.size (); k++)
+          offsets.push_back (j * loops[i].stride () + offsets_[k]);
+      offsets_.swap (offsets);
+    }
+  }
+  template <typename F> PrunedFFTPlan<F>::~PrunedFFTPlan () {}
+
+  template <typename F> void PrunedFFTPlan<F>::doExecute (const std::complex<F>* input, std::complex<F>* output, bool doForward, Core::ProfilingDataPtr prof) const {
+    ASSERT (input == output);
+
+    if (!pruned ()) {
+      plan_->execute (output, output, doForward, prof);
+      return;
+    }
+
+    // With x[n] = 0 for n >= size / 2 and w = exp (-2 pi i / size):
+    // X[2m] = FFT_{size/2} (x[n])[m], X[2m+1] = FFT_{size/2} (x[n] w^n)[m]
+    // The second half of every vector is zero and is used for x[n] w^n.
+    size_t half = this->size () () / 2 * stride_;
+    size_t dataSize = dataSize_ ();
+    if (doForward) {
+      for (size_t b = 0; b < offsets_.size (); b++) {
+        std::complex<F>* data = output + offsets_[b];
+        for (size_t n = 0; n < dataSize; n++)
+          data[half + n * stride_] = data[n * stride_] * twiddle_[n];
+      }
+      plan_->fftInPlace (output, prof);
+    } else {
+      plan_->ifftInPlace (output, prof);
+      for (size_t b = 0; b < offsets_.size (); b++) {
+        std::complex<F>* data = output + offsets_[b];
+        for (size_t n = 0; n < dataSize; n++)
+          data[n * stride_] += conj (twiddle_[n]) * data[half + n * stride_];
+      }
+    }
+  }
+  template <typename F> boost::shared_ptr<FFTPlan<F> > FFTPlanFactory<F>::doCreateStridedPlan (UNUSED csize_t size, UNUSED csize_t stride, UNUSED const std::vector<FFTLoop>& loops, UNUSED bool forward, UNUSED bool backward, UNUSED bool has128BitAlignment) const {
+    ABORT_MSG ("Strided plans are not supported by this FFT plan factory");
+  }
   template <typename F> FFTPlanFactory<F>::~FFTPlanFactory () {}
 
   CALL_MACRO_FOR_DEFAULT_FP_TYPES(CREATE_TEMPLATE_INSTANCE, FFTPlan)
   CALL_MACRO_FOR_DEFAULT_FP_TYPES(CREATE_TEMPLATE_INSTANCE, FFTPlanPair)
+  CALL_MACRO_FOR_DEFAULT_FP_TYPES(CREATE_TEMPLATE_INSTANCE, PrunedFFTPlan)
   CALL_MACRO_FOR_DEFAULT_FP_TYPES(CREATE_TEMPLATE_INSTANCE, FFTPlanFactory)
 }
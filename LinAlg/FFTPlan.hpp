@@ -25,6 +25,8 @@
 
 // LinAlg::FFTPlan is an abstract class for a 1d-fft plan running on the CPU
 //
+// LinAlg::PrunedFFTPlan is an FFTPlan for zero-padded data
+//
 // LinAlg::FFTPlanFactory is an abstract factory of FFTPlans
 
 #include <Core/Assert.hpp>
@@ -34,12 +36,22 @@
 #include <Math/FPTemplateInstances.hpp>
 
 #include <complex>
+#include <vector>
 
 #include <boost/shared_ptr.hpp>
 #include <boost/make_shared.hpp>
 #include <boost/multi_array.hpp>
 
 namespace LinAlg {
+  // A loop over the vectors of a strided FFT plan: count vectors whose first
+  // elements are stride elements apart
+  struct FFTLoop {
+    csize_t count;
+    csize_t stride;
+
+    FFTLoop (csize_t count, csize_t stride) : count (count), stride (stride) {}
+  };
+
   template <typename F> class FFTPlan {
     csize_t _size;
     csize_t _batchCount;
@@ -408,15 +420,81 @@ namespace LinAlg {
     }
   };
 
+  // An in-place FFT plan for vectors where only the first dataSize elements
+  // of the input are nonzero (forward transform) and only the first dataSize
+  // elements of the output are needed (backward transform).
+  //
+  // If dataSize <= size / 2 the transform is done using two FFTs of half the
+  // size. In this case the spectrum is not stored in the normal order: the
+  // value for the frequency 2m is stored at index m and the value for the
+  // frequency 2m + 1 at index size / 2 + m, frequency () returns the frequency
+  // for an index. The input elements starting at dataSize must be zero, the
+  // output elements starting at dataSize are undefined after a backward
+  // transform.
+  //
+  // The vectors may be strided (see FFTPlanFactory::createPrunedStridedPlan ()),
+  // the frequency order is the same in this case.
+  template <typename F> class PrunedFFTPlan : public FFTPlan<F> {
+    friend class FFTPlanFactory<F>;
+
+    csize_t dataSize_;
+    bool pruned_;
+    // Distance between two elements of a vector and the offset of the first
+    // element of every vector
+    size_t stride_;
+    std::vector<size_t> offsets_;
+    // FFT plan of half the size and twice the batch count if pruned
+    boost::shared_ptr<FFTPlan<F> > plan_;
+    // exp (-2 pi i n / size) for n < dataSize
+    std::vector<std::complex<F> > twiddle_;
+
+    PrunedFFTPlan (const boost::shared_ptr<FFTPlan<F> >& plan, csize_t size, csize_t dataSize, csize_t stride, const std::vector<FFTLoop>& loops, bool pruned, bool has128BitAlignment);
+
+  public:
+    virtual ~PrunedFFTPlan ();
+
+    csize_t dataSize () const {
+      return dataSize_;
+    }
+
+    bool pruned () const {
+      return pruned_;
+    }
+
+    size_t frequency (size_t index) const {
+      ASSERT (index < this->size ());
+      return frequency (this->size (), pruned (), index);
+    }
+
+    // Whether FFTPlanFactory creates a pruned plan for size and dataSize and
+    // the frequency for an index of such a plan, for users which need the
+    // frequency order before the plan is created
+    static bool isPruned (csize_t size, csize_t dataSize) {
+      return size >= 2 && size % 2 == 0 && dataSize * 2 <= size;
+    }
+    static size_t frequency (csize_t size, bool pruned, size_t index) {
+      if (!pruned)
+        return index;
+      size_t half = size () / 2;
+      return index < half ? 2 * index : 2 * (index - half) + 1;
+    }
+
+  protected:
+    virtual void doExecute (const std::complex<F>* input, std::complex<F>* output, bool doForward, Core::ProfilingDataPtr prof) const;
+  };
+
   template <typename F> class FFTPlanFactory {
     bool supportBidirectionalPlan_;
     bool supportNonPOTSizes_;
+    bool supportStridedPlans_;
 
   protected:
-    FFTPlanFactory (bool supportBidirectionalPlan, bool supportNonPOTSizes) : supportBidirectionalPlan_ (supportBidirectionalPlan), supportNonPOTSizes_ (supportNonPOTSizes) {
+    FFTPlanFactory (bool supportBidirectionalPlan, bool supportNonPOTSizes, bool supportStridedPlans = false) : supportBidirectionalPlan_ (supportBidirectionalPlan), supportNonPOTSizes_ (supportNonPOTSizes), supportStridedPlans_ (supportStridedPlans) {
     }
 
     virtual boost::shared_ptr<FFTPlan<F> > doCreatePlan (csize_t size, csize_t batchCount, bool inPlace, bool outOfPlace, bool forward, bool backward, bool has128BitAlignment) const = 0;
+    // Only called if supportStridedPlans () is true
+    virtual boost::shared_ptr<FFTPlan<F> > doCreateStridedPlan (csize_t size, csize_t stride, const std::vector<FFTLoop>& loops, bool forward, bool backward, bool has128BitAlignment) const;
 
   public:
     bool supportBidirectionalPlan () const {
@@ -427,6 +505,17 @@ namespace LinAlg {
       return supportNonPOTSizes_;
     }
 
+    bool supportStridedPlans () const {
+      return supportStridedPlans_;
+    }
+
+    static csize_t batchCount (const std::vector<FFTLoop>& loops) {
+      csize_t count = 1;
+      for (size_t i = 0; i < loops.size (); i++)
+        count *= loops[i].count;
+      return count;
+    }
+
     virtual ~FFTPlanFactory ();
 
     boost::shared_ptr<FFTPlan<F> > createPlan (csize_t size, csize_t batchCount, bool inPlace, bool outOfPlace, bool forward, bool backward, bool has128BitAlignment = false) const {
@@ -481,10 +570,72 @@ namespace LinAlg {
         return plan;
       }
     }
+
+    // Creates an in-place bidirectional plan, see PrunedFFTPlan
+    boost::shared_ptr<PrunedFFTPlan<F> > createPrunedPlan (csize_t size, csize_t dataSize, csize_t batchCount, bool has128BitAlignment = false) const {
+      ASSERT (dataSize <= size);
+
+      bool pruned = PrunedFFTPlan<F>::isPruned (size, dataSize);
+      boost::shared_ptr<FFTPlan<F> > plan = pruned ? createPlan (size / 2, batchCount * 2, true, false, true, true, has128BitAlignment) : createPlan (size, batchCount, true, false, true, true, has128BitAlignment);
+      boost::shared_ptr<PrunedFFTPlan<F> > prunedPlan (new PrunedFFTPlan<F> (plan, size, dataSize, 1, std::vector<FFTLoop> (1, FFTLoop (batchCount, size)), pruned, has128BitAlignment));
+      ASSERT (prunedPlan->size () == size);
+      ASSERT (prunedPlan->batchCount () == batchCount);
+
+      return prunedPlan;
+    }
+
+    // Creates an in-place bidirectional plan for vectors whose elements are
+    // stride elements apart. The vectors are given by nested loops, the
+    // offset of a vector is the sum of index * loops[i].stride over all
+    // loops. Needs supportStridedPlans ().
+    boost::shared_ptr<FFTPlan<F> > createStridedPlan (csize_t size, csize_t stride, const std::vector<FFTLoop>& loops, bool has128BitAlignment = false) const {
+      ASSERT (supportStridedPlans ());
+      csize_t count = batchCount (loops);
+
+      boost::shared_ptr<FFTPlan<F> > plan;
+      if (!supportBidirectionalPlan ()) {
+        boost::shared_ptr<FFTPlan<F> > forwardPlan = doCreateStridedPlan (size, stride, loops, true, false, has128BitAlignment);
+        boost::shared_ptr<FFTPlan<F> > backwardPlan = doCreateStridedPlan (size, stride, loops, false, true, has128BitAlignment);
+        ASSERT (forwardPlan && forwardPlan->forward () && !forwardPlan->backward ());
+        ASSERT (backwardPlan && !backwardPlan->forward () && backwardPlan->backward ());
+        plan.reset (new FFTPlanPair<F> (forwardPlan, backwardPlan, size, count, true, false, has128BitAlignment));
+      } else {
+        plan = doCreateStridedPlan (size, stride, loops, true, true, has128BitAlignment);
+      }
+      ASSERT (plan);
+      ASSERT (plan->size () == size);
+      ASSERT (plan->batchCount () == count);
+      ASSERT (plan->inPlace ());
+
+      return plan;
+    }
+
+    // Creates a strided PrunedFFTPlan, the parameters are the same as for
+    // createStridedPlan ()
+    boost::shared_ptr<PrunedFFTPlan<F> > createPrunedStridedPlan (csize_t size, csize_t dataSize, csize_t stride, const std::vector<FFTLoop>& loops, bool has128BitAlignment = false) const {
+      ASSERT (dataSize <= size);
+
+      bool pruned = PrunedFFTPlan<F>::isPruned (size, dataSize);
+      boost::shared_ptr<FFTPlan<F> > plan;
+      if (pruned) {
+        // The two halves of every vector are transformed separately
+        std::vector<FFTLoop> halfLoops (loops);
+        halfLoops.push_back (FFTLoop (2, size / 2 * stride));
+        plan = createStridedPlan (size / 2, stride, halfLoops, has128BitAlignment);
+      } else {
+        plan = createStridedPlan (size, stride, loops, has128BitAlignment);
+      }
+      boost::shared_ptr<PrunedFFTPlan<F> > prunedPlan (new PrunedFFTPlan<F> (plan, size, dataSize, stride, loops, pruned, has128BitAlignment));
+      ASSERT (prunedPlan->size () == size);
+      ASSERT (prunedPlan->batchCount () == batchCount (loops));
+
+      return prunedPlan;
+    }
   };
 
   CALL_MACRO_FOR_DEFAULT_FP_TYPES(DISABLE_TEMPLATE_INSTANCE, FFTPlan)
   CALL_MACRO_FOR_DEFAULT_FP_TYPES(DISABLE_TEMPLATE_INSTANCE, FFTPlanPair)
+  CALL_MACRO_FOR_DEFAULT_FP_TYPES(DISABLE_TEMPLATE_INSTANCE, PrunedFFTPlan)
   CALL_MACRO_FOR_DEFAULT_FP_TYPES(DISABLE_TEMPLATE_INSTANCE, FFTPlanFactory)
 }
 
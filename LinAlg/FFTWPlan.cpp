@@ -22,20 +22,38 @@
 
 #include "FFTWPlan.hpp"
 
+#include <Core/BoostFilesystem.hpp>
+#include <Core/File.hpp>
+
 #include <fftw3.h>
 
+#include <cstdlib>
+#include <sstream>
+
 #include <boost/type_traits/alignment_of.hpp>
 #include <boost/type_traits/aligned_storage.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 
 namespace LinAlg {
   namespace {
     template <typename F> struct FFTWOperations;
 
+    // Only the execute functions of FFTW are thread-safe, everything else
+    // (initialization, planning, wisdom and destroying plans) has to be
+    // serialized
+    boost::mutex fftwLock;
+
     template <typename F> class FFTWPlan : public FFTPlan<F> {
       void* p;
 
+      static std::string wisdomFileName (csize_t size, csize_t batchCount, csize_t stride, const std::vector<FFTLoop>& loops, bool inPlace, bool forward, bool has128BitAlignment, const FFTWOptions& options);
+
     public:  
-      FFTWPlan (csize_t size, csize_t batchCount, bool inPlace, bool forward, bool has128BitAlignment);
+      // Elements of a vector are stride elements apart, the vectors are
+      // given by loops (see FFTPlanFactory::createStridedPlan ())
+      FFTWPlan (csize_t size, csize_t stride, const std::vector<FFTLoop>& loops, bool inPlace, bool forward, bool has128BitAlignment, const FFTWOptions& options);
 
       virtual ~FFTWPlan ();
 
@@ -44,8 +62,13 @@ namespace LinAlg {
     };
 
     template <typename F> class FFTWPlanFactory : public FFTPlanFactory<F> {
+      FFTWOptions options;
+
     public:
-      FFTWPlanFactory () : FFTPlanFactory<F> (false, true) {
+      FFTWPlanFactory (const FFTWOptions& options = FFTWOptions ()) : FFTPlanFactory<F> (false, true, true), options (options) {
+        ASSERT (options.threads >= 1);
+        if (!options.wisdomDirectory.empty ())
+          boost::filesystem::create_directories (options.wisdomDirectory);
       }
 
     protected:
@@ -53,20 +76,63 @@ namespace LinAlg {
         ASSERT (!inPlace || !outOfPlace);
         ASSERT (!forward || !backward);
 
-        return boost::shared_ptr<FFTPlan<F> > (new FFTWPlan<F> (size, batchCount, inPlace, forward, has128BitAlignment));
+        return boost::shared_ptr<FFTPlan<F> > (new FFTWPlan<F> (size, 1, std::vector<FFTLoop> (1, FFTLoop (batchCount, size)), inPlace, forward, has128BitAlignment, options));
+      }
+
+      virtual boost::shared_ptr<FFTPlan<F> > doCreateStridedPlan (csize_t size, csize_t stride, const std::vector<FFTLoop>& loops, bool forward, bool backward, bool has128BitAlignment) const {
+        ASSERT (!forward || !backward);
+
+        return boost::shared_ptr<FFTPlan<F> > (new FFTWPlan<F> (size, stride, loops, true, forward, has128BitAlignment, options));
       }
     };
   }
 
+  FFTWOptions::Rigor FFTWOptions::parseRigor (const std::string& str) {
+    if (str == "estimate")
+      return estimate;
+    else if (str == "measure")
+      return measure;
+    else if (str == "patient")
+      return patient;
+    else
+      ABORT_MSG ("Unknown FFTW planner rigor `" + str + "'");
+  }
+
   template <typename F> const FFTPlanFactory<F>& getFFTWPlanFactory () {
     static FFTWPlanFactory<F> factory;
     return factory;
   }
 
+  template <typename F> boost::shared_ptr<const FFTPlanFactory<F> > createFFTWPlanFactory (const FFTWOptions& options) {
+    return boost::shared_ptr<const FFTPlanFactory<F> > (new FFTWPlanFactory<F> (options));
+  }
+
 #define TY(x) typename FFTWOperations<T>::x
 #define FUN(x) FFTWOperations<T>::x ()
 
-  template <class T> FFTWPlan<T>::FFTWPlan (csize_t size, csize_t batchCount, bool inPlace, bool forward, bool has128BitAlignment) : FFTPlan<T> (size, batchCount, inPlace, !inPlace, forward, !forward, has128BitAlignment) {
+  template <class T> std::string FFTWPlan<T>::wisdomFileName (csize_t size, csize_t batchCount, csize_t stride, const std::vector<FFTLoop>& loops, bool inPlace, bool forward, bool has128BitAlignment, const FFTWOptions& options) {
+    std::stringstream str;
+    str << FFTWOperations<T>::name () << "-" << size << "-" << batchCount << "-";
+    if (stride != 1 || loops.size () != 1 || loops[0].stride != size) {
+      str << "s" << stride;
+      for (size_t i = 0; i < loops.size (); i++)
+        str << "l" << loops[i].count << "x" << loops[i].stride;
+      str << "-";
+    }
+    str << (inPlace ? "inplace" : "outofplace") << "-" << (forward ? "forward" : "backward") << "-" << (has128BitAlignment ? "aligned" : "unaligned") << "-" << options.threads << "t-";
+    // Use separate files for the planner rigors, so that a file which
+    // contains only wisdom for a lower rigor is never loaded for a higher one
+    switch (options.rigor) {
+    case FFTWOptions::estimate: str << "estimate"; break;
+    case FFTWOptions::measure: str << "measure"; break;
+    case FFTWOptions::patient: str << "patient"; break;
+    default: ABORT ();
+    }
+    str << ".wisdom";
+    return str.str ();
+  }
+
+  template <class T> FFTWPlan<T>::FFTWPlan (csize_t size, csize_t stride, const std::vector<FFTLoop>& loops, bool inPlace, bool forward, bool has128BitAlignment, const FFTWOptions& options) : FFTPlan<T> (size, FFTPlanFactory<T>::batchCount (loops), inPlace, !inPlace, forward, !forward, has128BitAlignment) {
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
     typedef boost::aligned_storage<sizeof (TY(complex)), MAX(16, boost::alignment_of<TY(complex)>::value)> AlignedType;
 #undef MAX
@@ -77,11 +143,77 @@ namespace LinAlg {
     ASSERT (((uintptr_t) &out) % 16 == 0);
 
     if (size >= 1) {
-      int sizeInt = Core::checked_cast<int> (size);
-      int batchCountInt = Core::checked_cast<int> (batchCount);
-      TY(plan) plan = FUN(plan_many_dft) (1, &sizeInt, batchCountInt, (TY(complex)*) &in, NULL, 1, sizeInt, inPlace ? (TY(complex)*) &in : (TY(complex)*) &out, NULL, 1, sizeInt, forward ? FFTW_FORWARD : FFTW_BACKWARD, FFTW_ESTIMATE | FFTW_PRESERVE_INPUT | (has128BitAlignment ? 0 : FFTW_UNALIGNED));
+      csize_t batchCount = this->batchCount ();
+      TY(iodim) dim;
+      dim.n = Core::checked_cast<int> (size);
+      dim.is = dim.os = Core::checked_cast<int> (stride);
+      std::vector<TY(iodim)> loopDims (loops.size ());
+      // Number of elements spanned by the data
+      csize_t extent = (size - 1) * stride + 1;
+      for (size_t i = 0; i < loops.size (); i++) {
+        loopDims[i].n = Core::checked_cast<int> (loops[i].count);
+        loopDims[i].is = loopDims[i].os = Core::checked_cast<int> (loops[i].stride);
+        if (loops[i].count != 0)
+          extent += (loops[i].count - 1) * loops[i].stride;
+      }
+
+      unsigned int flags = FFTW_PRESERVE_INPUT | (has128BitAlignment ? 0 : FFTW_UNALIGNED);
+      switch (options.rigor) {
+      case FFTWOptions::estimate: flags |= FFTW_ESTIMATE; break;
+      case FFTWOptions::measure: flags |= FFTW_MEASURE; break;
+      case FFTWOptions::patient: flags |= FFTW_PATIENT; break;
+      default: ABORT ();
+      }
+
+      boost::unique_lock<boost::mutex> guard (fftwLock);
+
+      if (options.threads != 1 && !FFTWOperations<T>::threadsInitialized) {
+        int ret = FUN(init_threads) ();
+        ASSERT (ret != 0);
+        FFTWOperations<T>::threadsInitialized = true;
+      }
+      if (FFTWOperations<T>::threadsInitialized)
+        FUN(plan_with_nthreads) (Core::checked_cast<int> (options.threads));
+
+      // FFTW_ESTIMATE does not produce useful wisdom
+      boost::filesystem::path wisdomFile;
+      if (!options.wisdomDirectory.empty () && options.rigor != FFTWOptions::estimate) {
+        wisdomFile = options.wisdomDirectory / wisdomFileName (size, batchCount, stride, loops, inPlace, forward, has128BitAlignment, options);
+        FUN(forget_wisdom) ();
+        if (boost::filesystem::exists (wisdomFile))
+          FUN(import_wisdom_from_filename) (wisdomFile.BOOST_FILE_STRING.c_str ());
+      }
+
+      // The planner will overwrite the arrays unless FFTW_ESTIMATE is used,
+      // so real arrays are needed
+      TY(complex)* inPtr = (TY(complex)*) &in;
+      TY(complex)* outPtr = (TY(complex)*) &out;
+      if (options.rigor != FFTWOptions::estimate) {
+        inPtr = (TY(complex)*) FUN(malloc) (sizeof (TY(complex)) * extent ());
+        ASSERT (inPtr != NULL);
+        if (!inPlace) {
+          outPtr = (TY(complex)*) FUN(malloc) (sizeof (TY(complex)) * extent ());
+          ASSERT (outPtr != NULL);
+        }
+      }
+
+      TY(plan) plan = FUN(plan_guru_dft) (1, &dim, Core::checked_cast<int> (loopDims.size ()), loopDims.empty () ? NULL : &loopDims[0], inPtr, inPlace ? inPtr : outPtr, forward ? FFTW_FORWARD : FFTW_BACKWARD, flags);
       ASSERT (plan != NULL);
 
+      if (options.rigor != FFTWOptions::estimate) {
+        FUN(free) (inPtr);
+        if (!inPlace)
+          FUN(free) (outPtr);
+      }
+
+      if (!wisdomFile.empty ()) {
+        char* wisdom = FUN(export_wisdom_to_string) ();
+        ASSERT (wisdom != NULL);
+        std::string wisdomStr (wisdom);
+        free (wisdom);
+        Core::writeFileAtomically (wisdomFile, wisdomStr);
+      }
+
       p = (void*) plan;
     } else {
       p = NULL;
@@ -89,8 +221,10 @@ namespace LinAlg {
   }
 
   template <class T> FFTWPlan<T>::~FFTWPlan () {
-    if (p)
+    if (p) {
+      boost::unique_lock<boost::mutex> guard (fftwLock);
       FUN(destroy_plan) ((TY(plan)) p);
+    }
   }
 
   template <class T> void FFTWPlan<T>::doExecute (const std::complex<T>* input,
@@ -117,21 +251,35 @@ namespace LinAlg {
 #define DT(P, name) typedef P##name name;
 #define D(P, name) static inline __typeof__ (&P##name) name () { return P##name; }
 
-#define I(F, P)                                                 \
+#define I(F, P, N)                                              \
   namespace {                                                   \
     template <> struct FFTWOperations<F> {                      \
+      static const char* name () { return #N; }                 \
       DT (P, complex)                                           \
       DT (P, plan)                                              \
+      DT (P, iodim)                                             \
       D (P, execute_dft)                                        \
-      D (P, plan_many_dft)                                      \
+      D (P, plan_guru_dft)                                      \
       D (P, destroy_plan)                                       \
+      D (P, init_threads)                                       \
+      D (P, plan_with_nthreads)                                 \
+      D (P, forget_wisdom)                                      \
+      D (P, import_wisdom_from_filename)                        \
+      D (P, export_wisdom_to_string)                            \
+      D (P, malloc)                                             \
+      D (P, free)                                               \
+      /* Each precision is a separate library with its own */  \
+      /* init_threads (), protected by fftwLock */              \
+      static bool threadsInitialized;                           \
     };                                                          \
+    bool FFTWOperations<F>::threadsInitialized = false;         \
   }                                                             \
-  template const FFTPlanFactory<F>& getFFTWPlanFactory ();
+  template const FFTPlanFactory<F>& getFFTWPlanFactory ();      \
+  template boost::shared_ptr<const FFTPlanFactory<F> > createFFTWPlanFactory (const FFTWOptions& options);
 
-  I (float, fftwf_)
-  I (double, fftw_)
-  I (long double, fftwl_)
+  I (float, fftwf_, float)
+  I (double, fftw_, double)
+  I (long double, fftwl_, ldouble)
 
 #undef I
 #undef D
@@ -29,8 +29,33 @@
 
 #include <LinAlg/FFTPlan.hpp>
 
+#include <boost/filesystem/path.hpp>
+
 namespace LinAlg {
+  struct FFTWOptions {
+    enum Rigor {
+      estimate, measure, patient
+    };
+
+    // How much time the FFTW planner should spend on finding a fast plan
+    Rigor rigor;
+    // Number of threads used for executing a single plan
+    size_t threads;
+    // If not empty the wisdom for every plan will be loaded from / stored in
+    // a file in this directory, the file name depends on the size, the batch
+    // count, the precision and the other plan parameters
+    boost::filesystem::path wisdomDirectory;
+
+    FFTWOptions () : rigor (estimate), threads (1) {}
+
+    // Parse "estimate", "measure" or "patient"
+    static Rigor parseRigor (const std::string& str);
+  };
+
+  // Returns a factory using FFTW_ESTIMATE and one thread
   template <typename F> const FFTPlanFactory<F>& getFFTWPlanFactory ();
+
+  template <typename F> boost::shared_ptr<const FFTPlanFactory<F> > createFFTWPlanFactory (const FFTWOptions& options);
 }
 
 #endif // !LINALG_FFTWPLAN_HPP_INCLUDED
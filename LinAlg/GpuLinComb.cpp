@@ -24,11 +24,15 @@
 
 #include "GpuLinComb.stub.hpp"
 
+#include <sstream>
+
 namespace LinAlg {
   template <typename F> GpuLinComb<F>::GpuLinComb (const OpenCL::StubPool& pool, const cl::CommandQueue& queue, OpenCL::VectorAccounting& accounting, Core::ProfilingDataPtr prof) :
     computeUnits (queue.getInfo<CL_QUEUE_DEVICE> ().getInfo<CL_DEVICE_MAX_COMPUTE_UNITS> ()),
     reduce1WgCount (4 * computeUnits),
     reduce1WgSize (128),
+    options (pool.options ()),
+    reduce1Candidates (OpenCL::WorkSizeTuner::getLocalCandidates (queue.getInfo<CL_QUEUE_DEVICE> (), reduce1WgCount, reduce1WgSize)),
     reduce2WgSize (128),
     linCombWgCount (4 * computeUnits),
     linCombWgSize (32),
@@ -40,25 +44,35 @@ namespace LinAlg {
   template <typename F> void GpuLinComb<F>::reduce (const cl::CommandQueue& queue, const OpenCL::Vector<std::complex<F> >& input, const OpenCL::Pointer<F>& squaredNormOut, const OpenCL::Pointer<std::complex<F> >& selfVecProdConjOut) {
     ASSERT (squaredNormOut || selfVecProdConjOut);
 
+    std::string shape;
+    if (options.workSizeTuner ()) {
+      std::stringstream str;
+      str << sizeof (F) << "/" << input.size () << "/" << reduce1WgCount;
+      shape = str.str ();
+    }
+
     if (squaredNormOut) {
       if (selfVecProdConjOut) {
-        stub->reduceSqnVecOne<F> (queue, reduce1WgCount * reduce1WgSize, reduce1WgSize,
-                                  input.size (), temp, input);
+        for (OpenCL::WorkSizeTuning tuning (options, queue, "reduceSqnVecOne", shape, reduce1Candidates); tuning.next (); )
+          stub->reduceSqnVecOne<F> (queue, tuning.global (), tuning.local (),
+                                    input.size (), temp, input);
         stub->reduceSqnVecOne2<F> (queue, reduce2WgSize, reduce2WgSize,
                                    reduce1WgCount, temp,
                                    squaredNormOut.mem (), squaredNormOut.offset (),
                                    selfVecProdConjOut.mem (), selfVecProdConjOut.offset ());
       } else {
-        stub->reduceSqnOne<F> (queue, reduce1WgCount * reduce1WgSize, reduce1WgSize,
-                               input.size (), temp, input);
+        for (OpenCL::WorkSizeTuning tuning (options, queue, "reduceSqnOne", shape, reduce1Candidates); tuning.next (); )
+          stub->reduceSqnOne<F> (queue, tuning.global (), tuning.local (),
+                                 input.size (), temp, input);
         stub->reduceSqnOne2<F> (queue, reduce2WgSize, reduce2WgSize,
                                 reduce1WgCount, temp,
                                 squaredNormOut.mem (), squaredNormOut.offset ());
       }
     } else {
       if (selfVecProdConjOut) {
-        stub->reduceVecOne<F> (queue, reduce1WgCount * reduce1WgSize, reduce1WgSize,
-                               input.size (), temp, input);
+        for (OpenCL::WorkSizeTuning tuning (options, queue, "reduceVecOne", shape, reduce1Candidates); tuning.next (); )
+          stub->reduceVecOne<F> (queue, tuning.global (), tuning.local (),
+                                 input.size (), temp, input);
         stub->reduceVecOne2<F> (queue, reduce2WgSize, reduce2WgSize,
                                 reduce1WgCount, temp,
                                 selfVecProdConjOut.mem (), selfVecProdConjOut.offset ());
@@ -28,6 +28,7 @@
 #include <OpenCL/Vector.hpp>
 #include <OpenCL/StubPool.hpp>
 #include <OpenCL/Pointer.hpp>
+#include <OpenCL/WorkSizeTuner.hpp>
 
 #include <Math/FPTemplateInstances.hpp>
 
@@ -41,6 +42,9 @@ namespace LinAlg {
 
     size_t reduce1WgCount;
     size_t reduce1WgSize;
+    // The local size of the first reduction step can be tuned
+    OpenCL::Options options;
+    std::vector<OpenCL::WorkSize> reduce1Candidates;
 
     size_t reduce2WgSize;
 
@@ -25,10 +25,15 @@
 
 // Code for doing linear combinations and vector reductions on the CPU
 
+#include <Core/ThreadPool.hpp>
+
 #include <vector>
+#include <algorithm>
 
 #include <cstddef>
 
+#include <boost/bind.hpp>
+
 namespace LinAlg {
   template <typename F, typename S> void linComb (const std::vector<F>& v1, S s1, std::vector<F>& out) {
     ASSERT (v1.size() == out.size ());
@@ -72,6 +77,121 @@ namespace LinAlg {
     return result;
   }
 
+  // Linear combinations which also calculate the norm of the result (and
+  // optionally the sum of out[i] * out[i]) in the same pass over the vectors.
+  // out may be the same vector as one of the inputs.
+  //
+  // The vectors are split into chunks of linCombChunkSize elements which are
+  // run on threadPool (or in the calling thread if threadPool is NULL). The
+  // partial sums of the chunks are added in chunk order, so the result does
+  // not depend on the number of threads.
+
+  static const size_t linCombChunkSize = 4096;
+
+  namespace Intern {
+    // &v[0] is undefined for an empty vector (e.g. on an MPI rank without
+    // local dipoles)
+    template <typename F> const F* dataOrNull (const std::vector<F>& v) { return v.empty () ? NULL : &v[0]; }
+    template <typename F> F* dataOrNull (std::vector<F>& v) { return v.empty () ? NULL : &v[0]; }
+
+    // out = v1 * s1 + v2 * s2 + v3, s2 is only used if scaleV2 is true and
+    // v3 may be NULL
+    template <typename F, typename S> struct LinCombNormKernel {
+      typedef __decltype(norm (*(F*)0)) R;
+
+      const F* v1; S s1;
+      const F* v2; S s2;
+      bool scaleV2;
+      const F* v3;
+      F* out;
+      size_t size;
+      bool calcProd;
+      std::vector<R> norms;
+      std::vector<F> prods;
+
+      LinCombNormKernel (const F* v1, S s1, const F* v2, S s2, bool scaleV2, const F* v3, F* out, size_t size, bool calcProd)
+        : v1 (v1), s1 (s1), v2 (v2), s2 (s2), scaleV2 (scaleV2), v3 (v3), out (out), size (size), calcProd (calcProd),
+          norms ((size + linCombChunkSize - 1) / linCombChunkSize), prods (calcProd ? norms.size () : 0) {}
+
+      template <bool haveS2, bool haveV3, bool haveProd> void runChunk (size_t chunk) {
+        size_t begin = chunk * linCombChunkSize;
+        size_t end = std::min (begin + linCombChunkSize, size);
+        R result = 0;
+        F sum = 0;
+        for (size_t i = begin; i < end; i++) {
+          F value = v1[i] * s1 + (haveS2 ? v2[i] * s2 : v2[i]);
+          if (haveV3)
+            value += v3[i];
+          out[i] = value;
+          if (haveProd)
+            sum += value * value;
+          result += norm (value);
+        }
+        norms[chunk] = result;
+        if (haveProd)
+          prods[chunk] = sum;
+      }
+
+      void runChunks (UNUSED size_t thread, size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; chunk++) {
+          // Only the combinations used by the linComb*Norm () functions below
+          if (v3)
+            runChunk<true, true, true> (chunk);
+          else if (scaleV2)
+            runChunk<true, false, false> (chunk);
+          else if (calcProd)
+            runChunk<false, false, true> (chunk);
+          else
+            runChunk<false, false, false> (chunk);
+        }
+      }
+
+      R run (Core::ThreadPool* threadPool, F* prod) {
+        if (threadPool)
+          threadPool->run (norms.size (), boost::bind (&LinCombNormKernel::runChunks, this, _1, _2, _3));
+        else
+          runChunks (0, 0, norms.size ());
+        R result = 0;
+        for (size_t chunk = 0; chunk < norms.size (); chunk++)
+          result += norms[chunk];
+        if (calcProd) {
+          F sum = 0;
+          for (size_t chunk = 0; chunk < prods.size (); chunk++)
+            sum += prods[chunk];
+          *prod = sum;
+        }
+        return result;
+      }
+    };
+  }
+
+  // out = v1 * s1 + v2, returns norm (out)
+  template <typename F, typename S> __decltype(norm (*(F*)0)) linCombNorm (const std::vector<F>& v1, S s1, const std::vector<F>& v2, std::vector<F>& out, Core::ThreadPool* threadPool = NULL) {
+    ASSERT (v1.size() == out.size ());
+    ASSERT (v2.size() == out.size ());
+    return Intern::LinCombNormKernel<F, S> (Intern::dataOrNull (v1), s1, Intern::dataOrNull (v2), S (1), false, NULL, Intern::dataOrNull (out), out.size (), false).run (threadPool, NULL);
+  }
+  // out = v1 * s1 + v2 * s2, returns norm (out)
+  template <typename F, typename S> __decltype(norm (*(F*)0)) linCombNorm (const std::vector<F>& v1, S s1, const std::vector<F>& v2, S s2, std::vector<F>& out, Core::ThreadPool* threadPool = NULL) {
+    ASSERT (v1.size() == out.size ());
+    ASSERT (v2.size() == out.size ());
+    return Intern::LinCombNormKernel<F, S> (Intern::dataOrNull (v1), s1, Intern::dataOrNull (v2), s2, true, NULL, Intern::dataOrNull (out), out.size (), false).run (threadPool, NULL);
+  }
+
+  // out = v1 * s1 + v2, returns norm (out), prod = sum (out[i] * out[i])
+  template <typename F, typename S> __decltype(norm (*(F*)0)) linCombProdNorm (const std::vector<F>& v1, S s1, const std::vector<F>& v2, std::vector<F>& out, F& prod, Core::ThreadPool* threadPool = NULL) {
+    ASSERT (v1.size() == out.size ());
+    ASSERT (v2.size() == out.size ());
+    return Intern::LinCombNormKernel<F, S> (Intern::dataOrNull (v1), s1, Intern::dataOrNull (v2), S (1), false, NULL, Intern::dataOrNull (out), out.size (), true).run (threadPool, &prod);
+  }
+  // out = v1 * s1 + v2 * s2 + v3, returns norm (out), prod = sum (out[i] * out[i])
+  template <typename F, typename S> __decltype(norm (*(F*)0)) linCombProdNorm (const std::vector<F>& v1, S s1, const std::vector<F>& v2, S s2, const std::vector<F>& v3, std::vector<F>& out, F& prod, Core::ThreadPool* threadPool = NULL) {
+    ASSERT (v1.size() == out.size ());
+    ASSERT (v2.size() == out.size ());
+    ASSERT (v3.size() == out.size ());
+    return Intern::LinCombNormKernel<F, S> (Intern::dataOrNull (v1), s1, Intern::dataOrNull (v2), s2, true, Intern::dataOrNull (v3), Intern::dataOrNull (out), out.size (), true).run (threadPool, &prod);
+  }
+
   template <typename T> static void fill (std::vector<T>& array, const T& value) {
     std::fill (array.begin (), array.end (), value);
   }
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Test LinAlg::PrunedFFTPlan against full FFTW transforms of the zero-padded
+// vectors
+
+#include <LinAlg/FFTWPlan.hpp>
+
+#include <Core/Assert.hpp>
+#include <Core/OStream.hpp>
+
+#include <vector>
+#include <complex>
+#include <cstdlib>
+
+typedef double F;
+typedef std::complex<F> C;
+
+static C randomValue () {
+  return C (rand () / (F) RAND_MAX - 0.5, rand () / (F) RAND_MAX - 0.5);
+}
+
+// Maximum difference between the first count elements of the vectors,
+// relative to the maximum absolute value of the reference
+static F relError (const std::vector<C>& ref, const std::vector<C>& value, size_t count) {
+  F maxRef = 0, maxDiff = 0;
+  for (size_t i = 0; i < count; i++) {
+    maxRef = std::max (maxRef, std::abs (ref[i]));
+    maxDiff = std::max (maxDiff, std::abs (ref[i] - value[i]));
+  }
+  return maxRef == 0 ? maxDiff : maxDiff / maxRef;
+}
+
+// The vectors are stored in an array [outer][size][inner], i.e. with
+// stride inner. If strided is false inner has to be 1 and a non-strided plan
+// with a batch count of outer is tested.
+static F test (const LinAlg::FFTPlanFactory<F>& factory, size_t size, size_t dataSize, size_t inner, size_t outer, bool strided) {
+  boost::shared_ptr<LinAlg::PrunedFFTPlan<F> > plan;
+  if (!strided) {
+    ASSERT (inner == 1);
+    plan = factory.createPrunedPlan (size, dataSize, outer);
+  } else {
+    std::vector<LinAlg::FFTLoop> loops;
+    loops.push_back (LinAlg::FFTLoop (outer, size * inner));
+    loops.push_back (LinAlg::FFTLoop (inner, 1));
+    plan = factory.createPrunedStridedPlan (size, dataSize, inner, loops);
+  }
+  ASSERT (plan->pruned () == LinAlg::PrunedFFTPlan<F>::isPruned (size, dataSize));
+  boost::shared_ptr<LinAlg::FFTPlan<F> > fullPlan = factory.createPlan (size, 1, true, false, true, true);
+
+  F error = 0;
+  std::vector<C> data (outer * size * inner);
+  std::vector<C> ref (size);
+  std::vector<C> value (size);
+
+  // Forward: Only the first dataSize elements are nonzero
+  for (size_t o = 0; o < outer; o++)
+    for (size_t n = 0; n < size; n++)
+      for (size_t i = 0; i < inner; i++)
+        data[(o * size + n) * inner + i] = n < dataSize ? randomValue () : 0;
+  std::vector<C> input (data);
+  plan->fftInPlace (data.data ());
+  for (size_t o = 0; o < outer; o++) {
+    for (size_t i = 0; i < inner; i++) {
+      for (size_t n = 0; n < size; n++)
+        ref[n] = input[(o * size + n) * inner + i];
+      fullPlan->fftInPlace (ref.data ());
+      for (size_t k = 0; k < size; k++)
+        value[plan->frequency (k)] = data[(o * size + k) * inner + i];
+      error = std::max (error, relError (ref, value, size));
+    }
+  }
+
+  // Backward: The spectrum is given in the order of frequency (), only the
+  // first dataSize elements of the result are needed
+  for (size_t j = 0; j < data.size (); j++)
+    data[j] = randomValue ();
+  input = data;
+  plan->ifftInPlace (data.data ());
+  for (size_t o = 0; o < outer; o++) {
+    for (size_t i = 0; i < inner; i++) {
+      for (size_t k = 0; k < size; k++)
+        ref[plan->frequency (k)] = input[(o * size + k) * inner + i];
+      fullPlan->ifftInPlace (ref.data ());
+      for (size_t n = 0; n < size; n++)
+        value[n] = data[(o * size + n) * inner + i];
+      error = std::max (error, relError (ref, value, dataSize));
+    }
+  }
+
+  return error;
+}
+
+int main () {
+  Core::OStream out = Core::OStream::getStdout ();
+  const LinAlg::FFTPlanFactory<F>& factory = LinAlg::getFFTWPlanFactory<F> ();
+
+  srand (1);
+  const size_t sizes[] = { 1, 2, 9, 10, 12, 16 };
+  F maxError = 0;
+  for (size_t s = 0; s < sizeof (sizes) / sizeof (*sizes); s++) {
+    size_t size = sizes[s];
+    for (size_t dataSize = 1; dataSize <= size; dataSize++) {
+      F error1 = test (factory, size, dataSize, 1, 2, false);
+      F error2 = test (factory, size, dataSize, 3, 2, true);
+      out << "size " << size << " dataSize " << dataSize << " pruned " << LinAlg::PrunedFFTPlan<F>::isPruned (size, dataSize) << ": " << error1 << " " << error2 << std::endl;
+      maxError = std::max (maxError, std::max (error1, error2));
+    }
+  }
+  ASSERT (maxError < 1e-12);
+
+  return 0;
+}
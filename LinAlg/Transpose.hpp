@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef LINALG_TRANSPOSE_HPP_INCLUDED
+#define LINALG_TRANSPOSE_HPP_INCLUDED
+
+// Cache-blocked matrix transposition on the CPU
+
+#include <Core/Assert.hpp>
+
+#include <algorithm>
+
+#include <cstddef>
+
+namespace LinAlg {
+  // out[j + outStride * i] = in[i + inStride * j] for i < rows and j < cols,
+  // i.e. in is a rows x cols matrix in column-major order with leading
+  // dimension inStride and out is its cols x rows transpose with leading
+  // dimension outStride. in and out must not overlap.
+  //
+  // The matrix is processed in square blocks so that both the lines read
+  // from in and the lines written to out stay in the cache.
+  template <typename T> void transpose (size_t rows, size_t cols, const T* in, size_t inStride, T* out, size_t outStride) {
+    ASSERT (in != out);
+    ASSERT (inStride >= rows);
+    ASSERT (outStride >= cols);
+
+    const size_t blockSize = 16;
+    for (size_t j0 = 0; j0 < cols; j0 += blockSize) {
+      size_t j1 = std::min (j0 + blockSize, cols);
+      for (size_t i0 = 0; i0 < rows; i0 += blockSize) {
+        size_t i1 = std::min (i0 + blockSize, rows);
+        for (size_t j = j0; j < j1; j++)
+          for (size_t i = i0; i < i1; i++)
+            out[j + outStride * i] = in[i + inStride * j];
+      }
+    }
+  }
+}
+
+#endif // !LINALG_TRANSPOSE_HPP_INCLUDED
@@ -23,17 +23,23 @@
 #ifndef OPENCL_OPTIONS_HPP_INCLUDED
 #define OPENCL_OPTIONS_HPP_INCLUDED
 
-// Class containing options for opencl execution (currently just whether
-// CommandQueue::finish() should be called after every step)
+// Class containing options for opencl execution (whether
+// CommandQueue::finish() should be called after every step, the cache for
+// program binaries and the work size tuner)
 
 #include <OpenCL/Bindings.hpp>
 
 #include <boost/shared_ptr.hpp>
 
 namespace OpenCL {
+  class ProgramCache;
+  class WorkSizeTuner;
+
   class Options {
     struct Shared {
       bool enableSync;
+      boost::shared_ptr<const ProgramCache> programCache;
+      boost::shared_ptr<const WorkSizeTuner> workSizeTuner;
 
       Shared ()
         : enableSync (false)
@@ -55,6 +61,20 @@ namespace OpenCL {
       shared->enableSync = enableSync;
     }
 
+    // If set the programs created by StubPool are loaded from / stored in
+    // the cache
+    const boost::shared_ptr<const ProgramCache>& programCache () const { return shared->programCache; }
+    void programCache (const boost::shared_ptr<const ProgramCache>& programCache) const {
+      shared->programCache = programCache;
+    }
+
+    // If set the work sizes of some kernels are tuned on first use (see
+    // WorkSizeTuner.hpp)
+    const boost::shared_ptr<const WorkSizeTuner>& workSizeTuner () const { return shared->workSizeTuner; }
+    void workSizeTuner (const boost::shared_ptr<const WorkSizeTuner>& workSizeTuner) const {
+      shared->workSizeTuner = workSizeTuner;
+    }
+
     void sync (const cl::CommandQueue& queue) const {
       if (enableSync ())
         queue.finish ();
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "ProgramCache.hpp"
+
+#include <Core/Assert.hpp>
+#include <Core/BoostFilesystem.hpp>
+#include <Core/CheckedCast.hpp>
+#include <Core/File.hpp>
+#include <Core/Hash.hpp>
+#include <Core/IStream.hpp>
+#include <Core/OStream.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+
+namespace OpenCL {
+  namespace {
+    const char magic[8] = { 'D', 'D', 'A', 'C', 'L', 'B', 'I', '1' };
+
+    void writeFile (const Core::OStream& file, const std::string& key, const std::vector<char>& binary) {
+      uint64_t keyLength = key.length ();
+      uint64_t binaryLength = binary.size ();
+      file->write (magic, sizeof (magic));
+      file->write ((const char*) &keyLength, sizeof (keyLength));
+      file->write (key.data (), key.length ());
+      file->write ((const char*) &binaryLength, sizeof (binaryLength));
+      file->write (binary.data (), binary.size ());
+    }
+  }
+
+  ProgramCache::ProgramCache (const boost::filesystem::path& directory) : directory_ (directory) {
+    boost::filesystem::create_directories (directory);
+  }
+
+  std::string ProgramCache::getKey (const cl::Device& device, const std::string& source, const std::string& options) {
+    char sourceHash[32];
+    snprintf (sourceHash, sizeof (sourceHash), "%016llx", (unsigned long long) Core::fnv1aHash (source));
+    std::stringstream str;
+    str << "device=" << device.getInfo<CL_DEVICE_NAME> ();
+    str << " vendor=" << device.getInfo<CL_DEVICE_VENDOR> ();
+    str << " driver=" << device.getInfo<CL_DRIVER_VERSION> ();
+    str << " options=" << options;
+    str << " source=" << source.length () << "/" << sourceHash;
+    return str.str ();
+  }
+
+  boost::filesystem::path ProgramCache::getFilename (const std::string& key) const {
+    char name[64];
+    snprintf (name, sizeof (name), "program-%016llx.bin", (unsigned long long) Core::fnv1aHash (key));
+    return directory () / name;
+  }
+
+  bool ProgramCache::load (const std::string& key, std::vector<char>& binary) const {
+    boost::filesystem::path filename = getFilename (key);
+    if (!boost::filesystem::exists (filename))
+      return false;
+
+    Core::IStream file = Core::IStream::open (filename, std::ios_base::in | std::ios_base::binary);
+    char fileMagic[sizeof (magic)];
+    uint64_t keyLength;
+    file->read (fileMagic, sizeof (fileMagic));
+    file->read ((char*) &keyLength, sizeof (keyLength));
+    if (!file->good () || memcmp (fileMagic, magic, sizeof (magic)) != 0 || keyLength != key.length ())
+      return false;
+    std::vector<char> fileKey (key.length ());
+    file->read (fileKey.data (), fileKey.size ());
+    if (!file->good () || std::string (fileKey.data (), fileKey.size ()) != key)
+      return false;
+    uint64_t binaryLength;
+    file->read ((char*) &binaryLength, sizeof (binaryLength));
+    if (!file->good () || binaryLength == 0)
+      return false;
+    binary.resize (Core::checked_cast<size_t> (binaryLength));
+    file->read (binary.data (), binary.size ());
+    return file->good ();
+  }
+
+  void ProgramCache::store (const std::string& key, const std::vector<char>& binary) const {
+    Core::writeFileAtomically (getFilename (key), boost::bind (writeFile, _1, boost::cref (key), boost::cref (binary)), std::ios_base::out | std::ios_base::binary);
+  }
+
+  cl::Program ProgramCache::getProgram (const cl::Context& context, const std::string& source, const std::string& options) const {
+    std::vector<cl::Device> devices = context.getInfo<CL_CONTEXT_DEVICES> ();
+    std::vector<std::string> keys (devices.size ());
+    std::vector<std::vector<char> > binaries (devices.size ());
+    bool found = true;
+    for (size_t i = 0; i < devices.size (); i++) {
+      keys[i] = getKey (devices[i], source, options);
+      if (!load (keys[i], binaries[i]))
+        found = false;
+    }
+
+    if (found) {
+      cl::Program::Binaries bin;
+      for (size_t i = 0; i < devices.size (); i++)
+        bin.push_back (std::make_pair ((const void*) binaries[i].data (), binaries[i].size ()));
+      try {
+        // Errors for single binaries are reported by the exception thrown
+        // for the whole call, so no status vector is needed
+        cl::Program program (context, devices, bin, NULL);
+        callClProgramBuildAndShowWarnings (program, devices, options);
+        return program;
+      } catch (OpenCL::Error&) {
+        // E.g. CL_INVALID_BINARY after a driver update which did not change
+        // the version string, build from source
+      }
+    }
+
+    cl::Program program (context, cl::Program::Sources (1, std::make_pair (source.data (), source.length ())));
+    callClProgramBuildAndShowWarnings (program, devices, options);
+
+    // The binaries are returned in the order of CL_PROGRAM_DEVICES
+    std::vector<cl_device_id> programDevices = program.getInfo<CL_PROGRAM_DEVICES> ();
+    std::vector<size_t> sizes = program.getInfo<CL_PROGRAM_BINARY_SIZES> ();
+    ASSERT (sizes.size () == programDevices.size ());
+    std::vector<std::vector<char> > programBinaries (programDevices.size ());
+    std::vector<char*> pointers (programDevices.size ());
+    for (size_t i = 0; i < programDevices.size (); i++) {
+      programBinaries[i].resize (sizes[i]);
+      pointers[i] = programBinaries[i].data ();
+    }
+    cl::detail::errHandler (clGetProgramInfo (program (), CL_PROGRAM_BINARIES, pointers.size () * sizeof (char*), pointers.data (), NULL), "clGetProgramInfo");
+    for (size_t i = 0; i < programDevices.size (); i++)
+      if (sizes[i] != 0)
+        store (getKey (cl::Device (programDevices[i]), source, options), programBinaries[i]);
+
+    return program;
+  }
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef OPENCL_PROGRAMCACHE_HPP_INCLUDED
+#define OPENCL_PROGRAMCACHE_HPP_INCLUDED
+
+// On-disk cache for OpenCL program binaries
+//
+// The cache directory contains one file per program and device, the file name
+// is a hash of the device name, the driver version, the build options and the
+// program source. Every file contains a header with the full key (which is
+// checked on loading) followed by the binary returned by
+// CL_PROGRAM_BINARIES.
+
+#include <OpenCL/Bindings.hpp>
+
+#include <boost/filesystem/path.hpp>
+
+namespace OpenCL {
+  class ProgramCache {
+    boost::filesystem::path directory_;
+
+  public:
+    ProgramCache (const boost::filesystem::path& directory);
+
+    const boost::filesystem::path& directory () const { return directory_; }
+
+    static std::string getKey (const cl::Device& device, const std::string& source, const std::string& options);
+    boost::filesystem::path getFilename (const std::string& key) const;
+
+    // Returns false if there is no entry for the key
+    bool load (const std::string& key, std::vector<char>& binary) const;
+    void store (const std::string& key, const std::vector<char>& binary) const;
+
+    // Create the program from the cached binaries and build it. If the
+    // binary for one of the devices of the context is missing or cannot be
+    // used the program is built from source and the binaries are stored.
+    cl::Program getProgram (const cl::Context& context, const std::string& source, const std::string& options) const;
+  };
+}
+
+#endif // !OPENCL_PROGRAMCACHE_HPP_INCLUDED
@@ -32,6 +32,8 @@
 
 #include <OpenCL/Bindings.hpp>
 #include <OpenCL/Vector.hpp>
+#include <OpenCL/Options.hpp>
+#include <OpenCL/ProgramCache.hpp>
 
 #include <map>
 #include <set>
@@ -164,6 +166,14 @@ namespace OpenCL {
       callClProgramBuildAndShowWarnings (program, devices, options);
       return program;
     }
+
+    // Like getProgram (context), but use the program cache from options if
+    // there is one
+    static cl::Program getProgram (const cl::Context& context, const Options& options) {
+      if (!options.programCache ())
+        return getProgram (context);
+      return options.programCache ()->getProgram (context, std::string (getSource ().first, getSource ().second), getCompileOptions ());
+    }
   };
 }
 
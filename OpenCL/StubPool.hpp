@@ -72,7 +72,7 @@ namespace OpenCL {
       //Core::OStream::getStdout () << typeid (T).name () << " " << &*prof << std::endl;
       Core::ProfileHandle _p (prof, std::string ("init ") + typeid (T).name ());
 
-      boost::shared_ptr<T> value = T::create (shared->context);
+      boost::shared_ptr<T> value = T::create (T::getProgram (shared->context, shared->options));
       shared->data[&typeid (T)] = boost::any (value);
 
       it = shared->data.find (&typeid (T));
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "WorkSizeTuner.hpp"
+
+#include <Core/Assert.hpp>
+#include <Core/BoostFilesystem.hpp>
+#include <Core/File.hpp>
+#include <Core/Hash.hpp>
+#include <Core/IStream.hpp>
+#include <Core/OStream.hpp>
+#include <Core/Time.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <sstream>
+
+#include <boost/filesystem.hpp>
+
+namespace OpenCL {
+  namespace {
+    // Number of launches per candidate, the minimum time is used
+    const size_t tuningRuns = 3;
+
+    size_t getMaxLocalSize (const cl::Device& device) {
+      return std::min (device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE> (), device.getInfo<CL_DEVICE_MAX_WORK_ITEM_SIZES> ()[0]);
+    }
+  }
+
+  WorkSizeTuner::WorkSizeTuner (const boost::filesystem::path& directory) : directory_ (directory) {
+    if (!directory.empty ())
+      boost::filesystem::create_directories (directory);
+  }
+
+  std::string WorkSizeTuner::getKey (const cl::Device& device, const std::string& kernel, const std::string& shape) {
+    std::stringstream str;
+    str << "kernel=" << kernel;
+    str << " shape=" << shape;
+    str << " device=" << device.getInfo<CL_DEVICE_NAME> ();
+    str << " vendor=" << device.getInfo<CL_DEVICE_VENDOR> ();
+    str << " driver=" << device.getInfo<CL_DRIVER_VERSION> ();
+    return str.str ();
+  }
+
+  boost::filesystem::path WorkSizeTuner::getFilename (const std::string& key) const {
+    char name[64];
+    snprintf (name, sizeof (name), "worksize-%016llx.txt", (unsigned long long) Core::fnv1aHash (key));
+    return directory () / name;
+  }
+
+  bool WorkSizeTuner::load (const std::string& key, WorkSize& workSize) const {
+    {
+      boost::mutex::scoped_lock guard (lock);
+      std::map<std::string, WorkSize>::const_iterator it = values.find (key);
+      if (it != values.end ()) {
+        workSize = it->second;
+        return true;
+      }
+    }
+
+    if (directory ().empty ())
+      return false;
+    boost::filesystem::path filename = getFilename (key);
+    if (!boost::filesystem::exists (filename))
+      return false;
+
+    // The file contains the key in the first line and the global and the
+    // local size in the second line
+    Core::IStream file = Core::IStream::open (filename);
+    std::string fileKey;
+    WorkSize value;
+    std::getline (*file, fileKey);
+    *file >> value.global >> value.local;
+    if (file->fail () || fileKey != key || value.global == 0 || (value.local != 0 && value.global % value.local != 0))
+      return false;
+
+    boost::mutex::scoped_lock guard (lock);
+    values[key] = value;
+    workSize = value;
+    return true;
+  }
+
+  void WorkSizeTuner::store (const std::string& key, const WorkSize& workSize) const {
+    {
+      boost::mutex::scoped_lock guard (lock);
+      values[key] = workSize;
+    }
+
+    if (directory ().empty ())
+      return;
+    boost::filesystem::path filename = getFilename (key);
+    std::stringstream str;
+    str << key << std::endl << workSize.global << " " << workSize.local << std::endl;
+    Core::writeFileAtomically (filename, str.str ());
+  }
+
+  std::vector<WorkSize> WorkSizeTuner::getCandidates (const cl::Device& device) {
+    size_t computeUnits = device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS> ();
+    size_t maxLocal = std::min<size_t> (getMaxLocalSize (device), 256);
+
+    std::vector<WorkSize> res;
+    res.push_back (WorkSize (getDefaultWorkItemCount (device), 0));
+    for (size_t perUnit = 128; perUnit <= 2048; perUnit *= 2) {
+      size_t global = computeUnits * perUnit;
+      if (!(res[0] == WorkSize (global, 0)))
+        res.push_back (WorkSize (global, 0));
+      for (size_t local = 64; local <= maxLocal; local *= 2)
+        if (global % local == 0)
+          res.push_back (WorkSize (global, local));
+    }
+    return res;
+  }
+
+  std::vector<WorkSize> WorkSizeTuner::getLocalCandidates (const cl::Device& device, size_t groupCount, size_t defaultLocal) {
+    size_t maxLocal = std::min<size_t> (getMaxLocalSize (device), 256);
+
+    std::vector<WorkSize> res;
+    res.push_back (WorkSize (groupCount * defaultLocal, defaultLocal));
+    for (size_t local = 32; local <= maxLocal; local *= 2)
+      if (local != defaultLocal)
+        res.push_back (WorkSize (groupCount * local, local));
+    return res;
+  }
+
+  WorkSizeTuning::WorkSizeTuning (const Options& options, const cl::CommandQueue& queue, const std::string& kernel, const std::string& shape, const std::vector<WorkSize>& candidates)
+    : tuner (options.workSizeTuner ()),
+      queue (queue),
+      candidates (candidates),
+      tuning (false),
+      launched (false),
+      position (0),
+      start (0)
+  {
+    ASSERT (candidates.size () > 0);
+    current = candidates[0];
+    if (tuner) {
+      key = WorkSizeTuner::getKey (queue.getInfo<CL_QUEUE_DEVICE> (), kernel, shape);
+      if (!tuner->load (key, current)) {
+        tuning = true;
+        times.resize (candidates.size (), std::numeric_limits<double>::infinity ());
+      }
+    }
+  }
+
+  bool WorkSizeTuning::next () {
+    if (!tuning) {
+      if (launched)
+        return false;
+      launched = true;
+      return true;
+    }
+
+    // Wait for all previously enqueued work / for the last candidate
+    queue.finish ();
+    if (position > 0) {
+      double time = (Core::getCurrentTime () - start).getSeconds ();
+      size_t i = (position - 1) / tuningRuns;
+      times[i] = std::min (times[i], time);
+    }
+
+    if (position == candidates.size () * tuningRuns) {
+      size_t best = 0;
+      for (size_t i = 1; i < candidates.size (); i++)
+        if (times[i] < times[best])
+          best = i;
+      current = candidates[best];
+      tuner->store (key, current);
+      tuning = false;
+      launched = true;
+      return true;
+    }
+
+    current = candidates[position / tuningRuns];
+    position++;
+    start = Core::getCurrentTime ();
+    return true;
+  }
+}
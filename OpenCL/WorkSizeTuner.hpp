@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2010-2012 Steffen Kieß
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef OPENCL_WORKSIZETUNER_HPP_INCLUDED
+#define OPENCL_WORKSIZETUNER_HPP_INCLUDED
+
+// Autotuning of the global and local work size of kernel launches
+//
+// WorkSizeTuning is used at the launch site of a kernel which can be executed
+// several times without changing the result (i.e. which does not update its
+// output in place):
+//
+//   for (OpenCL::WorkSizeTuning tuning (options, queue, "kernel", shape, candidates); tuning.next (); )
+//     stub->kernel (queue, tuning.global (), tuning.local (), ...);
+//
+// Without a WorkSizeTuner in the options the body is executed once with the
+// first candidate. Otherwise the best work size for the kernel, the device
+// and the problem shape is looked up in the tuner. If there is none, every
+// candidate is launched and timed and the fastest one is stored (in memory
+// and, if a directory is given, on disk) before the kernel is launched a
+// final time with it.
+
+#include <Core/TimeSpan.hpp>
+
+#include <OpenCL/Bindings.hpp>
+#include <OpenCL/Options.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace OpenCL {
+  struct WorkSize {
+    size_t global;
+    // 0 = chosen by the implementation
+    size_t local;
+
+    WorkSize () : global (0), local (0) {}
+    WorkSize (size_t global, size_t local) : global (global), local (local) {}
+
+    bool operator== (const WorkSize& o) const {
+      return global == o.global && local == o.local;
+    }
+  };
+
+  class WorkSizeTuner {
+    boost::filesystem::path directory_;
+
+    mutable boost::mutex lock;
+    mutable std::map<std::string, WorkSize> values;
+
+  public:
+    // If directory is empty the results are only kept in memory
+    WorkSizeTuner (const boost::filesystem::path& directory = boost::filesystem::path ());
+
+    const boost::filesystem::path& directory () const { return directory_; }
+
+    static std::string getKey (const cl::Device& device, const std::string& kernel, const std::string& shape);
+    boost::filesystem::path getFilename (const std::string& key) const;
+
+    // Returns false if there is no entry for the key
+    bool load (const std::string& key, WorkSize& workSize) const;
+    void store (const std::string& key, const WorkSize& workSize) const;
+
+    // Candidates for kernels which loop over their data with a stride of
+    // get_global_size (0). The first entry is the default
+    // (getDefaultWorkItemCount () and no local size).
+    static std::vector<WorkSize> getCandidates (const cl::Device& device);
+    // Candidates for kernels which need a fixed number of work groups, the
+    // first entry uses defaultLocal
+    static std::vector<WorkSize> getLocalCandidates (const cl::Device& device, size_t groupCount, size_t defaultLocal);
+  };
+
+  class WorkSizeTuning {
+    boost::shared_ptr<const WorkSizeTuner> tuner;
+    cl::CommandQueue queue;
+    std::string key;
+    std::vector<WorkSize> candidates;
+    std::vector<double> times;
+
+    bool tuning;
+    bool launched;
+    size_t position;
+    WorkSize current;
+    Core::TimeSpan start;
+
+  public:
+    WorkSizeTuning (const Options& options, const cl::CommandQueue& queue, const std::string& kernel, const std::string& shape, const std::vector<WorkSize>& candidates);
+
+    // Returns true if the kernel should be launched (again) with global () /
+    // local ()
+    bool next ();
+
+    const WorkSize& workSize () const { return current; }
+    cl::NDRange global () const { return cl::NDRange (current.global); }
+    cl::NDRange local () const { return current.local ? cl::NDRange (current.local) : cl::NDRange (); }
+  };
+}
+
+#endif // !OPENCL_WORKSIZETUNER_HPP_INCLUDED